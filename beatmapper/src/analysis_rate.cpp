@@ -0,0 +1,183 @@
+#include "analysis_rate.h"
+#include "simd.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Output samples per pass; bounds the scratch to a few hundred KB.
+static const uint64_t OUT_BLOCK = 4096;
+
+uint32_t analysis_factor(uint32_t sample_rate)
+{
+    uint32_t min_rate = ANALYSIS_MIN_RATE;
+    const char* env = getenv("RIFFHOUND_ANALYSIS_RATE");
+    if (env && *env) min_rate = strcmp(env, "native") == 0 ? 0 : (uint32_t)atol(env);
+    if (min_rate == 0 || sample_rate / 2 < min_rate) return 1;
+    for (uint32_t f = sample_rate / min_rate; f > 1; f--)
+        if (sample_rate % f == 0) return f;
+    return 1;
+}
+
+int analysis_samples(double seconds, uint32_t sample_rate)
+{
+    long n = lround(seconds * sample_rate);
+    return n > 1 ? (int)n : 1;
+}
+
+int analysis_fft_size(double seconds, uint32_t sample_rate)
+{
+    double n = seconds * sample_rate;
+    int    e = n > 16.0 ? (int)lround(log2(n)) : 4;
+    return 1 << e;
+}
+
+uint64_t analysis_ready(uint64_t in_frames, uint32_t factor, bool complete)
+{
+    if (factor <= 1) return in_frames;
+    if (complete) return (in_frames + factor - 1) / factor;
+    // Output j reads input frames up to j * factor + half.
+    const uint64_t half = (uint64_t)ANALYSIS_TAPS * factor;
+    if (in_frames <= half) return 0;
+    return (in_frames - half - 1) / factor + 1;
+}
+
+// ---------------------------------------------------------------------------
+// Low-pass kernel: 2 * half + 1 taps centred on tap half, unit DC gain,
+// zero-padded to a multiple of four for the vector loop.
+// ---------------------------------------------------------------------------
+static float* design(uint32_t factor, int* half, int* taps)
+{
+    const int h = ANALYSIS_TAPS * (int)factor;
+    const int n = 2 * h + 1;
+    const int p = (n + 3) & ~3;
+    float*  k = (float*) calloc((size_t)p, sizeof(float));
+    double* d = (double*)malloc((size_t)n * sizeof(double));
+    if (!k || !d) { free(k); free(d); return nullptr; }
+
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        double x = (double)(i - h) / factor;          // cut-off at the output Nyquist
+        double s = i == h ? 1.0 : sin(M_PI * x) / (M_PI * x);
+        double t = 2.0 * M_PI * i / (n - 1);
+        d[i] = s * (0.42 - 0.5 * cos(t) + 0.08 * cos(2.0 * t));
+        sum += d[i];
+    }
+    for (int i = 0; i < n; i++) k[i] = (float)(d[i] / sum);
+    free(d);
+    *half = h;
+    *taps = p;
+    return k;
+}
+
+// y[j] = sum_k h[k] x[j * factor + k] for j in [0, n).
+static void fir_scalar(const float* x, const float* h, int taps, uint32_t factor,
+                       int64_t n, float* y)
+{
+    for (int64_t j = 0; j < n; j++) {
+        const float* p = x + j * factor;
+        float acc = 0.0f;
+        for (int k = 0; k < taps; k++) acc += h[k] * p[k];
+        y[j] = acc;
+    }
+}
+
+static void fir_f4(const float* x, const float* h, int taps, uint32_t factor,
+                   int64_t n, float* y)
+{
+    for (int64_t j = 0; j < n; j++) {
+        const float* p = x + j * factor;
+        f4 acc = f4_set1(0.0f);
+        for (int k = 0; k < taps; k += 4)
+            acc = f4_madd(f4_load(h + k), f4_load(p + k), acc);
+        y[j] = f4_hsum(acc);
+    }
+}
+
+// Channel average of count frames into out.  Sum, then scale: the arithmetic
+// the analyses' own mixdowns used, so at factor 1 nothing changes.
+static void mix(const float* in, uint64_t count, uint32_t ch, float* out)
+{
+    if (ch == 1) { memcpy(out, in, (size_t)count * sizeof(float)); return; }
+    const float inv_ch = 1.0f / (float)ch;
+    for (uint64_t i = 0; i < count; i++) {
+        const float* src = in + i * ch;
+        float s = 0.0f;
+        for (uint32_t c = 0; c < ch; c++) s += src[c];
+        out[i] = s * inv_ch;
+    }
+}
+
+bool analysis_decimate(AnalysisReadFn read, const void* src, uint64_t in_frames,
+                       uint32_t channels, uint32_t factor,
+                       uint64_t o0, uint64_t o1, float* out)
+{
+    if (o1 <= o0 || channels == 0) return true;
+    if (factor <= 1) {
+        float* scratch = (float*)malloc((size_t)OUT_BLOCK * channels * sizeof(float));
+        if (!scratch) return false;
+        for (uint64_t b = o0; b < o1; b += OUT_BLOCK) {
+            uint64_t n = o1 - b < OUT_BLOCK ? o1 - b : OUT_BLOCK;
+            uint64_t m = b < in_frames ? (in_frames - b < n ? in_frames - b : n) : 0;
+            if (m) mix(read(src, b, m, scratch), m, channels, out + (b - o0));
+            memset(out + (b - o0) + m, 0, (size_t)(n - m) * sizeof(float));
+        }
+        free(scratch);
+        return true;
+    }
+
+    int    half = 0, taps = 0;
+    float* h    = design(factor, &half, &taps);
+    const int64_t span_max = (int64_t)(OUT_BLOCK - 1) * factor + taps;
+    float* x       = (float*)malloc((size_t)span_max * sizeof(float));
+    float* scratch = (float*)malloc((size_t)span_max * channels * sizeof(float));
+    if (!h || !x || !scratch) { free(h); free(x); free(scratch); return false; }
+
+    const bool scalar = simd_level() == SIMD_SCALAR;
+    for (uint64_t b0 = o0; b0 < o1; b0 += OUT_BLOCK) {
+        const uint64_t b1 = o1 - b0 < OUT_BLOCK ? o1 : b0 + OUT_BLOCK;
+        // Input frames [first, first + span) feed this block; [a, z) of them
+        // exist.
+        const int64_t first = (int64_t)(b0 * factor) - half;
+        const int64_t span  = (int64_t)(b1 - b0 - 1) * factor + taps;
+        int64_t a = first < 0 ? 0 : first;
+        int64_t z = first + span < (int64_t)in_frames ? first + span : (int64_t)in_frames;
+        if (z < a) z = a;
+        memset(x, 0, (size_t)(a - first) * sizeof(float));
+        if (z > a) mix(read(src, (uint64_t)a, (uint64_t)(z - a), scratch), (uint64_t)(z - a),
+                       channels, x + (a - first));
+        memset(x + (z - first), 0, (size_t)(first + span - z) * sizeof(float));
+
+        if (scalar) fir_scalar(x, h, taps, factor, (int64_t)(b1 - b0), out + (b0 - o0));
+        else        fir_f4    (x, h, taps, factor, (int64_t)(b1 - b0), out + (b0 - o0));
+    }
+    free(h); free(x); free(scratch);
+    return true;
+}
+
+// A finished interleaved f32 buffer as an AnalysisReadFn source.
+struct F32Source {
+    const float* pcm;
+    uint32_t     channels;
+};
+
+static const float* read_f32(const void* src, uint64_t first, uint64_t, float*)
+{
+    const F32Source* s = (const F32Source*)src;
+    return s->pcm + first * s->channels;
+}
+
+float* analysis_signal(const float* pcm, uint64_t frames, uint32_t channels,
+                       uint32_t sample_rate, uint64_t* out_frames, uint32_t* out_rate)
+{
+    const uint32_t factor = analysis_factor(sample_rate);
+    const uint64_t n      = analysis_ready(frames, factor, true);
+    float* sig = (float*)malloc((size_t)(n ? n : 1) * sizeof(float));
+    F32Source src = { pcm, channels };
+    if (!sig || !analysis_decimate(read_f32, &src, frames, channels, factor, 0, n, sig)) {
+        free(sig);
+        return nullptr;
+    }
+    *out_frames = n;
+    *out_rate   = sample_rate / factor;
+    return sig;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ---------------------------------------------------------------------------
+// The signal the analyses run on.
+//
+// Nothing the beat detector or the chroma algorithms look at lies much above
+// 5 kHz, so rather than the decoded track they read its channel average
+// decimated by a whole factor to the lowest rate still at or above
+// ANALYSIS_MIN_RATE: 44.1 kHz becomes 22.05 kHz, 48 and 96 kHz become 24 kHz.
+// It is built once per track and shared by every analysis, which therefore
+// neither mixes channels down inside its frame loops nor pays for bandwidth
+// it ignores.
+//
+// The decimator is a Blackman-windowed sinc low-pass at the new Nyquist
+// frequency, ANALYSIS_TAPS taps per unit of factor either side of the centre,
+// evaluated only at the samples kept (the polyphase form).  Output sample j
+// is centred on input frame j * factor, so a time maps to the same place in
+// both signals.
+//
+// Because the rate now varies between tracks, the analyses give their frame
+// and hop sizes in seconds and convert them here.  The constants are chosen
+// so that at 44.1 kHz they come out at the sizes the analyses always used.
+//
+// RIFFHOUND_ANALYSIS_RATE overrides ANALYSIS_MIN_RATE (in Hz); "native"
+// analyses at the decoded rate, the channel average only.
+// ---------------------------------------------------------------------------
+
+static const uint32_t ANALYSIS_MIN_RATE = 20000;   // Hz
+static const int      ANALYSIS_TAPS     = 16;      // per unit of factor, each side
+
+// Decimation factor for a decoded rate: the largest factor dividing it that
+// keeps the result at or above the minimum rate (1 for rates below it).
+uint32_t analysis_factor(uint32_t sample_rate);
+
+// Samples nearest to a duration, at least one.
+int analysis_samples(double seconds, uint32_t sample_rate);
+
+// The power of two nearest to a duration in samples (geometrically), for FFT
+// frame sizes.  At least 16.
+int analysis_fft_size(double seconds, uint32_t sample_rate);
+
+// Output samples of a signal decimated by factor from in_frames input frames.
+// While the input is still growing (complete false) only those that need no
+// input past the end are counted, so they never change once built.
+uint64_t analysis_ready(uint64_t in_frames, uint32_t factor, bool complete);
+
+// Source of interleaved f32 frames for analysis_decimate: frames [first,
+// first + count) of src, written to scratch (room for count frames) or
+// returned in place.
+typedef const float* (*AnalysisReadFn)(const void* src, uint64_t first, uint64_t count,
+                                       float* scratch);
+
+// Output samples [o0, o1) of the decimated channel average of in_frames
+// frames read through read.  Frames past in_frames count as silence.  With
+// factor 1 this is the plain channel average.  Returns false if out of
+// memory.
+bool analysis_decimate(AnalysisReadFn read, const void* src, uint64_t in_frames,
+                       uint32_t channels, uint32_t factor,
+                       uint64_t o0, uint64_t o1, float* out);
+
+// The whole analysis signal of a finished interleaved buffer: malloc'd
+// (caller frees), *out_frames samples at *out_rate.  nullptr if out of
+// memory.
+float* analysis_signal(const float* pcm, uint64_t frames, uint32_t channels,
+                       uint32_t sample_rate, uint64_t* out_frames, uint32_t* out_rate);
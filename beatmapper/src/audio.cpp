@@ -3,10 +3,15 @@
 #include "audio.h"
 #include "wsola.h"
 #include "pitch_node.h"
+#include "render_ahead.h"
+#include "pcm_store.h"
+#include "pcm_cache.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <atomic>
+#include <thread>
 
 #ifdef __APPLE__
 #include <AudioToolbox/ExtendedAudioFile.h>
@@ -18,22 +23,53 @@ static ma_engine   s_engine;
 static ma_sound    s_sound;
 static WsolaSource s_wsola;
 static PitchNode   s_pitch;
+static RenderAhead s_ahead;                 // renders s_pitch off the audio thread
+static PcmStore*   s_store     = nullptr;   // decoded track; WSOLA borrows its buffer
 static bool        s_engine_ok = false;
 static bool        s_sound_ok  = false;
 static bool        s_wsola_ok  = false;
 static bool        s_pitch_ok  = false;
+static bool        s_ahead_ok  = false;     // else the sound plays s_pitch directly
 
 #ifdef __APPLE__
 static bool path_is_m4a(const char* p) {
     const char* dot = strrchr(p, '.');
     return dot && strcasecmp(dot, ".m4a") == 0;
 }
+#endif
+
+// ---------------------------------------------------------------------------
+// Streaming decoder: any supported file as stereo (2-channel) f32 PCM at the
+// file's native sample rate, read in chunks.  miniaudio handles mono→stereo
+// upmix for mp3/wav; M4A goes through ExtAudioFile on Apple and its channel
+// conversion is done here.
+// ---------------------------------------------------------------------------
+static const uint32_t DECODE_CHUNK = 65536;   // frames per read
+
+struct TrackDecoder {
+    ma_decoder ma;
+#ifdef __APPLE__
+    ExtAudioFileRef ef;        // non-null for M4A
+    ma_uint32       nch;       // M4A native channel count
+    float*          scratch;   // one chunk at nch channels
+#endif
+    uint32_t sample_rate;
+    uint64_t length;           // expected frames; 0 = unknown
+    bool     length_exact;     // length is the true length, not an estimate
+    char     path[512];        // source, for the PCM cache
+};
+
+// PCM cache (pcm_cache.h) tag for what decoder_open() will produce from path.
+static const char* decoder_tag(const char* path)
+{
+#ifdef __APPLE__
+    if (path_is_m4a(path)) return "extaudiofile-f32x2";
+#endif
+    return "miniaudio-f32x2";
+}
 
-// Decode M4A/AAC to float32 interleaved PCM at the file's native sample rate.
-// Caller must free *out_pcm with free().
-static bool decode_m4a_to_f32(const char* path, float** out_pcm,
-                                uint64_t* out_frames,
-                                ma_uint32* out_channels, uint32_t* out_sr)
+#ifdef __APPLE__
+static bool m4a_open(TrackDecoder* d, const char* path)
 {
     CFStringRef str = CFStringCreateWithCString(NULL, path, kCFStringEncodingUTF8);
     CFURLRef    url = CFURLCreateWithFileSystemPath(NULL, str, kCFURLPOSIXPathStyle, false);
@@ -64,159 +100,269 @@ static bool decode_m4a_to_f32(const char* path, float** out_pcm,
     outFmt.mBytesPerPacket   = 4 * nch;
     ExtAudioFileSetProperty(ef, kExtAudioFileProperty_ClientDataFormat, sizeof(outFmt), &outFmt);
 
-    // Estimate total frames for initial allocation
+    // The container's length is an estimate (priming and remainder frames).
     SInt64 estFrames = 0;
     sz = sizeof(estFrames);
     ExtAudioFileGetProperty(ef, kExtAudioFileProperty_FileLengthFrames, &sz, &estFrames);
-    if (estFrames <= 0) estFrames = (SInt64)sr * 600;
 
-    size_t capacity = (size_t)estFrames + 4096;
-    float* buf = (float*)malloc(capacity * nch * sizeof(float));
-    if (!buf) { ExtAudioFileDispose(ef); return false; }
+    d->scratch = (float*)malloc((size_t)DECODE_CHUNK * nch * sizeof(float));
+    if (!d->scratch) { ExtAudioFileDispose(ef); return false; }
+    d->ef           = ef;
+    d->nch          = nch;
+    d->sample_rate  = sr;
+    d->length       = estFrames > 0 ? (uint64_t)estFrames : 0;
+    d->length_exact = false;
+    return true;
+}
 
-    const UInt32 CHUNK = 65536;
-    uint64_t total = 0;
-    for (;;) {
-        if (total + CHUNK > capacity) {
-            capacity *= 2;
-            float* tmp = (float*)realloc(buf, capacity * nch * sizeof(float));
-            if (!tmp) { free(buf); ExtAudioFileDispose(ef); return false; }
-            buf = tmp;
+static uint64_t m4a_read(TrackDecoder* d, float* out, uint64_t frames)
+{
+    const ma_uint32 nch = d->nch;
+    AudioBufferList abl;
+    abl.mNumberBuffers              = 1;
+    abl.mBuffers[0].mNumberChannels = nch;
+    abl.mBuffers[0].mDataByteSize   = (UInt32)(frames * nch * sizeof(float));
+    abl.mBuffers[0].mData           = nch == 2 ? out : d->scratch;
+    UInt32 n = (UInt32)frames;
+    ExtAudioFileRead(d->ef, &n, &abl);
+
+    if (nch != 2) {
+        // Convert to stereo
+        for (UInt32 i = 0; i < n; i++) {
+            float l = d->scratch[i * nch + 0];
+            float r = (nch >= 2) ? d->scratch[i * nch + 1] : l;
+            out[i * 2 + 0] = l;
+            out[i * 2 + 1] = r;
         }
-        AudioBufferList abl;
-        abl.mNumberBuffers              = 1;
-        abl.mBuffers[0].mNumberChannels = nch;
-        abl.mBuffers[0].mDataByteSize   = CHUNK * nch * sizeof(float);
-        abl.mBuffers[0].mData           = buf + total * nch;
-        UInt32 n = CHUNK;
-        ExtAudioFileRead(ef, &n, &abl);
-        if (n == 0) break;
-        total += n;
     }
-    ExtAudioFileDispose(ef);
-
-    if (total == 0) { free(buf); return false; }
-    *out_pcm      = buf;
-    *out_frames   = total;
-    *out_channels = nch;
-    *out_sr       = sr;
-    return true;
+    return n;
 }
 #endif  // __APPLE__
 
-// Decode any supported file to stereo (2-channel) f32 PCM at the native sample
-// rate.  miniaudio handles mono→stereo upmix for mp3/wav; M4A channel conversion
-// is done here.  Caller must free *out_pcm with free().
-static bool decode_to_pcm_stereo(const char* path, float** out_pcm,
-                                   uint64_t* out_frames, uint32_t* out_sr)
+static bool decoder_open(TrackDecoder* d, const char* path)
 {
+    memset(d, 0, sizeof(*d));
+    snprintf(d->path, sizeof(d->path), "%s", path);
 #ifdef __APPLE__
-    if (path_is_m4a(path)) {
-        float*    pcm;
-        uint64_t  frames;
-        ma_uint32 nch;
-        uint32_t  sr;
-        if (!decode_m4a_to_f32(path, &pcm, &frames, &nch, &sr)) return false;
-
-        if (nch != 2) {
-            // Convert to stereo
-            float* stereo = (float*)malloc(frames * 2 * sizeof(float));
-            if (!stereo) { free(pcm); return false; }
-            for (uint64_t i = 0; i < frames; i++) {
-                float l = (nch >= 1) ? pcm[i * nch + 0] : 0.0f;
-                float r = (nch >= 2) ? pcm[i * nch + 1] : l;
-                stereo[i * 2 + 0] = l;
-                stereo[i * 2 + 1] = r;
-            }
-            free(pcm);
-            pcm = stereo;
-        }
-        *out_pcm    = pcm;
-        *out_frames = frames;
-        *out_sr     = sr;
-        return true;
-    }
+    if (path_is_m4a(path)) return m4a_open(d, path);
 #endif
 
     // Decode mp3/wav/etc. to stereo f32 at the file's native sample rate.
     ma_decoder_config cfg = ma_decoder_config_init(ma_format_f32, 2, 0);
-    ma_decoder decoder;
-    if (ma_decoder_init_file(path, &cfg, &decoder) != MA_SUCCESS) return false;
+    if (ma_decoder_init_file(path, &cfg, &d->ma) != MA_SUCCESS) return false;
 
-    uint32_t sr = decoder.outputSampleRate;
+    ma_uint64 len = 0;
+    if (ma_decoder_get_length_in_pcm_frames(&d->ma, &len) != MA_SUCCESS) len = 0;
+    d->sample_rate  = d->ma.outputSampleRate;
+    d->length       = len;
+    d->length_exact = true;
+    return true;
+}
 
-    const ma_uint64 CHUNK = 65536;
-    float*  buf      = NULL;
-    size_t  total    = 0;
-    size_t  capacity = 0;
+// Up to frames stereo frames into out; 0 at the end of the file.
+static uint64_t decoder_read(TrackDecoder* d, float* out, uint64_t frames)
+{
+#ifdef __APPLE__
+    if (d->ef) return m4a_read(d, out, frames);
+#endif
+    ma_uint64 read = 0;
+    ma_decoder_read_pcm_frames(&d->ma, out, frames, &read);
+    return read;
+}
+
+static void decoder_close(TrackDecoder* d)
+{
+#ifdef __APPLE__
+    if (d->ef) { ExtAudioFileDispose(d->ef); free(d->scratch); return; }
+#endif
+    ma_decoder_uninit(&d->ma);
+}
+
+// Whole file into a malloc'd buffer, for files whose length the decoder
+// cannot tell up front.  Caller must free *out_pcm with free().
+static bool decode_all(TrackDecoder* d, float** out_pcm, uint64_t* out_frames)
+{
+    float*   buf      = NULL;
+    uint64_t total    = 0;
+    uint64_t capacity = 0;
 
     for (;;) {
-        if (total + CHUNK > capacity) {
-            size_t new_cap = (capacity == 0) ? CHUNK * 16 : capacity * 2;
-            float* tmp = (float*)realloc(buf, new_cap * 2 * sizeof(float));
-            if (!tmp) { free(buf); ma_decoder_uninit(&decoder); return false; }
+        if (total + DECODE_CHUNK > capacity) {
+            uint64_t new_cap = (capacity == 0) ? (uint64_t)DECODE_CHUNK * 16 : capacity * 2;
+            float* tmp = (float*)realloc(buf, (size_t)new_cap * 2 * sizeof(float));
+            if (!tmp) { free(buf); return false; }
             buf = tmp;
             capacity = new_cap;
         }
-        ma_uint64 read = 0;
-        ma_result res = ma_decoder_read_pcm_frames(&decoder, buf + total * 2, CHUNK, &read);
-        total += (size_t)read;
-        if (res == MA_AT_END || read == 0) break;
+        uint64_t n = decoder_read(d, buf + total * 2, DECODE_CHUNK);
+        if (n == 0) break;
+        total += n;
     }
 
-    uint32_t out_sr_val = decoder.outputSampleRate;
-    ma_decoder_uninit(&decoder);
-
     if (total == 0) { free(buf); return false; }
     *out_pcm    = buf;
-    *out_frames = (uint64_t)total;
-    *out_sr     = out_sr_val;
-    (void)sr;
+    *out_frames = total;
     return true;
 }
 
-void audio_init(AudioState* a) {
-    memset(a, 0, sizeof(*a));
-    if (ma_engine_init(NULL, &s_engine) != MA_SUCCESS) {
-        fprintf(stderr, "[audio] failed to init miniaudio engine\n");
-        return;
+// A complete store of a whole decode, in the default format; takes over pcm.
+// An f32 store wraps the buffer, a compact one gets a converted copy.
+static PcmStore* store_from_decode(float* pcm, uint64_t frames, uint32_t sr)
+{
+    const PcmFormat format = pcm_format_default();
+    if (format == PCM_F32) return pcm_store_create(pcm, frames, 2, sr);
+    PcmStore* st = pcm_store_create_empty(frames, 2, sr, format);
+    if (st) {
+        pcm_store_append(st, pcm, frames);
+        pcm_store_finish(st);
     }
-    s_engine_ok = true;
+    free(pcm);
+    return st;
 }
 
-bool audio_load(AudioState* a, EditorState* e, const char* path) {
-    if (!s_engine_ok) return false;
+// ---------------------------------------------------------------------------
+// Background load.  The loader thread owns the decoder and a reference to the
+// store, appends chunks and commits each one, and stops early if the track is
+// replaced or the app shuts down.  A decode that reaches the end is then
+// written to the PCM cache, still on the thread, which is joined by the next
+// load or by shutdown.  One load runs at a time; the same thread writes the
+// cache for a track decoded up front.
+//
+// A decoder whose estimated length fell short runs out of room in the store.
+// The store cannot grow while playback and the analyses borrow its buffer, so
+// the loader then decodes the whole track into a new one and hands it over
+// through s_full; audio_update plays on from that.
+// ---------------------------------------------------------------------------
+static std::thread             s_loader;
+static std::atomic<bool>       s_loader_cancel(false);
+static std::atomic<PcmStore*>  s_full(nullptr);
+
+// Frames the track is expected to have while it loads (for progress).
+static uint64_t s_expected = 0;
+
+// Seconds of newly decoded audio that trigger re-analysis while loading.
+static const double ANALYSIS_STEP = 5.0;
+
+// The whole track as a new store: st's frames, the n frames in first that
+// did not fit, and the rest of the decode.  nullptr if cancelled or out of
+// memory.
+static PcmStore* decode_past_end(TrackDecoder* d, PcmStore* st, const float* first,
+                                 uint64_t n)
+{
+    uint64_t have     = pcm_store_decoded(st);
+    uint64_t capacity = (have + n) * 2;
+    float*   buf      = (float*)malloc((size_t)capacity * 2 * sizeof(float));
+    if (!buf) return nullptr;
+    pcm_store_read(st, 0, have, buf);
+    memcpy(buf + have * 2, first, (size_t)n * 2 * sizeof(float));
+    uint64_t total = have + n;
+    while (n > 0) {
+        if (s_loader_cancel.load(std::memory_order_relaxed)) { free(buf); return nullptr; }
+        if (total + DECODE_CHUNK > capacity) {
+            float* tmp = (float*)realloc(buf, (size_t)capacity * 2 * 2 * sizeof(float));
+            if (!tmp) { free(buf); return nullptr; }
+            buf = tmp;
+            capacity *= 2;
+        }
+        n = decoder_read(d, buf + total * 2, DECODE_CHUNK);
+        total += n;
+    }
+    return store_from_decode(buf, total, st->sample_rate);
+}
+
+static void load_thread(TrackDecoder* d, PcmStore* st)
+{
+    bool      whole = false;     // decoded to the end, not cancelled or cut short
+    PcmStore* full  = nullptr;   // the whole track, if st was too short for it
+    float*    chunk = (float*)malloc((size_t)DECODE_CHUNK * 2 * sizeof(float));
+    while (chunk && !s_loader_cancel.load(std::memory_order_relaxed)) {
+        uint64_t room = st->capacity - pcm_store_decoded(st);
+        if (room == 0) {
+            if (d->length_exact) { whole = true; break; }
+            uint64_t n = decoder_read(d, chunk, DECODE_CHUNK);
+            if (n == 0) { whole = true; break; }
+            fprintf(stderr, "[audio] '%s' runs past its estimated length of %.2fs; "
+                    "decoding it in full\n", d->path, (double)st->capacity / st->sample_rate);
+            full = decode_past_end(d, st, chunk, n);
+            break;
+        }
+        uint64_t n = decoder_read(d, chunk, room < DECODE_CHUNK ? room : DECODE_CHUNK);
+        if (n == 0) { whole = true; break; }
+        pcm_store_append(st, chunk, n);
+    }
+    free(chunk);
+    // Hand the whole decode over before st reads as complete, so that the
+    // main thread never settles on the short one.
+    if (full) s_full.store(pcm_store_retain(full), std::memory_order_release);
+    pcm_store_finish(st);
+
+    // The next open of this track maps the decode instead of redoing it.
+    uint64_t n = pcm_store_decoded(st);
+    if (whole && n > 0)
+        pcm_cache_store(d->path, decoder_tag(d->path), st->data, st->format, n, 2,
+                        st->sample_rate);
+    if (full) {
+        pcm_cache_store(d->path, decoder_tag(d->path), full->data, full->format,
+                        pcm_store_decoded(full), 2, full->sample_rate);
+        pcm_store_release(full);
+    }
+
+    decoder_close(d);
+    free(d);
+    pcm_store_release(st);
+}
 
-    // Tear down the previous sound if one was loaded.
+// A track decoded whole on the main thread (unknown length) is only written
+// to the PCM cache here, on the loader thread, so the UI is not held up by
+// the file write.  Takes over path (malloc'd) and the reference to st.
+static void cache_thread(char* path, PcmStore* st)
+{
+    pcm_cache_store(path, decoder_tag(path), st->data, st->format,
+                    pcm_store_decoded(st), st->channels, st->sample_rate);
+    free(path);
+    pcm_store_release(st);
+}
+
+static void loader_stop()
+{
+    if (!s_loader.joinable()) return;
+    s_loader_cancel.store(true, std::memory_order_relaxed);
+    s_loader.join();
+    s_loader_cancel.store(false, std::memory_order_relaxed);
+    pcm_store_release(s_full.exchange(nullptr));   // one audio_update never took
+}
+
+// Playback settings as last set, to rebuild the chain with (swap_in_full).
+static float  s_speed      = 1.0f;
+static float  s_ratio      = 1.0f;
+static double s_loop_start = 0.0;
+static double s_loop_end   = 0.0;
+
+static void chain_uninit()
+{
     if (s_sound_ok) { ma_sound_uninit(&s_sound);   s_sound_ok = false; }
+    if (s_ahead_ok) { render_ahead_uninit(&s_ahead); s_ahead_ok = false; }
     if (s_pitch_ok) { pitch_node_uninit(&s_pitch); s_pitch_ok = false; }
     if (s_wsola_ok) { wsola_uninit(&s_wsola);      s_wsola_ok = false; }
+}
 
-    a->loaded   = false;
-    a->playing  = false;
-    a->position = 0.0;
-
-    // Decode to stereo f32 PCM.
-    float*   pcm;
-    uint64_t frames;
-    uint32_t sr;
-    if (!decode_to_pcm_stereo(path, &pcm, &frames, &sr)) {
-        fprintf(stderr, "[audio] failed to decode '%s'\n", path);
-        return false;
-    }
+// WSOLA -> PitchNode -> [RenderAhead] -> sound over s_store, at the given
+// speed and pitch ratio.  On failure logs, tears down what it built and
+// returns false; s_store is the caller's to release.
+static bool chain_init(const char* path, uint32_t sr, float speed, float pitch)
+{
+    const uint64_t frames = s_store->capacity;
 
-    // Initialise WSOLA source (takes ownership of pcm).
-    if (!wsola_init(&s_wsola, pcm, frames, 2, sr, /*owns_pcm=*/true)) {
-        free(pcm);
+    // WSOLA reads an f32 buffer in place and converts anything else a window
+    // at a time.
+    if (!wsola_init(&s_wsola, (float*)pcm_store_f32(s_store), frames, 2, sr,
+                    /*owns_pcm=*/false)) {
         fprintf(stderr, "[audio] wsola_init failed for '%s'\n", path);
         return false;
     }
-    // Reset speed and pitch to defaults on every new file load.
-    e->speed     = 1.0f;
-    e->semitones = 0;
-    e->cents     = 0;
-    wsola_set_speed(&s_wsola, 1.0f);
-    wsola_set_pitch(&s_wsola, 1.0f);
+    wsola_set_store(&s_wsola, s_store);
+    wsola_set_speed(&s_wsola, speed);
+    wsola_set_pitch(&s_wsola, pitch);
     s_wsola_ok = true;
 
     // Wrap WSOLA in a PitchNode (resampler stage for pitch shifting).
@@ -227,34 +373,179 @@ bool audio_load(AudioState* a, EditorState* e, const char* path) {
     }
     s_pitch_ok = true;
 
-    // Initialise miniaudio sound backed by the PitchNode.
+    // Render the PitchNode ahead on its own thread, unless configured off (or
+    // it cannot start, when the callback renders as before).
+    uint32_t ahead = render_ahead_frames(sr);
+    s_ahead_ok = ahead > 0 && render_ahead_init(&s_ahead, &s_pitch, ahead);
+
+    // Initialise miniaudio sound backed by it.
+    ma_data_source* src = s_ahead_ok ? (ma_data_source*)&s_ahead : (ma_data_source*)&s_pitch;
     ma_result result = ma_sound_init_from_data_source(
-        &s_engine, &s_pitch,
+        &s_engine, src,
         MA_SOUND_FLAG_NO_PITCH | MA_SOUND_FLAG_NO_SPATIALIZATION,
         NULL, &s_sound);
     if (result != MA_SUCCESS) {
+        if (s_ahead_ok) { render_ahead_uninit(&s_ahead); s_ahead_ok = false; }
         pitch_node_uninit(&s_pitch); s_pitch_ok = false;
         wsola_uninit(&s_wsola); s_wsola_ok = false;
         fprintf(stderr, "[audio] ma_sound_init_from_data_source failed: %d\n", result);
         return false;
     }
     s_sound_ok = true;
+    return true;
+}
+
+// A store for a decode found in the PCM cache.  The cache is shared with
+// riffdsp and with runs under another RIFFHOUND_PCM_FORMAT, so the entry may
+// hold the other format; it is then converted into a private store of the
+// format asked for instead of mapped.  Takes over m either way.
+static PcmStore* store_from_cache(PcmMap* m)
+{
+    const PcmFormat format = pcm_format_default();
+    if (m->format == format) return pcm_store_create_mapped(m);
+
+    const uint32_t nch   = m->channels;
+    PcmStore*      st    = pcm_store_create_empty(m->frames, nch, m->sample_rate, format);
+    float*         chunk = m->format == PCM_S16
+                         ? (float*)malloc((size_t)DECODE_CHUNK * nch * sizeof(float)) : nullptr;
+    if (st && (m->format != PCM_S16 || chunk)) {
+        for (uint64_t f = 0; f < m->frames; f += DECODE_CHUNK) {
+            uint64_t n = m->frames - f < DECODE_CHUNK ? m->frames - f : DECODE_CHUNK;
+            const float* src;
+            if (m->format == PCM_S16) {
+                pcm_s16_to_f32((const int16_t*)m->data + f * nch, chunk, (size_t)n * nch);
+                src = chunk;
+            } else {
+                src = (const float*)m->data + f * nch;
+            }
+            pcm_store_append(st, src, n);
+        }
+        pcm_store_finish(st);
+    } else {
+        pcm_store_release(st);
+        st = nullptr;
+    }
+    free(chunk);
+    pcm_cache_close(m);
+    return st;
+}
+
+void audio_init(AudioState* a) {
+    memset(a, 0, sizeof(*a));
+    if (ma_engine_init(NULL, &s_engine) != MA_SUCCESS) {
+        fprintf(stderr, "[audio] failed to init miniaudio engine\n");
+        return;
+    }
+    s_engine_ok = true;
+}
+
+bool audio_load(AudioState* a, EditorState* e, const char* path) {
+    if (!s_engine_ok) return false;
+
+    // Tear down the previous sound if one was loaded.  A load still running
+    // is stopped first; it would only be filling a buffer nobody plays.
+    loader_stop();
+    chain_uninit();
+    pcm_store_release(s_store);   // and the cached analyses of the old track
+    s_store = nullptr;
+
+    a->loaded          = false;
+    a->playing         = false;
+    a->loading         = false;
+    a->load_progress   = 0.0f;
+    a->analysis_frames = 0;
+    a->position        = 0.0;
+
+    // Decoded before: map it from the PCM cache (or convert it, if cached in
+    // the other sample format).  Otherwise, known length:
+    // allocate the whole buffer now and decode into it in the background;
+    // playback and analysis start on whatever has landed.  An estimated
+    // length gets a second of slack (AAC priming and remainder frames).
+    // Unknown length: decode it all here, as before.
+    PcmMap        map;
+    TrackDecoder* dec = nullptr;
+    if (pcm_cache_open(path, decoder_tag(path), &map)) {
+        if (map.channels == 2) s_store = store_from_cache(&map);
+        else                   pcm_cache_close(&map);
+    }
+    if (!s_store) {
+        dec = (TrackDecoder*)malloc(sizeof(TrackDecoder));
+        if (!dec || !decoder_open(dec, path)) {
+            free(dec);
+            fprintf(stderr, "[audio] failed to decode '%s'\n", path);
+            return false;
+        }
+    }
+    const uint32_t sr = dec ? dec->sample_rate : s_store->sample_rate;
+
+    if (!dec) {
+        s_expected = s_store->capacity;
+    } else if (dec->length > 0) {
+        s_expected = dec->length;
+        uint64_t capacity = dec->length + (dec->length_exact ? 0 : sr);
+        s_store = pcm_store_create_empty(capacity, 2, sr, pcm_format_default());
+        if (!s_store) {
+            decoder_close(dec); free(dec);
+            fprintf(stderr, "[audio] out of memory loading '%s'\n", path);
+            return false;
+        }
+        s_loader  = std::thread(load_thread, dec, pcm_store_retain(s_store));
+        a->loading = true;
+    } else {
+        float*   pcm;
+        uint64_t frames;
+        bool ok = decode_all(dec, &pcm, &frames);
+        decoder_close(dec); free(dec);
+        if (!ok) {
+            fprintf(stderr, "[audio] failed to decode '%s'\n", path);
+            return false;
+        }
+        // The store owns the buffer from here on; playback and analysis borrow
+        // it.
+        s_expected = frames;
+        s_store    = store_from_decode(pcm, frames, sr);
+        if (!s_store) {
+            fprintf(stderr, "[audio] out of memory loading '%s'\n", path);
+            return false;
+        }
+        char* copy = (char*)malloc(strlen(path) + 1);
+        if (copy) {
+            strcpy(copy, path);
+            s_loader = std::thread(cache_thread, copy, pcm_store_retain(s_store));
+        }
+    }
+    if (!chain_init(path, sr, 1.0f, 1.0f)) {
+        loader_stop();
+        pcm_store_release(s_store); s_store = nullptr;
+        return false;
+    }
+    // Reset speed and pitch to defaults on every new file load.
+    e->speed     = 1.0f;
+    e->semitones = 0;
+    e->cents     = 0;
+    s_speed      = 1.0f;
+    s_ratio      = 1.0f;
 
     strncpy(a->filename, path, sizeof(a->filename) - 1);
     a->filename[sizeof(a->filename) - 1] = '\0';
-    a->duration = (double)frames / sr;
+    a->duration = (double)s_expected / sr;
     a->position = 0.0;
     a->playing  = false;
     a->loaded   = true;
+    a->track_id++;
+    a->analysis_frames = s_store->analysis_frames;
 
-    printf("[audio] loaded '%s'  duration=%.2fs  ch=2  sr=%u\n",
-           path, a->duration, sr);
+    printf("[audio] %s '%s'  duration=%.2fs  ch=2  sr=%u\n",
+           a->loading ? "loading" : "loaded", path, a->duration, sr);
     return true;
 }
 
 void audio_play(AudioState* a) {
     if (!s_sound_ok || !a->loaded) return;
     a->play_start = a->position;
+    // Played to the end: start over, as ma_sound_start does for a sound that
+    // reached MA_AT_END (which a rendered-ahead one never does).
+    if (s_ahead_ok && render_ahead_at_end(&s_ahead)) render_ahead_seek(&s_ahead, 0);
     ma_sound_start(&s_sound);
     a->playing = true;
 }
@@ -269,10 +560,16 @@ void audio_seek(AudioState* a, double time_sec) {
     if (!s_sound_ok || !a->loaded) return;
     if (time_sec < 0.0)         time_sec = 0.0;
     if (time_sec > a->duration) time_sec = a->duration;
+    if (a->loading) {
+        // Only as far as has been decoded.
+        double front = (double)pcm_store_decoded(s_store) / s_wsola.sample_rate;
+        if (time_sec > front) time_sec = front;
+    }
 
     // Seek in terms of the data source's (file's) sample rate.
     ma_uint64 frame = (ma_uint64)(time_sec * s_wsola.sample_rate + 0.5);
-    ma_sound_seek_to_pcm_frame(&s_sound, frame);
+    if (s_ahead_ok) render_ahead_seek(&s_ahead, frame);
+    else            ma_sound_seek_to_pcm_frame(&s_sound, frame);
     a->position = time_sec;
 }
 
@@ -286,7 +583,9 @@ void audio_set_speed(EditorState* e, float speed) {
     // Round to nearest 0.05
     speed = roundf(speed * 20.0f) / 20.0f;
     e->speed = speed;
-    if (s_wsola_ok) wsola_set_speed(&s_wsola, speed);
+    s_speed  = speed;
+    if (s_ahead_ok)      render_ahead_set_speed(&s_ahead, speed);
+    else if (s_wsola_ok) wsola_set_speed(&s_wsola, speed);
 }
 
 void audio_set_pitch(EditorState* e, int semitones, int cents) {
@@ -297,23 +596,89 @@ void audio_set_pitch(EditorState* e, int semitones, int cents) {
     e->semitones = semitones;
     e->cents     = cents;
     float ratio = powf(2.0f, (float)(semitones * 100 + cents) / 1200.0f);
-    if (s_wsola_ok) wsola_set_pitch(&s_wsola, ratio);
+    s_ratio = ratio;
+    if (s_ahead_ok)      render_ahead_set_pitch(&s_ahead, ratio);
+    else if (s_wsola_ok) wsola_set_pitch(&s_wsola, ratio);
 }
 
 void audio_set_loop(AudioState* a, bool enabled, double loop_start, double loop_end) {
-    a->loop = enabled;
+    a->loop      = enabled;
+    s_loop_start = loop_start;
+    s_loop_end   = loop_end;
     if (s_wsola_ok) {
         uint64_t sf = (uint64_t)(loop_start * s_wsola.sample_rate + 0.5);
         uint64_t ef = (uint64_t)(loop_end   * s_wsola.sample_rate + 0.5);
-        if (ef > s_wsola.frame_count) ef = s_wsola.frame_count;
+        uint64_t n  = a->loading ? s_wsola.frame_count : pcm_store_decoded(s_store);
+        if (ef > n) ef = n;
         if (sf >= ef) sf = 0;
-        wsola_set_loop(&s_wsola, enabled, sf, ef);
+        if (s_ahead_ok) render_ahead_set_loop(&s_ahead, enabled, sf, ef);
+        else            wsola_set_loop(&s_wsola, enabled, sf, ef);
     }
 }
 
+// Replace the short store of a track that ran past its estimated length with
+// its whole decode, and play on from the same place with the same settings.
+static void swap_in_full(AudioState* a, PcmStore* full)
+{
+    const double position = a->position;
+    const bool   playing  = a->playing;
+    chain_uninit();
+    pcm_store_release(s_store);
+    s_store    = full;
+    s_expected = full->capacity;
+    const uint32_t sr = full->sample_rate;
+    if (!chain_init(a->filename, sr, s_speed, s_ratio)) {
+        pcm_store_release(s_store); s_store = nullptr;
+        a->loaded  = false;
+        a->playing = false;
+        a->loading = false;
+        return;
+    }
+    a->loading         = false;
+    a->load_progress   = 1.0f;
+    a->duration        = (double)s_expected / sr;
+    a->analysis_frames = s_store->analysis_frames;
+    a->playing         = false;
+    audio_set_loop(a, a->loop, s_loop_start, s_loop_end);
+    audio_seek(a, position);
+    if (playing) audio_play(a);
+    printf("[audio] loaded '%s' in full  duration=%.2fs\n", a->filename, a->duration);
+}
+
 void audio_update(AudioState* a) {
     if (!s_sound_ok || !a->loaded) return;
 
+    if (PcmStore* full = s_full.exchange(nullptr, std::memory_order_acquire)) {
+        swap_in_full(a, full);
+        if (!s_sound_ok) return;
+    }
+
+    // Follow a background load: progress, the true length once it is known,
+    // and the prefix the analyses work on.
+    if (a->loading) {
+        uint64_t n = pcm_store_decoded(s_store);
+        if (pcm_store_complete(s_store)) {
+            a->loading       = false;
+            a->load_progress = 1.0f;
+            a->duration      = (double)n / s_store->sample_rate;
+            printf("[audio] loaded '%s'  duration=%.2fs\n", a->filename, a->duration);
+        } else {
+            a->load_progress = s_expected > 0 ? (float)((double)n / s_expected) : 0.0f;
+            if (a->load_progress > 1.0f) a->load_progress = 1.0f;
+        }
+    }
+    // Re-analyse when the decoded part has grown by half again (or at least
+    // ANALYSIS_STEP seconds), so a long track is redone only a few times.
+    uint64_t step = (uint64_t)(ANALYSIS_STEP * s_store->sample_rate);
+    if (step < s_store->analysis_frames / 2) step = s_store->analysis_frames / 2;
+    if (pcm_store_advance(s_store, step))
+        a->analysis_frames = s_store->analysis_frames;
+
+    // A rendered-ahead sound plays silence past the end rather than ending;
+    // stop it here once the end has been heard.
+    if (s_ahead_ok && a->playing && render_ahead_at_end(&s_ahead))
+        ma_sound_stop(&s_sound);
+
     // Sync the playing flag from the audio thread, but only allow it to go
     // false here.  audio_play() is the sole place that sets it true, so that
     // the brief async delay before ma_sound_is_playing reflects a ma_sound_stop
@@ -321,97 +686,63 @@ void audio_update(AudioState* a) {
     if (!ma_sound_is_playing(&s_sound))
         a->playing = false;
 
-    // Read cursor from the atomic updated by the audio thread after each hop.
-    if (s_wsola_ok) {
+    // Read cursor from the atomic updated by the audio thread after each hop,
+    // or with the render thread, after each block played.
+    if (s_ahead_ok) {
+        a->position = (double)s_ahead.played_cursor.load(std::memory_order_relaxed) /
+                      s_wsola.sample_rate;
+        a->jumps    = s_ahead.played_jumps.load(std::memory_order_relaxed);
+    } else if (s_wsola_ok) {
         uint64_t cur = s_wsola.cursor_frames.load(std::memory_order_relaxed);
         a->position = (double)cur / s_wsola.sample_rate;
+        a->jumps    = s_wsola.jumps.load(std::memory_order_relaxed);
     }
 }
 
-bool audio_decode_pcm(const char* path, float** out_samples,
-                      uint64_t* out_frame_count, uint32_t* out_sample_rate)
-{
-#ifdef __APPLE__
-    if (path_is_m4a(path)) {
-        float*    pcm;
-        uint64_t  frames;
-        ma_uint32 nch;
-        uint32_t  sr;
-        if (!decode_m4a_to_f32(path, &pcm, &frames, &nch, &sr)) return false;
-        // Mix down to mono if multichannel
-        if (nch > 1) {
-            for (uint64_t i = 0; i < frames; i++) {
-                float s = 0.0f;
-                for (ma_uint32 c = 0; c < nch; c++) s += pcm[i * nch + c];
-                pcm[i] = s / (float)nch;
-            }
-        }
-        *out_samples     = pcm;
-        *out_frame_count = frames;
-        *out_sample_rate = sr;
-        return true;
-    }
-#endif
-
-    // Decode entire file as mono f32 at the file's native sample rate.
-    ma_decoder_config cfg = ma_decoder_config_init(ma_format_f32, 1, 0);
-    ma_decoder decoder;
-    if (ma_decoder_init_file(path, &cfg, &decoder) != MA_SUCCESS)
-        return false;
-
-    const ma_uint64 CHUNK = 65536;
-    float*  buf      = NULL;
-    size_t  total    = 0;
-    size_t  capacity = 0;
-
-    for (;;) {
-        if (total + CHUNK > capacity) {
-            size_t new_cap = (capacity == 0) ? CHUNK * 16 : capacity * 2;
-            float* tmp = (float*)realloc(buf, new_cap * sizeof(float));
-            if (!tmp) { free(buf); ma_decoder_uninit(&decoder); return false; }
-            buf = tmp;
-            capacity = new_cap;
-        }
-        ma_uint64 read = 0;
-        ma_result res = ma_decoder_read_pcm_frames(&decoder, buf + total, CHUNK, &read);
-        total += (size_t)read;
-        if (res == MA_AT_END || read == 0) break;
-    }
-
-    uint32_t sr = decoder.outputSampleRate;
-    ma_decoder_uninit(&decoder);
-
-    if (total == 0) { free(buf); return false; }
-
-    *out_samples     = buf;
-    *out_frame_count = (uint64_t)total;
-    *out_sample_rate = sr;
-    return true;
+const float* audio_analysis_pcm(const AudioState* a,
+                                uint64_t* frame_count,
+                                uint32_t* channels,
+                                uint32_t* sample_rate) {
+    if (!s_store || s_store->analysis_frames == 0) return nullptr;
+    uint64_t     n   = 0;
+    uint32_t     sr  = 0;
+    const float* sig = pcm_store_analysis(s_store, &n, &sr);
+    if (!sig || n == 0) return nullptr;
+    if (frame_count)  *frame_count  = n;
+    if (channels)     *channels     = 1;
+    if (sample_rate)  *sample_rate  = sr;
+    return sig;
 }
 
-void audio_free_pcm(float* samples) {
-    free(samples);
+const float* audio_display_pcm(const AudioState* a,
+                               uint64_t* frame_count,
+                               uint32_t* channels,
+                               uint32_t* sample_rate) {
+    if (!s_store || s_store->analysis_frames == 0) return nullptr;
+    const float* mono = pcm_store_mono(s_store);
+    if (!mono) return nullptr;
+    if (frame_count)  *frame_count  = s_store->analysis_frames;
+    if (channels)     *channels     = 1;
+    if (sample_rate)  *sample_rate  = s_store->sample_rate;
+    return mono;
 }
 
-const float* audio_pcm_data(const AudioState* a,
-                              uint64_t* frame_count,
-                              uint32_t* channels,
-                              uint32_t* sample_rate) {
-    if (!s_wsola_ok || !s_wsola.pcm) return nullptr;
-    if (frame_count)  *frame_count  = s_wsola.frame_count;
-    if (channels)     *channels     = s_wsola.channels;
-    if (sample_rate)  *sample_rate  = s_wsola.sample_rate;
-    return s_wsola.pcm;
+PcmStore* audio_pcm_store(const AudioState* a) {
+    return s_store;
 }
 
 void audio_shutdown(AudioState* a) {
+    loader_stop();
     // Stop the sound (removes it from the node graph) first.
     if (s_sound_ok)  { ma_sound_uninit(&s_sound);   s_sound_ok = false; }
     // Stop the engine's audio thread BEFORE freeing WSOLA/PitchNode memory.
     if (s_engine_ok) { ma_engine_uninit(&s_engine);  s_engine_ok = false; }
+    if (s_ahead_ok)  { render_ahead_uninit(&s_ahead); s_ahead_ok = false; }
     if (s_pitch_ok)  { pitch_node_uninit(&s_pitch);  s_pitch_ok = false; }
-    // wsola_uninit frees ws->pcm; the audio thread must not be reading it.
-    if (s_wsola_ok)  { wsola_uninit(&s_wsola);       s_wsola_ok = false; }
+    if (s_wsola_ok)  { wsola_uninit(&s_wsola);      s_wsola_ok = false; }
+    // Frees the PCM; the audio thread must not be reading it.
+    pcm_store_release(s_store);
+    s_store = nullptr;
     a->loaded  = false;
     a->playing = false;
 }
@@ -6,13 +6,27 @@
 // Audio module: miniaudio + WSOLA pitch-preserving time stretching
 
 struct AudioState {
-    bool   loaded;
-    bool   playing;
-    bool   loop;        // loop mode on/off
-    double duration;    // seconds; set on load
-    double position;    // seconds; updated each frame by audio_update
-    double play_start;  // position at which the last play was initiated
-    char   filename[512];
+    bool     loaded;
+    bool     playing;
+    bool     loop;        // loop mode on/off
+    double   duration;    // seconds; set on load
+    double   position;    // seconds; updated each frame by audio_update
+    double   play_start;  // position at which the last play was initiated
+    uint32_t jumps;       // changes whenever playback jumps (seek, loop wrap); synced by audio_update
+    uint32_t track_id;    // bumped by every successful audio_load
+
+    // A track decodes in the background after audio_load returns.  Until
+    // loading clears, duration is the decoder's expected length, playback and
+    // seeking stop at the decode front, and analysis_frames -- the length
+    // audio_analysis_pcm reports -- grows in steps as audio_update sees more
+    // decoded.  Recompute analyses when it changes.  A track that runs past
+    // the decoder's estimated length is decoded again in full, and
+    // audio_update then plays on from that: duration and analysis_frames
+    // change, and the analysis buffer moves.
+    bool     loading;
+    float    load_progress;     // [0, 1]
+    uint64_t analysis_frames;
+    char     filename[512];
 };
 
 void   audio_init(AudioState* a);
@@ -39,16 +53,31 @@ void   audio_update(AudioState* a);
 
 void   audio_shutdown(AudioState* a);
 
-// Decode the file to mono f32 PCM for offline processing (e.g. spectrogram).
-// Returns true on success; caller must free *out_samples with audio_free_pcm().
-bool   audio_decode_pcm(const char* path, float** out_samples,
-                        uint64_t* out_frame_count, uint32_t* out_sample_rate);
-void   audio_free_pcm(float* samples);
-
-// Access the loaded PCM buffer (stereo interleaved f32). Returns nullptr if no
-// audio is loaded. Do not modify or free the returned pointer.
-// Safe to call from the main thread; do not call during file load.
-const float* audio_pcm_data(const AudioState* a,
-                             uint64_t* frame_count,
-                             uint32_t* channels,
-                             uint32_t* sample_rate);
+// The loaded track as the analyses read it: the store's analysis signal
+// (pcm_store_analysis), mono and usually at a lower rate than the track, so
+// *channels is 1 and *sample_rate is the analysis rate.  Beat detection and
+// chroma all take their input from here so that they share cache entries and
+// skip the per-frame mixdown.  *frame_count covers the
+// first a->analysis_frames frames of the track; nullptr until the first step
+// of a background load is in.  Do not modify or free the returned pointer; it
+// is valid until the next audio_load() or full decode (see loading above).
+// Main thread.
+const float* audio_analysis_pcm(const AudioState* a,
+                                uint64_t* frame_count,
+                                uint32_t* channels,
+                                uint32_t* sample_rate);
+
+// The loaded track as the spectrogram draws it: the store's mono view
+// (pcm_store_mono), at the track's own rate so the display reaches its
+// Nyquist.  *channels is 1; otherwise as audio_analysis_pcm.  Main thread.
+const float* audio_display_pcm(const AudioState* a,
+                               uint64_t* frame_count,
+                               uint32_t* channels,
+                               uint32_t* sample_rate);
+
+// The loaded track's PCM store (pcm_store.h), or nullptr.  The interleaved
+// samples themselves are read through it (pcm_store_read), as they may be
+// held in a compact format.  Borrowed; take a reference with
+// pcm_store_retain() to keep it past the next audio_load() or full decode.
+struct PcmStore;
+PcmStore* audio_pcm_store(const AudioState* a);
@@ -1,10 +1,39 @@
 #include "beat_algo.h"
+#include <stdlib.h>
 #include <string.h>
 
 void autobeat_init(AutoBeatList* ab) {
     memset(ab, 0, sizeof(*ab));
 }
 
+void autobeat_shutdown(AutoBeatList* ab) {
+    free(ab->beat_times);
+    free(ab->beat_selected);
+    free(ab->onset_times);
+    autobeat_init(ab);
+}
+
+bool autobeat_reserve_beats(AutoBeatList* ab, int n) {
+    if (n <= ab->beat_capacity) return true;
+    double* t = (double*)realloc(ab->beat_times, n * sizeof(double));
+    if (!t) return false;
+    ab->beat_times = t;
+    bool* sel = (bool*)realloc(ab->beat_selected, n * sizeof(bool));
+    if (!sel) return false;
+    ab->beat_selected = sel;
+    ab->beat_capacity = n;
+    return true;
+}
+
+bool autobeat_reserve_onsets(AutoBeatList* ab, int n) {
+    if (n <= ab->onset_capacity) return true;
+    double* t = (double*)realloc(ab->onset_times, n * sizeof(double));
+    if (!t) return false;
+    ab->onset_times    = t;
+    ab->onset_capacity = n;
+    return true;
+}
+
 const BeatAlgoDesc BEAT_ALGOS[] = {
     {
         "Spectral Flux + Ellis DP",
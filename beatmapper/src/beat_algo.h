@@ -3,24 +3,45 @@
 
 // ---------------------------------------------------------------------------
 // Output: auto-detected beat candidates
+//
+// The beat and onset arrays grow with the analysed span (one ODF frame per
+// beat_flux_hop() samples bounds both), so a whole recording is detected in
+// one pass.  They are reused across runs; autobeat_shutdown() releases them.
 // ---------------------------------------------------------------------------
-static const int MAX_BEAT_CANDS = 2048;
+static const int MAX_TEMPO_LAGS = 512;
 
 struct AutoBeatList {
     // Tempo-regularised beat positions (primary output of each algorithm)
-    double beat_times   [MAX_BEAT_CANDS];
-    bool   beat_selected[MAX_BEAT_CANDS];
-    int    beat_count;
+    double* beat_times;
+    bool*   beat_selected;
+    int     beat_count;
+    int     beat_capacity;
 
     // Raw onset times (shown as subtle ticks when show_raw is enabled)
-    double onset_times[MAX_BEAT_CANDS];
-    int    onset_count;
+    double* onset_times;
+    int     onset_count;
+    int     onset_capacity;
 
     // Estimated tempo in BPM; 0 = could not determine
     float  estimated_bpm;
+
+    // Tempo-strength curve of the analysed window (tempo.h), ordered by lag:
+    // tempo_strength[i] is the ODF autocorrelation at lag tempo_lag_min + i
+    // frames, tempo_fps frames per second.  Filled even when the tempo came
+    // from seed beats; tempo_lag_count = 0 if it could not be computed.
+    float  tempo_strength[MAX_TEMPO_LAGS];
+    int    tempo_lag_min;
+    int    tempo_lag_count;
+    float  tempo_fps;
 };
 
 void autobeat_init(AutoBeatList* ab);
+void autobeat_shutdown(AutoBeatList* ab);
+
+// Make room for n beats / n onsets.  Existing entries are kept; returns false
+// if memory ran out (the list is left as it was).
+bool autobeat_reserve_beats (AutoBeatList* ab, int n);
+bool autobeat_reserve_onsets(AutoBeatList* ab, int n);
 
 // ---------------------------------------------------------------------------
 // Algorithm interface
@@ -65,5 +86,28 @@ void beat_spectral_flux(const float* pcm, uint64_t frame_count,
                         const BeatAlgoParams* params,
                         AutoBeatList* out);
 
+// beat_spectral_flux keeps each stage of its last few runs (ODF, onsets,
+// tempo, DP) and recomputes only the stages whose inputs changed, so re-running
+// with a new threshold or tightness skips the FFT work.  Drop everything
+// cached for pcm; call before the buffer is freed.
+void beat_spectral_flux_release(const float* pcm);
+
+// Spectral flux onset detection function over [t_start, t_end], one value per
+// beat_flux_hop(sample_rate) samples (about 11.6 ms) on the shared STFT grid;
+// *out_t0 receives the time of odf[0].  malloc'd (caller frees); nullptr if
+// the window is too short.
+int    beat_flux_hop(uint32_t sample_rate);
+float* beat_flux_odf(const float* pcm, uint64_t frame_count,
+                     uint32_t channels, uint32_t sample_rate,
+                     double t_start, double t_end,
+                     int* out_n, double* out_t0);
+
+// Raw onsets of n ODF frames starting at time t_start: local maxima above
+// mean + threshold_mult * std of those frames, at least 50 ms apart.  Returns
+// the count; *times is malloc'd (caller frees), nullptr when there are none.
+int beat_flux_onsets(const float* odf, int n, double t_start,
+                     uint32_t sample_rate, float threshold_mult,
+                     double** times);
+
 extern const BeatAlgoDesc BEAT_ALGOS[];
 extern const int           BEAT_ALGO_COUNT;
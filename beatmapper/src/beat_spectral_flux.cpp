@@ -1,98 +1,109 @@
 // beat_spectral_flux.cpp
 // Beat detection via:
 //   1. Spectral flux onset detection function (ODF)
-//   2. Autocorrelation tempo estimation (or seed beats if provided)
+//   2. Autocorrelation tempo estimation, tempo.h (or seed beats if provided)
 //   3. Ellis DP beat tracker — regularises beats, fills quiet bars
 //   4. Phase alignment to existing accepted beats (when seeds are given)
 //   5. Pre-onset shift: each beat is placed a configurable amount before the
 //      detected peak, landing in the quiet moment just before the attack.
 //
+// The result of each stage is cached (see "Stage cache" below), so a re-run
+// that only changes later-stage parameters starts from the cached ODF.
+//
 // "Find the dominant beats, not every snap crackle and pop."
 
 #include "beat_algo.h"
-#include "chroma_fft.h"   // shared inline Cooley-Tukey FFT
+#include "analysis_rate.h"
+#include "stft_cache.h"
+#include "simd.h"
+#include "tempo.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <mutex>
+
+// STFT frame and hop in seconds: 2048 and 512 samples at 44.1 kHz, 1024 and
+// 256 at the usual 22.05 kHz analysis rate.
+static const double BF_FFT_SEC = 0.04644;
+static const double BF_HOP_SEC = 0.01161;
+
+// Window magnitudes grow with the frame length, and the DP weighs the ODF
+// against a fixed tightness penalty, so flux is expressed at the scale of a
+// BF_FFT_REF-point frame whatever the rate.
+static const int    BF_FFT_REF = 2048;
 
-static const int BF_FFT  = 2048;
-static const int BF_HOP  = 512;
-static const int BF_BINS = BF_FFT / 2;
+int beat_flux_hop(uint32_t sample_rate)
+{
+    return analysis_samples(BF_HOP_SEC, sample_rate);
+}
 
 // ---------------------------------------------------------------------------
 // Step 1: compute spectral flux ODF for the audio in [t_start, t_end].
+// Magnitude frames come from the shared STFT cache, so they are aligned to
+// the track-wide hop grid: *out_t0 receives the start time of flux[0].
+// Values are scaled to a BF_FFT_REF-point frame.
 // Returns heap-allocated float array; caller must free().
 // ---------------------------------------------------------------------------
-static float* compute_flux(const float* pcm, uint64_t total_frames,
-                           uint32_t channels, uint32_t sample_rate,
-                           double t_start, double t_end,
-                           int* out_n)
+float* beat_flux_odf(const float* pcm, uint64_t total_frames,
+                     uint32_t channels, uint32_t sample_rate,
+                     double t_start, double t_end,
+                     int* out_n, double* out_t0)
 {
-    *out_n = 0;
-    if (!pcm || total_frames == 0 || sample_rate == 0 || channels == 0) return nullptr;
-
-    uint64_t s0 = (uint64_t)(t_start * sample_rate);
-    uint64_t s1 = (uint64_t)(t_end   * sample_rate);
-    if (s1 > total_frames) s1 = total_frames;
-    if (s0 >= s1 || s1 - s0 < (uint64_t)BF_FFT) return nullptr;
-
-    int n = (int)((s1 - s0 - BF_FFT) / BF_HOP) + 1;
-    if (n <= 0) return nullptr;
+    *out_n  = 0;
+    *out_t0 = t_start;
+    const int n_fft = analysis_fft_size(BF_FFT_SEC, sample_rate);
+    const int hop   = beat_flux_hop(sample_rate);
+    const int bins  = n_fft / 2;
+    const float scale = (float)BF_FFT_REF / (float)n_fft;
+    StftView view;
+    if (!stft_open(&view, pcm, total_frames, channels, sample_rate, n_fft, hop, STFT_HANN))
+        return nullptr;
+
+    int64_t s0 = (int64_t)(t_start * sample_rate);
+    int64_t s1 = (int64_t)(t_end   * sample_rate);
+    int64_t k0, k1;
+    stft_frame_range(&view, s0, s1, &k0, &k1);
+    int n = (int)(k1 - k0);
+    if (n <= 0) { stft_close(&view); return nullptr; }
 
     float* flux = (float*)calloc(n, sizeof(float));
-    float* re   = (float*)malloc(BF_FFT * sizeof(float));
-    float* im   = (float*)malloc(BF_FFT * sizeof(float));
-    float* prev = (float*)calloc(BF_BINS, sizeof(float));
-    if (!flux || !re || !im || !prev) {
-        free(flux); free(re); free(im); free(prev); return nullptr;
+    float* prev = (float*)calloc(bins, sizeof(float));
+    if (!flux || !prev) {
+        free(flux); free(prev); stft_close(&view); return nullptr;
     }
 
-    // Hann window
-    float window[BF_FFT];
-    for (int i = 0; i < BF_FFT; i++)
-        window[i] = 0.5f * (1.0f - cosf(2.0f * 3.14159265f * i / (BF_FFT - 1)));
-
     for (int f = 0; f < n; f++) {
-        uint64_t off = s0 + (uint64_t)f * BF_HOP;
-        // Mix to mono (handles any channel count)
-        for (int i = 0; i < BF_FFT; i++) {
-            uint64_t fi = off + i;
-            float s = 0.0f;
-            if (fi < total_frames) {
-                for (uint32_t ch = 0; ch < channels; ch++)
-                    s += pcm[fi * channels + ch];
-                s /= (float)channels;
-            }
-            re[i] = s * window[i];
-            im[i] = 0.0f;
-        }
-        chroma_fft(re, im, BF_FFT);
+        const float* mag = stft_frame(&view, k0 + f);
+        if (!mag) break;
 
         // Spectral flux: sum of positive magnitude differences (half-wave rectified)
         float sf = 0.0f;
-        for (int b = 0; b < BF_BINS; b++) {
-            float mag  = sqrtf(re[b]*re[b] + im[b]*im[b]);
-            float diff = mag - prev[b];
+        for (int b = 0; b < bins; b++) {
+            float diff = mag[b] - prev[b];
             if (diff > 0.0f) sf += diff;
-            prev[b] = mag;
+            prev[b] = mag[b];
         }
-        flux[f] = sf;
+        flux[f] = sf * scale;
     }
+    stft_close(&view);
 
-    free(re); free(im); free(prev);
-    *out_n = n;
+    free(prev);
+    *out_n  = n;
+    *out_t0 = (double)(k0 * hop) / sample_rate;
     return flux;
 }
 
 // ---------------------------------------------------------------------------
 // Step 2a: collect raw onset times (local maxima above adaptive threshold).
+// Onsets are at least min_gap frames apart, which bounds how many there can
+// be; room for that many is allocated up front.
 // ---------------------------------------------------------------------------
-static void find_onsets(const float* flux, int n, double t_start,
-                        uint32_t sample_rate, float threshold_mult,
-                        double* times, int* count, int max_count)
+int beat_flux_onsets(const float* flux, int n, double t_start,
+                     uint32_t sample_rate, float threshold_mult,
+                     double** times)
 {
-    *count = 0;
-    if (n < 3) return;
+    *times = nullptr;
+    if (n < 3) return 0;
 
     // Adaptive threshold: mean + threshold_mult * std
     float sum = 0.0f, sum2 = 0.0f;
@@ -103,72 +114,36 @@ static void find_onsets(const float* flux, int n, double t_start,
     float thr  = mean + threshold_mult * std;
 
     // Minimum gap between onsets (~50 ms)
-    double hop_sec  = (double)BF_HOP / sample_rate;
+    double hop_sec  = (double)beat_flux_hop(sample_rate) / sample_rate;
     int    min_gap  = (int)(0.05 / hop_sec);
     if (min_gap < 1) min_gap = 1;
     int    last     = -min_gap * 2;
+    double* buf = (double*)malloc((n / min_gap + 1) * sizeof(double));
+    if (!buf) return 0;
 
-    for (int i = 1; i < n - 1 && *count < max_count; i++) {
+    int count = 0;
+    for (int i = 1; i < n - 1; i++) {
         if (flux[i] > thr && flux[i] > flux[i-1] && flux[i] >= flux[i+1]
                 && (i - last) >= min_gap) {
-            times[(*count)++] = t_start + (double)i * hop_sec;
+            buf[count++] = t_start + (double)i * hop_sec;
             last = i;
         }
     }
+    if (count == 0) { free(buf); return 0; }
+    *times = buf;
+    return count;
 }
 
 // ---------------------------------------------------------------------------
-// Step 2b: estimate beat period in ODF frames via autocorrelation.
-// Checks whether double the best lag is also strong (avoids subdivision lock).
+// Step 3: median of an array (in-place sort, returns mid element).
 // ---------------------------------------------------------------------------
-static float estimate_period(const float* flux, int n,
-                              float min_bpm, float max_bpm,
-                              uint32_t sample_rate)
-{
-    float fps    = (float)sample_rate / BF_HOP;   // ODF frames per second
-    int lag_min  = (int)(fps * 60.0f / max_bpm);
-    int lag_max  = (int)(fps * 60.0f / min_bpm);
-    if (lag_min < 1)    lag_min = 1;
-    if (lag_max >= n)   lag_max = n - 1;
-    if (lag_min > lag_max) return fps;  // fallback to 1 BPS
-
-    float best_val = -1.0f;
-    int   best_lag =  lag_min;
-
-    for (int lag = lag_min; lag <= lag_max; lag++) {
-        int   cnt = n - lag;
-        float ac  = 0.0f;
-        for (int i = 0; i < cnt; i++) ac += flux[i] * flux[i + lag];
-        ac /= (float)cnt;
-        if (ac > best_val) { best_val = ac; best_lag = lag; }
-    }
-
-    // Prefer double the period if it's nearly as strong (avoids 8th-note lock).
-    int double_lag = best_lag * 2;
-    if (double_lag <= lag_max) {
-        int   cnt = n - double_lag;
-        float ac2 = 0.0f;
-        if (cnt > 0) {
-            for (int i = 0; i < cnt; i++) ac2 += flux[i] * flux[i + double_lag];
-            ac2 /= (float)cnt;
-            if (ac2 >= best_val * 0.70f)
-                best_lag = double_lag;
-        }
-    }
-
-    return (float)best_lag;
+static int cmp_float(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
 }
 
-// ---------------------------------------------------------------------------
-// Step 3: median of an array (in-place sort, returns mid element).
-// For small arrays only.
-// ---------------------------------------------------------------------------
 static float array_median(float* a, int n) {
-    for (int i = 0; i < n - 1; i++) {
-        int m = i;
-        for (int j = i + 1; j < n; j++) if (a[j] < a[m]) m = j;
-        float t = a[i]; a[i] = a[m]; a[m] = t;
-    }
+    qsort(a, n, sizeof(float), cmp_float);
     return a[n / 2];
 }
 
@@ -177,40 +152,102 @@ static float array_median(float* a, int n) {
 // C[t] = ODF[t] + max_{t'} [ C[t'] - tightness * log(delta/tau)^2 ]
 // where delta = t - t'.  Quiet beats are "filled in" because the global
 // temporal-consistency bonus propagates across low-ODF frames.
+//
+// The penalty depends only on delta, so it is tabulated once per call and
+// stored reversed: for frame t, predecessor p reads rpen[p - t + dmax], which
+// runs forward with p.  The inner max is then two loads and a subtract per
+// predecessor, and vectorizes.  The first (earliest) predecessor reaching the
+// max wins, as in the plain loop.
 // ---------------------------------------------------------------------------
-static void dp_beat_track(const float* flux, int n, float tau, float tightness,
-                          int* beat_frames, int* beat_count, int max_beats)
+static void best_pred_scalar(const float* score, const float* rpen, int p0, int p1,
+                             float* best_val, int* best_p)
+{
+    float bv = -1e30f;
+    int   bp = -1;
+    for (int p = p0; p <= p1; p++) {
+        float val = score[p] - rpen[p];
+        if (val > bv) { bv = val; bp = p; }
+    }
+    *best_val = bv;
+    *best_p   = bp;
+}
+
+static void best_pred_f4(const float* score, const float* rpen, int p0, int p1,
+                         float* best_val, int* best_p)
+{
+    const int end4 = p0 + ((p1 - p0 + 1) & ~3);
+    if (end4 == p0) { best_pred_scalar(score, rpen, p0, p1, best_val, best_p); return; }
+
+    f4 m = f4_set1(-1e30f);
+    for (int p = p0; p < end4; p += 4)
+        m = f4_max(m, f4_sub(f4_load(score + p), f4_load(rpen + p)));
+    float bv = f4_hmax(m);
+    for (int p = end4; p <= p1; p++) {
+        float val = score[p] - rpen[p];
+        if (val > bv) bv = val;
+    }
+
+    // Second pass: the first predecessor holding the max.
+    f4 b4 = f4_set1(bv);
+    for (int p = p0; p < end4; p += 4) {
+        int mask = f4_eq_mask(f4_sub(f4_load(score + p), f4_load(rpen + p)), b4);
+        if (mask) { *best_val = bv; *best_p = p + __builtin_ctz(mask); return; }
+    }
+    for (int p = end4; p <= p1; p++)
+        if (score[p] - rpen[p] == bv) { *best_val = bv; *best_p = p; return; }
+    *best_val = bv;
+    *best_p   = -1;
+}
+
+// Returns the beat frames in chronological order (malloc'd, caller frees) and
+// their count in *beat_count; nullptr when there are none.
+static int* dp_beat_track(const float* flux, int n, float tau, float tightness,
+                          int* beat_count)
 {
     *beat_count = 0;
-    if (n < 2 || tau < 1.0f) return;
+    if (n < 2 || tau < 1.0f) return nullptr;
+
+    // Longest gap ever searched: t - (int)(t - 2.5 tau) <= ceil(2.5 tau), and
+    // never more than the frames before t.
+    int dmax = (int)ceilf(2.5f * tau) + 1;
+    if (dmax > n) dmax = n;
 
     float* score = (float*)malloc(n * sizeof(float));
     int*   prev  = (int*)  malloc(n * sizeof(int));
-    if (!score || !prev) { free(score); free(prev); return; }
+    float* rpen  = (float*)malloc((dmax + 1) * sizeof(float));
+    if (!score || !prev || !rpen) { free(score); free(prev); free(rpen); return nullptr; }
+
+    rpen[dmax] = 0.0f;   // delta 0 is never searched
+    for (int d = 1; d <= dmax; d++) {
+        float ratio = (float)d / tau;
+        float logr  = logf(ratio);
+        rpen[dmax - d] = tightness * logr * logr;
+    }
 
     for (int t = 0; t < n; t++) { score[t] = flux[t]; prev[t] = -1; }
 
+    const bool scalar = simd_level() == SIMD_SCALAR;
     for (int t = 1; t < n; t++) {
         // Search range: 0.5 * tau  to  2.5 * tau back
         int t_lo = (int)(t - 2.5f * tau);
         int t_hi = (int)(t - 0.5f * tau);
         if (t_lo < 0) t_lo = 0;
         if (t_hi < 0 || t_hi >= t) { t_hi = t - 1; }
-
-        float best_val = -1e30f;
-        int   best_p   = -1;
-        for (int p = t_lo; p <= t_hi; p++) {
-            float delta = (float)(t - p);
-            float ratio = delta / tau;
-            float logr  = logf(ratio);
-            float val   = score[p] - tightness * logr * logr;
-            if (val > best_val) { best_val = val; best_p = p; }
-        }
+        if (t_lo < t - dmax) t_lo = t - dmax;
+        if (t_lo > t_hi) continue;
+
+        // rpen shifted so that index p holds the penalty for delta t - p.
+        const float* pen = rpen + dmax - t;
+        float best_val;
+        int   best_p;
+        if (scalar) best_pred_scalar(score, pen, t_lo, t_hi, &best_val, &best_p);
+        else        best_pred_f4    (score, pen, t_lo, t_hi, &best_val, &best_p);
         if (best_p >= 0) {
             score[t] = flux[t] + best_val;
             prev[t]  = best_p;
         }
     }
+    free(rpen);
 
     // Find best end frame (search last half of track)
     float best_sc = -1e30f;
@@ -219,19 +256,206 @@ static void dp_beat_track(const float* flux, int n, float tau, float tightness,
         if (score[t] > best_sc) { best_sc = score[t]; end_t = t; }
     }
 
-    // Backtrack
-    int tmp[MAX_BEAT_CANDS];
+    // Backtrack: count the chain, then fill it in chronological order.
     int cnt = 0;
-    int t   = end_t;
-    while (t >= 0 && cnt < max_beats) {
-        tmp[cnt++] = t;
-        t = prev[t];
+    for (int t = end_t; t >= 0; t = prev[t]) cnt++;
+    int* beats = (int*)malloc(cnt * sizeof(int));
+    if (beats) {
+        int i = cnt;
+        for (int t = end_t; t >= 0; t = prev[t]) beats[--i] = t;
+        *beat_count = cnt;
     }
-    // Reverse to chronological order
-    for (int i = 0; i < cnt; i++) beat_frames[i] = tmp[cnt - 1 - i];
-    *beat_count = cnt;
 
     free(score); free(prev);
+    return beats;
+}
+
+// ---------------------------------------------------------------------------
+// Step 3.5: grid bias.  When seed beats are present, reshape the ODF so the DP
+// strongly prefers frames that lie on the established beat grid and is
+// significantly penalised for the halfway (subdivision) positions.
+//
+//   a) Best-fit anchor: find the phase origin that minimises the RMS
+//      distance from each seed beat to its nearest grid position.
+//   b) Steadiness: if the seeds are very regular (low RMS phase error),
+//      the bias amplitude is high.  Irregular seeds produce a weaker bias
+//      so the ODF still has some say.
+//   c) Cosine bias:  bias[f] = amplitude * cos(2π * phase_f)
+//        phase_f = 0   → on-grid  → +amplitude  (bonus)
+//        phase_f = 0.5 → halfway  → -amplitude  (penalty)
+//      At full steadiness a halfway transient must exceed ~4× the mean
+//      ODF to compete with a quiet on-grid frame.
+//
+// Applied in place, so callers pass a copy of the cached ODF.
+// ---------------------------------------------------------------------------
+static void seed_grid_bias(float* flux, int n_flux, double t0, double hop_sec,
+                           double tau_sec, const double* seeds, int ns)
+{
+    // a) Iteratively refine anchor toward mean-residual minimum
+    double seed_anchor = seeds[0];
+    for (int iter = 0; iter < 4; iter++) {
+        double err_sum = 0.0;
+        for (int j = 0; j < ns; j++) {
+            double off = seeds[j] - seed_anchor;
+            err_sum += off - round(off / tau_sec) * tau_sec;
+        }
+        seed_anchor += err_sum / ns;
+    }
+
+    // b) RMS phase error → steadiness in [0, 1]
+    //    Quarter-beat jitter (0.25 * tau) maps to steadiness = 0.
+    double rms2 = 0.0;
+    for (int j = 0; j < ns; j++) {
+        double off = seeds[j] - seed_anchor;
+        double err = off - round(off / tau_sec) * tau_sec;
+        rms2 += err * err;
+    }
+    float rms_ratio  = (float)(sqrt(rms2 / ns) / (0.25 * tau_sec));
+    float steadiness = 1.0f - fminf(1.0f, rms_ratio);
+    steadiness *= steadiness;  // square: very steady grids get a big boost
+    if (steadiness <= 0.01f) return;
+
+    // c) Apply cosine bias in-place
+    float flux_mean = 0.0f;
+    for (int f = 0; f < n_flux; f++) flux_mean += flux[f];
+    if (n_flux > 0) flux_mean /= n_flux;
+
+    float amplitude = steadiness * 4.0f * flux_mean;
+    for (int f = 0; f < n_flux; f++) {
+        double phase_sec = fmod(t0 + (double)f * hop_sec - seed_anchor, tau_sec);
+        if (phase_sec < 0.0) phase_sec += tau_sec;
+        float bias = amplitude * cosf(2.0f * 3.14159265f *
+                                      (float)(phase_sec / tau_sec));
+        flux[f] = fmaxf(0.0f, flux[f] + bias);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Stage cache.
+//
+// Each stage depends only on the stage before it and its own parameters:
+//
+//   ODF     audio span                        (the only stage reading PCM)
+//   onsets  ODF, onset_threshold
+//   tempo   ODF, min / max BPM
+//   DP      ODF, tau, seed beats, dp_tightness
+//   output  DP, seed beats, pre_onset_ms      (cheap; always redone)
+//
+// Every stage's result is kept with the inputs it came from and recomputed
+// only when those change: moving the threshold re-picks peaks from the
+// cached ODF, a tightness change reruns just the DP.
+//
+// Entries are keyed by the audio span and the STAGE_ENTRIES most recent are
+// kept.  A run takes its entry out of the list and puts it back when done,
+// so concurrent runs never share one (a second run on the same span simply
+// starts cold).
+// ---------------------------------------------------------------------------
+static const int STAGE_ENTRIES = 4;
+
+struct FluxStages {
+    // ODF stage, keyed by the audio span
+    const float* pcm;
+    uint64_t     frame_count;
+    uint32_t     channels;
+    uint32_t     sample_rate;
+    double       t_start, t_end;
+    float*       flux;          // nullptr if the span was too short
+    int          n_flux;
+    double       t0;            // time of flux[0]
+
+    // Onset stage
+    bool    onsets_ok;
+    float   thresh;
+    double* onsets;
+    int     onset_count;
+
+    // Tempo stage
+    bool       tempo_ok;
+    float      min_bpm, max_bpm;
+    TempoCurve curve;           // count == 0 if no lag was in range
+
+    // DP stage
+    bool    dp_ok;
+    float   tau, tight;
+    double* seeds;              // copy of the seed beats the ODF was biased by
+    int     seed_count;
+    int*    beats;              // beat frames, chronological
+    int     beat_count;
+
+    FluxStages* next;
+};
+
+static std::mutex  s_stage_mutex;
+static FluxStages* s_stages = nullptr;
+
+static void stages_free(FluxStages* st)
+{
+    free(st->flux);
+    free(st->onsets);
+    tempo_curve_free(&st->curve);
+    free(st->seeds);
+    free(st->beats);
+    free(st);
+}
+
+static bool stages_match(const FluxStages* st, const float* pcm, uint64_t frame_count,
+                         uint32_t channels, uint32_t sample_rate,
+                         double t_start, double t_end)
+{
+    return st->pcm == pcm && st->frame_count == frame_count &&
+           st->channels == channels && st->sample_rate == sample_rate &&
+           st->t_start == t_start && st->t_end == t_end;
+}
+
+// Detach the cached entry for a span, or nullptr if there is none.
+static FluxStages* stages_take(const float* pcm, uint64_t frame_count,
+                               uint32_t channels, uint32_t sample_rate,
+                               double t_start, double t_end)
+{
+    std::lock_guard<std::mutex> lock(s_stage_mutex);
+    for (FluxStages** link = &s_stages; *link; link = &(*link)->next) {
+        FluxStages* st = *link;
+        if (stages_match(st, pcm, frame_count, channels, sample_rate, t_start, t_end)) {
+            *link    = st->next;
+            st->next = nullptr;
+            return st;
+        }
+    }
+    return nullptr;
+}
+
+// Return an entry to the front of the list.  Drops any other entry for the
+// same span (left by a concurrent run) and the oldest beyond STAGE_ENTRIES.
+static void stages_put(FluxStages* st)
+{
+    std::lock_guard<std::mutex> lock(s_stage_mutex);
+    st->next = s_stages;
+    s_stages = st;
+    int kept = 1;
+    for (FluxStages** link = &st->next; *link; ) {
+        FluxStages* e = *link;
+        if (kept >= STAGE_ENTRIES ||
+            stages_match(e, st->pcm, st->frame_count, st->channels,
+                         st->sample_rate, st->t_start, st->t_end)) {
+            *link = e->next;
+            stages_free(e);
+        } else {
+            kept++;
+            link = &e->next;
+        }
+    }
+}
+
+void beat_spectral_flux_release(const float* pcm)
+{
+    std::lock_guard<std::mutex> lock(s_stage_mutex);
+    FluxStages** link = &s_stages;
+    while (*link) {
+        FluxStages* st = *link;
+        if (st->pcm != pcm) { link = &st->next; continue; }
+        *link = st->next;
+        stages_free(st);
+    }
 }
 
 // ---------------------------------------------------------------------------
@@ -243,9 +467,10 @@ void beat_spectral_flux(const float* pcm, uint64_t frame_count,
                         const BeatAlgoParams* params,
                         AutoBeatList* out)
 {
-    out->beat_count    = 0;
-    out->onset_count   = 0;
-    out->estimated_bpm = 0.0f;
+    out->beat_count      = 0;
+    out->onset_count     = 0;
+    out->estimated_bpm   = 0.0f;
+    out->tempo_lag_count = 0;
     if (!pcm || frame_count == 0 || sample_rate == 0) return;
 
     float min_bpm  = (params->min_bpm  > 0.0f) ? params->min_bpm  : 60.0f;
@@ -254,148 +479,148 @@ void beat_spectral_flux(const float* pcm, uint64_t frame_count,
     float tight    = (params->dp_tightness   > 0.0f) ? params->dp_tightness   : 400.0f;
     double pre_sec = (double)params->pre_onset_ms / 1000.0;
 
+    const double* seeds = (params->seed_count >= 2) ? params->seed_times : nullptr;
+    const int     ns    = seeds ? params->seed_count : 0;
+
     // 1. Spectral flux ODF
-    int    n_flux = 0;
-    float* flux   = compute_flux(pcm, frame_count, channels, sample_rate,
-                                 t_start, t_end, &n_flux);
-    if (!flux || n_flux < 4) { free(flux); return; }
+    FluxStages* st = stages_take(pcm, frame_count, channels, sample_rate, t_start, t_end);
+    if (!st) {
+        st = (FluxStages*)calloc(1, sizeof(FluxStages));
+        if (!st) return;
+        st->pcm         = pcm;
+        st->frame_count = frame_count;
+        st->channels    = channels;
+        st->sample_rate = sample_rate;
+        st->t_start     = t_start;
+        st->t_end       = t_end;
+        st->flux = beat_flux_odf(pcm, frame_count, channels, sample_rate,
+                                 t_start, t_end, &st->n_flux, &st->t0);
+    }
+    const float* flux   = st->flux;
+    const int    n_flux = st->n_flux;
+    const double t0     = st->t0;
+    if (!flux || n_flux < 4) { stages_put(st); return; }
 
-    double hop_sec = (double)BF_HOP / sample_rate;
-    float  fps     = (float)sample_rate / BF_HOP;
+    const int hop     = beat_flux_hop(sample_rate);
+    double    hop_sec = (double)hop / sample_rate;
+    float     fps     = (float)sample_rate / hop;
 
     // 2. Raw onsets (always computed; used for display with show_raw_onsets)
-    find_onsets(flux, n_flux, t_start, sample_rate, thresh,
-                out->onset_times, &out->onset_count, MAX_BEAT_CANDS);
+    if (!st->onsets_ok || st->thresh != thresh) {
+        free(st->onsets);
+        st->onset_count = beat_flux_onsets(flux, n_flux, t0, sample_rate, thresh, &st->onsets);
+        st->thresh      = thresh;
+        st->onsets_ok   = true;
+    }
+    if (st->onset_count > 0 && autobeat_reserve_onsets(out, st->onset_count)) {
+        memcpy(out->onset_times, st->onsets, st->onset_count * sizeof(double));
+        out->onset_count = st->onset_count;
+    }
+
+    // 3. Period estimation.  The autocorrelation tempo curve is kept in the
+    //    output for display even when seeds decide the period.
+    if (!st->tempo_ok || st->min_bpm != min_bpm || st->max_bpm != max_bpm) {
+        tempo_curve_free(&st->curve);
+        tempo_curve_compute(flux, n_flux, fps, min_bpm, max_bpm, &st->curve);
+        st->min_bpm  = min_bpm;
+        st->max_bpm  = max_bpm;
+        st->tempo_ok = true;
+    }
+    const TempoCurve* curve = &st->curve;
+    float ac_tau = curve->count > 0 ? (float)curve->best_lag : fps;   // fallback to 1 BPS
+    out->tempo_fps       = fps;
+    out->tempo_lag_min   = curve->lag_min;
+    out->tempo_lag_count = curve->count < MAX_TEMPO_LAGS ? curve->count : MAX_TEMPO_LAGS;
+    if (out->tempo_lag_count > 0)
+        memcpy(out->tempo_strength, curve->strength, out->tempo_lag_count * sizeof(float));
 
-    // 3. Period estimation
     float tau;  // expected beat period in ODF frames
-    if (params->seed_count >= 2 && params->seed_times) {
-        float ibis[MAX_BEAT_CANDS];
-        int   n_ibis = 0;
-        for (int i = 1; i < params->seed_count && n_ibis < MAX_BEAT_CANDS; i++) {
-            double ibi = params->seed_times[i] - params->seed_times[i - 1];
+    if (seeds) {
+        float* ibis   = (float*)malloc(ns * sizeof(float));
+        int    n_ibis = 0;
+        for (int i = 1; ibis && i < ns; i++) {
+            double ibi = seeds[i] - seeds[i - 1];
             if (ibi > 0.08 && ibi < 5.0)
                 ibis[n_ibis++] = (float)ibi;
         }
-        tau = (n_ibis > 0) ? array_median(ibis, n_ibis) * fps
-                           : estimate_period(flux, n_flux, min_bpm, max_bpm, sample_rate);
+        tau = (n_ibis > 0) ? array_median(ibis, n_ibis) * fps : ac_tau;
+        free(ibis);
     } else {
-        tau = estimate_period(flux, n_flux, min_bpm, max_bpm, sample_rate);
+        tau = ac_tau;
     }
     if (tau < 1.0f) tau = 1.0f;
 
     double tau_sec = tau * hop_sec;
     out->estimated_bpm = 60.0f / (float)tau_sec;
 
-    // 3.5. Grid bias: when seed beats are present, reshape the ODF so the DP
-    //      strongly prefers frames that lie on the established beat grid and
-    //      is significantly penalised for the halfway (subdivision) positions.
-    //
-    //      a) Best-fit anchor: find the phase origin that minimises the RMS
-    //         distance from each seed beat to its nearest grid position.
-    //      b) Steadiness: if the seeds are very regular (low RMS phase error),
-    //         the bias amplitude is high.  Irregular seeds produce a weaker bias
-    //         so the ODF still has some say.
-    //      c) Cosine bias:  bias[f] = amplitude * cos(2π * phase_f)
-    //           phase_f = 0   → on-grid  → +amplitude  (bonus)
-    //           phase_f = 0.5 → halfway  → -amplitude  (penalty)
-    //         At full steadiness a halfway transient must exceed ~4× the mean
-    //         ODF to compete with a quiet on-grid frame.
-
-    double seed_anchor = 0.0;  // reused in step 5
-    float  steadiness  = 0.0f;
-
-    if (params->seed_count >= 2 && params->seed_times) {
-        const double* seeds = params->seed_times;
-        int           ns    = params->seed_count;
-
-        // a) Iteratively refine anchor toward mean-residual minimum
-        seed_anchor = seeds[0];
-        for (int iter = 0; iter < 4; iter++) {
-            double err_sum = 0.0;
-            for (int j = 0; j < ns; j++) {
-                double off = seeds[j] - seed_anchor;
-                err_sum += off - round(off / tau_sec) * tau_sec;
-            }
-            seed_anchor += err_sum / ns;
-        }
-
-        // b) RMS phase error → steadiness in [0, 1]
-        //    Quarter-beat jitter (0.25 * tau) maps to steadiness = 0.
-        double rms2 = 0.0;
-        for (int j = 0; j < ns; j++) {
-            double off = seeds[j] - seed_anchor;
-            double err = off - round(off / tau_sec) * tau_sec;
-            rms2 += err * err;
-        }
-        float rms_ratio = (float)(sqrt(rms2 / ns) / (0.25 * tau_sec));
-        steadiness = 1.0f - fminf(1.0f, rms_ratio);
-        steadiness *= steadiness;  // square: very steady grids get a big boost
-
-        // c) Apply cosine bias in-place
-        if (steadiness > 0.01f) {
-            float flux_mean = 0.0f;
-            for (int f = 0; f < n_flux; f++) flux_mean += flux[f];
-            if (n_flux > 0) flux_mean /= n_flux;
-
-            float amplitude = steadiness * 4.0f * flux_mean;
-            for (int f = 0; f < n_flux; f++) {
-                double phase_sec = fmod(t_start + (double)f * hop_sec - seed_anchor,
-                                        tau_sec);
-                if (phase_sec < 0.0) phase_sec += tau_sec;
-                float bias = amplitude * cosf(2.0f * 3.14159265f *
-                                              (float)(phase_sec / tau_sec));
-                flux[f] = fmaxf(0.0f, flux[f] + bias);
+    // 4. DP beat tracking, on a grid-biased copy of the ODF (step 3.5) when
+    //    seeds are given.
+    bool same_seeds = st->seed_count == ns &&
+                      (ns == 0 || !memcmp(st->seeds, seeds, ns * sizeof(double)));
+    if (!st->dp_ok || st->tau != tau || st->tight != tight || !same_seeds) {
+        free(st->beats);
+        free(st->seeds);
+        st->beats      = nullptr;
+        st->beat_count = 0;
+        st->seeds      = nullptr;
+        st->seed_count = 0;
+        st->dp_ok      = false;
+        if (seeds) {
+            st->seeds  = (double*)malloc(ns * sizeof(double));
+            float* biased = (float*)malloc(n_flux * sizeof(float));
+            if (st->seeds && biased) {
+                memcpy(st->seeds, seeds, ns * sizeof(double));
+                st->seed_count = ns;
+                memcpy(biased, flux, n_flux * sizeof(float));
+                seed_grid_bias(biased, n_flux, t0, hop_sec, tau_sec, seeds, ns);
+                st->beats = dp_beat_track(biased, n_flux, tau, tight, &st->beat_count);
             }
+            free(biased);
+        } else {
+            st->beats = dp_beat_track(flux, n_flux, tau, tight, &st->beat_count);
         }
+        st->tau   = tau;
+        st->tight = tight;
+        st->dp_ok = st->beats != nullptr;
     }
-
-    // 4. DP beat tracking on the (possibly biased) ODF
-    int beat_frames[MAX_BEAT_CANDS];
-    int beat_count  = 0;
-    dp_beat_track(flux, n_flux, tau, tight, beat_frames, &beat_count, MAX_BEAT_CANDS);
-    free(flux);
-    flux = nullptr;
-
-    if (beat_count == 0) return;
+    const int* beat_frames = st->beats;
+    const int  beat_count  = st->beat_count;
 
     // 5. Fine-tune: shift all DP beats by the median residual offset to seed
     //    beats.  The grid bias has already done the heavy lifting; this corrects
     //    any remaining sub-frame systematic error.
-    if (params->seed_count >= 2 && params->seed_times) {
-        const double* seeds = params->seed_times;
-        int           ns    = params->seed_count;
-        float offsets[MAX_BEAT_CANDS];
-        int   n_off = 0;
+    int frame_shift = 0;
+    if (seeds && beat_count > 0) {
+        float* offsets = (float*)malloc(ns * sizeof(float));
+        int    n_off   = 0;
 
-        for (int j = 0; j < ns && n_off < MAX_BEAT_CANDS; j++) {
+        for (int j = 0; offsets && j < ns; j++) {
             double best_dist = 1e30, best_off = 0.0;
             for (int i = 0; i < beat_count; i++) {
-                double dp_t = t_start + (double)beat_frames[i] * hop_sec;
+                double dp_t = t0 + (double)beat_frames[i] * hop_sec;
                 double off  = seeds[j] - dp_t;
                 off -= tau_sec * round(off / tau_sec);
                 if (fabs(off) < best_dist) { best_dist = fabs(off); best_off = off; }
             }
             offsets[n_off++] = (float)best_off;
         }
-        if (n_off > 0) {
-            int frame_shift = (int)(array_median(offsets, n_off) / hop_sec + 0.5);
-            for (int i = 0; i < beat_count; i++) {
-                beat_frames[i] += frame_shift;
-                if (beat_frames[i] < 0)      beat_frames[i] = 0;
-                if (beat_frames[i] >= n_flux) beat_frames[i] = n_flux - 1;
-            }
-        }
+        if (n_off > 0)
+            frame_shift = (int)(array_median(offsets, n_off) / hop_sec + 0.5);
+        free(offsets);
     }
 
     // 6. Convert frame indices to times; apply pre-onset shift; store output
-    int cnt = 0;
-    for (int i = 0; i < beat_count && cnt < MAX_BEAT_CANDS; i++) {
-        double t = t_start + (double)beat_frames[i] * hop_sec - pre_sec;
-        if (t < 0.0) t = 0.0;
-        out->beat_times[cnt]    = t;
-        out->beat_selected[cnt] = true;
-        cnt++;
+    if (beat_count > 0 && autobeat_reserve_beats(out, beat_count)) {
+        for (int i = 0; i < beat_count; i++) {
+            int f = beat_frames[i] + frame_shift;
+            if (f < 0)       f = 0;
+            if (f >= n_flux) f = n_flux - 1;
+            double t = t0 + (double)f * hop_sec - pre_sec;
+            if (t < 0.0) t = 0.0;
+            out->beat_times[i]    = t;
+            out->beat_selected[i] = true;
+        }
+        out->beat_count = beat_count;
     }
-    out->beat_count = cnt;
+    stages_put(st);
 }
@@ -4,33 +4,52 @@ const ChromaAlgoDesc CHROMA_ALGOS[] = {
     {
         "Goertzel / Hann",
         "Goertzel filters at exact note frequencies, Hann window (4096 samples)",
-        chroma_goertzel_hann
+        chroma_goertzel_hann,
+        chroma_goertzel_hann_batch,
+        &CHROMA_FRAMES_GOERTZEL_HANN
     },
     {
         "Goertzel / Blackman-Harris",
         "Goertzel filters with 4-term Blackman-Harris window (-92 dB sidelobes)",
-        chroma_goertzel_blackman
+        chroma_goertzel_blackman,
+        chroma_goertzel_blackman_batch,
+        &CHROMA_FRAMES_GOERTZEL_BLACKMAN
     },
     {
         "HPS",
         "Harmonic Product Spectrum: multiplies magnitude at f, 2f, 3f, 4f to suppress overtones",
-        chroma_hps
+        chroma_hps,
+        chroma_hps_batch,
+        &CHROMA_FRAMES_HPS
     },
     {
         "NNLS Chroma",
         "Non-Negative Least Squares fit of harmonic templates (most accurate for polyphony)",
-        chroma_nnls
+        chroma_nnls,
+        chroma_nnls_batch,
+        &CHROMA_FRAMES_NNLS
     },
     {
         "Spectral Peaks",
         "Finds spectral peaks then groups harmonically-related ones to a single fundamental",
-        chroma_peaks
+        chroma_peaks,
+        chroma_peaks_batch,
+        &CHROMA_FRAMES_PEAKS
     },
     {
         "Resonate",
         "Bank of 60 complex resonators updated per-sample (Francois); no FFT, no window function",
-        chroma_resonate
+        chroma_resonate,
+        chroma_resonate_batch,
+        &CHROMA_FRAMES_RESONATE
+    },
+    {
+        "Constant-Q",
+        "Sparse-kernel constant-Q transform, 36 bins/octave, folded to 12 with tuning estimate",
+        chroma_cqt,
+        chroma_cqt_batch,
+        &CHROMA_FRAMES_CQT
     },
 };
 
-const int CHROMA_ALGO_COUNT = 6;
+const int CHROMA_ALGO_COUNT = 7;
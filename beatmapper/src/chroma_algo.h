@@ -18,10 +18,32 @@ typedef void (*ChromaFn)(
     float        result[12]     // out: normalised chroma [0,1], C..B
 );
 
+// Batch form: n intervals [t_start[i], t_end[i]) in one call, filling
+// out[i * 12 .. i * 12 + 11].  Work shared between intervals (frames that
+// neighbouring intervals both cover, resonator warm-up) is done once, so a
+// whole beat map costs about one pass over the audio.
+typedef void (*ChromaBatchFn)(
+    const float*  pcm,
+    uint64_t      frame_count,
+    uint32_t      channels,
+    uint32_t      sample_rate,
+    const double* t_start,      // n window starts (seconds)
+    const double* t_end,        // n window ends   (seconds)
+    int           n,
+    float*        out           // out: n x 12, row-major
+);
+
+// Frame-level form (chroma_frames.h): per-frame features on a track-wide grid
+// plus the step that turns summed features into chroma.  This is what a
+// whole-track chromagram (chromagram.h) is built from.
+struct ChromaFrameAlgo;
+
 struct ChromaAlgoDesc {
-    const char* name;   // shown in the selector combo
-    const char* tip;    // tooltip / one-line description
-    ChromaFn    fn;
+    const char*            name;     // shown in the selector combo
+    const char*            tip;      // tooltip / one-line description
+    ChromaFn               fn;
+    ChromaBatchFn          batch;
+    const ChromaFrameAlgo* frames;
 };
 
 // Forward declarations (each algorithm is defined in its own .cpp)
@@ -31,6 +53,23 @@ void chroma_hps              (const float*, uint64_t, uint32_t, uint32_t, double
 void chroma_nnls             (const float*, uint64_t, uint32_t, uint32_t, double, double, float[12]);
 void chroma_peaks            (const float*, uint64_t, uint32_t, uint32_t, double, double, float[12]);
 void chroma_resonate         (const float*, uint64_t, uint32_t, uint32_t, double, double, float[12]);
+void chroma_cqt              (const float*, uint64_t, uint32_t, uint32_t, double, double, float[12]);
+
+void chroma_goertzel_hann_batch    (const float*, uint64_t, uint32_t, uint32_t, const double*, const double*, int, float*);
+void chroma_goertzel_blackman_batch(const float*, uint64_t, uint32_t, uint32_t, const double*, const double*, int, float*);
+void chroma_hps_batch              (const float*, uint64_t, uint32_t, uint32_t, const double*, const double*, int, float*);
+void chroma_nnls_batch             (const float*, uint64_t, uint32_t, uint32_t, const double*, const double*, int, float*);
+void chroma_peaks_batch            (const float*, uint64_t, uint32_t, uint32_t, const double*, const double*, int, float*);
+void chroma_resonate_batch         (const float*, uint64_t, uint32_t, uint32_t, const double*, const double*, int, float*);
+void chroma_cqt_batch              (const float*, uint64_t, uint32_t, uint32_t, const double*, const double*, int, float*);
+
+extern const ChromaFrameAlgo CHROMA_FRAMES_GOERTZEL_HANN;
+extern const ChromaFrameAlgo CHROMA_FRAMES_GOERTZEL_BLACKMAN;
+extern const ChromaFrameAlgo CHROMA_FRAMES_HPS;
+extern const ChromaFrameAlgo CHROMA_FRAMES_NNLS;
+extern const ChromaFrameAlgo CHROMA_FRAMES_PEAKS;
+extern const ChromaFrameAlgo CHROMA_FRAMES_RESONATE;
+extern const ChromaFrameAlgo CHROMA_FRAMES_CQT;
 
 // Registration table – defined in chroma_algo.cpp
 extern const ChromaAlgoDesc CHROMA_ALGOS[];
@@ -0,0 +1,86 @@
+#include "chroma_algo.h"
+#include "chroma_frames.h"
+#include "cqt.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// ---------------------------------------------------------------------------
+// Constant-Q chroma.
+//
+// Per frame, the constant-Q spectrum (cqt.h) over C2..B6 is folded onto one
+// octave at the transform's own resolution: 36 bins, three per semitone,
+// bin 0 exactly on C.  Power is what gets summed over the window.
+//
+// The finishing step estimates tuning from the summed fold -- whichever of the
+// three sub-semitone offsets carries the most power is taken as the note
+// centres -- and pools each centre with its two neighbours into one pitch
+// class.  A recording a third of a semitone sharp or flat therefore still
+// lands on the right notes instead of smearing across two.
+//
+// Every bin of the CQT has the same resolution in cents, so the low octaves
+// separate neighbouring semitones that an 8192-point FFT cannot.
+// ---------------------------------------------------------------------------
+
+static const int CQT_CHROMA_BINS = 5 * CQT_BINS_PER_OCTAVE;   // C2..B6
+static const int FOLD            = CQT_BINS_PER_OCTAVE;       // 36
+static const int BLOCK           = 32;                         // frames per cqt_frames call
+
+static void cqt_chroma_frames(const float* pcm, uint64_t frame_count, uint32_t ch,
+                              uint32_t sr, int64_t k0, int64_t k1, double* feat)
+{
+    const CqtKernel* kern = cqt_kernel(sr);
+    if (!kern) return;
+    int n, hop;
+    chroma_frame_grid(&CHROMA_FRAMES_CQT, sr, &n, &hop);
+    float* mag = (float*)malloc((size_t)BLOCK * CQT_BINS * sizeof(float));
+    if (!mag) return;
+
+    for (int64_t b0 = k0; b0 < k1; b0 += BLOCK) {
+        int64_t b1 = b0 + BLOCK < k1 ? b0 + BLOCK : k1;
+        cqt_frames(kern, pcm, frame_count, ch, 0, hop, b0, b1, mag);
+        for (int64_t f = b0; f < b1; f++) {
+            const float* m    = mag + (f - b0) * CQT_BINS;
+            double*      fold = feat + (f - k0) * FOLD;
+            for (int k = 0; k < CQT_CHROMA_BINS; k++)
+                fold[k % FOLD] += (double)m[k] * m[k];
+        }
+    }
+    free(mag);
+}
+
+static void cqt_chroma_finish(const double* fold, int, float result[12])
+{
+    // Tuning: the offset (0 = on pitch, 1 = a third sharp, 2 = a third flat)
+    // whose bins hold the most power.
+    double best = -1.0;
+    int    off  = 0;
+    for (int o = 0; o < 3; o++) {
+        double e = 0.0;
+        for (int p = 0; p < 12; p++) e += fold[3 * p + o];
+        if (e > best) { best = e; off = o; }
+    }
+
+    double power[12] = {};
+    for (int p = 0; p < 12; p++) {
+        int c  = 3 * p + off;
+        int pc = ((c + 1) / 3) % 12;   // offset 2 sits just below the next note
+        power[pc] += fold[(c + FOLD - 1) % FOLD] + fold[c % FOLD] + fold[(c + 1) % FOLD];
+    }
+    chroma_normalize_db(power, result);
+}
+
+const ChromaFrameAlgo CHROMA_FRAMES_CQT = { CQT_FRAME_SEC, 8, FOLD, cqt_chroma_frames, cqt_chroma_finish };
+
+void chroma_cqt(const float* pcm, uint64_t frame_count, uint32_t ch,
+                uint32_t sr, double t0, double t1, float result[12])
+{
+    chroma_frames_run(&CHROMA_FRAMES_CQT, pcm, frame_count, ch, sr, &t0, &t1, 1, result);
+}
+
+void chroma_cqt_batch(const float* pcm, uint64_t frame_count, uint32_t ch,
+                      uint32_t sr, const double* t0, const double* t1,
+                      int n, float* out)
+{
+    chroma_frames_run(&CHROMA_FRAMES_CQT, pcm, frame_count, ch, sr, t0, t1, n, out);
+}
@@ -0,0 +1,129 @@
+#include "chroma_frames.h"
+#include "analysis_rate.h"
+#include "stft_cache.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Span {
+    int     idx;      // interval index
+    int64_t k0, k1;   // frame range, k0 < k1
+};
+
+static int span_cmp(const void* a, const void* b)
+{
+    const Span* x = (const Span*)a;
+    const Span* y = (const Span*)b;
+    return (x->k0 < y->k0) ? -1 : (x->k0 > y->k0) ? 1 : 0;
+}
+
+void chroma_frame_grid(const ChromaFrameAlgo* algo, uint32_t sr, int* frame_len, int* hop)
+{
+    *frame_len = analysis_fft_size(algo->frame_sec, sr);
+    *hop       = *frame_len / algo->overlap;
+}
+
+void chroma_frame_range(int frame_len, int hop, int64_t num_frames,
+                        int64_t s0, int64_t s1, int64_t* k0, int64_t* k1)
+{
+    *k0 = *k1 = 0;
+    if (num_frames <= 0 || s1 <= s0) return;
+    stft_grid_range(frame_len, hop, num_frames, s0, s1, k0, k1);
+    if (*k1 > *k0) return;
+
+    // Frame k is centred on k * hop + frame_len / 2.
+    const int64_t half = frame_len / 2;
+    int64_t a = s0 - half > 0 ? (s0 - half + hop - 1) / hop : 0;
+    int64_t z = s1 - half > 0 ? (s1 - half + hop - 1) / hop : 0;
+    if (z > num_frames) z = num_frames;
+    if (a < z) { *k0 = a; *k1 = z; return; }
+
+    double  centre = 0.5 * (double)(s0 + s1) - half;
+    int64_t k      = (int64_t)floor(centre / hop + 0.5);
+    if (k < 0) k = 0;
+    if (k >= num_frames) k = num_frames - 1;
+    *k0 = k; *k1 = k + 1;
+}
+
+void chroma_frames_run(const ChromaFrameAlgo* algo,
+                       const float* pcm, uint64_t frame_count, uint32_t ch,
+                       uint32_t sr, const double* t_start, const double* t_end,
+                       int n, float* out)
+{
+    if (n <= 0) return;
+    memset(out, 0, (size_t)n * 12 * sizeof(float));
+    if (!pcm || ch == 0 || sr == 0) return;
+    int frame_len, hop;
+    chroma_frame_grid(algo, sr, &frame_len, &hop);
+    if (frame_count < (uint64_t)frame_len) return;
+
+    const int     dims       = algo->dims;
+    const int64_t num_frames = (int64_t)(frame_count - frame_len) / hop + 1;
+
+    Span* spans = (Span*)malloc((size_t)n * sizeof(Span));
+    if (!spans) return;
+    int ns = 0;
+    for (int i = 0; i < n; i++) {
+        double t0 = t_start[i], t1 = t_end[i];
+        if (t1 - t0 > CHROMA_MAX_SPAN) t0 = t1 - CHROMA_MAX_SPAN;
+        int64_t s0 = (int64_t)(t0 * sr); if (s0 < 0) s0 = 0;
+        int64_t s1 = (int64_t)(t1 * sr); if (s1 > (int64_t)frame_count) s1 = (int64_t)frame_count;
+        int64_t k0, k1;
+        chroma_frame_range(frame_len, hop, num_frames, s0, s1, &k0, &k1);
+        if (k1 > k0) spans[ns++] = { i, k0, k1 };
+    }
+    qsort(spans, (size_t)ns, sizeof(Span), span_cmp);
+
+    // Walk runs of overlapping or touching spans.  Each run's frames are
+    // reduced once, prefix-summed, and every span in it is a subtraction.
+    double* feat = nullptr;
+    double* pre  = nullptr;
+    int64_t cap  = 0;
+    int a = 0;
+    while (a < ns) {
+        int64_t lo = spans[a].k0, hi = spans[a].k1;
+        int z = a + 1;
+        while (z < ns && spans[z].k0 <= hi) {
+            if (spans[z].k1 > hi) hi = spans[z].k1;
+            z++;
+        }
+
+        int64_t len = hi - lo;
+        if (len > cap) {
+            free(feat); free(pre);
+            feat = (double*)malloc((size_t)len * dims * sizeof(double));
+            pre  = (double*)malloc((size_t)(len + 1) * dims * sizeof(double));
+            cap  = len;
+            if (!feat || !pre) break;
+        }
+        memset(feat, 0, (size_t)len * dims * sizeof(double));
+        algo->frames(pcm, frame_count, ch, sr, lo, hi, feat);
+
+        memset(pre, 0, (size_t)dims * sizeof(double));
+        for (int64_t f = 0; f < len; f++)
+            for (int d = 0; d < dims; d++)
+                pre[(f + 1) * dims + d] = pre[f * dims + d] + feat[f * dims + d];
+
+        for (int j = a; j < z; j++) {
+            const Span& sp = spans[j];
+            double sum[CHROMA_MAX_DIMS];
+            for (int d = 0; d < dims; d++)
+                sum[d] = pre[(sp.k1 - lo) * dims + d] - pre[(sp.k0 - lo) * dims + d];
+            algo->finish(sum, (int)(sp.k1 - sp.k0), out + (size_t)sp.idx * 12);
+        }
+        a = z;
+    }
+
+    free(feat); free(pre); free(spans);
+}
+
+void chroma_normalize_db(const double power[12], float result[12])
+{
+    double mx = 1e-30;
+    for (int i = 0; i < 12; i++) if (power[i] > mx) mx = power[i];
+    for (int i = 0; i < 12; i++) {
+        float db = 10.0f * log10f((float)(power[i] / mx) + 1e-30f);
+        float v  = (db + 30.0f) / 30.0f;
+        result[i] = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+    }
+}
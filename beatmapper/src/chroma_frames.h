@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+
+// ---------------------------------------------------------------------------
+// Frame-based chroma driver.
+//
+// Goertzel, HPS, NNLS, spectral-peak and constant-Q chroma all have the same
+// shape: cut the window into fixed frames, reduce each frame to a small
+// feature vector (pitch-class power, or NNLS's 60-bin log spectrum), sum the
+// vectors over the window, then turn the sum into a chroma vector.  Written
+// in that form they share this driver, which
+//
+//   - puts every algorithm's frames on a track-wide grid (frame k starts at
+//     sample k * hop), the same grid the shared STFT cache uses, and
+//   - in batch mode computes each frame's features once however many
+//     intervals cover it, answering each interval from prefix sums.
+//
+// An interval takes the frames lying entirely inside it (chroma_frame_range).
+// One with no such frame -- shorter than a frame, or falling between grid
+// frames -- takes the frames centred inside it, or failing that the single
+// frame centred nearest to it, so that no interval is left without chroma
+// however long the algorithm's frame (constant-Q's is 0.74 s, longer than a
+// beat at 100 BPM).  Intervals longer than CHROMA_MAX_SPAN keep their last
+// CHROMA_MAX_SPAN seconds, as the single-window API always has.
+// ---------------------------------------------------------------------------
+
+static const int    CHROMA_MAX_DIMS = 60;    // largest per-frame feature vector
+static const double CHROMA_MAX_SPAN = 8.0;   // seconds
+
+struct ChromaFrameAlgo {
+    double frame_sec;   // frame length, rounded to a power of two in samples
+    int    overlap;     // frames per frame length: hop = frame_len / overlap
+    int    dims;        // feature values per frame (<= CHROMA_MAX_DIMS)
+
+    // Write the features of frames [k0, k1) to feat[(k - k0) * dims ...].
+    // feat is zeroed by the driver.
+    void (*frames)(const float* pcm, uint64_t frame_count, uint32_t ch,
+                   uint32_t sr, int64_t k0, int64_t k1, double* feat);
+
+    // Turn the summed features of nframes (>= 1) frames into chroma [0,1].
+    void (*finish)(const double* sum, int nframes, float result[12]);
+};
+
+// Frame length and hop in samples at rate sr (analysis_rate.h): frame k
+// covers [k * hop, k * hop + frame_len).
+void chroma_frame_grid(const ChromaFrameAlgo* algo, uint32_t sr, int* frame_len, int* hop);
+
+// Frames [*k0, *k1) of num_frames on the grid that samples [s0, s1) take, by
+// the rule above.  Empty only if s1 <= s0 or there are no frames.
+void chroma_frame_range(int frame_len, int hop, int64_t num_frames,
+                        int64_t s0, int64_t s1, int64_t* k0, int64_t* k1);
+
+// Evaluate n intervals [t_start[i], t_end[i]) into out[i * 12 .. i * 12 + 11].
+void chroma_frames_run(const ChromaFrameAlgo* algo,
+                       const float* pcm, uint64_t frame_count, uint32_t ch,
+                       uint32_t sr, const double* t_start, const double* t_end,
+                       int n, float* out);
+
+// Shared finishing step: peak -> 0 dB, -30 dB floor -> 0.  power[] is in
+// power units (10 log10).
+void chroma_normalize_db(const double power[12], float result[12]);
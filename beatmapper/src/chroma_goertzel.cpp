@@ -1,5 +1,8 @@
 #include "chroma_algo.h"
+#include "chroma_frames.h"
+#include "simd.h"
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 
@@ -8,119 +11,226 @@
 //
 // The Goertzel algorithm evaluates the DFT at any arbitrary frequency,
 // avoiding the bin-quantisation error of a standard FFT.  Analysis runs
-// over non-overlapping frames of GOERTZEL_N samples; each frame contributes
-// independently to the 12-element pitch-class energy accumulator.
+// over non-overlapping frames of GOERTZEL_SEC on the track-wide grid
+// (see chroma_frames.h); each frame contributes independently to the
+// 12-element pitch-class energy accumulator.
 //
 // Target frequencies: pitch classes C..B in octaves 2..6 (60 targets total).
+//
+// The 60 filters run as a bank: each recurrence is independent, so they sit
+// side by side in SIMD lanes and advance together over the windowed frame.
+// A tile of four vectors (16 targets in SSE2/NEON, 32 in AVX2) keeps its
+// state in registers for the whole sweep, so a frame costs two to four
+// sweeps instead of sixty.  The filter coefficients 2 cos(w) depend only on
+// the sample rate and are built once per rate.
 // ---------------------------------------------------------------------------
 
-static const int GOERTZEL_N = 4096;   // samples per analysis frame
+static const double GOERTZEL_SEC = 0.09288;   // frame length (4096 samples at 44.1 kHz)
+
+static const int N_TARGETS  = 60;     // 12 pitch classes × octaves 2..6
+static const int BANK       = 64;     // padded to a whole number of tiles
+static const int TILE       = 4;      // vectors per register tile
+
+// Filter coefficients 2 cos(2 pi f / sr), target t = octave_index * 12 + pc.
+// Padding lanes keep coefficient 0 and are never read back.  Per thread, so
+// concurrent analyses at different rates do not fight over one table.
+struct GoertzelCoeffs {
+    uint32_t sr;
+    alignas(32) float coeff[BANK];
+};
+static thread_local GoertzelCoeffs s_coeffs;
+
+static const float* coeffs_for(uint32_t sr)
+{
+    if (s_coeffs.sr == sr) return s_coeffs.coeff;
+    memset(s_coeffs.coeff, 0, sizeof(s_coeffs.coeff));
+    for (int oi = 0; oi < 5; oi++)
+        for (int pc = 0; pc < 12; pc++) {
+            int    oct  = oi + 2;                     // octaves 2, 3, 4, 5, 6
+            int    midi = 12 * (oct + 1) + pc;        // C4=60, A4=69 convention
+            double f    = 440.0 * pow(2.0, (midi - 69) / 12.0);
+            s_coeffs.coeff[oi * 12 + pc] = (float)(2.0 * cos(2.0 * M_PI * f / sr));
+        }
+    s_coeffs.sr = sr;
+    return s_coeffs.coeff;
+}
 
-// Pitch-class target frequencies – computed once on first call.
-static float s_target[12][5];         // [pitch_class][octave_index], octaves 2..6
-static bool  s_target_init = false;
+// ---------------------------------------------------------------------------
+// Bank kernels: run every filter over the windowed block x[0..n) and write
+// each target's power s1^2 + s2^2 - coeff s1 s2 to out[].
+// ---------------------------------------------------------------------------
 
-static void ensure_targets()
+// Scalar reference: one filter at a time.
+static void bank_scalar(const float* x, int n, const float* coeff, float* out)
 {
-    if (s_target_init) return;
-    for (int pc = 0; pc < 12; pc++)
-        for (int oi = 0; oi < 5; oi++) {
-            int oct  = oi + 2;                     // octaves 2, 3, 4, 5, 6
-            int midi = 12 * (oct + 1) + pc;        // C4=60, A4=69 convention
-            s_target[pc][oi] = 440.0f * powf(2.0f, (midi - 69) / 12.0f);
+    for (int t = 0; t < N_TARGETS; t++) {
+        float c = coeff[t];
+        float s1 = 0.0f, s2 = 0.0f;
+        for (int i = 0; i < n; i++) {
+            float s0 = x[i] + c * s1 - s2;
+            s2 = s1; s1 = s0;
         }
-    s_target_init = true;
+        out[t] = s1*s1 + s2*s2 - c*s1*s2;
+    }
 }
 
-// Single-bin Goertzel filter applied to a Hann- (or other-) windowed mono block.
-static float goertzel(const float* mono, const float* win, int N,
-                       float freq, float sr)
+static void bank_f4(const float* x, int n, const float* coeff, float* out)
 {
-    float w     = 2.0f * 3.14159265358979f * freq / sr;
-    float coeff = 2.0f * cosf(w);
-    float s1 = 0.0f, s2 = 0.0f;
-    for (int i = 0; i < N; i++) {
-        float s0 = mono[i] * win[i] + coeff * s1 - s2;
-        s2 = s1; s1 = s0;
+    for (int t = 0; t < BANK; t += 4 * TILE) {
+        f4 c[TILE], s1[TILE], s2[TILE];
+        for (int j = 0; j < TILE; j++) {
+            c[j]  = f4_load(coeff + t + 4 * j);
+            s1[j] = s2[j] = f4_set1(0.0f);
+        }
+        for (int i = 0; i < n; i++) {
+            f4 xv = f4_set1(x[i]);
+            for (int j = 0; j < TILE; j++) {
+                f4 s0 = f4_sub(f4_madd(c[j], s1[j], xv), s2[j]);
+                s2[j] = s1[j]; s1[j] = s0;
+            }
+        }
+        for (int j = 0; j < TILE; j++) {
+            f4 p = f4_add(f4_mul(s1[j], s1[j]), f4_mul(s2[j], s2[j]));
+            p = f4_sub(p, f4_mul(c[j], f4_mul(s1[j], s2[j])));
+            f4_store(out + t + 4 * j, p);
+        }
     }
-    return s1*s1 + s2*s2 - coeff*s1*s2;
 }
 
-// Common inner loop; win[] selects the window function.
-static void run_goertzel(const float* pcm, uint64_t frame_count, uint32_t ch,
-                          uint32_t sr, double t0, double t1,
-                          float result[12], const float* win)
+#if SIMD_HAVE_AVX2
+SIMD_AVX2_FN static void bank_avx2(const float* x, int n, const float* coeff, float* out)
 {
-    memset(result, 0, 12 * sizeof(float));
-    ensure_targets();
-    if (!pcm || frame_count == 0 || ch == 0 || sr == 0) return;
-    if (t1 - t0 > 8.0) t0 = t1 - 8.0;
+    for (int t = 0; t < BANK; t += 8 * TILE) {
+        __m256 c[TILE], s1[TILE], s2[TILE];
+        for (int j = 0; j < TILE; j++) {
+            c[j]  = _mm256_loadu_ps(coeff + t + 8 * j);
+            s1[j] = s2[j] = _mm256_setzero_ps();
+        }
+        for (int i = 0; i < n; i++) {
+            __m256 xv = _mm256_set1_ps(x[i]);
+            for (int j = 0; j < TILE; j++) {
+                __m256 s0 = _mm256_sub_ps(_mm256_fmadd_ps(c[j], s1[j], xv), s2[j]);
+                s2[j] = s1[j]; s1[j] = s0;
+            }
+        }
+        for (int j = 0; j < TILE; j++) {
+            __m256 p = _mm256_fmadd_ps(s1[j], s1[j], _mm256_mul_ps(s2[j], s2[j]));
+            p = _mm256_fnmadd_ps(c[j], _mm256_mul_ps(s1[j], s2[j]), p);
+            _mm256_storeu_ps(out + t + 8 * j, p);
+        }
+    }
+}
+#endif
 
-    int64_t fs = (int64_t)(t0 * sr); if (fs < 0) fs = 0;
-    int64_t fe = (int64_t)(t1 * sr); if (fe > (int64_t)frame_count) fe = (int64_t)frame_count;
-    if (fe - fs < GOERTZEL_N) return;
+// Window function: sample i of n.
+typedef float (*GoertzelWindowFn)(int i, int n);
 
-    static float s_mono[GOERTZEL_N];
-    double power[12] = {};
+// Per-frame pitch-class power; window selects the window function.
+static void goertzel_frames(const ChromaFrameAlgo* algo, const float* pcm, uint32_t ch,
+                            uint32_t sr, int64_t k0, int64_t k1, double* feat,
+                            GoertzelWindowFn window)
+{
+    int n, hop;
+    chroma_frame_grid(algo, sr, &n, &hop);
+    const float*    coeff = coeffs_for(sr);
+    const SimdLevel level = simd_level();
+    float* win = (float*)malloc((size_t)n * sizeof(float));
+    float* x   = (float*)malloc((size_t)n * sizeof(float));
+    if (!win || !x) { free(win); free(x); return; }
+    for (int i = 0; i < n; i++) win[i] = window(i, n);
 
-    for (int64_t pos = fs; pos + GOERTZEL_N <= fe; pos += GOERTZEL_N) {
-        // Stereo → mono
-        for (int i = 0; i < GOERTZEL_N; i++) {
+    float bank[BANK];
+    for (int64_t k = k0; k < k1; k++) {
+        const float* src = pcm + (uint64_t)k * hop * ch;
+        // Stereo → mono, windowed once for the whole bank
+        for (int i = 0; i < n; i++) {
             float s = 0.0f;
-            for (uint32_t c = 0; c < ch; c++) s += pcm[(pos + i) * ch + c];
-            s_mono[i] = s / (float)ch;
+            for (uint32_t c = 0; c < ch; c++) s += src[(uint64_t)i * ch + c];
+            x[i] = (s / (float)ch) * win[i];
         }
-        // One Goertzel filter per target note; accumulate into pitch class.
-        for (int pc = 0; pc < 12; pc++)
-            for (int oi = 0; oi < 5; oi++)
-                power[pc] += goertzel(s_mono, win, GOERTZEL_N,
-                                      s_target[pc][oi], (float)sr);
-    }
 
-    // Normalise: peak → 0 dB, −30 dB floor → 0.
-    double mx = 1e-30;
-    for (int i = 0; i < 12; i++) if (power[i] > mx) mx = power[i];
-    for (int i = 0; i < 12; i++) {
-        float db = 10.0f * log10f((float)(power[i] / mx) + 1e-30f);
-        float v  = (db + 30.0f) / 30.0f;
-        result[i] = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+#if SIMD_HAVE_AVX2
+        if (level == SIMD_AVX2)         bank_avx2  (x, n, coeff, bank);
+        else
+#endif
+        if (level == SIMD_SCALAR)       bank_scalar(x, n, coeff, bank);
+        else                            bank_f4    (x, n, coeff, bank);
+
+        // Accumulate each target into its pitch class.
+        double* power = feat + (k - k0) * 12;
+        for (int t = 0; t < N_TARGETS; t++) power[t % 12] += bank[t];
     }
+    free(win); free(x);
+}
+
+// Normalise: peak → 0 dB, −30 dB floor → 0.
+static void goertzel_finish(const double* sum, int, float result[12])
+{
+    chroma_normalize_db(sum, result);
 }
 
 // ---------------------------------------------------------------------------
-// Public API
+// Windows
 // ---------------------------------------------------------------------------
 
 // Hann window: w[n] = 0.5 * (1 − cos(2π n/(N−1)))
-void chroma_goertzel_hann(const float* pcm, uint64_t frames, uint32_t ch,
-                           uint32_t sr, double t0, double t1, float result[12])
+static float hann_window(int i, int n)
 {
-    static float s_win[GOERTZEL_N];
-    static bool  s_init = false;
-    if (!s_init) {
-        for (int i = 0; i < GOERTZEL_N; i++)
-            s_win[i] = 0.5f * (1.0f - cosf(2.0f * 3.14159265358979f * i / (GOERTZEL_N - 1)));
-        s_init = true;
-    }
-    run_goertzel(pcm, frames, ch, sr, t0, t1, result, s_win);
+    return 0.5f * (1.0f - cosf(2.0f * 3.14159265358979f * i / (n - 1)));
 }
 
 // 4-term Blackman-Harris: −92 dB sidelobe level (vs −31 dB for Hann).
 // Coefficients from Harris (1978): a0=0.35875, a1=0.48829, a2=0.14128, a3=0.01168.
+static float blackman_window(int i, int n)
+{
+    float t = 2.0f * 3.14159265358979f * i / (n - 1);
+    return 0.35875f
+         - 0.48829f * cosf(t)
+         + 0.14128f * cosf(2.0f * t)
+         - 0.01168f * cosf(3.0f * t);
+}
+
+static void hann_frames(const float* pcm, uint64_t, uint32_t ch, uint32_t sr,
+                        int64_t k0, int64_t k1, double* feat)
+{
+    goertzel_frames(&CHROMA_FRAMES_GOERTZEL_HANN, pcm, ch, sr, k0, k1, feat, hann_window);
+}
+
+static void blackman_frames(const float* pcm, uint64_t, uint32_t ch, uint32_t sr,
+                            int64_t k0, int64_t k1, double* feat)
+{
+    goertzel_frames(&CHROMA_FRAMES_GOERTZEL_BLACKMAN, pcm, ch, sr, k0, k1, feat, blackman_window);
+}
+
+const ChromaFrameAlgo CHROMA_FRAMES_GOERTZEL_HANN     = { GOERTZEL_SEC, 1, 12, hann_frames,     goertzel_finish };
+const ChromaFrameAlgo CHROMA_FRAMES_GOERTZEL_BLACKMAN = { GOERTZEL_SEC, 1, 12, blackman_frames, goertzel_finish };
+
+// ---------------------------------------------------------------------------
+// Public API
+// ---------------------------------------------------------------------------
+
+void chroma_goertzel_hann(const float* pcm, uint64_t frames, uint32_t ch,
+                           uint32_t sr, double t0, double t1, float result[12])
+{
+    chroma_frames_run(&CHROMA_FRAMES_GOERTZEL_HANN, pcm, frames, ch, sr, &t0, &t1, 1, result);
+}
+
 void chroma_goertzel_blackman(const float* pcm, uint64_t frames, uint32_t ch,
                                uint32_t sr, double t0, double t1, float result[12])
 {
-    static float s_win[GOERTZEL_N];
-    static bool  s_init = false;
-    if (!s_init) {
-        for (int i = 0; i < GOERTZEL_N; i++) {
-            float t = 2.0f * 3.14159265358979f * i / (GOERTZEL_N - 1);
-            s_win[i] = 0.35875f
-                     - 0.48829f * cosf(t)
-                     + 0.14128f * cosf(2.0f * t)
-                     - 0.01168f * cosf(3.0f * t);
-        }
-        s_init = true;
-    }
-    run_goertzel(pcm, frames, ch, sr, t0, t1, result, s_win);
+    chroma_frames_run(&CHROMA_FRAMES_GOERTZEL_BLACKMAN, pcm, frames, ch, sr, &t0, &t1, 1, result);
+}
+
+void chroma_goertzel_hann_batch(const float* pcm, uint64_t frames, uint32_t ch,
+                                uint32_t sr, const double* t0, const double* t1,
+                                int n, float* out)
+{
+    chroma_frames_run(&CHROMA_FRAMES_GOERTZEL_HANN, pcm, frames, ch, sr, t0, t1, n, out);
+}
+
+void chroma_goertzel_blackman_batch(const float* pcm, uint64_t frames, uint32_t ch,
+                                    uint32_t sr, const double* t0, const double* t1,
+                                    int n, float* out)
+{
+    chroma_frames_run(&CHROMA_FRAMES_GOERTZEL_BLACKMAN, pcm, frames, ch, sr, t0, t1, n, out);
 }
@@ -1,7 +1,7 @@
 #include "chroma_algo.h"
-#include "chroma_fft.h"
+#include "chroma_frames.h"
+#include "stft_cache.h"
 #include <math.h>
-#include <string.h>
 #include <stdint.h>
 
 // ---------------------------------------------------------------------------
@@ -16,51 +16,26 @@
 // 12 pitch classes using the same midi-rounding approach as the FFT chroma.
 // ---------------------------------------------------------------------------
 
-static const int HPS_N     = 8192;  // FFT window size
-static const int HPS_ORDER = 5;     // number of harmonics to multiply
+static const double HPS_SEC   = 0.18576;  // FFT window (8192 samples at 44.1 kHz), half-overlapped
+static const int    HPS_ORDER = 5;        // number of harmonics to multiply
 
-void chroma_hps(const float* pcm, uint64_t frame_count, uint32_t ch,
-                uint32_t sr, double t0, double t1, float result[12])
+static void hps_frames(const float* pcm, uint64_t frame_count, uint32_t ch,
+                       uint32_t sr, int64_t k0, int64_t k1, double* feat)
 {
-    memset(result, 0, 12 * sizeof(float));
-    if (!pcm || frame_count == 0 || ch == 0 || sr == 0) return;
-    if (t1 - t0 > 8.0) t0 = t1 - 8.0;
-
-    int64_t fs = (int64_t)(t0 * sr); if (fs < 0) fs = 0;
-    int64_t fe = (int64_t)(t1 * sr); if (fe > (int64_t)frame_count) fe = (int64_t)frame_count;
-    if (fe - fs < HPS_N) return;
-
-    // Static scratch buffers
-    static float s_re[HPS_N], s_im[HPS_N];
-    static float s_mag[HPS_N / 2];
-    static float s_win[HPS_N];
-    static bool  s_win_init = false;
-    if (!s_win_init) {
-        for (int i = 0; i < HPS_N; i++)
-            s_win[i] = 0.5f * (1.0f - cosf(2.0f * 3.14159265358979f * i / (HPS_N - 1)));
-        s_win_init = true;
-    }
+    int n, hop;
+    chroma_frame_grid(&CHROMA_FRAMES_HPS, sr, &n, &hop);
+    StftView view;
+    if (!stft_open(&view, pcm, frame_count, ch, sr, n, hop, STFT_HANN)) return;
 
-    const int   BINS         = HPS_N / 2;
-    const float freq_per_bin = (float)sr / (float)HPS_N;
+    const int   BINS         = n / 2;
+    const float freq_per_bin = (float)sr / (float)n;
     // Maximum bin for which a full HPS_ORDER-way product is valid
     const int   MAX_FUND_BIN = BINS / HPS_ORDER;
 
-    double power[12] = {};
-
-    for (int64_t pos = fs; pos + HPS_N <= fe; pos += HPS_N) {
-        // Stereo → mono, apply window
-        for (int i = 0; i < HPS_N; i++) {
-            float s = 0.0f;
-            for (uint32_t c = 0; c < ch; c++) s += pcm[(pos + i) * ch + c];
-            s_re[i] = (s / (float)ch) * s_win[i];
-            s_im[i] = 0.0f;
-        }
-        chroma_fft(s_re, s_im, HPS_N);
-
-        // Magnitude spectrum
-        for (int k = 0; k < BINS; k++)
-            s_mag[k] = sqrtf(s_re[k]*s_re[k] + s_im[k]*s_im[k]);
+    for (int64_t f = k0; f < k1; f++) {
+        const float* mag = stft_frame(&view, f);   // magnitude spectrum
+        if (!mag) break;
+        double* power = feat + (f - k0) * 12;
 
         // Accumulate HPS into pitch classes (C2..C6: 65..1047 Hz)
         for (int k = 1; k < MAX_FUND_BIN; k++) {
@@ -68,9 +43,9 @@ void chroma_hps(const float* pcm, uint64_t frame_count, uint32_t ch,
             if (freq < 60.0f || freq > 1100.0f) continue;
 
             // HPS product: multiply magnitudes at fundamental and harmonics
-            float hps = s_mag[k];
+            float hps = mag[k];
             for (int h = 2; h <= HPS_ORDER; h++)
-                hps *= s_mag[k * h];
+                hps *= mag[k * h];
 
             // Map to pitch class
             float midi = 12.0f * log2f(freq / 440.0f) + 69.0f;
@@ -78,13 +53,25 @@ void chroma_hps(const float* pcm, uint64_t frame_count, uint32_t ch,
             power[pc] += (double)hps;
         }
     }
+    stft_close(&view);
+}
 
-    // Normalise
-    double mx = 1e-30;
-    for (int i = 0; i < 12; i++) if (power[i] > mx) mx = power[i];
-    for (int i = 0; i < 12; i++) {
-        float db = 10.0f * log10f((float)(power[i] / mx) + 1e-30f);
-        float v  = (db + 30.0f) / 30.0f;
-        result[i] = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
-    }
+static void hps_finish(const double* sum, int, float result[12])
+{
+    chroma_normalize_db(sum, result);
+}
+
+const ChromaFrameAlgo CHROMA_FRAMES_HPS = { HPS_SEC, 2, 12, hps_frames, hps_finish };
+
+void chroma_hps(const float* pcm, uint64_t frame_count, uint32_t ch,
+                uint32_t sr, double t0, double t1, float result[12])
+{
+    chroma_frames_run(&CHROMA_FRAMES_HPS, pcm, frame_count, ch, sr, &t0, &t1, 1, result);
+}
+
+void chroma_hps_batch(const float* pcm, uint64_t frame_count, uint32_t ch,
+                      uint32_t sr, const double* t0, const double* t1,
+                      int n, float* out)
+{
+    chroma_frames_run(&CHROMA_FRAMES_HPS, pcm, frame_count, ch, sr, t0, t1, n, out);
 }
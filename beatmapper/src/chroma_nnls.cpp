@@ -1,5 +1,6 @@
 #include "chroma_algo.h"
-#include "chroma_fft.h"
+#include "chroma_frames.h"
+#include "stft_cache.h"
 #include <math.h>
 #include <string.h>
 #include <stdint.h>
@@ -13,9 +14,10 @@
 //   2. Build a 12-column template matrix A where column pc contains the
 //      expected spectral shape of pitch class pc across all octaves and
 //      harmonics, with exponentially decaying harmonic weights.
-//   3. Solve: x = argmin_{x≥0} ||A x − b||² using multiplicative updates
-//      (Lee-Seung NMF/NNLS rule), which for 12 variables converges in ~80
-//      iterations and runs in microseconds.
+//   3. Solve: x = argmin_{x≥0} ||A x − b||² exactly with the Lawson-Hanson
+//      active-set method on the normal equations.  Only the 12×12 Gram
+//      matrix AᵀA and the 12-vector Aᵀb enter, and with 12 variables the
+//      active set settles in a handful of steps.
 //   4. Normalise x to [0,1] with a dB floor.
 //
 // Because the templates explicitly model the harmonic series, energy from a
@@ -23,10 +25,10 @@
 // leaking into neighbouring pitch classes.
 // ---------------------------------------------------------------------------
 
-static const int NNLS_N     = 8192;   // FFT window size
+static const double NNLS_SEC = 0.18576;   // FFT window (8192 samples at 44.1 kHz), half-overlapped
+static const int MAP_BINS   = 1024;   // FFT bins mapped; B6 (~2 kHz) lies well below
 static const int LOG_BINS   = 60;     // C2..B6 (5 octaves × 12 semitones)
 static const int N_PC       = 12;     // pitch classes
-static const int NNLS_ITERS = 80;     // multiplicative update iterations
 
 // C2 = MIDI 36 = 440 * 2^((36-69)/12) ≈ 65.406 Hz
 static const float F_C2 = 65.406f;
@@ -41,118 +43,226 @@ static int freq_to_logbin(float f)
     return (k >= 0 && k < LOG_BINS) ? k : -1;
 }
 
-// Build the 60×12 template matrix A.
+// Template matrix A (60×12) and its Gram matrix G = AᵀA.
 // A[k][pc] = total weighted contribution of pitch class pc to log bin k,
 //            summed over octaves 2..6 and harmonics 1..10.
-static void build_templates(float A[LOG_BINS][N_PC])
+// Neither depends on the sample rate, so both are built once.
+struct NnlsModel {
+    double A[LOG_BINS][N_PC];
+    double G[N_PC][N_PC];
+};
+
+static NnlsModel build_model()
 {
-    memset(A, 0, LOG_BINS * N_PC * sizeof(float));
-    const float ROLLOFF = 0.65f;   // amplitude decay per harmonic
+    NnlsModel m;
+    memset(&m, 0, sizeof(m));
+    const double ROLLOFF = 0.65;   // amplitude decay per harmonic
     for (int pc = 0; pc < N_PC; pc++) {
         for (int oct = 2; oct <= 6; oct++) {
             int   midi = 12 * (oct + 1) + pc;
             float fund = 440.0f * powf(2.0f, (midi - 69) / 12.0f);
-            float w    = 1.0f;
+            double w   = 1.0;
             for (int h = 1; h <= 10; h++, w *= ROLLOFF) {
                 int k = freq_to_logbin(h * fund);
-                if (k >= 0) A[k][pc] += w;
+                if (k >= 0) m.A[k][pc] += w;
             }
         }
     }
+    for (int j = 0; j < N_PC; j++)
+        for (int k = 0; k < N_PC; k++)
+            for (int r = 0; r < LOG_BINS; r++) m.G[j][k] += m.A[r][j] * m.A[r][k];
+    return m;
 }
 
-void chroma_nnls(const float* pcm, uint64_t frame_count, uint32_t ch,
-                  uint32_t sr, double t0, double t1, float result[12])
+static const NnlsModel& nnls_model()
 {
-    memset(result, 0, N_PC * sizeof(float));
-    if (!pcm || frame_count == 0 || ch == 0 || sr == 0) return;
-    if (t1 - t0 > 8.0) t0 = t1 - 8.0;
-
-    int64_t fs = (int64_t)(t0 * sr); if (fs < 0) fs = 0;
-    int64_t fe = (int64_t)(t1 * sr); if (fe > (int64_t)frame_count) fe = (int64_t)frame_count;
-    if (fe - fs < NNLS_N) return;
-
-    // Template matrix and its Gram matrix (A^T A) – computed once.
-    static float s_A   [LOG_BINS][N_PC];
-    static float s_AtA [N_PC][N_PC];
-    static bool  s_tmpl_init = false;
-    if (!s_tmpl_init) {
-        build_templates(s_A);
-        for (int j = 0; j < N_PC; j++)
-            for (int k = 0; k < N_PC; k++) {
-                float v = 0.0f;
-                for (int r = 0; r < LOG_BINS; r++) v += s_A[r][j] * s_A[r][k];
-                s_AtA[j][k] = v;
-            }
-        s_tmpl_init = true;
-    }
+    static const NnlsModel s_model = build_model();
+    return s_model;
+}
+
+// FFT bin -> log bin for one sample rate and FFT size, and the range of bins
+// that land inside C2..B6 at all (everything above ~2 kHz does not).  Per
+// thread, so concurrent analyses at different rates do not fight over one
+// table.
+struct NnlsBins {
+    uint32_t sr;
+    int      n;
+    int      lo, hi;                  // bins [lo, hi) can map
+    int8_t   logbin[MAP_BINS];        // -1 = outside C2..B6
+};
+static thread_local NnlsBins s_bins;
 
-    // Hann window
-    static float s_win[NNLS_N];
-    static bool  s_win_init = false;
-    if (!s_win_init) {
-        for (int i = 0; i < NNLS_N; i++)
-            s_win[i] = 0.5f * (1.0f - cosf(2.0f * 3.14159265358979f * i / (NNLS_N - 1)));
-        s_win_init = true;
+static const NnlsBins* bins_for(uint32_t sr, int n)
+{
+    if (s_bins.sr == sr && s_bins.n == n) return &s_bins;
+    float freq_per_bin = (float)sr / (float)n;
+    int   nb           = n / 2 < MAP_BINS ? n / 2 : MAP_BINS;
+    s_bins.lo = nb;
+    s_bins.hi = 1;
+    for (int b = 1; b < nb; b++) {
+        int k = freq_to_logbin(b * freq_per_bin);
+        s_bins.logbin[b] = (int8_t)k;
+        if (k >= 0) {
+            if (b < s_bins.lo)     s_bins.lo = b;
+            if (b + 1 > s_bins.hi) s_bins.hi = b + 1;
+        }
     }
+    s_bins.sr = sr;
+    s_bins.n  = n;
+    return &s_bins;
+}
 
-    // Accumulate log-frequency power spectrum across all frames
-    static float s_re[NNLS_N], s_im[NNLS_N];
-    double logspec[LOG_BINS] = {};
-    float freq_per_bin = (float)sr / (float)NNLS_N;
-    int num_frames = 0;
-
-    for (int64_t pos = fs; pos + NNLS_N <= fe; pos += NNLS_N) {
-        for (int i = 0; i < NNLS_N; i++) {
-            float s = 0.0f;
-            for (uint32_t c = 0; c < ch; c++) s += pcm[(pos + i) * ch + c];
-            s_re[i] = (s / (float)ch) * s_win[i];
-            s_im[i] = 0.0f;
+// Per-frame log-frequency power spectrum (LOG_BINS values).
+static void nnls_frames(const float* pcm, uint64_t frame_count, uint32_t ch,
+                        uint32_t sr, int64_t k0, int64_t k1, double* feat)
+{
+    int n, hop;
+    chroma_frame_grid(&CHROMA_FRAMES_NNLS, sr, &n, &hop);
+    StftView view;
+    if (!stft_open(&view, pcm, frame_count, ch, sr, n, hop, STFT_HANN)) return;
+
+    const NnlsBins* bins = bins_for(sr, n);
+    for (int64_t f = k0; f < k1; f++) {
+        const float* mag = stft_frame(&view, f);
+        if (!mag) break;
+        double* logspec = feat + (f - k0) * LOG_BINS;
+        for (int b = bins->lo; b < bins->hi; b++) {
+            int k = bins->logbin[b];
+            if (k >= 0) logspec[k] += mag[b] * mag[b];
         }
-        chroma_fft(s_re, s_im, NNLS_N);
+    }
+    stft_close(&view);
+}
 
-        for (int b = 1; b < NNLS_N / 2; b++) {
-            int k = freq_to_logbin(b * freq_per_bin);
-            if (k >= 0) logspec[k] += s_re[b]*s_re[b] + s_im[b]*s_im[b];
+// Solve G_PP z_P = c_P for the passive set P (Cholesky; G_PP is positive
+// definite because A has full column rank).  z is zero outside P.  Returns
+// false if the subsystem is numerically singular.
+static bool solve_passive(const double G[N_PC][N_PC], const double* c,
+                          const bool* passive, double* z)
+{
+    int idx[N_PC], n = 0;
+    for (int j = 0; j < N_PC; j++) { z[j] = 0.0; if (passive[j]) idx[n++] = j; }
+
+    double L[N_PC][N_PC];
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k <= i; k++) {
+            double v = G[idx[i]][idx[k]];
+            for (int m = 0; m < k; m++) v -= L[i][m] * L[k][m];
+            if (i == k) {
+                if (v <= 1e-12 * G[idx[i]][idx[i]]) return false;
+                L[i][i] = sqrt(v);
+            } else {
+                L[i][k] = v / L[k][k];
+            }
         }
-        num_frames++;
     }
-    if (num_frames == 0) return;
+    double y[N_PC];
+    for (int i = 0; i < n; i++) {
+        double v = c[idx[i]];
+        for (int m = 0; m < i; m++) v -= L[i][m] * y[m];
+        y[i] = v / L[i][i];
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        double v = y[i];
+        for (int m = i + 1; m < n; m++) v -= L[m][i] * y[m];
+        y[i] = v / L[i][i];
+    }
+    for (int i = 0; i < n; i++) z[idx[i]] = y[i];
+    return true;
+}
 
-    // Average to get the observation vector b
-    float b_vec[LOG_BINS];
-    for (int k = 0; k < LOG_BINS; k++)
-        b_vec[k] = (float)(logspec[k] / num_frames);
+// Lawson-Hanson active-set NNLS in normal-equation form:
+//   minimise ½ xᵀ G x − cᵀ x  subject to x ≥ 0.
+// Each outer step frees the variable with the largest positive gradient;
+// the inner loop steps back along the segment whenever that would drive a
+// free variable negative.  Exact at termination.
+static void nnls_solve(const double G[N_PC][N_PC], const double c[N_PC], double x[N_PC])
+{
+    bool passive[N_PC] = {};
+    for (int j = 0; j < N_PC; j++) x[j] = 0.0;
 
-    // Precompute A^T b (the numerator in the update rule)
-    float Atb[N_PC] = {};
-    for (int j = 0; j < N_PC; j++)
-        for (int k = 0; k < LOG_BINS; k++)
-            Atb[j] += s_A[k][j] * b_vec[k];
-
-    // Multiplicative update (Lee-Seung NNLS):
-    //   x ← x .* (A^T b) ./ (A^T A x + ε)
-    // Initialise x from A^T b so the first iterate is non-negative.
-    float x[N_PC];
-    for (int j = 0; j < N_PC; j++) x[j] = Atb[j] + 1e-6f;
-
-    for (int iter = 0; iter < NNLS_ITERS; iter++) {
-        float AtAx[N_PC] = {};
-        for (int j = 0; j < N_PC; j++)
-            for (int k = 0; k < N_PC; k++)
-                AtAx[j] += s_AtA[j][k] * x[k];
+    double cmax = 0.0;
+    for (int j = 0; j < N_PC; j++) if (fabs(c[j]) > cmax) cmax = fabs(c[j]);
+    const double tol = 1e-10 * (cmax > 0.0 ? cmax : 1.0);
+
+    for (int outer = 0; outer < 3 * N_PC; outer++) {
+        // Negative gradient w = c − G x; stop when no bound variable wants to grow.
+        int    best  = -1;
+        double wbest = tol;
         for (int j = 0; j < N_PC; j++) {
-            x[j] *= Atb[j] / (AtAx[j] + 1e-12f);
-            if (x[j] < 0.0f) x[j] = 0.0f;
+            if (passive[j]) continue;
+            double w = c[j];
+            for (int k = 0; k < N_PC; k++) w -= G[j][k] * x[k];
+            if (w > wbest) { wbest = w; best = j; }
         }
+        if (best < 0) break;
+        passive[best] = true;
+
+        for (int inner = 0; inner < 3 * N_PC; inner++) {
+            double z[N_PC];
+            if (!solve_passive(G, c, passive, z)) { passive[best] = false; return; }
+
+            bool feasible = true;
+            for (int j = 0; j < N_PC; j++)
+                if (passive[j] && z[j] <= 0.0) { feasible = false; break; }
+            if (feasible) {
+                for (int j = 0; j < N_PC; j++) x[j] = z[j];
+                break;
+            }
+
+            // Step from x towards z as far as feasibility allows, then bind
+            // the variables that hit zero.
+            double alpha = 1.0;
+            for (int j = 0; j < N_PC; j++)
+                if (passive[j] && z[j] <= 0.0) {
+                    double a = x[j] / (x[j] - z[j]);
+                    if (a < alpha) alpha = a;
+                }
+            for (int j = 0; j < N_PC; j++) {
+                x[j] += alpha * (z[j] - x[j]);
+                if (passive[j] && x[j] <= tol) { passive[j] = false; x[j] = 0.0; }
+            }
+        }
+    }
+}
+
+// Fit the templates to the window's average log spectrum.
+static void nnls_finish(const double* logspec, int num_frames, float result[12])
+{
+    const NnlsModel& m = nnls_model();
+
+    // c = Aᵀ b for the average spectrum b.
+    double c[N_PC] = {};
+    for (int k = 0; k < LOG_BINS; k++) {
+        double b = logspec[k] / num_frames;
+        if (b == 0.0) continue;
+        for (int j = 0; j < N_PC; j++) c[j] += m.A[k][j] * b;
     }
 
+    double x[N_PC];
+    nnls_solve(m.G, c, x);
+
     // Normalise with dB floor
-    float mx = 1e-30f;
+    double mx = 1e-30;
     for (int j = 0; j < N_PC; j++) if (x[j] > mx) mx = x[j];
     for (int j = 0; j < N_PC; j++) {
-        float db = 20.0f * log10f(x[j] / mx + 1e-30f);
+        float db = 20.0f * log10f((float)(x[j] / mx) + 1e-30f);
         float v  = (db + 30.0f) / 30.0f;
         result[j] = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
     }
 }
+
+const ChromaFrameAlgo CHROMA_FRAMES_NNLS = { NNLS_SEC, 2, LOG_BINS, nnls_frames, nnls_finish };
+
+void chroma_nnls(const float* pcm, uint64_t frame_count, uint32_t ch,
+                  uint32_t sr, double t0, double t1, float result[12])
+{
+    chroma_frames_run(&CHROMA_FRAMES_NNLS, pcm, frame_count, ch, sr, &t0, &t1, 1, result);
+}
+
+void chroma_nnls_batch(const float* pcm, uint64_t frame_count, uint32_t ch,
+                       uint32_t sr, const double* t0, const double* t1,
+                       int n, float* out)
+{
+    chroma_frames_run(&CHROMA_FRAMES_NNLS, pcm, frame_count, ch, sr, t0, t1, n, out);
+}
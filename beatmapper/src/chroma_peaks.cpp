@@ -1,5 +1,6 @@
 #include "chroma_algo.h"
-#include "chroma_fft.h"
+#include "chroma_frames.h"
+#include "stft_cache.h"
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
@@ -24,7 +25,7 @@
 // where the fundamental is weaker than its overtones.
 // ---------------------------------------------------------------------------
 
-static const int   PEAKS_N      = 8192;   // FFT window size
+static const double PEAKS_SEC   = 0.18576; // FFT window (8192 samples at 44.1 kHz), half-overlapped
 static const int   MAX_PEAKS    = 300;    // max peaks per frame
 static const float PEAK_THRESH  = 0.04f;  // min peak magnitude as fraction of frame max
 static const float HARM_TOL     = 0.03f;  // harmonic ratio tolerance (3%)
@@ -39,52 +40,32 @@ static int peak_cmp_freq(const void* a, const void* b)
     return (fa < fb) ? -1 : (fa > fb) ? 1 : 0;
 }
 
-void chroma_peaks(const float* pcm, uint64_t frame_count, uint32_t ch,
-                   uint32_t sr, double t0, double t1, float result[12])
+static void peaks_frames(const float* pcm, uint64_t frame_count, uint32_t ch,
+                         uint32_t sr, int64_t k0, int64_t k1, double* feat)
 {
-    memset(result, 0, 12 * sizeof(float));
-    if (!pcm || frame_count == 0 || ch == 0 || sr == 0) return;
-    if (t1 - t0 > 8.0) t0 = t1 - 8.0;
-
-    int64_t fs = (int64_t)(t0 * sr); if (fs < 0) fs = 0;
-    int64_t fe = (int64_t)(t1 * sr); if (fe > (int64_t)frame_count) fe = (int64_t)frame_count;
-    if (fe - fs < PEAKS_N) return;
-
-    static float s_re[PEAKS_N], s_im[PEAKS_N], s_mag[PEAKS_N / 2];
-    static float s_win[PEAKS_N];
-    static bool  s_win_init = false;
-    if (!s_win_init) {
-        for (int i = 0; i < PEAKS_N; i++)
-            s_win[i] = 0.5f * (1.0f - cosf(2.0f * 3.14159265358979f * i / (PEAKS_N - 1)));
-        s_win_init = true;
-    }
+    int n, hop;
+    chroma_frame_grid(&CHROMA_FRAMES_PEAKS, sr, &n, &hop);
+    StftView view;
+    if (!stft_open(&view, pcm, frame_count, ch, sr, n, hop, STFT_HANN)) return;
 
-    const int   BINS         = PEAKS_N / 2;
-    const float freq_per_bin = (float)sr / (float)PEAKS_N;
-
-    double power[12] = {};
+    const int   BINS         = n / 2;
+    const float freq_per_bin = (float)sr / (float)n;
 
     Peak s_peaks[MAX_PEAKS];
     // Fundamentals identified this frame
     float s_fund_freq[MAX_PEAKS];
     float s_fund_mag [MAX_PEAKS];
 
-    for (int64_t pos = fs; pos + PEAKS_N <= fe; pos += PEAKS_N) {
-        // Stereo → mono + window
-        for (int i = 0; i < PEAKS_N; i++) {
-            float s = 0.0f;
-            for (uint32_t c = 0; c < ch; c++) s += pcm[(pos + i) * ch + c];
-            s_re[i] = (s / (float)ch) * s_win[i];
-            s_im[i] = 0.0f;
-        }
-        chroma_fft(s_re, s_im, PEAKS_N);
+    for (int64_t fr = k0; fr < k1; fr++) {
+        const float* mag = stft_frame(&view, fr);   // magnitude spectrum
+        if (!mag) break;
 
-        // Magnitude spectrum + frame max
+        double* power = feat + (fr - k0) * 12;
+
+        // Frame max
         float max_mag = 1e-30f;
-        for (int k = 0; k < BINS; k++) {
-            s_mag[k] = sqrtf(s_re[k]*s_re[k] + s_im[k]*s_im[k]);
-            if (s_mag[k] > max_mag) max_mag = s_mag[k];
-        }
+        for (int k = 0; k < BINS; k++)
+            if (mag[k] > max_mag) max_mag = mag[k];
 
         // Collect local maxima in C2–C6 range (65–1047 Hz)
         int   n_peaks = 0;
@@ -92,8 +73,8 @@ void chroma_peaks(const float* pcm, uint64_t frame_count, uint32_t ch,
         for (int k = 1; k < BINS - 1 && n_peaks < MAX_PEAKS; k++) {
             float f = (float)k * freq_per_bin;
             if (f < 60.0f || f > 1100.0f) continue;
-            if (s_mag[k] > s_mag[k-1] && s_mag[k] > s_mag[k+1] && s_mag[k] >= thresh)
-                s_peaks[n_peaks++] = { f, s_mag[k] };
+            if (mag[k] > mag[k-1] && mag[k] > mag[k+1] && mag[k] >= thresh)
+                s_peaks[n_peaks++] = { f, mag[k] };
         }
 
         // Sort by frequency ascending so fundamentals come before harmonics
@@ -132,13 +113,25 @@ void chroma_peaks(const float* pcm, uint64_t frame_count, uint32_t ch,
             power[pc] += (double)s_fund_mag[j];
         }
     }
+    stft_close(&view);
+}
 
-    // Normalise
-    double mx = 1e-30;
-    for (int i = 0; i < 12; i++) if (power[i] > mx) mx = power[i];
-    for (int i = 0; i < 12; i++) {
-        float db = 10.0f * log10f((float)(power[i] / mx) + 1e-30f);
-        float v  = (db + 30.0f) / 30.0f;
-        result[i] = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
-    }
+static void peaks_finish(const double* sum, int, float result[12])
+{
+    chroma_normalize_db(sum, result);
+}
+
+const ChromaFrameAlgo CHROMA_FRAMES_PEAKS = { PEAKS_SEC, 2, 12, peaks_frames, peaks_finish };
+
+void chroma_peaks(const float* pcm, uint64_t frame_count, uint32_t ch,
+                   uint32_t sr, double t0, double t1, float result[12])
+{
+    chroma_frames_run(&CHROMA_FRAMES_PEAKS, pcm, frame_count, ch, sr, &t0, &t1, 1, result);
+}
+
+void chroma_peaks_batch(const float* pcm, uint64_t frame_count, uint32_t ch,
+                        uint32_t sr, const double* t0, const double* t1,
+                        int n, float* out)
+{
+    chroma_frames_run(&CHROMA_FRAMES_PEAKS, pcm, frame_count, ch, sr, t0, t1, n, out);
 }
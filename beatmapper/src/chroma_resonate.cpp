@@ -1,6 +1,10 @@
 #include "chroma_algo.h"
+#include "chroma_frames.h"
+#include "chroma_resonate.h"
+#include "simd.h"
 #include <math.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdint.h>
 
 // ---------------------------------------------------------------------------
@@ -60,6 +64,15 @@
 // The chroma window is handled by averaging each resonator's instantaneous
 // power over the window rather than sampling it at the end, so the result
 // reflects the whole span the caller asked about, not just its last few ms.
+//
+// The 60 recurrences are independent and all consume the same sample, so the
+// bank runs them in lock-step: resonators sit side by side in SIMD lanes (4
+// per vector with SSE2/NEON, 8 with AVX2) and one instruction stream advances
+// a whole vector of them.  Because every lane shares the sample index, the
+// phasor renormalisation happens on the same samples it always did; only the
+// per-resonator warm-up skip needs bookkeeping, which the sweep handles by
+// recording each lane's running power total at the sample offsets a caller
+// asks for (see bank_sweep).
 // ---------------------------------------------------------------------------
 
 static const int OCT_LO   = 2;                              // lowest octave
@@ -95,13 +108,11 @@ static const float WARMUP_TAU = 3.0f;
 // algorithms' 8 s cap).  Longer requests keep the most recent samples.
 static const int64_t MAX_SAMPLES = 384000;
 
-static float s_mono[MAX_SAMPLES];
-
-// Resonator tuning table, built once: frequency and EWMA rate per resonator.
+// Resonator tuning table, built once per thread: frequency and EWMA rate per resonator.
 // a_k depends on the sample rate, so the table is rebuilt if that changes.
-static float    s_freq[N_RES];
-static float    s_alpha[N_RES];
-static uint32_t s_tuned_sr = 0;
+static thread_local float    s_freq[N_RES];
+static thread_local float    s_alpha[N_RES];
+static thread_local uint32_t s_tuned_sr = 0;
 
 static void ensure_tuning(uint32_t sr)
 {
@@ -121,6 +132,231 @@ static void ensure_tuning(uint32_t sr)
     s_tuned_sr = sr;
 }
 
+// One resonator's state: phasor P, resonator R and smoothed S.
+struct Resonator {
+    float pr, pi;       // P
+    float rr, ri;       // R
+    float qr, qi;       // S
+    float cw, sw;       // constant per-sample rotation e^(-i w dt)
+};
+
+static void res_start(Resonator* z, float freq, uint32_t sr)
+{
+    // w dt = 2 pi f / sr
+    const float th = 6.283185307179586f * freq / (float)sr;
+    z->cw = cosf(th); z->sw = -sinf(th);
+    z->pr = 1.0f; z->pi = 0.0f;
+    z->rr = z->ri = z->qr = z->qi = 0.0f;
+}
+
+// Advance by one sample x (n = samples since res_start); returns |S|^2.
+static inline float res_step(Resonator* z, float x, float a, float b, int64_t n)
+{
+    // P *= e^(-i w dt)
+    float np = z->pr * z->cw - z->pi * z->sw;
+    z->pi    = z->pr * z->sw + z->pi * z->cw;
+    z->pr    = np;
+    if ((n & (RENORM_EVERY - 1)) == 0) {
+        float g = 1.0f / sqrtf(z->pr * z->pr + z->pi * z->pi);
+        z->pr *= g; z->pi *= g;
+    }
+
+    z->rr += a * (x * z->pr - z->rr);      // R += a (x P - R)
+    z->ri += a * (x * z->pi - z->ri);
+    z->qr += b * (z->rr - z->qr);          // S += b (R - S)
+    z->qi += b * (z->ri - z->qi);
+    return z->qr * z->qr + z->qi * z->qi;
+}
+
+// ---------------------------------------------------------------------------
+// Lock-step bank.  Structure-of-arrays so a vector load picks up the same
+// field of consecutive resonators.  Lanes past N_RES, and resonators too near
+// Nyquist, have a = b = 0 and stay silent.
+// ---------------------------------------------------------------------------
+static const int BANK = 64;                 // N_RES padded to whole AVX2 vectors
+
+// Power is summed in float over at most this many samples before being folded
+// into the double-precision running totals.
+static const int SEG = 256;
+
+struct ResBank {
+    alignas(32) float pr[BANK], pi[BANK];     // P
+    alignas(32) float rr[BANK], ri[BANK];     // R
+    alignas(32) float qr[BANK], qi[BANK];     // S
+    alignas(32) float cw[BANK], sw[BANK];     // e^(-i w dt)
+    alignas(32) float a[BANK],  b[BANK];      // EWMA rates
+};
+
+static void bank_start(ResBank* bk, uint32_t sr)
+{
+    ensure_tuning(sr);
+    const float nyq_lim = 0.45f * (float)sr;    // ignore resonators too near Nyquist
+    for (int r = 0; r < BANK; r++) {
+        Resonator z;
+        res_start(&z, r < N_RES ? s_freq[r] : 0.0f, sr);
+        bool live = r < N_RES && s_freq[r] < nyq_lim;
+        bk->pr[r] = z.pr; bk->pi[r] = z.pi;
+        bk->rr[r] = z.rr; bk->ri[r] = z.ri;
+        bk->qr[r] = z.qr; bk->qi[r] = z.qi;
+        bk->cw[r] = z.cw; bk->sw[r] = z.sw;
+        bk->a[r]  = live ? s_alpha[r] : 0.0f;
+        bk->b[r]  = live ? s_alpha[r] * BETA_SCALE : 0.0f;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Bank kernels: advance every lane over x[0..count), count <= SEG, where x[0]
+// is sample n0 since bank_start, and add each lane's summed |S|^2 to acc[].
+// ---------------------------------------------------------------------------
+
+// Scalar reference: one resonator at a time through res_step.
+static void bank_scalar(ResBank* bk, const float* x, int64_t n0, int count, double* acc)
+{
+    for (int r = 0; r < N_RES; r++) {
+        Resonator z = { bk->pr[r], bk->pi[r], bk->rr[r], bk->ri[r],
+                        bk->qr[r], bk->qi[r], bk->cw[r], bk->sw[r] };
+        const float a = bk->a[r], b = bk->b[r];
+        float sum = 0.0f;
+        for (int i = 0; i < count; i++) sum += res_step(&z, x[i], a, b, n0 + i);
+        bk->pr[r] = z.pr; bk->pi[r] = z.pi;
+        bk->rr[r] = z.rr; bk->ri[r] = z.ri;
+        bk->qr[r] = z.qr; bk->qi[r] = z.qi;
+        acc[r] += (double)sum;
+    }
+}
+
+static void bank_f4(ResBank* bk, const float* x, int64_t n0, int count, double* acc)
+{
+    const f4 one = f4_set1(1.0f);
+    for (int r = 0; r < N_RES; r += 4) {
+        f4 pr = f4_load(bk->pr + r), pi = f4_load(bk->pi + r);
+        f4 rr = f4_load(bk->rr + r), ri = f4_load(bk->ri + r);
+        f4 qr = f4_load(bk->qr + r), qi = f4_load(bk->qi + r);
+        const f4 cw = f4_load(bk->cw + r), sw = f4_load(bk->sw + r);
+        const f4 a  = f4_load(bk->a  + r), b  = f4_load(bk->b  + r);
+        f4 sum = f4_set1(0.0f);
+        for (int i = 0; i < count; i++) {
+            f4 np = f4_nmadd(pi, sw, f4_mul(pr, cw));
+            pi    = f4_madd (pr, sw, f4_mul(pi, cw));
+            pr    = np;
+            if (((n0 + i) & (RENORM_EVERY - 1)) == 0) {
+                f4 g = f4_div(one, f4_sqrt(f4_madd(pr, pr, f4_mul(pi, pi))));
+                pr = f4_mul(pr, g); pi = f4_mul(pi, g);
+            }
+            f4 xv = f4_set1(x[i]);
+            rr  = f4_madd(a, f4_sub(f4_mul(xv, pr), rr), rr);
+            ri  = f4_madd(a, f4_sub(f4_mul(xv, pi), ri), ri);
+            qr  = f4_madd(b, f4_sub(rr, qr), qr);
+            qi  = f4_madd(b, f4_sub(ri, qi), qi);
+            sum = f4_madd(qr, qr, f4_madd(qi, qi, sum));
+        }
+        f4_store(bk->pr + r, pr); f4_store(bk->pi + r, pi);
+        f4_store(bk->rr + r, rr); f4_store(bk->ri + r, ri);
+        f4_store(bk->qr + r, qr); f4_store(bk->qi + r, qi);
+        float s[4];
+        f4_store(s, sum);
+        for (int j = 0; j < 4; j++) acc[r + j] += (double)s[j];
+    }
+}
+
+#if SIMD_HAVE_AVX2
+SIMD_AVX2_FN static void bank_avx2(ResBank* bk, const float* x, int64_t n0, int count, double* acc)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    for (int r = 0; r < N_RES; r += 8) {
+        __m256 pr = _mm256_loadu_ps(bk->pr + r), pi = _mm256_loadu_ps(bk->pi + r);
+        __m256 rr = _mm256_loadu_ps(bk->rr + r), ri = _mm256_loadu_ps(bk->ri + r);
+        __m256 qr = _mm256_loadu_ps(bk->qr + r), qi = _mm256_loadu_ps(bk->qi + r);
+        const __m256 cw = _mm256_loadu_ps(bk->cw + r), sw = _mm256_loadu_ps(bk->sw + r);
+        const __m256 a  = _mm256_loadu_ps(bk->a  + r), b  = _mm256_loadu_ps(bk->b  + r);
+        __m256 sum = _mm256_setzero_ps();
+        for (int i = 0; i < count; i++) {
+            __m256 np = _mm256_fnmadd_ps(pi, sw, _mm256_mul_ps(pr, cw));
+            pi        = _mm256_fmadd_ps (pr, sw, _mm256_mul_ps(pi, cw));
+            pr        = np;
+            if (((n0 + i) & (RENORM_EVERY - 1)) == 0) {
+                __m256 m = _mm256_fmadd_ps(pr, pr, _mm256_mul_ps(pi, pi));
+                __m256 g = _mm256_div_ps(one, _mm256_sqrt_ps(m));
+                pr = _mm256_mul_ps(pr, g); pi = _mm256_mul_ps(pi, g);
+            }
+            __m256 xv = _mm256_set1_ps(x[i]);
+            rr  = _mm256_fmadd_ps(a, _mm256_fmsub_ps(xv, pr, rr), rr);
+            ri  = _mm256_fmadd_ps(a, _mm256_fmsub_ps(xv, pi, ri), ri);
+            qr  = _mm256_fmadd_ps(b, _mm256_sub_ps(rr, qr), qr);
+            qi  = _mm256_fmadd_ps(b, _mm256_sub_ps(ri, qi), qi);
+            sum = _mm256_fmadd_ps(qr, qr, _mm256_fmadd_ps(qi, qi, sum));
+        }
+        _mm256_storeu_ps(bk->pr + r, pr); _mm256_storeu_ps(bk->pi + r, pi);
+        _mm256_storeu_ps(bk->rr + r, rr); _mm256_storeu_ps(bk->ri + r, ri);
+        _mm256_storeu_ps(bk->qr + r, qr); _mm256_storeu_ps(bk->qi + r, qi);
+        alignas(32) float s[8];
+        _mm256_store_ps(s, sum);
+        for (int j = 0; j < 8; j++) acc[r + j] += (double)s[j];
+    }
+}
+#endif
+
+// Advance the bank over x[0..count), count <= SEG, with the best kernel.
+static void bank_run(ResBank* bk, const float* x, int64_t n0, int count, double* acc)
+{
+    const SimdLevel level = simd_level();
+#if SIMD_HAVE_AVX2
+    if (level == SIMD_AVX2)         bank_avx2  (bk, x, n0, count, acc);
+    else
+#endif
+    if (level == SIMD_SCALAR)       bank_scalar(bk, x, n0, count, acc);
+    else                            bank_f4    (bk, x, n0, count, acc);
+}
+
+// Run a freshly started bank over x[0..len) and record, for each mark m
+// (ascending, each in [0, len]), every lane's total |S|^2 over samples
+// [0, marks[m]) in snap[m * BANK + lane].  Any window's per-resonator average
+// is then a difference of two snapshots.
+static void bank_sweep(ResBank* bk, const float* x, int64_t len,
+                       const int64_t* marks, int nmarks, double* snap)
+{
+    double acc[BANK] = {};
+    int64_t n = 0;
+    int     m = 0;
+    for (;;) {
+        while (m < nmarks && marks[m] <= n)
+            memcpy(snap + (size_t)m++ * BANK, acc, sizeof(acc));
+        if (n >= len || m >= nmarks) break;
+
+        int64_t stop = marks[m] < len ? marks[m] : len;
+        int count = stop - n > SEG ? SEG : (int)(stop - n);
+        bank_run(bk, x + n, n, count, acc);
+        n += count;
+    }
+}
+
+static int mark_cmp(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+// Sort marks and drop duplicates; returns the new count.
+static int marks_unique(int64_t* marks, int n)
+{
+    qsort(marks, (size_t)n, sizeof(int64_t), mark_cmp);
+    int k = 0;
+    for (int i = 0; i < n; i++)
+        if (k == 0 || marks[i] != marks[k - 1]) marks[k++] = marks[i];
+    return k;
+}
+
+// Index of v in the sorted, unique marks[0..n).
+static int mark_index(const int64_t* marks, int n, int64_t v)
+{
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (marks[mid] < v) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
 void chroma_resonate(const float* pcm, uint64_t frame_count, uint32_t ch,
                       uint32_t sr, double t0, double t1, float result[12])
 {
@@ -133,72 +369,343 @@ void chroma_resonate(const float* pcm, uint64_t frame_count, uint32_t ch,
     int64_t n_samp = fe - fs;
     if (n_samp <= 0) return;
 
-    ensure_tuning(sr);
-
-    // Materialise the window as mono up front.  The resonator loop is then
-    // resonator-outer / sample-inner, which keeps each resonator's whole state
-    // in registers for the length of the window.
+    // Materialise the window as mono up front; the bank then streams it.
+    // Allocated per call, sized to the window, so that concurrent tracks
+    // each get their own without every thread carrying MAX_SAMPLES of it.
+    float* mono = (float*)malloc((size_t)n_samp * sizeof(float));
+    if (!mono) return;
     const float inv_ch = 1.0f / (float)ch;
     for (int64_t i = 0; i < n_samp; i++) {
         float s = 0.0f;
         for (uint32_t c = 0; c < ch; c++) s += pcm[(fs + i) * ch + c];
-        s_mono[i] = s * inv_ch;
+        mono[i] = s * inv_ch;
     }
 
-    const float two_pi   = 6.283185307179586f;
-    const float nyq_lim  = 0.45f * (float)sr;    // ignore resonators too near Nyquist
-    double power[N_PC] = {};
+    ResBank bk;
+    bank_start(&bk, sr);
+
+    // Ignore each resonator's EWMA start-up transient.  Never skip more than
+    // half the window, or a short window would yield no samples at all.
+    int64_t skip[N_RES];
+    int64_t marks[N_RES + 1];
+    for (int r = 0; r < N_RES; r++) {
+        skip[r] = bk.a[r] > 0.0f ? (int64_t)(WARMUP_TAU / bk.a[r]) : 0;
+        if (skip[r] > n_samp / 2) skip[r] = n_samp / 2;
+        marks[r] = skip[r];
+    }
+    marks[N_RES] = n_samp;
+    int nmarks = marks_unique(marks, N_RES + 1);
+
+    double snap[(N_RES + 1) * BANK];
+    bank_sweep(&bk, mono, n_samp, marks, nmarks, snap);
+    free(mono);
 
+    const double* total = snap + (size_t)(nmarks - 1) * BANK;
+    double power[N_PC] = {};
     for (int r = 0; r < N_RES; r++) {
-        if (s_freq[r] >= nyq_lim) continue;
-
-        const float a = s_alpha[r];
-        const float b = a * BETA_SCALE;
-
-        // Ignore the EWMA start-up transient.  Never skip more than half the
-        // window, or a short window would yield no samples at all.
-        int64_t skip = (int64_t)(WARMUP_TAU / a);
-        if (skip > n_samp / 2) skip = n_samp / 2;
-
-        // Constant per-sample rotation e^(-i w dt), w dt = 2 pi f / sr.
-        const float th = two_pi * s_freq[r] / (float)sr;
-        const float cw = cosf(th), sw = -sinf(th);
-
-        float pr = 1.0f, pi = 0.0f;    // phasor P
-        float rr = 0.0f, ri = 0.0f;    // resonator R
-        float qr = 0.0f, qi = 0.0f;    // smoothed S
-        double acc = 0.0;
-        int64_t nacc = 0;
-
-        for (int64_t n = 0; n < n_samp; n++) {
-            // P *= e^(-i w dt)
-            float np = pr * cw - pi * sw;
-            pi       = pr * sw + pi * cw;
-            pr       = np;
-            if ((n & (RENORM_EVERY - 1)) == 0) {
-                float g = 1.0f / sqrtf(pr * pr + pi * pi);
-                pr *= g; pi *= g;
+        if (bk.a[r] == 0.0f) continue;
+        const double* head = snap + (size_t)mark_index(marks, nmarks, skip[r]) * BANK;
+        int64_t nacc = n_samp - skip[r];
+        if (nacc) power[r % N_PC] += (total[r] - head[r]) / (double)nacc;
+    }
+
+    // Normalise: peak -> 0 dB, -30 dB floor -> 0 (same mapping as the other
+    // algorithms so the panel's colour scale stays comparable).
+    chroma_normalize_db(power, result);
+}
+
+// ---------------------------------------------------------------------------
+// Batch: the bank runs continuously through each run of nearby intervals
+// instead of restarting cold at every one.  A run starts PRE-ROLL samples
+// before its first interval -- long enough for the slowest resonator to
+// settle -- so no interval loses its head to warm-up.  The sweep snapshots
+// each resonator's running power total at every interval boundary, making
+// every interval's average a subtraction.  Runs are capped at MAX_RUN_SEC so the scratch stays bounded;
+// the next run simply pre-rolls again.
+// ---------------------------------------------------------------------------
+static const double MAX_RUN_SEC = 30.0;
+
+struct ResSpan {
+    int     idx;
+    int64_t s0, s1;
+};
+
+static int res_span_cmp(const void* a, const void* b)
+{
+    const ResSpan* x = (const ResSpan*)a;
+    const ResSpan* y = (const ResSpan*)b;
+    return (x->s0 < y->s0) ? -1 : (x->s0 > y->s0) ? 1 : 0;
+}
+
+// First sample of [s, e) at which resonator r has settled, a run having
+// started cold at sample 0; never past the middle of the interval.
+static int64_t settled_start(const ResBank* bk, int r, int64_t s, int64_t e)
+{
+    int64_t settle = bk->a[r] > 0.0f ? (int64_t)(WARMUP_TAU / bk->a[r]) : 0;
+    int64_t s_eff  = s < settle ? settle : s;
+    if (s_eff > s + (e - s) / 2) s_eff = s + (e - s) / 2;
+    return s_eff;
+}
+
+void chroma_resonate_batch(const float* pcm, uint64_t frame_count, uint32_t ch,
+                           uint32_t sr, const double* t0, const double* t1,
+                           int n, float* out)
+{
+    if (n <= 0) return;
+    memset(out, 0, (size_t)n * N_PC * sizeof(float));
+    if (!pcm || frame_count == 0 || ch == 0 || sr == 0) return;
+
+    ensure_tuning(sr);
+
+    ResSpan* spans = (ResSpan*)malloc((size_t)n * sizeof(ResSpan));
+    double*  power = (double*) calloc((size_t)n * N_PC, sizeof(double));
+    if (!spans || !power) { free(spans); free(power); return; }
+
+    int ns = 0;
+    for (int i = 0; i < n; i++) {
+        int64_t fs = (int64_t)(t0[i] * sr); if (fs < 0) fs = 0;
+        int64_t fe = (int64_t)(t1[i] * sr); if (fe > (int64_t)frame_count) fe = (int64_t)frame_count;
+        if (fe - fs > MAX_SAMPLES) fs = fe - MAX_SAMPLES;   // keep the tail
+        if (fe > fs) spans[ns++] = { i, fs, fe };
+    }
+    qsort(spans, (size_t)ns, sizeof(ResSpan), res_span_cmp);
+
+    // The lowest resonator has the smallest rate and the longest settling.
+    const int64_t preroll = (int64_t)(WARMUP_TAU / s_alpha[0]);
+    const int64_t max_run = (int64_t)(MAX_RUN_SEC * sr) + preroll;
+    const float   inv_ch  = 1.0f / (float)ch;
+
+    float*   mono  = nullptr;
+    int64_t* marks = nullptr;
+    double*  snap  = nullptr;
+    int64_t  cap   = 0;
+    int      mcap  = 0;
+
+    int a = 0;
+    while (a < ns) {
+        int64_t lo = spans[a].s0 - preroll; if (lo < 0) lo = 0;
+        int64_t hi = spans[a].s1;
+        int z = a + 1;
+        while (z < ns && spans[z].s0 - preroll <= hi && spans[z].s1 - lo <= max_run) {
+            if (spans[z].s1 > hi) hi = spans[z].s1;
+            z++;
+        }
+
+        int64_t len = hi - lo;
+        if (len > cap) {
+            free(mono);
+            mono = (float*)malloc((size_t)len * sizeof(float));
+            cap  = len;
+            if (!mono) break;
+        }
+        int need = (z - a) * (N_RES + 2);
+        if (need > mcap) {
+            free(marks); free(snap);
+            marks = (int64_t*)malloc((size_t)need * sizeof(int64_t));
+            snap  = (double*) malloc((size_t)need * BANK * sizeof(double));
+            mcap  = need;
+            if (!marks || !snap) break;
+        }
+        for (int64_t i = 0; i < len; i++) {
+            float s = 0.0f;
+            for (uint32_t c = 0; c < ch; c++) s += pcm[(lo + i) * ch + c];
+            mono[i] = s * inv_ch;
+        }
+
+        // Only a run starting at the head of the track can be unsettled
+        // inside an interval; trim as the single-window path does, never by
+        // more than half the interval.
+        ResBank bk;
+        bank_start(&bk, sr);
+        int nm = 0;
+        for (int j = a; j < z; j++) {
+            int64_t s = spans[j].s0 - lo, e = spans[j].s1 - lo;
+            marks[nm++] = s;
+            marks[nm++] = e;
+            if (s < preroll)
+                for (int r = 0; r < N_RES; r++)
+                    marks[nm++] = settled_start(&bk, r, s, e);
+        }
+        nm = marks_unique(marks, nm);
+        bank_sweep(&bk, mono, len, marks, nm, snap);
+
+        for (int j = a; j < z; j++) {
+            int64_t s = spans[j].s0 - lo, e = spans[j].s1 - lo;
+            const double* tail = snap + (size_t)mark_index(marks, nm, e) * BANK;
+            double* pw = power + (size_t)spans[j].idx * N_PC;
+            for (int r = 0; r < N_RES; r++) {
+                if (bk.a[r] == 0.0f) continue;
+                int64_t s_eff = s < preroll ? settled_start(&bk, r, s, e) : s;
+                const double* head = snap + (size_t)mark_index(marks, nm, s_eff) * BANK;
+                pw[r % N_PC] += (tail[r] - head[r]) / (double)(e - s_eff);
             }
+        }
+        a = z;
+    }
 
-            const float x = s_mono[n];
-            rr += a * (x * pr - rr);      // R += a (x P - R)
-            ri += a * (x * pi - ri);
-            qr += b * (rr - qr);          // S += b (R - S)
-            qi += b * (ri - qi);
+    for (int j = 0; j < ns; j++) {
+        int i = spans[j].idx;
+        chroma_normalize_db(power + (size_t)i * N_PC, out + (size_t)i * N_PC);
+    }
+    free(mono); free(marks); free(snap); free(spans); free(power);
+}
 
-            if (n >= skip) { acc += (double)(qr * qr + qi * qi); nacc++; }
+// ---------------------------------------------------------------------------
+// Frame form, for whole-track chromagrams (chromagram.h).  Frame k is the
+// block of RES_SEC (one hop) starting at k * hop; its features are each
+// resonator's summed |S|^2 over the block.  The bank runs continuously
+// across the requested frames, pre-rolled like a batch run; at the head of
+// the track a resonator's blocks are left at zero until it has settled.
+// ---------------------------------------------------------------------------
+static const double RES_SEC = 0.02322;   // 1024 samples at 44.1 kHz
+
+static void resonate_frames(const float* pcm, uint64_t, uint32_t ch, uint32_t sr,
+                            int64_t k0, int64_t k1, double* feat)
+{
+    int n, hop;
+    chroma_frame_grid(&CHROMA_FRAMES_RESONATE, sr, &n, &hop);
+    ResBank bk;
+    bank_start(&bk, sr);
+
+    const int64_t preroll = (int64_t)(WARMUP_TAU / s_alpha[0]);
+    const int64_t first   = k0 * hop;
+    int64_t lo = first - preroll; if (lo < 0) lo = 0;
+    const int64_t len    = k1 * hop - lo;
+    const int     nmarks = (int)(k1 - k0) + 1;
+
+    float*   mono  = (float*)  malloc((size_t)len * sizeof(float));
+    int64_t* marks = (int64_t*)malloc((size_t)nmarks * sizeof(int64_t));
+    double*  snap  = (double*) malloc((size_t)nmarks * BANK * sizeof(double));
+    if (!mono || !marks || !snap) { free(mono); free(marks); free(snap); return; }
+
+    const float inv_ch = 1.0f / (float)ch;
+    for (int64_t i = 0; i < len; i++) {
+        float s = 0.0f;
+        for (uint32_t c = 0; c < ch; c++) s += pcm[(lo + i) * ch + c];
+        mono[i] = s * inv_ch;
+    }
+    for (int m = 0; m < nmarks; m++) marks[m] = first - lo + (int64_t)m * hop;
+    bank_sweep(&bk, mono, len, marks, nmarks, snap);
+
+    for (int r = 0; r < N_RES; r++) {
+        if (bk.a[r] == 0.0f) continue;
+        const int64_t settle = lo == 0 ? (int64_t)(WARMUP_TAU / bk.a[r]) : 0;
+        for (int m = 0; m + 1 < nmarks; m++) {
+            if (marks[m] < settle) continue;
+            feat[(size_t)m * N_RES + r] =
+                snap[(size_t)(m + 1) * BANK + r] - snap[(size_t)m * BANK + r];
         }
+    }
+    free(mono); free(marks); free(snap);
+}
+
+static void resonate_finish(const double* sum, int, float result[12])
+{
+    double power[N_PC] = {};
+    for (int r = 0; r < N_RES; r++) power[r % N_PC] += sum[r];
+    chroma_normalize_db(power, result);
+}
 
-        if (nacc) power[r % N_PC] += acc / (double)nacc;
+const ChromaFrameAlgo CHROMA_FRAMES_RESONATE = { RES_SEC, 1, N_RES, resonate_frames, resonate_finish };
+
+// ---------------------------------------------------------------------------
+// Streaming: the bank persists between calls and is fed only new samples.
+// Every SEG samples the running power totals are snapshotted into a ring
+// covering the longest window a caller may ask for, so a rolling window's
+// average is again a difference of two snapshots -- its start rounded to
+// the nearest SEG boundary (~5 ms at 48 kHz).
+// ---------------------------------------------------------------------------
+struct ResonateStream {
+    ResBank  bank;
+    uint32_t sr;
+    int64_t  n;              // samples pushed since the last reset
+    double   acc[BANK];      // running |S|^2 totals since the last reset
+    int      ring_len;       // snapshots kept
+    double*  ring;           // total at sample b * SEG in ring[(b % ring_len) * BANK]
+    float    mono[SEG];
+};
+
+ResonateStream* resonate_stream_create(uint32_t sample_rate, double max_window)
+{
+    if (sample_rate == 0 || max_window <= 0.0) return nullptr;
+    ResonateStream* st = (ResonateStream*)calloc(1, sizeof(ResonateStream));
+    if (!st) return nullptr;
+    st->sr       = sample_rate;
+    st->ring_len = (int)(max_window * sample_rate / SEG) + 2;
+    st->ring     = (double*)malloc((size_t)st->ring_len * BANK * sizeof(double));
+    if (!st->ring) { free(st); return nullptr; }
+    resonate_stream_reset(st);
+    return st;
+}
+
+void resonate_stream_destroy(ResonateStream* st)
+{
+    if (!st) return;
+    free(st->ring);
+    free(st);
+}
+
+void resonate_stream_reset(ResonateStream* st)
+{
+    bank_start(&st->bank, st->sr);
+    st->n = 0;
+    memset(st->acc, 0, sizeof(st->acc));
+    memset(st->ring, 0, BANK * sizeof(double));     // snapshot at sample 0
+}
+
+void resonate_stream_push(ResonateStream* st, const float* pcm, uint64_t frames,
+                          uint32_t ch)
+{
+    if (!pcm || ch == 0) return;
+    const float inv_ch = 1.0f / (float)ch;
+    uint64_t done = 0;
+    while (done < frames) {
+        // Stop at the next SEG boundary so it can be snapshotted.
+        int      count = SEG - (int)(st->n % SEG);
+        uint64_t left  = frames - done;
+        if ((uint64_t)count > left) count = (int)left;
+        for (int i = 0; i < count; i++) {
+            float s = 0.0f;
+            for (uint32_t c = 0; c < ch; c++) s += pcm[(done + i) * ch + c];
+            st->mono[i] = s * inv_ch;
+        }
+        bank_run(&st->bank, st->mono, st->n, count, st->acc);
+        st->n += count;
+        done  += count;
+        if (st->n % SEG == 0) {
+            int64_t b = st->n / SEG;
+            memcpy(st->ring + (size_t)(b % st->ring_len) * BANK, st->acc, sizeof(st->acc));
+        }
     }
+}
 
-    // Normalise: peak -> 0 dB, -30 dB floor -> 0 (same mapping as the other
-    // algorithms so the panel's colour scale stays comparable).
-    double mx = 1e-30;
-    for (int i = 0; i < N_PC; i++) if (power[i] > mx) mx = power[i];
-    for (int i = 0; i < N_PC; i++) {
-        float db = 10.0f * log10f((float)(power[i] / mx) + 1e-30f);
-        float v  = (db + 30.0f) / 30.0f;
-        result[i] = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+void resonate_stream_read_chroma(const ResonateStream* st, double window, float result[12])
+{
+    memset(result, 0, N_PC * sizeof(float));
+    if (st->n == 0) return;
+
+    // Boundaries still in the ring: b_lo .. b_hi (b_hi * SEG <= n).
+    const int64_t b_hi = st->n / SEG;
+    int64_t b_lo = b_hi - (st->ring_len - 1);
+    if (b_lo < 0) b_lo = 0;
+
+    int64_t start = st->n - (int64_t)(window * st->sr);
+    if (start < 0) start = 0;
+
+    // Each resonator skips its warm-up as the one-shot path does: only a
+    // window reaching back to the reset can contain it, and never by more
+    // than half the window.
+    double power[N_PC] = {};
+    for (int r = 0; r < N_RES; r++) {
+        if (st->bank.a[r] == 0.0f) continue;
+        int64_t s = settled_start(&st->bank, r, start, st->n);
+        int64_t b = (s + SEG / 2) / SEG;
+        if (b < b_lo) b = b_lo;
+        if (b > b_hi) b = b_hi;
+        if (b * SEG >= st->n) b = (st->n - 1) / SEG;
+        if (b < b_lo) continue;
+        const double* head = st->ring + (size_t)(b % st->ring_len) * BANK;
+        power[r % N_PC] += (st->acc[r] - head[r]) / (double)(st->n - b * SEG);
     }
+    chroma_normalize_db(power, result);
 }
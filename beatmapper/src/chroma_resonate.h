@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+
+// ---------------------------------------------------------------------------
+// Streaming Resonate chroma.
+//
+// chroma_resonate() starts a cold resonator bank for every window it is
+// given.  For a window that slides forward with the playhead, this keeps one
+// bank alive instead: push() feeds it only the samples played since the last
+// call, and read_chroma() reports the rolling window ending at the newest
+// sample, so the cost per UI frame follows the audio elapsed rather than the
+// window length.
+//
+// The bank assumes contiguous input.  Call reset() whenever playback jumps
+// (seek, loop wrap, a different track) and push the new window again.
+// ---------------------------------------------------------------------------
+
+struct ResonateStream;
+
+// max_window: longest window read_chroma() will be asked for, in seconds.
+ResonateStream* resonate_stream_create(uint32_t sample_rate, double max_window);
+void            resonate_stream_destroy(ResonateStream* st);
+
+// Back to a cold bank with no samples.
+void resonate_stream_reset(ResonateStream* st);
+
+// Feed frames of interleaved PCM (channels are averaged).
+void resonate_stream_push(ResonateStream* st, const float* pcm, uint64_t frames,
+                          uint32_t channels);
+
+// Chroma over the last `window` seconds pushed (fewer if fewer have been
+// pushed since the last reset), normalised as chroma_resonate() does.
+void resonate_stream_read_chroma(const ResonateStream* st, double window,
+                                 float result[12]);
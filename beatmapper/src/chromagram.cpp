@@ -0,0 +1,258 @@
+#include "chromagram.h"
+#include "chroma_algo.h"
+#include "chroma_frames.h"
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static const int CHUNK      = 1024;   // frames per call to the frame form
+static const int MAX_LEVELS = 24;
+
+struct Chromagram {
+    const ChromaFrameAlgo* algo;
+    const float*           pcm;
+    uint64_t               frame_count;
+    uint32_t               channels;
+    uint32_t               sample_rate;
+    int                    frame_len;      // chroma_frame_grid at sample_rate
+    int                    hop;
+
+    int64_t     num_frames;
+    int64_t     built;                  // frames summed so far; under s_mutex
+    double*     cum;                    // (num_frames + 1) * dims running sums
+    float*      tiles[MAX_LEVELS];      // per level: tile_count * 12, lazily
+    uint8_t*    tile_done[MAX_LEVELS];
+    Chromagram* next;
+};
+
+static std::mutex  s_mutex;
+static Chromagram* s_graphs = nullptr;
+
+// One builder thread sums the graphs' frames a chunk at a time, newest graph
+// first.  It holds no lock while summing; s_building marks the graph it is
+// working on, which chromagram_release waits out before freeing it.  The
+// thread exits when nothing is left to build and is joined by the next
+// chromagram_get that needs it or the release that empties the list.
+static std::thread             s_builder;
+static std::mutex              s_builder_mutex;   // guards s_builder itself
+static bool                    s_builder_running = false;
+static Chromagram*             s_building        = nullptr;
+static std::condition_variable s_built;           // s_building was cleared
+
+static void graph_free(Chromagram* g)
+{
+    for (int l = 0; l < MAX_LEVELS; l++) { free(g->tiles[l]); free(g->tile_done[l]); }
+    free(g->cum);
+    free(g);
+}
+
+// An empty graph; the builder fills in cum.
+static Chromagram* create(const ChromaFrameAlgo* algo, const float* pcm,
+                          uint64_t frame_count, uint32_t ch, uint32_t sr)
+{
+    Chromagram* g = (Chromagram*)calloc(1, sizeof(Chromagram));
+    if (!g) return nullptr;
+    g->algo        = algo;
+    g->pcm         = pcm;
+    g->frame_count = frame_count;
+    g->channels    = ch;
+    g->sample_rate = sr;
+    chroma_frame_grid(algo, sr, &g->frame_len, &g->hop);
+    g->num_frames  = (int64_t)(frame_count - g->frame_len) / g->hop + 1;
+
+    g->cum = (double*)malloc((size_t)(g->num_frames + 1) * algo->dims * sizeof(double));
+    if (!g->cum) { graph_free(g); return nullptr; }
+    memset(g->cum, 0, (size_t)algo->dims * sizeof(double));
+    return g;
+}
+
+// Sum frames [k0, k1) into the running sums.  feat holds CHUNK frames.
+static void sum_chunk(Chromagram* g, int64_t k0, int64_t k1, double* feat)
+{
+    const int dims = g->algo->dims;
+    memset(feat, 0, (size_t)(k1 - k0) * dims * sizeof(double));
+    g->algo->frames(g->pcm, g->frame_count, g->channels, g->sample_rate, k0, k1, feat);
+    for (int64_t k = k0; k < k1; k++)
+        for (int d = 0; d < dims; d++)
+            g->cum[(k + 1) * dims + d] = g->cum[k * dims + d] + feat[(k - k0) * dims + d];
+}
+
+// The graph to work on next: the newest unfinished one that a newer graph of
+// the same track and algorithm has not superseded (a track still loading
+// gets a longer graph at every analysis step).  Under s_mutex.
+static Chromagram* next_to_build()
+{
+    for (Chromagram* g = s_graphs; g; g = g->next) {
+        if (g->built >= g->num_frames) continue;
+        bool superseded = false;
+        for (Chromagram* h = s_graphs; h != g; h = h->next)
+            if (h->algo == g->algo && h->pcm == g->pcm) { superseded = true; break; }
+        if (!superseded) return g;
+    }
+    return nullptr;
+}
+
+static void builder()
+{
+    double* feat = (double*)malloc((size_t)CHUNK * CHROMA_MAX_DIMS * sizeof(double));
+    std::unique_lock<std::mutex> lock(s_mutex);
+    while (Chromagram* g = feat ? next_to_build() : nullptr) {
+        const int64_t k0 = g->built;
+        const int64_t k1 = k0 + CHUNK < g->num_frames ? k0 + CHUNK : g->num_frames;
+        s_building = g;
+        lock.unlock();
+        sum_chunk(g, k0, k1, feat);
+        lock.lock();
+        g->built   = k1;
+        s_building = nullptr;
+        s_built.notify_all();
+    }
+    s_builder_running = false;
+    lock.unlock();
+    free(feat);
+}
+
+Chromagram* chromagram_get(const ChromaAlgoDesc* desc, const float* pcm,
+                           uint64_t frame_count, uint32_t channels,
+                           uint32_t sample_rate)
+{
+    const ChromaFrameAlgo* algo = desc ? desc->frames : nullptr;
+    if (!algo || !pcm || channels == 0 || sample_rate == 0) return nullptr;
+    int frame_len, hop;
+    chroma_frame_grid(algo, sample_rate, &frame_len, &hop);
+    if (frame_count < (uint64_t)frame_len) return nullptr;
+
+    Chromagram* g = nullptr;
+    bool        start = false;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (g = s_graphs; g; g = g->next)
+            if (g->algo == algo && g->pcm == pcm && g->frame_count == frame_count &&
+                g->channels == channels && g->sample_rate == sample_rate)
+                return g;
+
+        g = create(algo, pcm, frame_count, channels, sample_rate);
+        if (!g) return nullptr;
+        g->next  = s_graphs;
+        s_graphs = g;
+        start    = !s_builder_running;
+        s_builder_running = true;
+    }
+    if (start) {
+        std::lock_guard<std::mutex> lock(s_builder_mutex);
+        if (s_builder.joinable()) s_builder.join();   // the last one, on its way out
+        s_builder = std::thread(builder);
+    }
+    return g;
+}
+
+// Frames summed so far.
+static int64_t built(const Chromagram* g)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return g->built;
+}
+
+// Finished chroma of frames [k0, k1).
+static void finish_range(const Chromagram* g, int64_t k0, int64_t k1, float result[12])
+{
+    const int dims = g->algo->dims;
+    double sum[CHROMA_MAX_DIMS];
+    for (int d = 0; d < dims; d++)
+        sum[d] = g->cum[k1 * dims + d] - g->cum[k0 * dims + d];
+    g->algo->finish(sum, (int)(k1 - k0), result);
+}
+
+bool chromagram_query(const Chromagram* g, double t0, double t1, float result[12])
+{
+    memset(result, 0, 12 * sizeof(float));
+    if (!g) return false;
+    const uint32_t sr = g->sample_rate;
+    int64_t s0 = (int64_t)(t0 * sr); if (s0 < 0) s0 = 0;
+    int64_t s1 = (int64_t)(t1 * sr); if (s1 > (int64_t)g->frame_count) s1 = (int64_t)g->frame_count;
+
+    int64_t k0, k1;
+    chroma_frame_range(g->frame_len, g->hop, g->num_frames, s0, s1, &k0, &k1);
+    if (k1 > built(g)) return false;
+    if (k1 > k0) finish_range(g, k0, k1, result);
+    return true;
+}
+
+int chromagram_level(const Chromagram* g, double seconds)
+{
+    const double frame_sec = (double)g->hop / g->sample_rate;
+    int l = 0;
+    while (l + 1 < MAX_LEVELS && frame_sec * (double)((int64_t)1 << l) < seconds) l++;
+    return l;
+}
+
+// Tiles are drawn from the centre of their first frame minus half a hop.
+static double tile_origin(const Chromagram* g)
+{
+    return 0.5 * (double)(g->frame_len - g->hop) / g->sample_rate;
+}
+
+int64_t chromagram_tile_at(const Chromagram* g, int level, double t)
+{
+    const double tile_sec = (double)g->hop * ((int64_t)1 << level) / g->sample_rate;
+    double k = (t - tile_origin(g)) / tile_sec;
+    return k < 0.0 ? -1 : (int64_t)k;
+}
+
+const float* chromagram_tile(Chromagram* g, int level, int64_t k,
+                             double* t0, double* t1)
+{
+    if (level < 0 || level >= MAX_LEVELS) return nullptr;
+    const int64_t span  = (int64_t)1 << level;
+    const int64_t count = (g->num_frames + span - 1) / span;
+    if (k < 0 || k >= count) return nullptr;
+
+    const double frame_sec = (double)g->hop / g->sample_rate;
+    int64_t a = k * span;
+    int64_t b = a + span < g->num_frames ? a + span : g->num_frames;
+    *t0 = tile_origin(g) + (double)a * frame_sec;
+    *t1 = tile_origin(g) + (double)b * frame_sec;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (b > g->built) return nullptr;
+    if (!g->tiles[level]) {
+        g->tiles[level]     = (float*)  malloc((size_t)count * 12 * sizeof(float));
+        g->tile_done[level] = (uint8_t*)calloc((size_t)count, 1);
+        if (!g->tiles[level] || !g->tile_done[level]) {
+            free(g->tiles[level]); free(g->tile_done[level]);
+            g->tiles[level] = nullptr; g->tile_done[level] = nullptr;
+            return nullptr;
+        }
+    }
+    float* out = g->tiles[level] + k * 12;
+    if (!g->tile_done[level][k]) {
+        finish_range(g, a, b, out);
+        g->tile_done[level][k] = 1;
+    }
+    return out;
+}
+
+void chromagram_release(const float* pcm)
+{
+    bool idle;
+    {
+        std::unique_lock<std::mutex> lock(s_mutex);
+        Chromagram** link = &s_graphs;
+        while (*link) {
+            Chromagram* g = *link;
+            if (g->pcm != pcm) { link = &g->next; continue; }
+            *link = g->next;
+            while (s_building == g) s_built.wait(lock);
+            graph_free(g);
+        }
+        idle = !s_graphs;
+    }
+    // Nothing left: the builder is exiting, or has; reap it so that no
+    // thread outlives the last track.
+    if (idle) {
+        std::lock_guard<std::mutex> lock(s_builder_mutex);
+        if (s_builder.joinable()) s_builder.join();
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+
+// ---------------------------------------------------------------------------
+// Whole-track chromagram.
+//
+// The first request for a track and algorithm runs the algorithm's frame form
+// (chroma_frames.h) over the entire track once and keeps only the running
+// (integral) sums of the per-frame features.  That pass runs on a background
+// thread, front to back, so the request itself returns at once; an interval
+// can be queried as soon as the pass has got past it.  Chroma over any interval is
+// then two lookups, a subtraction and the algorithm's finishing step, however
+// long the interval is -- so unlike the ChromaFn / ChromaBatchFn entry points
+// there is no CHROMA_MAX_SPAN cap.  An interval takes the same frames it
+// would in chroma_frames_run().
+//
+// For display, the frames are also grouped into tiles of 2^level frames
+// whose finished chroma is computed on first use and memoised, so a strip
+// drawn at any zoom costs one finish per newly exposed tile.
+//
+// Thread-safe.
+// ---------------------------------------------------------------------------
+
+struct ChromaAlgoDesc;
+struct Chromagram;
+
+// Chromagram of pcm under algo, whose building starts on first use.  nullptr
+// if the track is shorter than one frame or memory ran out.
+Chromagram* chromagram_get(const ChromaAlgoDesc* algo, const float* pcm,
+                           uint64_t frame_count, uint32_t channels,
+                           uint32_t sample_rate);
+
+// Chroma over [t0, t1) seconds, normalised [0,1] as the algorithm's ChromaFn.
+// False, with zero chroma, until the build has reached t1.
+bool chromagram_query(const Chromagram* g, double t0, double t1, float result[12]);
+
+// Smallest tile level whose tiles are at least `seconds` long.
+int chromagram_level(const Chromagram* g, double seconds);
+
+// Index of the level's tile containing time t (may be out of range).
+int64_t chromagram_tile_at(const Chromagram* g, int level, double t);
+
+// Finished chroma of tile k, and the time span [*t0, *t1) it is drawn over
+// (frame centres, so neighbouring tiles abut).  nullptr if k is out of range
+// or not built yet.
+// The pointer stays valid until the chromagram is released.
+const float* chromagram_tile(Chromagram* g, int level, int64_t k,
+                             double* t0, double* t1);
+
+// Drop every chromagram built over pcm.  Call before the buffer is freed.
+void chromagram_release(const float* pcm);
@@ -0,0 +1,206 @@
+#include "cqt.h"
+#include "analysis_rate.h"
+#include "fft.h"
+#include "simd.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+// Kernel of bin k: coefficients re/im[off[k] .. off[k] + len[k]) apply to FFT
+// bins lo[k] .. lo[k] + len[k].  len[k] is a multiple of 4 (0 for an empty
+// bin) so the vector loop needs no tail.
+struct CqtKernel {
+    uint32_t   sample_rate;
+    int        n;                // frame length
+    int        lo [CQT_BINS];
+    int        len[CQT_BINS];
+    int        off[CQT_BINS];
+    float*     re;
+    float*     im;
+    CqtKernel* next;
+};
+
+static std::mutex  s_mutex;
+static CqtKernel*  s_kernels = nullptr;
+
+int cqt_frame_len(const CqtKernel* kern)
+{
+    return kern->n;
+}
+
+float cqt_bin_freq(float k)
+{
+    return CQT_FMIN * exp2f(k / (float)CQT_BINS_PER_OCTAVE);
+}
+
+static CqtKernel* kernel_build(uint32_t sr)
+{
+    const int      N     = analysis_fft_size(CQT_FRAME_SEC, sr);
+    const FftPlan* plan  = fft_plan(N);
+    const int      nbins = N / 2 + 1;
+    const double   Q     = 1.0 / (exp2(1.0 / CQT_BINS_PER_OCTAVE) - 1.0);
+
+    CqtKernel* kern = (CqtKernel*)calloc(1, sizeof(CqtKernel));
+    float*     tr   = (float*)malloc(N * sizeof(float));
+    float*     ti   = (float*)malloc(N * sizeof(float));
+    if (!plan || !kern || !tr || !ti) { free(kern); free(tr); free(ti); return nullptr; }
+    kern->sample_rate = sr;
+    kern->n           = N;
+
+    int total = 0, cap = 0;
+    for (int k = 0; k < CQT_BINS; k++) {
+        double f = cqt_bin_freq((float)k);
+        kern->off[k] = total;
+        if (f >= 0.45 * sr) continue;
+
+        // Temporal kernel: Hann-windowed e^(i 2 pi f t), centred in the frame
+        // and scaled so a unit sine at f gives magnitude 1.
+        int nk = (int)ceil(Q * sr / f);
+        if (nk > N) nk = N;
+        int start = (N - nk) / 2;
+        memset(tr, 0, N * sizeof(float));
+        memset(ti, 0, N * sizeof(float));
+        double wsum = 0.0;
+        for (int n = 0; n < nk; n++) wsum += 0.5 - 0.5 * cos(2.0 * M_PI * (n + 0.5) / nk);
+        for (int n = 0; n < nk; n++) {
+            double w  = (0.5 - 0.5 * cos(2.0 * M_PI * (n + 0.5) / nk)) * 2.0 / wsum;
+            double ph = 2.0 * M_PI * f * (n - 0.5 * nk) / sr;
+            tr[start + n] = (float)(w * cos(ph));
+            ti[start + n] = (float)(w * sin(ph));
+        }
+        fft_complex(plan, tr, ti);
+
+        // Keep the run of positive-frequency bins above the cut-off; the
+        // kernel is analytic, so its negative frequencies are negligible.
+        float peak = 0.0f;
+        for (int j = 0; j < nbins; j++) {
+            float m = tr[j] * tr[j] + ti[j] * ti[j];
+            if (m > peak) peak = m;
+        }
+        float thresh = peak * CQT_SPARSITY * CQT_SPARSITY;
+        int a = 0, z = nbins - 1;
+        while (a < z && tr[a] * tr[a] + ti[a] * ti[a] < thresh) a++;
+        while (z > a && tr[z] * tr[z] + ti[z] * ti[z] < thresh) z--;
+        int len = (z - a + 1 + 3) & ~3;
+        if (a + len > nbins) a = nbins - len;
+
+        if (total + len > cap) {
+            cap = (total + len) * 2;
+            float* re = (float*)realloc(kern->re, (size_t)cap * sizeof(float));
+            if (re) kern->re = re;
+            float* im = (float*)realloc(kern->im, (size_t)cap * sizeof(float));
+            if (im) kern->im = im;
+            if (!re || !im) {
+                free(kern->re); free(kern->im); free(kern); free(tr); free(ti);
+                return nullptr;
+            }
+        }
+        // Spectral kernel conj(T[j]) / N: the CQT value is then sum X[j] * S[j].
+        const float inv_n = 1.0f / N;
+        for (int j = 0; j < len; j++) {
+            kern->re[total + j] =  tr[a + j] * inv_n;
+            kern->im[total + j] = -ti[a + j] * inv_n;
+        }
+        kern->lo[k]  = a;
+        kern->len[k] = len;
+        total += len;
+    }
+    free(tr); free(ti);
+    return kern;
+}
+
+const CqtKernel* cqt_kernel(uint32_t sample_rate)
+{
+    if (sample_rate == 0) return nullptr;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (CqtKernel* k = s_kernels; k; k = k->next)
+        if (k->sample_rate == sample_rate) return k;
+
+    CqtKernel* k = kernel_build(sample_rate);
+    if (!k) return nullptr;
+    k->next   = s_kernels;
+    s_kernels = k;
+    return k;
+}
+
+// ---------------------------------------------------------------------------
+// Kernel application: |sum_j X[j] * S[j]| for every bin.
+// ---------------------------------------------------------------------------
+static void apply_scalar(const CqtKernel* kern, const float* xr, const float* xi, float* out)
+{
+    for (int k = 0; k < CQT_BINS; k++) {
+        const float* sr = kern->re + kern->off[k];
+        const float* si = kern->im + kern->off[k];
+        const float* ar = xr + kern->lo[k];
+        const float* ai = xi + kern->lo[k];
+        float re = 0.0f, im = 0.0f;
+        for (int j = 0; j < kern->len[k]; j++) {
+            re += ar[j] * sr[j] - ai[j] * si[j];
+            im += ar[j] * si[j] + ai[j] * sr[j];
+        }
+        out[k] = sqrtf(re * re + im * im);
+    }
+}
+
+static void apply_f4(const CqtKernel* kern, const float* xr, const float* xi, float* out)
+{
+    for (int k = 0; k < CQT_BINS; k++) {
+        const float* sr = kern->re + kern->off[k];
+        const float* si = kern->im + kern->off[k];
+        const float* ar = xr + kern->lo[k];
+        const float* ai = xi + kern->lo[k];
+        f4 re = f4_set1(0.0f), im = f4_set1(0.0f);
+        for (int j = 0; j < kern->len[k]; j += 4) {
+            f4 a = f4_load(ar + j), b = f4_load(ai + j);
+            f4 c = f4_load(sr + j), d = f4_load(si + j);
+            re = f4_nmadd(b, d, f4_madd(a, c, re));
+            im = f4_madd(b, c, f4_madd(a, d, im));
+        }
+        float r = f4_hsum(re), i = f4_hsum(im);
+        out[k] = sqrtf(r * r + i * i);
+    }
+}
+
+void cqt_frames(const CqtKernel* kern, const float* pcm, uint64_t frame_count,
+                uint32_t ch, int64_t origin, int hop, int64_t k0, int64_t k1,
+                float* out)
+{
+    if (!kern || !pcm || ch == 0 || hop <= 0 || k1 <= k0) return;
+    const int      N     = kern->n;
+    const FftPlan* plan  = fft_plan(N);
+    const int      nbins = N / 2 + 1;
+    float* frame = (float*)malloc(N * sizeof(float));
+    float* xr    = (float*)malloc(nbins * sizeof(float));
+    float* xi    = (float*)malloc(nbins * sizeof(float));
+    if (!frame || !xr || !xi) { free(frame); free(xr); free(xi); return; }
+
+    const bool  scalar = simd_level() == SIMD_SCALAR;
+    const float inv_ch = 1.0f / (float)ch;
+    for (int64_t f = k0; f < k1; f++) {
+        // Samples [a, z) of the frame lie inside the track.
+        int64_t s0 = origin + f * hop;
+        int64_t a  = s0 < 0 ? -s0 : 0;
+        int64_t z  = (int64_t)frame_count - s0;
+        if (z > N) z = N;
+        if (z < a)     z = a;
+        for (int64_t i = 0; i < a; i++) frame[i] = 0.0f;
+        if (ch == 1) {
+            for (int64_t i = a; i < z; i++) frame[i] = pcm[s0 + i];
+        } else {
+            for (int64_t i = a; i < z; i++) {
+                const float* src = pcm + (uint64_t)(s0 + i) * ch;
+                float s = 0.0f;
+                for (uint32_t c = 0; c < ch; c++) s += src[c];
+                frame[i] = s * inv_ch;
+            }
+        }
+        for (int64_t i = z; i < N; i++) frame[i] = 0.0f;
+        fft_real(plan, frame, xr, xi);
+
+        float* dst = out + (f - k0) * CQT_BINS;
+        if (scalar) apply_scalar(kern, xr, xi, dst);
+        else        apply_f4(kern, xr, xi, dst);
+    }
+    free(frame); free(xr); free(xi);
+}
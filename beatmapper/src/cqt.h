@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+
+// ---------------------------------------------------------------------------
+// Constant-Q transform (Brown & Puckette's sparse spectral kernel).
+//
+// Bin k sits at CQT_FMIN * 2^(k / CQT_BINS_PER_OCTAVE) and is analysed with a
+// Hann-windowed complex exponential Q cycles long, so every bin has the same
+// resolution in cents: low notes get long windows, high notes short ones.
+//
+// All CQT_BINS kernels are centred in one frame of CQT_FRAME_SEC (32768
+// samples at 44.1 kHz, rounded to a power of two at other rates) and
+// transformed once per sample rate.  In the frequency domain each kernel is a narrow band
+// around its own frequency; everything below CQT_SPARSITY of its peak is
+// dropped, leaving a short run of coefficients per bin.  A frame of the
+// transform is then one real FFT of the audio followed by a complex dot
+// product per bin over its run -- the FFT dominates, the kernels are cheap.
+//
+// Kernels longer than the frame (the lowest few bins) are clamped to it,
+// which widens those bins slightly.  Bins at or above 0.45 *
+// sample rate are left empty.
+// ---------------------------------------------------------------------------
+
+static const int   CQT_BINS_PER_OCTAVE = 36;       // three bins per semitone
+static const int   CQT_OCTAVES         = 7;
+static const int   CQT_BINS            = CQT_BINS_PER_OCTAVE * CQT_OCTAVES;
+static const float CQT_FMIN            = 65.406f;  // C2; bin 0 is exactly C2
+static const double CQT_FRAME_SEC      = 0.74304;  // frame length (FFT size)
+static const float CQT_SPARSITY        = 0.005f;   // kernel cut-off, fraction of peak
+
+struct CqtKernel;
+
+// Sparse kernel for a sample rate, built on first request and cached for the
+// life of the process.  Safe to call from any thread.  nullptr if memory ran
+// out.
+const CqtKernel* cqt_kernel(uint32_t sample_rate);
+
+// Frame length in samples at the kernel's rate.
+int cqt_frame_len(const CqtKernel* kern);
+
+// Centre frequency of (fractional) bin k.
+float cqt_bin_freq(float k);
+
+// Magnitudes of frames [k0, k1) of interleaved PCM (channels are averaged).
+// Frame k covers samples [origin + k * hop, origin + k * hop + frame len); parts
+// of a frame outside the track are zero.  Writes (k1 - k0) * CQT_BINS floats
+// to out, frame after frame, bin 0 first.  A full-scale sine centred on a bin
+// reads about 1.0 there.
+void cqt_frames(const CqtKernel* kern, const float* pcm, uint64_t frame_count,
+                uint32_t channels, int64_t origin, int hop, int64_t k0, int64_t k1,
+                float* out);
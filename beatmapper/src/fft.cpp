@@ -0,0 +1,375 @@
+#include "fft.h"
+#include "simd.h"
+#include <math.h>
+#include <stdlib.h>
+#include <atomic>
+
+// ---------------------------------------------------------------------------
+// Plan cache: one slot per power of two.  A plan is immutable once published,
+// so readers need nothing beyond an acquire load.  Two threads racing to build
+// the same size both build it; the loser frees its copy.
+// ---------------------------------------------------------------------------
+static std::atomic<FftPlan*> s_plans[FFT_MAX_LOG2 + 1];
+
+static FftPlan* plan_build(int n, int log2n)
+{
+    FftPlan* p = (FftPlan*)calloc(1, sizeof(FftPlan));
+    if (!p) return nullptr;
+    p->n      = n;
+    p->log2n  = log2n;
+    p->swap   = (int*)  malloc((size_t)n * sizeof(int));   // < n/2 pairs
+    p->tw_re  = (float*)malloc((size_t)n * sizeof(float));
+    p->tw_im  = (float*)malloc((size_t)n * sizeof(float));
+    if (!p->swap || !p->tw_re || !p->tw_im) {
+        free(p->swap); free(p->tw_re); free(p->tw_im); free(p);
+        return nullptr;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int r = 0;
+        for (int b = 0; b < log2n; b++)
+            if (i & (1 << b)) r |= 1 << (log2n - 1 - b);
+        if (i < r) {
+            p->swap[2 * p->nswap]     = i;
+            p->swap[2 * p->nswap + 1] = r;
+            p->nswap++;
+        }
+    }
+
+    // Evaluated directly in double rather than by the rotating recurrence the
+    // old per-call code used, so late stages carry no accumulated error.
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len >> 1;
+        for (int j = 0; j < half; j++) {
+            double ang = -2.0 * M_PI * (double)j / (double)len;
+            p->tw_re[half - 1 + j] = (float)cos(ang);
+            p->tw_im[half - 1 + j] = (float)sin(ang);
+        }
+    }
+    return p;
+}
+
+const FftPlan* fft_plan(int n)
+{
+    if (n < 2 || (n & (n - 1)) != 0) return nullptr;
+    int log2n = 0;
+    while ((1 << log2n) < n) log2n++;
+    if (log2n > FFT_MAX_LOG2) return nullptr;
+
+    FftPlan* p = s_plans[log2n].load(std::memory_order_acquire);
+    if (p) return p;
+
+    FftPlan* fresh = plan_build(n, log2n);
+    if (!fresh) return nullptr;
+    fresh->half = (n >= 4) ? fft_plan(n >> 1) : nullptr;
+
+    FftPlan* expected = nullptr;
+    if (!s_plans[log2n].compare_exchange_strong(expected, fresh,
+                                                std::memory_order_acq_rel)) {
+        free(fresh->swap); free(fresh->tw_re); free(fresh->tw_im); free(fresh);
+        return expected;
+    }
+    return fresh;
+}
+
+// ---------------------------------------------------------------------------
+// Scalar reference: iterative radix-2 decimation-in-time butterflies over
+// bit-reversed input.  Also used for sizes too small to fill a vector.
+// ---------------------------------------------------------------------------
+static void bit_reverse(const FftPlan* p, float* re, float* im)
+{
+    const int* sw = p->swap;
+    for (int q = 0; q < p->nswap; q++) {
+        int i = sw[2 * q], j = sw[2 * q + 1];
+        float t;
+        t = re[i]; re[i] = re[j]; re[j] = t;
+        t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+}
+
+static void complex_scalar(const FftPlan* p, float* re, float* im)
+{
+    const int n = p->n;
+    bit_reverse(p, re, im);
+
+    for (int len = 2; len <= n; len <<= 1) {
+        const int    half = len >> 1;
+        const float* wr   = p->tw_re + half - 1;
+        const float* wi   = p->tw_im + half - 1;
+        for (int i = 0; i < n; i += len) {
+            float* lo_r = re + i;         float* lo_i = im + i;
+            float* hi_r = re + i + half;  float* hi_i = im + i + half;
+            for (int j = 0; j < half; j++) {
+                float vr = hi_r[j] * wr[j] - hi_i[j] * wi[j];
+                float vi = hi_r[j] * wi[j] + hi_i[j] * wr[j];
+                float ur = lo_r[j], ui = lo_i[j];
+                lo_r[j] = ur + vr;  lo_i[j] = ui + vi;
+                hi_r[j] = ur - vr;  hi_i[j] = ui - vi;
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Vector path.  After bit reversal the first two stages (twiddles 1 and -i)
+// run as one scalar radix-4 pass.  The rest run as radix-4 passes that fuse
+// stage h (butterfly span h) with stage 2h, so each pass reads and writes
+// the data once for two stages:
+//
+//   block of 4h:   a = x[j]   b = x[j+h]   c = x[j+2h]   d = x[j+3h]
+//   stage h:       a, b = a +- w1 b        c, d = c +- w1 d        w1 = W_2h^j
+//   stage 2h:      a, c = a +- w2 c        b, d = b +- w3 d        w2 = W_4h^j
+//                                                                  w3 = W_4h^(j+h)
+//
+// All three twiddles come straight from the plan's per-stage tables.  Vectors
+// run along j, which needs h >= lane count; a leftover odd stage runs as a
+// plain radix-2 pass.
+// ---------------------------------------------------------------------------
+static void first_radix4(float* re, float* im, int n)
+{
+    for (int i = 0; i < n; i += 4) {
+        float ar = re[i] + re[i+1], ai = im[i] + im[i+1];
+        float br = re[i] - re[i+1], bi = im[i] - im[i+1];
+        float cr = re[i+2] + re[i+3], ci = im[i+2] + im[i+3];
+        float dr = re[i+2] - re[i+3], di = im[i+2] - im[i+3];
+        re[i]   = ar + cr;  im[i]   = ai + ci;
+        re[i+2] = ar - cr;  im[i+2] = ai - ci;
+        re[i+1] = br + di;  im[i+1] = bi - dr;   // b + (-i) d
+        re[i+3] = br - di;  im[i+3] = bi + dr;
+    }
+}
+
+// (xr + i xi) * (wr + i wi)
+static inline void cmul4(f4 xr, f4 xi, f4 wr, f4 wi, f4* yr, f4* yi)
+{
+    *yr = f4_sub(f4_mul(xr, wr), f4_mul(xi, wi));
+    *yi = f4_add(f4_mul(xr, wi), f4_mul(xi, wr));
+}
+
+static void radix4_f4(const FftPlan* p, float* re, float* im, int h)
+{
+    const int    n   = p->n;
+    const float* w1r = p->tw_re + h - 1;      const float* w1i = p->tw_im + h - 1;
+    const float* w2r = p->tw_re + 2 * h - 1;  const float* w2i = p->tw_im + 2 * h - 1;
+    const float* w3r = w2r + h;               const float* w3i = w2i + h;
+
+    for (int i = 0; i < n; i += 4 * h) {
+        float* r = re + i;
+        float* m = im + i;
+        for (int j = 0; j < h; j += 4) {
+            f4 ar = f4_load(r + j),         ai = f4_load(m + j);
+            f4 br = f4_load(r + j + h),     bi = f4_load(m + j + h);
+            f4 cr = f4_load(r + j + 2 * h), ci = f4_load(m + j + 2 * h);
+            f4 dr = f4_load(r + j + 3 * h), di = f4_load(m + j + 3 * h);
+            f4 wr = f4_load(w1r + j),       wi = f4_load(w1i + j);
+            f4 tr, ti;
+
+            cmul4(br, bi, wr, wi, &tr, &ti);
+            br = f4_sub(ar, tr);  bi = f4_sub(ai, ti);
+            ar = f4_add(ar, tr);  ai = f4_add(ai, ti);
+            cmul4(dr, di, wr, wi, &tr, &ti);
+            dr = f4_sub(cr, tr);  di = f4_sub(ci, ti);
+            cr = f4_add(cr, tr);  ci = f4_add(ci, ti);
+
+            cmul4(cr, ci, f4_load(w2r + j), f4_load(w2i + j), &tr, &ti);
+            f4_store(r + j,         f4_add(ar, tr));  f4_store(m + j,         f4_add(ai, ti));
+            f4_store(r + j + 2 * h, f4_sub(ar, tr));  f4_store(m + j + 2 * h, f4_sub(ai, ti));
+            cmul4(dr, di, f4_load(w3r + j), f4_load(w3i + j), &tr, &ti);
+            f4_store(r + j + h,     f4_add(br, tr));  f4_store(m + j + h,     f4_add(bi, ti));
+            f4_store(r + j + 3 * h, f4_sub(br, tr));  f4_store(m + j + 3 * h, f4_sub(bi, ti));
+        }
+    }
+}
+
+static void radix2_f4(const FftPlan* p, float* re, float* im, int h)
+{
+    const int    n  = p->n;
+    const float* wr = p->tw_re + h - 1;
+    const float* wi = p->tw_im + h - 1;
+    for (int i = 0; i < n; i += 2 * h) {
+        float* r = re + i;
+        float* m = im + i;
+        for (int j = 0; j < h; j += 4) {
+            f4 ar = f4_load(r + j),     ai = f4_load(m + j);
+            f4 br = f4_load(r + j + h), bi = f4_load(m + j + h);
+            f4 tr, ti;
+            cmul4(br, bi, f4_load(wr + j), f4_load(wi + j), &tr, &ti);
+            f4_store(r + j,     f4_add(ar, tr));  f4_store(m + j,     f4_add(ai, ti));
+            f4_store(r + j + h, f4_sub(ar, tr));  f4_store(m + j + h, f4_sub(ai, ti));
+        }
+    }
+}
+
+#if SIMD_HAVE_AVX2
+SIMD_AVX2_FN static inline void cmul8(__m256 xr, __m256 xi, __m256 wr, __m256 wi,
+                                      __m256* yr, __m256* yi)
+{
+    *yr = _mm256_fmsub_ps(xr, wr, _mm256_mul_ps(xi, wi));
+    *yi = _mm256_fmadd_ps(xr, wi, _mm256_mul_ps(xi, wr));
+}
+
+SIMD_AVX2_FN static void radix4_avx2(const FftPlan* p, float* re, float* im, int h)
+{
+    const int    n   = p->n;
+    const float* w1r = p->tw_re + h - 1;      const float* w1i = p->tw_im + h - 1;
+    const float* w2r = p->tw_re + 2 * h - 1;  const float* w2i = p->tw_im + 2 * h - 1;
+    const float* w3r = w2r + h;               const float* w3i = w2i + h;
+
+    for (int i = 0; i < n; i += 4 * h) {
+        float* r = re + i;
+        float* m = im + i;
+        for (int j = 0; j < h; j += 8) {
+            __m256 ar = _mm256_loadu_ps(r + j),         ai = _mm256_loadu_ps(m + j);
+            __m256 br = _mm256_loadu_ps(r + j + h),     bi = _mm256_loadu_ps(m + j + h);
+            __m256 cr = _mm256_loadu_ps(r + j + 2 * h), ci = _mm256_loadu_ps(m + j + 2 * h);
+            __m256 dr = _mm256_loadu_ps(r + j + 3 * h), di = _mm256_loadu_ps(m + j + 3 * h);
+            __m256 wr = _mm256_loadu_ps(w1r + j),       wi = _mm256_loadu_ps(w1i + j);
+            __m256 tr, ti;
+
+            cmul8(br, bi, wr, wi, &tr, &ti);
+            br = _mm256_sub_ps(ar, tr);  bi = _mm256_sub_ps(ai, ti);
+            ar = _mm256_add_ps(ar, tr);  ai = _mm256_add_ps(ai, ti);
+            cmul8(dr, di, wr, wi, &tr, &ti);
+            dr = _mm256_sub_ps(cr, tr);  di = _mm256_sub_ps(ci, ti);
+            cr = _mm256_add_ps(cr, tr);  ci = _mm256_add_ps(ci, ti);
+
+            cmul8(cr, ci, _mm256_loadu_ps(w2r + j), _mm256_loadu_ps(w2i + j), &tr, &ti);
+            _mm256_storeu_ps(r + j,         _mm256_add_ps(ar, tr));
+            _mm256_storeu_ps(m + j,         _mm256_add_ps(ai, ti));
+            _mm256_storeu_ps(r + j + 2 * h, _mm256_sub_ps(ar, tr));
+            _mm256_storeu_ps(m + j + 2 * h, _mm256_sub_ps(ai, ti));
+            cmul8(dr, di, _mm256_loadu_ps(w3r + j), _mm256_loadu_ps(w3i + j), &tr, &ti);
+            _mm256_storeu_ps(r + j + h,     _mm256_add_ps(br, tr));
+            _mm256_storeu_ps(m + j + h,     _mm256_add_ps(bi, ti));
+            _mm256_storeu_ps(r + j + 3 * h, _mm256_sub_ps(br, tr));
+            _mm256_storeu_ps(m + j + 3 * h, _mm256_sub_ps(bi, ti));
+        }
+    }
+}
+
+SIMD_AVX2_FN static void radix2_avx2(const FftPlan* p, float* re, float* im, int h)
+{
+    const int    n  = p->n;
+    const float* wr = p->tw_re + h - 1;
+    const float* wi = p->tw_im + h - 1;
+    for (int i = 0; i < n; i += 2 * h) {
+        float* r = re + i;
+        float* m = im + i;
+        for (int j = 0; j < h; j += 8) {
+            __m256 ar = _mm256_loadu_ps(r + j),     ai = _mm256_loadu_ps(m + j);
+            __m256 br = _mm256_loadu_ps(r + j + h), bi = _mm256_loadu_ps(m + j + h);
+            __m256 tr, ti;
+            cmul8(br, bi, _mm256_loadu_ps(wr + j), _mm256_loadu_ps(wi + j), &tr, &ti);
+            _mm256_storeu_ps(r + j,     _mm256_add_ps(ar, tr));
+            _mm256_storeu_ps(m + j,     _mm256_add_ps(ai, ti));
+            _mm256_storeu_ps(r + j + h, _mm256_sub_ps(ar, tr));
+            _mm256_storeu_ps(m + j + h, _mm256_sub_ps(ai, ti));
+        }
+    }
+}
+#endif
+
+void fft_complex(const FftPlan* p, float* re, float* im)
+{
+    const int       n     = p->n;
+    const SimdLevel level = simd_level();
+    if (level == SIMD_SCALAR || n < 16) {
+        complex_scalar(p, re, im);
+        return;
+    }
+
+    bit_reverse(p, re, im);
+    first_radix4(re, im, n);
+
+    int h = 4;
+    for (; 4 * h <= n; h *= 4) {
+#if SIMD_HAVE_AVX2
+        if (level == SIMD_AVX2 && h >= 8) { radix4_avx2(p, re, im, h); continue; }
+#endif
+        radix4_f4(p, re, im, h);
+    }
+    if (2 * h == n) {
+#if SIMD_HAVE_AVX2
+        if (level == SIMD_AVX2 && h >= 8) { radix2_avx2(p, re, im, h); return; }
+#endif
+        radix2_f4(p, re, im, h);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Real-input transform via an n/2-point complex FFT.
+//
+// With z[k] = x[2k] + i x[2k+1] and Z = FFT_{n/2}(z), the spectrum of x is
+//
+//   X[k] = E[k] + W^k O[k],      W = e^(-2 pi i / n)
+//   E[k] = (Z[k] + conj Z[n/2-k]) / 2          (spectrum of the even samples)
+//   O[k] = (Z[k] - conj Z[n/2-k]) / 2i         (spectrum of the odd samples)
+//
+// and X[n/2-k] = conj(E[k] - W^k O[k]), so each pass of the unpack loop
+// produces a pair of bins from a pair of Z values.  That lets it run in place
+// in the output arrays.
+// ---------------------------------------------------------------------------
+void fft_real(const FftPlan* p, const float* in, float* out_re, float* out_im)
+{
+    const int m = p->n >> 1;
+
+    const bool vec = simd_level() != SIMD_SCALAR && m >= 16;
+
+    int k0 = 0;
+    if (vec) {
+        for (; k0 + 4 <= m; k0 += 4) {
+            f4 ev, od;
+            f4_deinterleave(in + 2 * k0, &ev, &od);
+            f4_store(out_re + k0, ev);
+            f4_store(out_im + k0, od);
+        }
+    }
+    for (int k = k0; k < m; k++) {
+        out_re[k] = in[2 * k];
+        out_im[k] = in[2 * k + 1];
+    }
+    fft_complex(p->half, out_re, out_im);
+
+    // Unpack twiddles W^k, k < n/2: the last stage of this plan's table.
+    const float* wr = p->tw_re + m - 1;
+    const float* wi = p->tw_im + m - 1;
+
+    // Vector pass: bins k..k+3 with their partners m-k-3..m-k, loaded and
+    // stored reversed.  Stops while both runs are still on their own side of
+    // m/2; the scalar loop below finishes the middle.
+    int k = 1;
+    if (vec) {
+        const f4 half = f4_set1(0.5f);
+        for (; k + 4 <= m / 2; k += 4) {
+            const int j = m - k - 3;
+            f4 ar = f4_load(out_re + k),          ai = f4_load(out_im + k);
+            f4 cr = f4_reverse(f4_load(out_re + j)), ci = f4_reverse(f4_load(out_im + j));
+            f4 er  = f4_mul(half, f4_add(ar, cr));
+            f4 ei  = f4_mul(half, f4_sub(ai, ci));
+            f4 orr = f4_mul(half, f4_add(ai, ci));
+            f4 oi  = f4_mul(half, f4_sub(cr, ar));
+            f4 w_r = f4_load(wr + k), w_i = f4_load(wi + k);
+            f4 tr  = f4_sub(f4_mul(w_r, orr), f4_mul(w_i, oi));
+            f4 ti  = f4_add(f4_mul(w_r, oi),  f4_mul(w_i, orr));
+            f4_store(out_re + k, f4_add(er, tr));
+            f4_store(out_im + k, f4_add(ei, ti));
+            f4_store(out_re + j, f4_reverse(f4_sub(er, tr)));
+            f4_store(out_im + j, f4_reverse(f4_sub(ti, ei)));
+        }
+    }
+    for (int j = m - k; k < j; k++, j--) {
+        float ar = out_re[k], ai = out_im[k];
+        float cr = out_re[j], ci = out_im[j];
+        float er = 0.5f * (ar + cr), ei = 0.5f * (ai - ci);   // E[k]
+        float orr = 0.5f * (ai + ci), oi = 0.5f * (cr - ar);  // O[k]
+        float tr = wr[k] * orr - wi[k] * oi;                  // W^k O[k]
+        float ti = wr[k] * oi  + wi[k] * orr;
+        out_re[k] = er + tr;   out_im[k] =   ei + ti;
+        out_re[j] = er - tr;   out_im[j] = -(ei - ti);
+    }
+    if (m >= 2) out_im[m / 2] = -out_im[m / 2];   // X[n/4] = conj Z[n/4]
+
+    float z0r = out_re[0], z0i = out_im[0];
+    out_re[0] = z0r + z0i;  out_im[0] = 0.0f;
+    out_re[m] = z0r - z0i;  out_im[m] = 0.0f;
+}
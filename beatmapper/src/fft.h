@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+
+// ---------------------------------------------------------------------------
+// Planned FFT shared by every analysis routine (spectrogram, spectral flux,
+// HPS / NNLS / peak chroma).
+//
+// A plan holds everything about a transform size that does not depend on the
+// data: the bit-reversal permutation and the twiddle factors of every stage.
+// Plans are built once per size on first use and live for the rest of the
+// process, so a transform costs the butterflies alone -- no cosf/sinf and no
+// permutation search per call.
+//
+// Real input goes through fft_real(): the N samples are packed into an N/2
+// point complex transform (even samples as real part, odd as imaginary) and
+// separated afterwards, which is about half the work of transforming them as
+// complex numbers with a zero imaginary part.
+//
+// Butterflies run as fused radix-4 passes vectorized with SSE2 / NEON, or
+// AVX2 + FMA when the CPU has it (see simd.h).  The scalar radix-2 loop is
+// kept as the reference; RIFFHOUND_SIMD=scalar forces it.
+// ---------------------------------------------------------------------------
+
+static const int FFT_MAX_LOG2 = 24;   // largest supported size is 2^24
+
+struct FftPlan {
+    int   n;          // transform size (power of two)
+    int   log2n;
+    // Bit-reversal permutation as a list of the (i, rev(i)) pairs with
+    // i < rev(i): nswap pairs, 2 * nswap ints.  Walking the pairs directly
+    // avoids a data-dependent branch per element.
+    int   nswap;
+    int*  swap;
+
+    // Twiddles e^(-2 pi i j / len) for every butterfly stage, stored stage
+    // after stage: stage len starts at offset len/2 - 1 and holds len/2
+    // entries, n - 1 in total.  The last stage (len = n) doubles as the
+    // unpack table for a real transform of size n.
+    float* tw_re;
+    float* tw_im;
+
+    const FftPlan* half;   // plan for n/2 (the core of fft_real); null if n < 4
+};
+
+// Plan for size n, which must be a power of two in [2, 2^FFT_MAX_LOG2].
+// Built on first request and cached for the life of the process; safe to call
+// from any thread.  Returns nullptr for an unsupported size.
+const FftPlan* fft_plan(int n);
+
+// In-place forward complex FFT of re[n], im[n] (unnormalised).
+void fft_complex(const FftPlan* p, float* re, float* im);
+
+// Forward FFT of n real samples in[n] (n >= 4).  Writes bins 0 .. n/2 to
+// out_re/out_im, which must each hold n/2 + 1 floats.  in[] is not modified.
+// Bin values are identical to fft_complex() on the same samples with a zero
+// imaginary part.
+void fft_real(const FftPlan* p, const float* in, float* out_re, float* out_im);
@@ -201,6 +201,8 @@ int main(int argc, char** argv) {
 
     audio_init(&audio);
     spectrogram_init(&spectro);
+    uint32_t shown_track    = 0;   // audio.track_id the view was last reset for
+    uint64_t spectro_frames = 0;   // audio.analysis_frames the spectrogram shows
     editor_init(&editor);
     beatmap_init(&beatmap);
     sectionmap_init(&sectionmap);
@@ -276,24 +278,34 @@ int main(int argc, char** argv) {
             audio_pause(&audio);
         }
 
-        // Recompute spectrogram whenever a new file is loaded.
-        // Detected by comparing the duration the spectrogram was last built for
-        // against the current audio duration.
-        if (audio.loaded && spectro.duration != audio.duration) {
-            float*   pcm     = nullptr;
-            uint64_t nframes = 0;
-            uint32_t sr      = 0;
-            if (audio_decode_pcm(audio.filename, &pcm, &nframes, &sr)) {
-                spectrogram_compute(&spectro, pcm, nframes, sr);
-                audio_free_pcm(pcm);
-            }
-            // Always update these so we don't retry endlessly on decode failure.
-            spectro.duration  = audio.duration;
+        // A new file resets the view; the spectrogram is recomputed whenever
+        // the analysed part of the track changes -- once for a new file, and
+        // a few more times while it is still decoding, so columns fill in
+        // left to right.
+        if (audio.loaded && shown_track != audio.track_id) {
+            shown_track       = audio.track_id;
+            spectro_frames    = 0;
+            spectrogram_shutdown(&spectro);   // the old track's, until the new one's is in
             editor.duration   = audio.duration;
             editor.view_start = 0.0;
             editor.view_end   = (audio.duration < 30.0) ? audio.duration : 30.0;
             editor_clamp_view(&editor);
         }
+        if (audio.loaded && editor.duration != audio.duration) {
+            // The decoder's estimate was replaced by the true length.
+            editor.duration = audio.duration;
+            editor_clamp_view(&editor);
+        }
+        if (audio.loaded && spectro_frames != audio.analysis_frames) {
+            uint64_t     nframes = 0;
+            uint32_t     nch     = 0;
+            uint32_t     sr      = 0;
+            const float* pcm     = audio_display_pcm(&audio, &nframes, &nch, &sr);
+            if (pcm)
+                spectrogram_compute(&spectro, pcm, nframes, nch, sr);
+            // Always update this so we don't retry endlessly on failure.
+            spectro_frames = audio.analysis_frames;
+        }
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -576,6 +588,7 @@ int main(int argc, char** argv) {
     lyricmap_shutdown(&lyricmap);
     sectionmap_shutdown(&sectionmap);
     beatmap_shutdown(&beatmap);
+    autobeat_shutdown(&autobeat);
     audio_shutdown(&audio);
     spectrogram_shutdown(&spectro);
 
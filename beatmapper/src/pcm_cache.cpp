@@ -0,0 +1,247 @@
+#include "pcm_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <atomic>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
+#define ST_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define ST_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+// ---------------------------------------------------------------------------
+// File layout: one header page, then frames * channels samples.
+// ---------------------------------------------------------------------------
+static const char     CACHE_MAGIC[8] = {'R', 'H', 'P', 'C', 'M', '0', '1', '\n'};
+static const uint32_t DATA_OFFSET    = 4096;
+
+struct CacheHeader {
+    char     magic[8];
+    uint32_t data_offset;
+    uint32_t channels;
+    uint32_t sample_rate;
+    uint32_t format;            // PcmFormat
+    uint64_t frames;
+    uint64_t src_size;          // source identity at decode time
+    int64_t  src_mtime_sec;
+    int64_t  src_mtime_nsec;
+    char     decoder[32];
+    char     path[4000];        // canonical source path, NUL-terminated
+};
+static_assert(sizeof(CacheHeader) <= DATA_OFFSET, "header must fit its page");
+
+// Where the cache lives, created on first use; false if disabled.
+static bool cache_dir(char* out, size_t out_size)
+{
+    const char* env = getenv("RIFFHOUND_PCM_CACHE");
+    if (env && strcmp(env, "off") == 0) return false;
+    if (env && *env) {
+        snprintf(out, out_size, "%s", env);
+    } else {
+        const char* home = getenv("HOME");
+        if (!home) return false;
+        snprintf(out, out_size, "%s/.riffhound_pcm", home);
+    }
+    mkdir(out, 0755);   // EEXIST is the usual outcome
+    return true;
+}
+
+static uint64_t cache_budget()
+{
+    const char* env = getenv("RIFFHOUND_PCM_CACHE_MB");
+    long mb = env ? atol(env) : 0;
+    return mb > 0 ? (uint64_t)mb << 20 : PCM_CACHE_BUDGET;
+}
+
+// The header fields that identify the source: canonical path plus the size
+// and modification time it has now.  False if the file cannot be stat'ed or
+// its path is too long to record.
+static bool source_identity(const char* path, const char* decoder, CacheHeader* h)
+{
+    char real[PATH_MAX];
+    struct stat st;
+    if (!realpath(path, real) || stat(real, &st) != 0) return false;
+    if (strlen(real) >= sizeof(h->path) || strlen(decoder) >= sizeof(h->decoder))
+        return false;
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, CACHE_MAGIC, sizeof(h->magic));
+    h->data_offset    = DATA_OFFSET;
+    h->src_size       = (uint64_t)st.st_size;
+    h->src_mtime_sec  = (int64_t)st.st_mtime;
+    h->src_mtime_nsec = (int64_t)ST_MTIME_NSEC(st);
+    strcpy(h->decoder, decoder);
+    strcpy(h->path, real);
+    return true;
+}
+
+// FNV-1a over s including its terminator, so ("ab", "c") and ("a", "bc")
+// hash differently.
+static uint64_t fnv1a(uint64_t x, const char* s)
+{
+    for (;; s++) {
+        x ^= (uint8_t)*s;
+        x *= 1099511628211ull;
+        if (!*s) return x;
+    }
+}
+
+// <dir>/<hash of decoder and path>.pcm
+static void cache_file(const char* dir, const CacheHeader* h, char* out, size_t out_size)
+{
+    uint64_t x = fnv1a(fnv1a(1469598103934665603ull, h->decoder), h->path);
+    snprintf(out, out_size, "%s/%016llx.pcm", dir, (unsigned long long)x);
+}
+
+bool pcm_cache_open(const char* path, const char* decoder, PcmMap* m)
+{
+    memset(m, 0, sizeof(*m));
+    char dir[PATH_MAX], file[PATH_MAX + 32];
+    CacheHeader want;
+    if (!cache_dir(dir, sizeof(dir)) || !source_identity(path, decoder, &want)) return false;
+    cache_file(dir, &want, file, sizeof(file));
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)DATA_OFFSET) { close(fd); return false; }
+    size_t size = (size_t)st.st_size;
+    void*  base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) { close(fd); return false; }
+
+    const CacheHeader* h = (const CacheHeader*)base;
+    bool ok = memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) == 0 &&
+              h->data_offset == DATA_OFFSET &&
+              h->src_size == want.src_size &&
+              h->src_mtime_sec == want.src_mtime_sec &&
+              h->src_mtime_nsec == want.src_mtime_nsec &&
+              strcmp(h->decoder, want.decoder) == 0 &&
+              strcmp(h->path, want.path) == 0 &&
+              (h->format == PCM_F32 || h->format == PCM_S16) &&
+              h->channels > 0 && h->sample_rate > 0 && h->frames > 0 &&
+              h->frames <= (size - DATA_OFFSET) /
+                           (pcm_format_bytes((PcmFormat)h->format) * h->channels);
+    if (!ok) { munmap(base, size); close(fd); return false; }
+
+    futimens(fd, nullptr);   // recently used: last to be pruned
+    close(fd);
+
+    m->data        = (const char*)base + DATA_OFFSET;
+    m->format      = (PcmFormat)h->format;
+    m->frames      = h->frames;
+    m->channels    = h->channels;
+    m->sample_rate = h->sample_rate;
+    m->base        = base;
+    m->size        = size;
+    return true;
+}
+
+void pcm_cache_close(PcmMap* m)
+{
+    if (m->base) munmap(m->base, m->size);
+    memset(m, 0, sizeof(*m));
+}
+
+// ---------------------------------------------------------------------------
+// Pruning: drop the least recently opened files until the directory is back
+// under budget.  Opening a file bumps its mtime, so mtime order is use order.
+// The file just written is kept even if it alone is over budget.
+// ---------------------------------------------------------------------------
+struct CacheEntry {
+    char     name[32];
+    uint64_t size;
+    int64_t  mtime;
+};
+
+static int cmp_mtime(const void* a, const void* b)
+{
+    int64_t x = ((const CacheEntry*)a)->mtime, y = ((const CacheEntry*)b)->mtime;
+    return (x > y) - (x < y);
+}
+
+static void prune(const char* dir, const char* keep)
+{
+    DIR* d = opendir(dir);
+    if (!d) return;
+    CacheEntry* list  = nullptr;
+    int         count = 0, cap = 0;
+    uint64_t    total = 0;
+    char        file[PATH_MAX + 64];
+    while (struct dirent* de = readdir(d)) {
+        size_t len = strlen(de->d_name);
+        if (len < 5 || len >= sizeof(list->name) || strcmp(de->d_name + len - 4, ".pcm") != 0)
+            continue;
+        snprintf(file, sizeof(file), "%s/%s", dir, de->d_name);
+        struct stat st;
+        if (stat(file, &st) != 0) continue;
+        if (strcmp(file, keep) == 0) { total += (uint64_t)st.st_size; continue; }
+        if (count == cap) {
+            int         ncap = cap ? cap * 2 : 64;
+            CacheEntry* nl   = (CacheEntry*)realloc(list, ncap * sizeof(CacheEntry));
+            if (!nl) break;
+            list = nl; cap = ncap;
+        }
+        CacheEntry& e = list[count++];
+        strcpy(e.name, de->d_name);
+        e.size  = (uint64_t)st.st_size;
+        e.mtime = (int64_t)st.st_mtime;
+        total  += e.size;
+    }
+    closedir(d);
+
+    const uint64_t budget = cache_budget();
+    if (total > budget) {
+        qsort(list, count, sizeof(CacheEntry), cmp_mtime);
+        // Unlinking a file another process has mapped is safe: the mapping
+        // keeps the data until it is closed.
+        for (int i = 0; i < count && total > budget; i++) {
+            snprintf(file, sizeof(file), "%s/%s", dir, list[i].name);
+            if (unlink(file) == 0) total -= list[i].size;
+        }
+    }
+    free(list);
+}
+
+bool pcm_cache_store(const char* path, const char* decoder,
+                     const void* data, PcmFormat format, uint64_t frames,
+                     uint32_t channels, uint32_t sample_rate)
+{
+    char dir[PATH_MAX], file[PATH_MAX + 32], tmp[PATH_MAX + 64];
+    if (!data || frames == 0 || channels == 0) return false;
+    if (!cache_dir(dir, sizeof(dir))) return false;
+
+    char* head = (char*)calloc(1, DATA_OFFSET);
+    if (!head) return false;
+    CacheHeader* h = (CacheHeader*)head;
+    if (!source_identity(path, decoder, h)) { free(head); return false; }
+    h->format      = (uint32_t)format;
+    h->channels    = channels;
+    h->sample_rate = sample_rate;
+    h->frames      = frames;
+    cache_file(dir, h, file, sizeof(file));
+
+    // Unique per process and per call, so concurrent writers never share a
+    // temporary; whichever rename lands last wins, and both are complete.
+    static std::atomic<unsigned> s_seq{0};
+    snprintf(tmp, sizeof(tmp), "%s.%d.%u.tmp", file, (int)getpid(), s_seq.fetch_add(1));
+
+    FILE* f = fopen(tmp, "wb");
+    if (!f) { free(head); return false; }
+    const size_t n  = (size_t)frames * channels;
+    const size_t sz = pcm_format_bytes(format);
+    bool         ok = fwrite(head, 1, DATA_OFFSET, f) == DATA_OFFSET &&
+                      fwrite(data, sz, n, f) == n;
+    ok = (fclose(f) == 0) && ok;
+    free(head);
+    if (!ok || rename(tmp, file) != 0) { unlink(tmp); return false; }
+
+    prune(dir, file);
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "pcm_format.h"
+
+// ---------------------------------------------------------------------------
+// On-disk cache of decoded PCM, shared by the GUI and riffdsp.
+//
+// Decoding a track costs far more than reading it back: a cached track is
+// memory-mapped read-only, so reopening it is nearly free, concurrent
+// processes (the GUI and any number of riffdsp runs) share the same page
+// cache, and a track longer than RAM is simply paged in as it is read.
+//
+// One file per (source path, decoder) in the cache directory, named by a hash
+// of the two.  The header records the source's size and modification time;
+// a file whose source has changed since is a miss and gets rewritten.  The
+// decoder tag distinguishes outputs that differ for the same source (miniaudio
+// decodes at the native rate, riffdsp's ffmpeg fallback resamples to 44.1 kHz).
+//
+// Directory: $RIFFHOUND_PCM_CACHE, else $HOME/.riffhound_pcm; set the
+// variable to "off" to disable caching.  Files are written whole to a
+// temporary name and renamed into place, so a reader never sees a partial
+// file.  The least recently used files are removed once the directory holds
+// more than PCM_CACHE_BUDGET bytes ($RIFFHOUND_PCM_CACHE_MB overrides).
+//
+// The data is interleaved samples in the format they were stored in (f32 or
+// s16, pcm_format.h), page-aligned in the file.
+// ---------------------------------------------------------------------------
+
+static const uint64_t PCM_CACHE_BUDGET = (uint64_t)4 << 30;   // bytes
+
+struct PcmMap {
+    const void*  data;          // interleaved, channels samples per frame
+    PcmFormat    format;
+    uint64_t     frames;
+    uint32_t     channels;
+    uint32_t     sample_rate;
+    void*        base;          // the mapping; nullptr when closed
+    size_t       size;
+};
+
+// Map the cached decode of path by decoder, if there is an up-to-date one.
+// Returns false on a miss (or with caching disabled).
+bool pcm_cache_open(const char* path, const char* decoder, PcmMap* m);
+
+void pcm_cache_close(PcmMap* m);
+
+// Write a decode of path to the cache, replacing any older one.  Failure is
+// not an error for the caller -- the next open just misses -- so it only
+// returns whether the file was written.
+bool pcm_cache_store(const char* path, const char* decoder,
+                     const void* data, PcmFormat format, uint64_t frames,
+                     uint32_t channels, uint32_t sample_rate);
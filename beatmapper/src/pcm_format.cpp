@@ -0,0 +1,156 @@
+#include "pcm_format.h"
+#include "simd.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const float S16_SCALE     = 32768.0f;
+static const float S16_INV_SCALE = 1.0f / 32768.0f;   // exact: a power of two
+
+PcmFormat pcm_format_default()
+{
+    const char* f = getenv("RIFFHOUND_PCM_FORMAT");
+    return (f && strcmp(f, "s16") == 0) ? PCM_S16 : PCM_F32;
+}
+
+// ---------------------------------------------------------------------------
+// Scalar reference.  lrintf rounds in the current mode, nearest-even by
+// default, like the vector conversions below.  Clamping in float first keeps
+// the conversion in range, so it saturates instead of wrapping.
+// ---------------------------------------------------------------------------
+static void s16_to_f32_scalar(const int16_t* in, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) out[i] = (float)in[i] * S16_INV_SCALE;
+}
+
+static void f32_to_s16_scalar(const float* in, int16_t* out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        float x = in[i] * S16_SCALE;
+        if (x < -32768.0f) x = -32768.0f;
+        if (x >  32767.0f) x =  32767.0f;
+        out[i] = (int16_t)lrintf(x);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// 8 samples at a time: SSE2 or NEON.
+// ---------------------------------------------------------------------------
+#if SIMD_F4_SSE2
+static void s16_to_f32_f4(const int16_t* in, float* out, size_t n)
+{
+    const __m128 k = _mm_set1_ps(S16_INV_SCALE);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v  = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);   // sign-extend
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), k));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), k));
+    }
+    s16_to_f32_scalar(in + i, out + i, n - i);
+}
+
+static void f32_to_s16_f4(const float* in, int16_t* out, size_t n)
+{
+    const __m128 k  = _mm_set1_ps(S16_SCALE);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps( 32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i),     k), lo), hi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), k), lo), hi);
+        _mm_storeu_si128((__m128i*)(out + i),
+                         _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    f32_to_s16_scalar(in + i, out + i, n - i);
+}
+#elif SIMD_F4_NEON
+static void s16_to_f32_f4(const int16_t* in, float* out, size_t n)
+{
+    const float32x4_t k = vdupq_n_f32(S16_INV_SCALE);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(in + i);
+        vst1q_f32(out + i,     vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))),  k));
+        vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), k));
+    }
+    s16_to_f32_scalar(in + i, out + i, n - i);
+}
+
+static void f32_to_s16_f4(const float* in, int16_t* out, size_t n)
+{
+    const float32x4_t k  = vdupq_n_f32(S16_SCALE);
+    const float32x4_t lo = vdupq_n_f32(-32768.0f);
+    const float32x4_t hi = vdupq_n_f32( 32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t a = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(in + i),     k), lo), hi);
+        float32x4_t b = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(in + i + 4), k), lo), hi);
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)),
+                                        vqmovn_s32(vcvtnq_s32_f32(b))));
+    }
+    f32_to_s16_scalar(in + i, out + i, n - i);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// 16 samples at a time: AVX2.
+// ---------------------------------------------------------------------------
+#if SIMD_HAVE_AVX2
+SIMD_AVX2_FN static void s16_to_f32_avx2(const int16_t* in, float* out, size_t n)
+{
+    const __m256 k = _mm256_set1_ps(S16_INV_SCALE);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in + i + 8));
+        _mm256_storeu_ps(out + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)), k));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b)), k));
+    }
+    s16_to_f32_scalar(in + i, out + i, n - i);
+}
+
+SIMD_AVX2_FN static void f32_to_s16_avx2(const float* in, int16_t* out, size_t n)
+{
+    const __m256 k  = _mm256_set1_ps(S16_SCALE);
+    const __m256 lo = _mm256_set1_ps(-32768.0f);
+    const __m256 hi = _mm256_set1_ps( 32767.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i),     k), lo), hi);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), k), lo), hi);
+        // packs works within 128-bit lanes; put the quarters back in order.
+        __m256i p = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        p = _mm256_permute4x64_epi64(p, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out + i), p);
+    }
+    f32_to_s16_scalar(in + i, out + i, n - i);
+}
+#endif
+
+void pcm_s16_to_f32(const int16_t* in, float* out, size_t n)
+{
+    const SimdLevel level = simd_level();
+#if SIMD_HAVE_AVX2
+    if (level >= SIMD_AVX2) { s16_to_f32_avx2(in, out, n); return; }
+#endif
+#if SIMD_F4_SSE2 || SIMD_F4_NEON
+    if (level >= SIMD_F4) { s16_to_f32_f4(in, out, n); return; }
+#endif
+    (void)level;
+    s16_to_f32_scalar(in, out, n);
+}
+
+void pcm_f32_to_s16(const float* in, int16_t* out, size_t n)
+{
+    const SimdLevel level = simd_level();
+#if SIMD_HAVE_AVX2
+    if (level >= SIMD_AVX2) { f32_to_s16_avx2(in, out, n); return; }
+#endif
+#if SIMD_F4_SSE2 || SIMD_F4_NEON
+    if (level >= SIMD_F4) { f32_to_s16_f4(in, out, n); return; }
+#endif
+    (void)level;
+    f32_to_s16_scalar(in, out, n);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ---------------------------------------------------------------------------
+// Sample formats a decoded track can be held in.
+//
+// f32 is what every analysis and the mixer work in.  s16 halves the memory of
+// the interleaved buffer a loaded track keeps for playback -- 16-bit is the
+// resolution of the CD-sourced material anyway -- and is converted back to
+// f32 a window at a time where it is read (WSOLA's frames, the mono mixdown).
+//
+// The default for newly decoded tracks is f32; RIFFHOUND_PCM_FORMAT=s16
+// selects the compact one.
+// ---------------------------------------------------------------------------
+
+enum PcmFormat {
+    PCM_F32 = 0,
+    PCM_S16 = 1,   // full scale is 32768; f32 input is clipped to [-1, 1)
+};
+
+inline size_t pcm_format_bytes(PcmFormat f) { return f == PCM_S16 ? 2 : 4; }
+
+PcmFormat pcm_format_default();
+
+// n samples.  s16 -> f32 is exact; f32 -> s16 rounds to nearest (ties to
+// even) and saturates.  The vector paths give the same results as the scalar
+// ones.
+void pcm_s16_to_f32(const int16_t* in, float* out, size_t n);
+void pcm_f32_to_s16(const float* in, int16_t* out, size_t n);
@@ -0,0 +1,228 @@
+#include "pcm_store.h"
+#include "analysis_rate.h"
+#include "stft_cache.h"
+#include "chromagram.h"
+#include "beat_algo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+static std::mutex s_mutex;
+
+static PcmStore* store_alloc(void* data, PcmFormat format, uint64_t capacity,
+                             uint32_t channels, uint32_t sample_rate)
+{
+    PcmStore* s = (PcmStore*)calloc(1, sizeof(PcmStore));
+    if (!s) return nullptr;
+    s->data        = data;
+    s->format      = format;
+    s->capacity    = capacity;
+    s->channels    = channels;
+    s->sample_rate = sample_rate;
+    s->refs        = 1;
+    s->decoded.store(0, std::memory_order_relaxed);
+    s->complete.store(false, std::memory_order_relaxed);
+    return s;
+}
+
+static void mark_complete(PcmStore* s, uint64_t frames)
+{
+    s->decoded.store(frames, std::memory_order_release);
+    s->complete.store(true, std::memory_order_release);
+    s->analysis_frames = frames;
+}
+
+PcmStore* pcm_store_create(float* pcm, uint64_t frame_count,
+                           uint32_t channels, uint32_t sample_rate)
+{
+    PcmStore* s = store_alloc(pcm, PCM_F32, frame_count, channels, sample_rate);
+    if (!s) { free(pcm); return nullptr; }
+    mark_complete(s, frame_count);
+    return s;
+}
+
+PcmStore* pcm_store_create_mapped(PcmMap* m)
+{
+    PcmStore* s = store_alloc((void*)m->data, m->format, m->frames, m->channels,
+                              m->sample_rate);
+    if (!s) { pcm_cache_close(m); return nullptr; }
+    s->map = *m;
+    mark_complete(s, m->frames);
+    return s;
+}
+
+PcmStore* pcm_store_create_empty(uint64_t capacity, uint32_t channels,
+                                 uint32_t sample_rate, PcmFormat format)
+{
+    void* data = calloc((size_t)capacity * channels, pcm_format_bytes(format));
+    if (!data) return nullptr;
+    PcmStore* s = store_alloc(data, format, capacity, channels, sample_rate);
+    if (!s) free(data);
+    return s;
+}
+
+uint64_t pcm_store_append(PcmStore* s, const float* frames, uint64_t count)
+{
+    const uint64_t at = s->decoded.load(std::memory_order_relaxed);
+    if (count > s->capacity - at) count = s->capacity - at;
+    const size_t first = (size_t)at * s->channels;
+    const size_t n     = (size_t)count * s->channels;
+    if (s->format == PCM_S16) pcm_f32_to_s16(frames, (int16_t*)s->data + first, n);
+    else                      memcpy((float*)s->data + first, frames, n * sizeof(float));
+    s->decoded.store(at + count, std::memory_order_release);   // publishes the samples
+    return count;
+}
+
+void pcm_store_finish(PcmStore* s)
+{
+    s->complete.store(true, std::memory_order_release);
+}
+
+void pcm_store_read(const PcmStore* s, uint64_t first, uint64_t count, float* out)
+{
+    const size_t i0 = (size_t)first * s->channels;
+    const size_t n  = (size_t)count * s->channels;
+    if (s->format == PCM_S16) pcm_s16_to_f32((const int16_t*)s->data + i0, out, n);
+    else                      memcpy(out, (const float*)s->data + i0, n * sizeof(float));
+}
+
+PcmStore* pcm_store_retain(PcmStore* s)
+{
+    if (!s) return nullptr;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s->refs++;
+    return s;
+}
+
+// Analyses keyed by the buffer's length; rebuilt from the (kept) STFT frames.
+static void release_length_caches(const float* buf)
+{
+    chromagram_release(buf);
+    beat_spectral_flux_release(buf);
+}
+
+// Everything keyed by buffer address; drop it before the address can be
+// handed out again.
+static void release_caches(const float* buf)
+{
+    stft_release(buf);
+    release_length_caches(buf);
+}
+
+bool pcm_store_advance(PcmStore* s, uint64_t min_frames)
+{
+    const bool     done = pcm_store_complete(s);
+    const uint64_t n    = pcm_store_decoded(s);
+    if (n <= s->analysis_frames) return false;
+    if (!done && n - s->analysis_frames < min_frames) return false;
+
+    if (s->analysis_frames > 0) {
+        const float* f32 = pcm_store_f32(s);
+        if (f32) release_length_caches(f32);
+        if (s->mono && s->mono != f32) release_length_caches(s->mono);
+        if (s->signal && s->signal != f32) release_length_caches(s->signal);
+    }
+    s->analysis_frames = n;
+    return true;
+}
+
+void pcm_store_release(PcmStore* s)
+{
+    if (!s) return;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (--s->refs > 0) return;
+    }
+    const float* f32 = pcm_store_f32(s);
+    if (f32) release_caches(f32);
+    if (s->mono && s->mono != f32) {
+        release_caches(s->mono);
+        free(s->mono);
+    }
+    if (s->signal && s->signal != f32) {
+        release_caches(s->signal);
+        free(s->signal);
+    }
+    if (s->map.base) pcm_cache_close(&s->map);
+    else             free(s->data);
+    free(s);
+}
+
+// Frames mixed per block when the buffer has to be converted first.
+static const uint64_t MIX_BLOCK = 4096;
+
+const float* pcm_store_mono(PcmStore* s)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    const float* f32 = pcm_store_f32(s);
+    if (s->channels == 1 && f32) return s->mono = (float*)f32;
+    if (!s->mono) {
+        s->mono = (float*)malloc((size_t)s->capacity * sizeof(float));
+        if (!s->mono) return nullptr;
+        s->mono_frames = 0;
+    }
+
+    const uint32_t ch     = s->channels;
+    const float    inv_ch = 1.0f / (float)ch;
+    float*         tmp    = nullptr;
+    if (!f32 && s->mono_frames < s->analysis_frames) {
+        tmp = (float*)malloc((size_t)MIX_BLOCK * ch * sizeof(float));
+        if (!tmp) return nullptr;
+    }
+    for (uint64_t b = s->mono_frames; b < s->analysis_frames; b += MIX_BLOCK) {
+        uint64_t     n   = s->analysis_frames - b < MIX_BLOCK ? s->analysis_frames - b : MIX_BLOCK;
+        const float* blk = f32 ? f32 + b * ch : tmp;
+        if (!f32) pcm_store_read(s, b, n, tmp);
+        for (uint64_t i = 0; i < n; i++) {
+            const float* src = blk + i * ch;
+            float sum = 0.0f;
+            for (uint32_t c = 0; c < ch; c++) sum += src[c];
+            s->mono[b + i] = sum * inv_ch;
+        }
+    }
+    free(tmp);
+    if (s->analysis_frames > s->mono_frames) s->mono_frames = s->analysis_frames;
+    return s->mono;
+}
+
+static const float* store_read(const void* src, uint64_t first, uint64_t count,
+                               float* scratch)
+{
+    const PcmStore* s   = (const PcmStore*)src;
+    const float*    f32 = pcm_store_f32(s);
+    if (f32) return f32 + first * s->channels;
+    pcm_store_read(s, first, count, scratch);
+    return scratch;
+}
+
+const float* pcm_store_analysis(PcmStore* s, uint64_t* frame_count, uint32_t* sample_rate)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    const float* f32 = pcm_store_f32(s);
+    if (!s->signal) {
+        s->signal_factor = analysis_factor(s->sample_rate);
+        if (s->channels == 1 && f32 && s->signal_factor == 1) {
+            s->signal = (float*)f32;
+        } else {
+            // Sized for the whole track up front: the caches built over it
+            // are keyed by its address, which must not move as it grows.
+            uint64_t n = analysis_ready(s->capacity, s->signal_factor, true);
+            s->signal  = (float*)malloc((size_t)(n ? n : 1) * sizeof(float));
+            if (!s->signal) return nullptr;
+        }
+        s->signal_frames = 0;
+    }
+
+    const bool whole = pcm_store_complete(s) && s->analysis_frames == pcm_store_decoded(s);
+    const uint64_t n = analysis_ready(s->analysis_frames, s->signal_factor, whole);
+    if (s->signal != f32 && n > s->signal_frames) {
+        if (!analysis_decimate(store_read, s, s->analysis_frames, s->channels,
+                               s->signal_factor, s->signal_frames, n,
+                               s->signal + s->signal_frames))
+            return nullptr;
+    }
+    if (n > s->signal_frames) s->signal_frames = n;
+    *frame_count = s->signal_frames;
+    *sample_rate = s->sample_rate / s->signal_factor;
+    return s->signal;
+}
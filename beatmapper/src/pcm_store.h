@@ -0,0 +1,117 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "pcm_cache.h"
+
+// ---------------------------------------------------------------------------
+// Decoded PCM of one loaded track, shared by everything that reads it.
+//
+// The store owns the interleaved buffer the decoder writes, in f32 or in the
+// compact s16 format (pcm_format.h).  Playback (WSOLA) reads that buffer --
+// directly when it is f32, through pcm_store_read() otherwise.  Everything
+// else only ever wants the channel average, and borrows an f32 view derived
+// from the buffer once instead of mixing it down again inside each frame
+// loop: the spectrogram the mono view, at the track's rate, and the beat
+// detector and chroma algorithms, which need none of the top octave, the
+// analysis signal (analysis_rate.h), the mono view decimated.
+//
+// A store can be filled while it is in use.  The buffer is allocated up front
+// at the decoder's expected length, and a single writer thread appends chunks
+// and commits each one; readers only touch the committed prefix:
+//   - playback reads up to pcm_store_decoded(), lock-free, from the audio
+//     thread;
+//   - analyses see analysis_frames, a prefix the main thread advances in
+//     steps with pcm_store_advance(), so the spectrogram and detectors are
+//     redone a few times as the track lands rather than on every chunk.
+// A store made from a finished buffer (pcm_store_create) is complete at once.
+//
+// Reference counted: audio_load holds one reference (its decoding thread holds
+// another), and anything that must keep the buffers past the next track load
+// takes its own with pcm_store_retain().  When the last reference goes, the
+// analysis caches built over either buffer (STFT, chromagram, beat stages)
+// go with it.
+// ---------------------------------------------------------------------------
+
+struct PcmStore {
+    void*     data;          // interleaved, channels samples per frame
+    PcmFormat format;
+    uint64_t capacity;       // frames allocated
+    uint32_t channels;
+    uint32_t sample_rate;
+
+    std::atomic<uint64_t> decoded;    // leading frames written and committed
+    std::atomic<bool>     complete;   // writer finished; decoded is the length
+
+    uint64_t analysis_frames;   // prefix the analyses see; main thread only
+    int      refs;              // guarded by the module lock
+    float*   mono;              // channel average; nullptr until first requested
+    uint64_t mono_frames;       // mono samples mixed so far
+    float*   signal;            // analysis signal; nullptr until first requested
+    uint64_t signal_frames;     // samples of it built so far
+    uint32_t signal_factor;     // its decimation from sample_rate
+    PcmMap   map;               // data is this read-only mapping if map.base is set
+};
+
+// Wrap a finished malloc'd interleaved f32 buffer; the store takes ownership
+// of it (and frees it itself on failure).  Returns the store, complete, with
+// one reference, or nullptr if out of memory.
+PcmStore* pcm_store_create(float* pcm, uint64_t frame_count,
+                           uint32_t channels, uint32_t sample_rate);
+
+// Wrap a decode mapped from the PCM cache (pcm_cache.h); the store takes over
+// the mapping and closes it on the last release.  Complete at once.  The
+// buffer is read-only.
+PcmStore* pcm_store_create_mapped(PcmMap* m);
+
+// An empty store of capacity frames (zeroed) in the given format for a
+// decoder to fill: pcm_store_append() f32 frames as they are decoded, then
+// pcm_store_finish().  One reference; nullptr if out of memory.
+PcmStore* pcm_store_create_empty(uint64_t capacity, uint32_t channels,
+                                 uint32_t sample_rate, PcmFormat format);
+
+// Store frames (converted to the store's format) after the decoded ones and
+// commit them.  Returns how many fit.  Writer thread only.
+uint64_t  pcm_store_append(PcmStore* s, const float* frames, uint64_t count);
+void      pcm_store_finish(PcmStore* s);
+
+// The buffer itself if it holds f32, else nullptr.
+inline const float* pcm_store_f32(const PcmStore* s)
+{
+    return s->format == PCM_F32 ? (const float*)s->data : nullptr;
+}
+
+// Interleaved frames [first, first + count) as f32 into out; they must be
+// decoded already.  Any thread.
+void pcm_store_read(const PcmStore* s, uint64_t first, uint64_t count, float* out);
+
+inline uint64_t pcm_store_decoded(const PcmStore* s)
+{
+    return s->decoded.load(std::memory_order_acquire);
+}
+
+inline bool pcm_store_complete(const PcmStore* s)
+{
+    return s->complete.load(std::memory_order_acquire);
+}
+
+// Move analysis_frames up to everything decoded, if that adds at least
+// min_frames or finishes the track.  Analyses keyed by the old length
+// (chromagrams, beat stages) are dropped; STFT frames are kept and the
+// entries extended.  Returns true if analysis_frames changed.  Main thread.
+bool pcm_store_advance(PcmStore* s, uint64_t min_frames);
+
+PcmStore* pcm_store_retain(PcmStore* s);
+void      pcm_store_release(PcmStore* s);
+
+// analysis_frames channel-averaged samples, mixed on demand (the interleaved
+// buffer itself for a one-channel f32 store).  nullptr if out of memory.
+// Valid for as long as the caller's reference.
+const float* pcm_store_mono(PcmStore* s);
+
+// The analysis signal of the first analysis_frames frames, built on demand
+// (the interleaved buffer itself for a one-channel f32 store analysed at its
+// own rate): *frame_count samples at *sample_rate, one channel.  Until the
+// track is complete it stops the decimator's reach short of analysis_frames,
+// so the samples it has never change.  nullptr if out of memory.  Valid for
+// as long as the caller's reference.
+const float* pcm_store_analysis(PcmStore* s, uint64_t* frame_count, uint32_t* sample_rate);
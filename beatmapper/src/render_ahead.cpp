@@ -0,0 +1,349 @@
+#include "render_ahead.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+static const uint64_t NO_END = ~(uint64_t)0;
+
+// ---- vtable forward declarations -------------------------------------------
+
+static ma_result render_ahead_on_read(ma_data_source* pDS, void* pFramesOut,
+                                      ma_uint64 frameCount, ma_uint64* pFramesRead);
+static ma_result render_ahead_on_seek(ma_data_source* pDS, ma_uint64 frameIndex);
+static ma_result render_ahead_on_get_data_format(ma_data_source* pDS, ma_format* pFormat,
+                                                 ma_uint32* pChannels, ma_uint32* pSampleRate,
+                                                 ma_channel* pChannelMap, size_t channelMapCap);
+static ma_result render_ahead_on_get_cursor(ma_data_source* pDS, ma_uint64* pCursor);
+static ma_result render_ahead_on_get_length(ma_data_source* pDS, ma_uint64* pLength);
+
+static ma_data_source_vtable s_render_vtable = {
+    render_ahead_on_read,
+    render_ahead_on_seek,
+    render_ahead_on_get_data_format,
+    render_ahead_on_get_cursor,
+    render_ahead_on_get_length,
+    NULL,  // onSetLooping
+    0      // flags
+};
+
+// ---- render thread ----------------------------------------------------------
+
+// Drop everything queued: read jumps to write, racing the callback, which
+// throws away whatever it copied if its own advance of read then fails.
+// cursor becomes the played position until the callback plays a new block.
+static void flush(RenderAhead* ra, uint64_t cursor)
+{
+    const uint64_t w = ra->write.load(std::memory_order_relaxed);
+    uint64_t r = ra->read.load(std::memory_order_acquire);
+    while (r < w && !ra->read.compare_exchange_weak(r, w, std::memory_order_acq_rel)) {}
+    ra->end.store(NO_END, std::memory_order_relaxed);
+    ra->played_cursor.store(cursor, std::memory_order_relaxed);
+    ra->played_jumps.store(ra->wsola->jumps.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+}
+
+// Restart WSOLA where playback is, discarding what was rendered after it.
+static void rerender(RenderAhead* ra, uint64_t frame)
+{
+    ma_data_source_seek_to_pcm_frame(ra->src, frame);
+    flush(ra, frame);
+}
+
+static void apply(RenderAhead* ra, const RenderCmd& c)
+{
+    WsolaSource* ws = ra->wsola;
+    switch (c.type) {
+    case RENDER_SEEK:
+        rerender(ra, c.frame);
+        ra->seeks_done.fetch_add(1, std::memory_order_release);
+        break;
+    case RENDER_SPEED:
+        wsola_set_speed(ws, c.value);
+        break;
+    case RENDER_PITCH:
+        wsola_set_pitch(ws, c.value);
+        break;
+    case RENDER_LOOP: {
+        wsola_set_loop(ws, c.enabled, c.frame, c.end);
+        // What is queued was rendered under the old loop.  It is still right
+        // unless it wraps, or runs on past where the new loop now wraps.
+        const uint64_t played   = ra->played_cursor.load(std::memory_order_relaxed);
+        const uint64_t rendered = ws->cursor_frames.load(std::memory_order_relaxed);
+        const bool wrapped = ws->jumps.load(std::memory_order_relaxed) !=
+                             ra->played_jumps.load(std::memory_order_relaxed);
+        const bool overran = c.enabled && c.end > c.frame && played < c.end &&
+                             rendered >= c.end;
+        if ((wrapped || overran) && ra->end.load(std::memory_order_relaxed) == NO_END)
+            rerender(ra, played);
+        break;
+    }
+    }
+}
+
+static bool commands_pending(const RenderAhead* ra)
+{
+    return ra->queue_tail.load(std::memory_order_relaxed) !=
+           ra->queue_head.load(std::memory_order_acquire);
+}
+
+// Top the ring up to capacity, a block at a time, while no command waits.
+static void fill(RenderAhead* ra)
+{
+    const uint32_t ch = ra->channels;
+    while (!commands_pending(ra) && ra->end.load(std::memory_order_relaxed) == NO_END) {
+        const uint64_t w = ra->write.load(std::memory_order_relaxed);
+        if (w + RENDER_BLOCK - ra->read.load(std::memory_order_acquire) > ra->capacity) return;
+
+        float*    dst = ra->ring + (w % ra->capacity) * ch;
+        ma_uint64 got = 0;
+        ma_data_source_read_pcm_frames(ra->src, dst, RENDER_BLOCK, &got);
+        if (got < RENDER_BLOCK)   // end of track: pad the block, mark the end
+            memset(dst + got * ch, 0, (size_t)(RENDER_BLOCK - got) * ch * sizeof(float));
+
+        RenderMark& m = ra->marks[(w / RENDER_BLOCK) % ra->mark_count];
+        m.cursor.store(ra->wsola->cursor_frames.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+        m.jumps.store(ra->wsola->jumps.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+        if (got < RENDER_BLOCK) ra->end.store(w + got, std::memory_order_relaxed);
+        ra->write.store(w + RENDER_BLOCK, std::memory_order_release);
+    }
+}
+
+// Apply commands, top up, and sleep until the next command or poll_ms,
+// whichever comes first.  The callback never wakes this thread (that would
+// take a lock); poll_ms is a fraction of the look-ahead.
+static void render_thread(RenderAhead* ra)
+{
+    std::unique_lock<std::mutex> lock(ra->mutex);
+    while (!ra->quit) {
+        lock.unlock();
+        while (commands_pending(ra)) {
+            uint32_t t = ra->queue_tail.load(std::memory_order_relaxed);
+            apply(ra, ra->queue[t % RENDER_QUEUE]);
+            ra->queue_tail.store(t + 1, std::memory_order_release);
+        }
+        fill(ra);
+        lock.lock();
+        if (!ra->quit && !commands_pending(ra))
+            ra->wake.wait_for(lock, std::chrono::milliseconds(ra->poll_ms));
+    }
+}
+
+static void post(RenderAhead* ra, const RenderCmd& c)
+{
+    const uint32_t h = ra->queue_head.load(std::memory_order_relaxed);
+    // Full only if the render thread has stalled; wait for it.
+    while (h - ra->queue_tail.load(std::memory_order_acquire) >= RENDER_QUEUE)
+        std::this_thread::yield();
+    ra->queue[h % RENDER_QUEUE] = c;
+    ra->queue_head.store(h + 1, std::memory_order_release);
+    { std::lock_guard<std::mutex> lock(ra->mutex); }   // not between its check and wait
+    ra->wake.notify_one();
+}
+
+// ---- vtable implementations -------------------------------------------------
+
+// Audio thread: copy out what is queued, silence for the rest.
+static ma_result render_ahead_on_read(ma_data_source* pDS, void* pFramesOut,
+                                      ma_uint64 frameCount, ma_uint64* pFramesRead)
+{
+    RenderAhead*   ra  = (RenderAhead*)pDS;
+    float*         out = (float*)pFramesOut;
+    const uint32_t ch  = ra->channels;
+
+    // read first: write only grows, so w - r cannot underflow.
+    uint64_t       r = ra->read.load(std::memory_order_acquire);
+    const uint64_t w = ra->write.load(std::memory_order_acquire);
+    uint64_t       n = w - r < frameCount ? w - r : frameCount;
+
+    if (n > 0) {
+        const uint64_t at    = r % ra->capacity;
+        const uint64_t first = ra->capacity - at < n ? ra->capacity - at : n;
+        memcpy(out, ra->ring + at * ch, (size_t)first * ch * sizeof(float));
+        memcpy(out + first * ch, ra->ring, (size_t)(n - first) * ch * sizeof(float));
+
+        const RenderMark& m = ra->marks[((r + n - 1) / RENDER_BLOCK) % ra->mark_count];
+        const uint64_t cursor = m.cursor.load(std::memory_order_relaxed);
+        const uint32_t jumps  = m.jumps.load(std::memory_order_relaxed);
+        if (ra->read.compare_exchange_strong(r, r + n, std::memory_order_acq_rel)) {
+            ra->played_cursor.store(cursor, std::memory_order_relaxed);
+            ra->played_jumps.store(jumps, std::memory_order_relaxed);
+        } else {
+            n = 0;   // flushed while copying: what was copied is stale
+        }
+    }
+    if (n < frameCount) {
+        memset(out + n * ch, 0, (size_t)(frameCount - n) * ch * sizeof(float));
+        if (r + n < ra->end.load(std::memory_order_relaxed))
+            ra->underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (pFramesRead) *pFramesRead = frameCount;
+    return MA_SUCCESS;
+}
+
+// Called by ma_sound_start on the main thread only (for a sound at its end,
+// which this one never is).
+static ma_result render_ahead_on_seek(ma_data_source* pDS, ma_uint64 frameIndex)
+{
+    render_ahead_seek((RenderAhead*)pDS, frameIndex);
+    return MA_SUCCESS;
+}
+
+static ma_result render_ahead_on_get_data_format(ma_data_source* pDS, ma_format* pFormat,
+                                                 ma_uint32* pChannels, ma_uint32* pSampleRate,
+                                                 ma_channel* pChannelMap, size_t channelMapCap)
+{
+    RenderAhead* ra = (RenderAhead*)pDS;
+    return ma_data_source_get_data_format(ra->src, pFormat, pChannels, pSampleRate,
+                                          pChannelMap, channelMapCap);
+}
+
+static ma_result render_ahead_on_get_cursor(ma_data_source* pDS, ma_uint64* pCursor)
+{
+    RenderAhead* ra = (RenderAhead*)pDS;
+    *pCursor = ra->played_cursor.load(std::memory_order_relaxed);
+    return MA_SUCCESS;
+}
+
+static ma_result render_ahead_on_get_length(ma_data_source* pDS, ma_uint64* pLength)
+{
+    RenderAhead* ra = (RenderAhead*)pDS;
+    return ma_data_source_get_length_in_pcm_frames(ra->src, pLength);
+}
+
+// ---- public API -------------------------------------------------------------
+
+uint32_t render_ahead_frames(uint32_t sample_rate)
+{
+    long ms = RENDER_AHEAD_MS;
+    const char* env = getenv("RIFFHOUND_RENDER_AHEAD_MS");
+    if (env && *env) ms = atol(env);
+    if (ms <= 0) return 0;
+    uint64_t frames = (uint64_t)ms * sample_rate / 1000;
+    const uint64_t cap = (uint64_t)RENDER_MAX_BLOCKS * RENDER_BLOCK;
+    return (uint32_t)(frames < cap ? frames : cap);
+}
+
+bool render_ahead_init(RenderAhead* ra, PitchNode* pn, uint32_t frames)
+{
+    memset(&ra->base, 0, sizeof(ra->base));
+    ra->src         = pn;
+    ra->wsola       = pn->wsola;
+    ra->channels    = pn->channels;
+    ra->sample_rate = pn->sample_rate;
+
+    // Whole blocks, at least two so that one can render while one plays.
+    uint32_t blocks = (frames + RENDER_BLOCK - 1) / RENDER_BLOCK;
+    if (blocks < 2)                 blocks = 2;
+    if (blocks > RENDER_MAX_BLOCKS) blocks = RENDER_MAX_BLOCKS;
+    ra->capacity   = (uint64_t)blocks * RENDER_BLOCK;
+    // One mark more than the ring holds blocks, so the callback can still read
+    // the mark of the block it finishes while the render thread refills.
+    ra->mark_count = blocks + 1;
+    ra->ring = (float*)calloc((size_t)ra->capacity * ra->channels, sizeof(float));
+    if (!ra->ring) return false;
+
+    const uint32_t jumps = ra->wsola->jumps.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < ra->mark_count; i++) {
+        ra->marks[i].cursor.store(0, std::memory_order_relaxed);
+        ra->marks[i].jumps.store(jumps, std::memory_order_relaxed);
+    }
+    ra->read.store(0, std::memory_order_relaxed);
+    ra->write.store(0, std::memory_order_relaxed);
+    ra->end.store(NO_END, std::memory_order_relaxed);
+    ra->played_cursor.store(ra->wsola->cursor_frames.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+    ra->played_jumps.store(jumps, std::memory_order_relaxed);
+    ra->underruns.store(0, std::memory_order_relaxed);
+    ra->queue_head.store(0, std::memory_order_relaxed);
+    ra->queue_tail.store(0, std::memory_order_relaxed);
+    ra->seeks_done.store(0, std::memory_order_relaxed);
+    ra->seeks_posted = 0;
+    ra->loop_enabled = ra->wsola->loop_enabled.load(std::memory_order_relaxed);
+    ra->loop_start   = ra->wsola->loop_start_frames.load(std::memory_order_relaxed);
+    ra->loop_end     = ra->wsola->loop_end_frames.load(std::memory_order_relaxed);
+    ra->quit         = false;
+    uint64_t poll = ra->capacity * 1000 / ra->sample_rate / 4;
+    ra->poll_ms   = poll < 1 ? 1 : (uint32_t)poll;
+
+    ma_data_source_config cfg = ma_data_source_config_init();
+    cfg.vtable = &s_render_vtable;
+    if (ma_data_source_init(&cfg, &ra->base) != MA_SUCCESS) {
+        free(ra->ring); ra->ring = nullptr;
+        return false;
+    }
+    ra->thread = std::thread(render_thread, ra);
+    return true;
+}
+
+void render_ahead_uninit(RenderAhead* ra)
+{
+    {
+        std::lock_guard<std::mutex> lock(ra->mutex);
+        ra->quit = true;
+    }
+    ra->wake.notify_one();
+    if (ra->thread.joinable()) ra->thread.join();
+
+    uint32_t n = ra->underruns.load(std::memory_order_relaxed);
+    if (n) printf("[audio] %u render underruns (RIFFHOUND_RENDER_AHEAD_MS)\n", n);
+    ma_data_source_uninit(&ra->base);
+    free(ra->ring);
+    ra->ring = nullptr;
+}
+
+void render_ahead_seek(RenderAhead* ra, uint64_t frame)
+{
+    RenderCmd c = {};
+    c.type  = RENDER_SEEK;
+    c.frame = frame;
+    ra->seeks_posted++;
+    post(ra, c);
+    // Shown at once; the render thread publishes it again as it flushes.
+    ra->played_cursor.store(frame, std::memory_order_relaxed);
+}
+
+void render_ahead_set_speed(RenderAhead* ra, float speed)
+{
+    RenderCmd c = {};
+    c.type  = RENDER_SPEED;
+    c.value = speed;
+    post(ra, c);
+}
+
+void render_ahead_set_pitch(RenderAhead* ra, float pitch)
+{
+    RenderCmd c = {};
+    c.type  = RENDER_PITCH;
+    c.value = pitch;
+    post(ra, c);
+}
+
+void render_ahead_set_loop(RenderAhead* ra, bool enabled,
+                           uint64_t loop_start_frames, uint64_t loop_end_frames)
+{
+    // audio.cpp sets the loop every UI frame; only changes are worth a command.
+    if (enabled == ra->loop_enabled && loop_start_frames == ra->loop_start &&
+        loop_end_frames == ra->loop_end)
+        return;
+    ra->loop_enabled = enabled;
+    ra->loop_start   = loop_start_frames;
+    ra->loop_end     = loop_end_frames;
+
+    RenderCmd c = {};
+    c.type    = RENDER_LOOP;
+    c.enabled = enabled;
+    c.frame   = loop_start_frames;
+    c.end     = loop_end_frames;
+    post(ra, c);
+}
+
+bool render_ahead_at_end(RenderAhead* ra)
+{
+    if (ra->seeks_done.load(std::memory_order_acquire) != ra->seeks_posted) return false;
+    uint64_t e = ra->end.load(std::memory_order_relaxed);
+    return e != NO_END && ra->read.load(std::memory_order_relaxed) >= e;
+}
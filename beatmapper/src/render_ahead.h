@@ -0,0 +1,129 @@
+#pragma once
+
+#include "pitch_node.h"
+#include "miniaudio.h"
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// RenderAhead: a ma_data_source that plays a PitchNode rendered ahead of time
+// on its own thread, so the device callback does nothing but copy.
+//
+//   WsolaSource --> PitchNode --> [render thread] --> ring --> RenderAhead
+//                                                               --> engine
+//
+// The render thread keeps up to RIFFHOUND_RENDER_AHEAD_MS (RENDER_AHEAD_MS by
+// default) of audio queued in a single-producer single-consumer ring, in
+// blocks of RENDER_BLOCK frames, each tagged with the WSOLA cursor and jump
+// count it ended on so that the position the UI sees is the one being heard.
+// A slow WSOLA hop now eats into that margin instead of the device buffer;
+// if the ring does run dry the callback plays silence and counts an underrun.
+//
+// Control goes through a lock-free command queue, main thread to render
+// thread, instead of the WSOLA atomics:
+//   - a seek flushes the ring and renders from the new position at once,
+//     whether or not the sound is playing;
+//   - a loop change re-renders from the heard position if the queued audio
+//     has already run past the new loop end or wrapped under the old loop;
+//   - speed and pitch take effect from the next block rendered, so within
+//     the look-ahead.  Restarting WSOLA on every step of a slider would be
+//     heard; a look-ahead's worth of latency is not.
+//
+// Playback never reaches MA_AT_END: past the end of the track the callback
+// plays silence and render_ahead_at_end() turns true; audio.cpp stops the
+// sound from the main thread.
+//
+// RIFFHOUND_RENDER_AHEAD_MS=0 renders in the callback as before (audio.cpp
+// then plays the PitchNode directly).
+
+#define RENDER_AHEAD_MS     60    // default look-ahead
+#define RENDER_BLOCK       256    // frames rendered per pass (one cursor mark)
+#define RENDER_MAX_BLOCKS 1024    // look-ahead cap (~1.4 s at 192 kHz)
+#define RENDER_QUEUE        64    // pending commands
+
+enum RenderCmdType {
+    RENDER_SEEK,
+    RENDER_SPEED,
+    RENDER_PITCH,
+    RENDER_LOOP,
+};
+
+struct RenderCmd {
+    RenderCmdType type;
+    bool          enabled;   // RENDER_LOOP
+    float         value;     // RENDER_SPEED, RENDER_PITCH
+    uint64_t      frame;     // RENDER_SEEK target; RENDER_LOOP start
+    uint64_t      end;       // RENDER_LOOP end
+};
+
+// Where WSOLA stood when a block finished rendering.
+struct RenderMark {
+    std::atomic<uint64_t> cursor;
+    std::atomic<uint32_t> jumps;
+};
+
+struct RenderAhead {
+    ma_data_source_base base;       // must be first
+    PitchNode*          src;
+    WsolaSource*        wsola;      // src->wsola; driven from the render thread
+    uint32_t            channels;
+    uint32_t            sample_rate;
+
+    // Ring: frames [read, write) are queued, at position % capacity.  The
+    // callback advances read as it plays; the render thread advances write,
+    // and moves read up to write itself to flush.  capacity is a multiple of
+    // RENDER_BLOCK, and write always a block boundary.
+    float*                ring;
+    uint64_t              capacity;
+    std::atomic<uint64_t> read;
+    std::atomic<uint64_t> write;
+    std::atomic<uint64_t> end;        // frame position the track ends at; ~0 = not yet
+    RenderMark            marks[RENDER_MAX_BLOCKS + 1];   // by (position / RENDER_BLOCK) % count
+    uint32_t              mark_count;
+
+    // The block last played, for the UI.
+    std::atomic<uint64_t> played_cursor;
+    std::atomic<uint32_t> played_jumps;
+    std::atomic<uint32_t> underruns;
+
+    // Commands [queue_tail, queue_head) at index % RENDER_QUEUE.
+    RenderCmd             queue[RENDER_QUEUE];
+    std::atomic<uint32_t> queue_head;   // written by the main thread
+    std::atomic<uint32_t> queue_tail;   // written by the render thread
+    std::atomic<uint32_t> seeks_done;   // by the render thread
+    uint32_t              seeks_posted; // main thread only
+    bool                  loop_enabled; // last loop posted (main thread only)
+    uint64_t              loop_start;
+    uint64_t              loop_end;
+
+    std::thread             thread;
+    std::mutex              mutex;      // guards quit and the sleep below
+    std::condition_variable wake;
+    bool                    quit;
+    uint32_t                poll_ms;    // sleep between top-ups
+};
+
+// Look-ahead in frames at sample_rate, from RIFFHOUND_RENDER_AHEAD_MS; 0 means
+// render in the callback.
+uint32_t render_ahead_frames(uint32_t sample_rate);
+
+// Start rendering pn ahead by frames (render_ahead_frames).  pn and its
+// WsolaSource must be set up, and are driven from the render thread until
+// render_ahead_uninit; set their parameters only through the calls below.
+bool render_ahead_init(RenderAhead* ra, PitchNode* pn, uint32_t frames);
+
+// Stop the render thread.  Uninit the sound playing ra first.
+void render_ahead_uninit(RenderAhead* ra);
+
+// Main thread only: the command queue has one producer.
+void render_ahead_seek(RenderAhead* ra, uint64_t frame);
+void render_ahead_set_speed(RenderAhead* ra, float speed);
+void render_ahead_set_pitch(RenderAhead* ra, float pitch);
+void render_ahead_set_loop(RenderAhead* ra, bool enabled,
+                           uint64_t loop_start_frames, uint64_t loop_end_frames);
+
+// True once everything up to the end of the track has been played and no
+// seek is pending.  Main thread.
+bool render_ahead_at_end(RenderAhead* ra);
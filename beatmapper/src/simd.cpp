@@ -0,0 +1,54 @@
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+static SimdLevel detect()
+{
+    SimdLevel best = SIMD_SCALAR;
+#if SIMD_F4_SSE2 || SIMD_F4_NEON
+    best = SIMD_F4;
+#endif
+#if SIMD_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        best = SIMD_AVX2;
+#endif
+
+    const char* cap = getenv("RIFFHOUND_SIMD");
+    if (cap) {
+        SimdLevel want = best;
+        if      (strcmp(cap, "scalar") == 0) want = SIMD_SCALAR;
+        else if (strcmp(cap, "f4")     == 0) want = SIMD_F4;
+        else if (strcmp(cap, "avx2")   == 0) want = SIMD_AVX2;
+        if (want < best) best = want;
+    }
+    return best;
+}
+
+SimdLevel simd_level()
+{
+    // -1 = not yet detected.  Detection is idempotent, so a race just runs it
+    // twice.
+    static std::atomic<int> s_level{-1};
+    int l = s_level.load(std::memory_order_relaxed);
+    if (l < 0) {
+        l = (int)detect();
+        s_level.store(l, std::memory_order_relaxed);
+    }
+    return (SimdLevel)l;
+}
+
+const char* simd_level_name(SimdLevel l)
+{
+    switch (l) {
+    case SIMD_SCALAR: return "scalar";
+#if SIMD_F4_NEON
+    case SIMD_F4:     return "neon";
+#else
+    case SIMD_F4:     return "sse2";
+#endif
+    case SIMD_AVX2:   return "avx2";
+    }
+    return "?";
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+// ---------------------------------------------------------------------------
+// Minimal SIMD layer for the DSP kernels.
+//
+// f4 is a 4-lane float vector: SSE2 on x86-64 (always present there), NEON on
+// ARM64, and a plain struct elsewhere so the same kernel source compiles
+// everywhere.  Only the handful of operations the kernels need are wrapped.
+//
+// 8-lane AVX2 kernels are written directly with intrinsics inside functions
+// marked SIMD_AVX2_FN, which builds them for AVX2+FMA without raising the
+// baseline of the rest of the program.  They may only be called after
+// simd_level() reported SIMD_AVX2.
+// ---------------------------------------------------------------------------
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+  #include <emmintrin.h>
+  #define SIMD_F4_SSE2 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+  #include <arm_neon.h>
+  #define SIMD_F4_NEON 1
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+  #include <immintrin.h>
+  #define SIMD_HAVE_AVX2 1
+  #define SIMD_AVX2_FN __attribute__((target("avx2,fma")))
+#endif
+
+enum SimdLevel {
+    SIMD_SCALAR = 0,   // reference loops only
+    SIMD_F4,           // 4-lane kernels (SSE2 / NEON)
+    SIMD_AVX2,         // 8-lane kernels (AVX2 + FMA)
+};
+
+// Best level supported by this CPU, detected once on first call.  Setting the
+// environment variable RIFFHOUND_SIMD to "scalar", "f4" or "avx2" caps it,
+// which is how the vector kernels are checked against the scalar reference.
+SimdLevel   simd_level();
+const char* simd_level_name(SimdLevel l);
+
+// ---------------------------------------------------------------------------
+// f4
+// ---------------------------------------------------------------------------
+#if SIMD_F4_SSE2
+
+typedef __m128 f4;
+inline f4   f4_load (const float* p)       { return _mm_loadu_ps(p); }
+inline void f4_store(float* p, f4 v)       { _mm_storeu_ps(p, v); }
+inline f4   f4_set1 (float x)              { return _mm_set1_ps(x); }
+inline f4   f4_add  (f4 a, f4 b)           { return _mm_add_ps(a, b); }
+inline f4   f4_sub  (f4 a, f4 b)           { return _mm_sub_ps(a, b); }
+inline f4   f4_mul  (f4 a, f4 b)           { return _mm_mul_ps(a, b); }
+inline f4   f4_max  (f4 a, f4 b)           { return _mm_max_ps(a, b); }
+inline f4   f4_div  (f4 a, f4 b)           { return _mm_div_ps(a, b); }
+inline f4   f4_sqrt (f4 a)                 { return _mm_sqrt_ps(a); }
+// Lanes in reverse order.
+inline f4   f4_reverse(f4 v)               { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)); }
+// Split 8 interleaved floats p[0..7] into evens and odds.
+inline void f4_deinterleave(const float* p, f4* even, f4* odd)
+{
+    f4 lo = _mm_loadu_ps(p), hi = _mm_loadu_ps(p + 4);
+    *even = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    *odd  = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+}
+inline float f4_hsum(f4 v)
+{
+    f4 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+inline float f4_hmax(f4 v)
+{
+    f4 m = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+// Bit i set where lane i of a equals lane i of b.
+inline int  f4_eq_mask(f4 a, f4 b)         { return _mm_movemask_ps(_mm_cmpeq_ps(a, b)); }
+
+#elif SIMD_F4_NEON
+
+typedef float32x4_t f4;
+inline f4   f4_load (const float* p)       { return vld1q_f32(p); }
+inline void f4_store(float* p, f4 v)       { vst1q_f32(p, v); }
+inline f4   f4_set1 (float x)              { return vdupq_n_f32(x); }
+inline f4   f4_add  (f4 a, f4 b)           { return vaddq_f32(a, b); }
+inline f4   f4_sub  (f4 a, f4 b)           { return vsubq_f32(a, b); }
+inline f4   f4_mul  (f4 a, f4 b)           { return vmulq_f32(a, b); }
+inline f4   f4_max  (f4 a, f4 b)           { return vmaxq_f32(a, b); }
+inline f4   f4_div  (f4 a, f4 b)           { return vdivq_f32(a, b); }
+inline f4   f4_sqrt (f4 a)                 { return vsqrtq_f32(a); }
+inline f4   f4_reverse(f4 v)
+{
+    f4 r = vrev64q_f32(v);                 // 1 0 3 2
+    return vextq_f32(r, r, 2);             // 3 2 1 0
+}
+inline void f4_deinterleave(const float* p, f4* even, f4* odd)
+{
+    float32x4x2_t v = vld2q_f32(p);
+    *even = v.val[0];
+    *odd  = v.val[1];
+}
+inline float f4_hsum(f4 v)                 { return vaddvq_f32(v); }
+inline float f4_hmax(f4 v)                 { return vmaxvq_f32(v); }
+inline int  f4_eq_mask(f4 a, f4 b)
+{
+    static const uint32_t bits[4] = { 1, 2, 4, 8 };
+    return (int)vaddvq_u32(vandq_u32(vceqq_f32(a, b), vld1q_u32(bits)));
+}
+
+#else
+
+#include <math.h>
+
+struct f4 { float v[4]; };
+inline f4 f4_load(const float* p)          { f4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+inline void f4_store(float* p, f4 a)       { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+inline f4 f4_set1(float x)                 { f4 r; for (int i = 0; i < 4; i++) r.v[i] = x; return r; }
+inline f4 f4_add(f4 a, f4 b)               { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline f4 f4_sub(f4 a, f4 b)               { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline f4 f4_mul(f4 a, f4 b)               { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline f4 f4_max(f4 a, f4 b)               { for (int i = 0; i < 4; i++) if (b.v[i] > a.v[i]) a.v[i] = b.v[i]; return a; }
+inline f4 f4_div(f4 a, f4 b)               { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+inline f4 f4_sqrt(f4 a)                    { for (int i = 0; i < 4; i++) a.v[i] = sqrtf(a.v[i]); return a; }
+inline f4 f4_reverse(f4 a)                 { f4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[3 - i]; return r; }
+inline void f4_deinterleave(const float* p, f4* even, f4* odd)
+{
+    for (int i = 0; i < 4; i++) { even->v[i] = p[2 * i]; odd->v[i] = p[2 * i + 1]; }
+}
+inline float f4_hsum(f4 a)                 { return (a.v[0] + a.v[1]) + (a.v[2] + a.v[3]); }
+inline float f4_hmax(f4 a)
+{
+    float m = a.v[0];
+    for (int i = 1; i < 4; i++) if (a.v[i] > m) m = a.v[i];
+    return m;
+}
+inline int  f4_eq_mask(f4 a, f4 b)
+{
+    int m = 0;
+    for (int i = 0; i < 4; i++) if (a.v[i] == b.v[i]) m |= 1 << i;
+    return m;
+}
+
+#endif
+
+// a*b + c and c - a*b, kept as separate ops so results match across ISAs.
+inline f4 f4_madd(f4 a, f4 b, f4 c)        { return f4_add(f4_mul(a, b), c); }
+inline f4 f4_nmadd(f4 a, f4 b, f4 c)       { return f4_sub(c, f4_mul(a, b)); }
@@ -1,9 +1,15 @@
 #include "spectrogram.h"
+#include "analysis_rate.h"
+#include "stft_cache.h"
+#include "cqt.h"
+#include "pcm_store.h"
 #include "imgui.h"
 #include <math.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <atomic>
+#include <thread>
 
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
@@ -13,51 +19,14 @@
 #endif
 
 // ---------------------------------------------------------------------------
-// STFT parameters
+// STFT parameters.  Sizes are in seconds (analysis_rate.h), so the image
+// looks the same at any track rate.
 // ---------------------------------------------------------------------------
-static const int FFT_N    = 2048;   // FFT window size (must be power-of-two)
-static const int HOP      = 512;    // hop size (75% overlap)
-static const int BINS     = FFT_N / 2;   // 1024 bins, 0 Hz .. Nyquist
-static const int MAX_TEXW = 8192;   // max texture width (time columns)
-
-// ---------------------------------------------------------------------------
-// Iterative Cooley-Tukey radix-2 FFT (in-place, decimation-in-time).
-// re[] and im[] must each have n elements; n must be a power of two.
-// ---------------------------------------------------------------------------
-static void fft(float* re, float* im, int n)
-{
-    // Bit-reversal permutation
-    for (int i = 1, j = 0; i < n; i++) {
-        int bit = n >> 1;
-        for (; j & bit; bit >>= 1) j ^= bit;
-        j ^= bit;
-        if (i < j) {
-            float t;
-            t = re[i]; re[i] = re[j]; re[j] = t;
-            t = im[i]; im[i] = im[j]; im[j] = t;
-        }
-    }
-    // Butterfly stages
-    for (int len = 2; len <= n; len <<= 1) {
-        float ang = -2.0f * 3.14159265358979f / (float)len;
-        float wr  = cosf(ang), wi = sinf(ang);
-        for (int i = 0; i < n; i += len) {
-            float cr = 1.0f, ci = 0.0f;
-            for (int j = 0; j < (len >> 1); j++) {
-                float ur = re[i+j],              ui = im[i+j];
-                float vr = re[i+j+len/2]*cr - im[i+j+len/2]*ci;
-                float vi = re[i+j+len/2]*ci + im[i+j+len/2]*cr;
-                re[i+j]         = ur + vr;
-                im[i+j]         = ui + vi;
-                re[i+j+len/2]   = ur - vr;
-                im[i+j+len/2]   = ui - vi;
-                float nr = cr*wr - ci*wi;
-                float ni = cr*wi + ci*wr;
-                cr = nr; ci = ni;
-            }
-        }
-    }
-}
+static const double FFT_SEC     = 0.04644;   // FFT window: 1024 bins at 44.1 kHz
+static const double HOP_SEC     = 0.01161;   // hop size (75% overlap)
+static const int    MAX_TEXW    = 8192;      // max texture width (time columns)
+static const double CQT_HOP_SEC = 0.02322;   // constant-Q column hop (before MAX_TEXW)
+static const int    CQT_BLOCK   = 32;        // constant-Q frames per cqt_frames call
 
 // ---------------------------------------------------------------------------
 // Colormap: intensity [0,1] → RGB bytes.
@@ -89,6 +58,132 @@ static void colormap(float v, uint8_t* r, uint8_t* g, uint8_t* b)
     *r = (uint8_t)stops[N-1].r; *g = (uint8_t)stops[N-1].g; *b = (uint8_t)stops[N-1].b;
 }
 
+// Magnitude (1.0 = 0 dBFS sine) → texel, -80 dB .. 0 dB across the colormap.
+static void put_texel(uint8_t* pixels, int tex_w, int row, int col, float mag)
+{
+    float db = 20.0f * log10f(mag + 1e-9f);
+    float v  = (db + 80.0f) / 80.0f;
+    if (v < 0.0f) v = 0.0f;
+    if (v > 1.0f) v = 1.0f;
+
+    int pidx = (row * tex_w + col) * 4;
+    uint8_t r, g, b;
+    colormap(v, &r, &g, &b);
+    pixels[pidx + 0] = r;
+    pixels[pidx + 1] = g;
+    pixels[pidx + 2] = b;
+    pixels[pidx + 3] = 255;
+}
+
+static void delete_texture(unsigned int* tex)
+{
+    if (*tex) {
+        GLuint t = (GLuint)*tex;
+        glDeleteTextures(1, &t);
+        *tex = 0;
+    }
+}
+
+static unsigned int upload_texture(const uint8_t* pixels, int tex_w, int tex_h)
+{
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
+                 tex_w, tex_h, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return (unsigned int)tex;
+}
+
+// ---------------------------------------------------------------------------
+// Constant-Q builder.  The texture is one large FFT per column -- most of a
+// second for a long track -- so it is built on a thread of its own, which
+// fills s_cqt's pixels; spectrogram_compute_cqt polls it from the GL thread
+// and uploads them.  The job holds a reference to the store the samples live
+// in, so a track change cannot free them under it; a newer
+// spectrogram_compute cancels it between blocks.  One job at a time, for the
+// one spectrogram.
+// ---------------------------------------------------------------------------
+struct CqtJob {
+    PcmStore*    store;        // reference held until the job is reaped
+    const float* pcm;
+    uint64_t     frame_count;
+    uint32_t     channels;
+    uint32_t     sample_rate;
+    uint8_t*     pixels;       // tex_w * CQT_BINS texels; nullptr if it failed
+    int          tex_w;
+    int          hop;
+};
+
+static std::thread       s_cqt_thread;
+static std::atomic<bool> s_cqt_cancel{false};
+static std::atomic<bool> s_cqt_done{false};   // the thread has finished with s_cqt
+static CqtJob            s_cqt;
+
+static void cqt_build()
+{
+    CqtJob* j = &s_cqt;
+    const CqtKernel* kern = cqt_kernel(j->sample_rate);
+    if (!kern) { s_cqt_done.store(true, std::memory_order_release); return; }
+
+    // Column c is the frame centred on the middle of samples
+    // [c * hop, (c + 1) * hop), so columns tile the track like the STFT
+    // texture's do and need no offset when drawn.
+    int64_t col_hop = analysis_samples(CQT_HOP_SEC, j->sample_rate);
+    int64_t cols    = ((int64_t)j->frame_count + col_hop - 1) / col_hop;
+    if (cols > MAX_TEXW) cols = MAX_TEXW;
+    int     hop    = (int)(((int64_t)j->frame_count + cols - 1) / cols);
+    int64_t origin = hop / 2 - cqt_frame_len(kern) / 2;
+    int     tex_w  = (int)cols;
+    int     tex_h  = CQT_BINS;
+
+    uint8_t* pixels = (uint8_t*)malloc((size_t)tex_w * tex_h * 4);
+    float*   mag    = (float*)  malloc((size_t)CQT_BLOCK * CQT_BINS * sizeof(float));
+    if (pixels && mag) {
+        for (int c0 = 0; c0 < tex_w; c0 += CQT_BLOCK) {
+            if (s_cqt_cancel.load(std::memory_order_relaxed)) {
+                free(pixels);
+                pixels = nullptr;
+                break;
+            }
+            int c1 = c0 + CQT_BLOCK < tex_w ? c0 + CQT_BLOCK : tex_w;
+            cqt_frames(kern, j->pcm, j->frame_count, j->channels, origin, hop, c0, c1, mag);
+            for (int col = c0; col < c1; col++) {
+                const float* m = mag + (size_t)(col - c0) * CQT_BINS;
+                for (int bin = 0; bin < tex_h; bin++)
+                    put_texel(pixels, tex_w, (tex_h - 1) - bin, col, m[bin]);
+            }
+        }
+    } else {
+        free(pixels);
+        pixels = nullptr;
+    }
+    free(mag);
+
+    j->pixels = pixels;
+    j->tex_w  = tex_w;
+    j->hop    = hop;
+    s_cqt_done.store(true, std::memory_order_release);
+}
+
+// Wait for the thread (cancelled first if cancel), then drop the job.
+static void cqt_reap(bool cancel)
+{
+    if (!s_cqt_thread.joinable()) return;
+    if (cancel) s_cqt_cancel.store(true, std::memory_order_relaxed);
+    s_cqt_thread.join();
+    s_cqt_cancel.store(false, std::memory_order_relaxed);
+    s_cqt_done.store(false, std::memory_order_relaxed);
+    pcm_store_release(s_cqt.store);
+    free(s_cqt.pixels);
+    s_cqt = CqtJob{};
+}
+
 // ---------------------------------------------------------------------------
 // Public API
 // ---------------------------------------------------------------------------
@@ -100,111 +195,82 @@ void spectrogram_init(SpectrogramState* s) {
     s->tex_w        = 0;
     s->tex_h        = 0;
     s->sample_rate  = 0;
+    s->cqt_computed = false;
+    s->cqt_texture  = 0;
+    s->cqt_span     = 0.0;
 }
 
 void spectrogram_shutdown(SpectrogramState* s) {
-    if (s->texture) {
-        GLuint t = (GLuint)s->texture;
-        glDeleteTextures(1, &t);
-        s->texture = 0;
-    }
-    s->computed = false;
-    s->duration = 0.0;
+    cqt_reap(true);
+    delete_texture(&s->texture);
+    delete_texture(&s->cqt_texture);
+    s->computed     = false;
+    s->cqt_computed = false;
+    s->duration     = 0.0;
 }
 
 void spectrogram_compute(SpectrogramState* s,
-                         const float* mono_samples,
-                         uint64_t     num_samples,
+                         const float* pcm,
+                         uint64_t     frame_count,
+                         uint32_t     channels,
                          uint32_t     sample_rate)
 {
-    if (!mono_samples || num_samples < (uint64_t)FFT_N || sample_rate == 0)
+    const int fft_n = analysis_fft_size(FFT_SEC, sample_rate);
+    const int bins  = fft_n / 2;   // 0 Hz .. Nyquist
+    StftView  view;
+    if (!stft_open(&view, pcm, frame_count, channels, sample_rate, fft_n,
+                   analysis_samples(HOP_SEC, sample_rate), STFT_HANN))
         return;
 
-    int64_t num_frames = (int64_t)(num_samples - FFT_N) / HOP + 1;
-    if (num_frames <= 0) return;
-
+    int64_t num_frames = view.num_frames;
     int tex_w = (int)(num_frames < MAX_TEXW ? num_frames : MAX_TEXW);
-    int tex_h = BINS;  // 1024
-
-    // Hann window
-    float window[FFT_N];
-    for (int i = 0; i < FFT_N; i++)
-        window[i] = 0.5f * (1.0f - cosf(2.0f * 3.14159265358979f * i / (FFT_N - 1)));
+    int tex_h = bins;
 
     uint8_t* pixels = (uint8_t*)malloc((size_t)tex_w * tex_h * 4);
-    float*   re     = (float*)  malloc(FFT_N * sizeof(float));
-    float*   im     = (float*)  malloc(FFT_N * sizeof(float));
-    if (!pixels || !re || !im) {
-        free(pixels); free(re); free(im);
+    float*   col_mag = (float*) malloc(bins * sizeof(float));
+    if (!pixels || !col_mag) {
+        free(pixels); free(col_mag);
+        stft_close(&view);
         return;
     }
 
-    float inv_norm = 1.0f / (FFT_N * 0.5f);  // normalize so 0 dBFS sine ≈ 1.0
+    float inv_norm = 1.0f / (fft_n * 0.5f);  // normalize so 0 dBFS sine ≈ 1.0
 
     for (int col = 0; col < tex_w; col++) {
-        // Map texture column linearly to an STFT frame
-        int64_t frame  = (tex_w > 1) ? (int64_t)col * (num_frames - 1) / (tex_w - 1) : 0;
-        int64_t offset = frame * HOP;
-
-        for (int i = 0; i < FFT_N; i++) {
-            int64_t idx = offset + i;
-            float   samp = (idx < (int64_t)num_samples) ? mono_samples[idx] : 0.0f;
-            re[i] = samp * window[i];
-            im[i] = 0.0f;
+        // Each texture column covers a run of STFT frames; take the per-bin
+        // peak so short transients survive when the track has more frames
+        // than the texture has columns.
+        int64_t f0 = (int64_t)col       * num_frames / tex_w;
+        int64_t f1 = (int64_t)(col + 1) * num_frames / tex_w;
+        for (int bin = 0; bin < bins; bin++) col_mag[bin] = 0.0f;
+        for (int64_t f = f0; f < f1; f++) {
+            const float* mag = stft_frame(&view, f);
+            if (!mag) continue;
+            for (int bin = 0; bin < bins; bin++)
+                if (mag[bin] > col_mag[bin]) col_mag[bin] = mag[bin];
         }
 
-        fft(re, im, FFT_N);
-
-        for (int bin = 0; bin < tex_h; bin++) {
-            float mag = sqrtf(re[bin]*re[bin] + im[bin]*im[bin]) * inv_norm;
-            float db  = 20.0f * log10f(mag + 1e-9f);
-
-            // Map -80 dB .. 0 dB → [0, 1]
-            float v = (db + 80.0f) / 80.0f;
-            if (v < 0.0f) v = 0.0f;
-            if (v > 1.0f) v = 1.0f;
-
-            // bin 0 (DC / low freq) → bottom row; bin BINS-1 (Nyquist) → top row
-            int row  = (tex_h - 1) - bin;
-            int pidx = (row * tex_w + col) * 4;
-            uint8_t r, g, b;
-            colormap(v, &r, &g, &b);
-            pixels[pidx + 0] = r;
-            pixels[pidx + 1] = g;
-            pixels[pidx + 2] = b;
-            pixels[pidx + 3] = 255;
-        }
+        // bin 0 (DC / low freq) → bottom row; bin bins-1 (Nyquist) → top row
+        for (int bin = 0; bin < tex_h; bin++)
+            put_texel(pixels, tex_w, (tex_h - 1) - bin, col, col_mag[bin] * inv_norm);
     }
 
-    free(re);
-    free(im);
+    free(col_mag);
+    stft_close(&view);
 
-    // Delete old texture
-    if (s->texture) {
-        GLuint t = (GLuint)s->texture;
-        glDeleteTextures(1, &t);
-        s->texture = 0;
-    }
-
-    // Upload to GPU
-    GLuint tex = 0;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
-                 tex_w, tex_h, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Replace the STFT texture.  The constant-Q one is rebuilt for the new
+    // length when next shown; until then the old one is drawn over the part
+    // it covers.
+    cqt_reap(true);
+    delete_texture(&s->texture);
+    s->cqt_computed = false;
 
+    s->texture      = upload_texture(pixels, tex_w, tex_h);
     free(pixels);
 
-    s->texture      = (unsigned int)tex;
     s->tex_w        = tex_w;
     s->tex_h        = tex_h;
-    s->duration     = (double)num_samples / (double)sample_rate;
+    s->duration     = (double)frame_count / (double)sample_rate;
     s->sample_rate  = sample_rate;
     s->computed     = true;
 
@@ -212,10 +278,72 @@ void spectrogram_compute(SpectrogramState* s,
            tex_w, tex_h, s->duration, (long long)num_frames);
 }
 
+void spectrogram_compute_cqt(SpectrogramState* s, PcmStore* store,
+                             const float* pcm,
+                             uint64_t     frame_count,
+                             uint32_t     channels,
+                             uint32_t     sample_rate)
+{
+    if (s_cqt_thread.joinable()) {
+        if (!s_cqt_done.load(std::memory_order_acquire)) return;   // still building
+        // Marked done even if it failed, so a failure is not retried every frame.
+        s->cqt_computed = true;
+        if (s_cqt.pixels) {
+            delete_texture(&s->cqt_texture);
+            s->cqt_texture = upload_texture(s_cqt.pixels, s_cqt.tex_w, CQT_BINS);
+            s->cqt_span    = (double)s_cqt.tex_w * s_cqt.hop / (double)s_cqt.sample_rate;
+            printf("[spectrogram] constant-Q %d×%d  hop=%d\n", s_cqt.tex_w, CQT_BINS, s_cqt.hop);
+        }
+        cqt_reap(false);
+        return;
+    }
+
+    if (!store || !pcm || frame_count == 0 || channels == 0 || sample_rate == 0) {
+        s->cqt_computed = true;
+        return;
+    }
+    s_cqt.store       = pcm_store_retain(store);
+    s_cqt.pcm         = pcm;
+    s_cqt.frame_count = frame_count;
+    s_cqt.channels    = channels;
+    s_cqt.sample_rate = sample_rate;
+    s_cqt_thread      = std::thread(cqt_build);
+}
+
+// Frequency range drawn on the CQT axis: bottom edge of bin 0 up to max_freq,
+// which cannot exceed the top edge of the last bin.
+static void cqt_range(float max_freq, float* lo, float* hi)
+{
+    *lo = cqt_bin_freq(-0.5f);
+    *hi = cqt_bin_freq((float)CQT_BINS - 0.5f);
+    if (max_freq > *lo && max_freq < *hi) *hi = max_freq;
+}
+
+float spectrogram_freq_frac(const SpectrogramState* s, SpectroAxis axis,
+                            float max_freq, float f)
+{
+    float nyquist = s->sample_rate > 0 ? (float)(s->sample_rate / 2) : 22050.0f;
+    if (max_freq <= 0.0f || max_freq > nyquist) max_freq = nyquist;
+    if (f < 1e-3f) f = 1e-3f;
+
+    switch (axis) {
+    case SPECTRO_AXIS_LOG:
+        if (max_freq <= SPECTRO_LOG_FMIN) return 1.0f;
+        return 1.0f - logf(f / SPECTRO_LOG_FMIN) / logf(max_freq / SPECTRO_LOG_FMIN);
+    case SPECTRO_AXIS_CQT: {
+        float lo, hi;
+        cqt_range(max_freq, &lo, &hi);
+        return logf(hi / f) / logf(hi / lo);
+    }
+    default:
+        return 1.0f - f / max_freq;
+    }
+}
+
 void spectrogram_render(SpectrogramState* s, ImDrawList* dl,
                         float x, float y, float width, float height,
                         double view_start, double view_end, float max_freq,
-                        bool log_freq)
+                        SpectroAxis axis)
 {
     if (width <= 0.0f || height <= 0.0f) return;
 
@@ -232,18 +360,44 @@ void spectrogram_render(SpectrogramState* s, ImDrawList* dl,
         return;
     }
 
-    // UV-X maps the view window onto [0, 1] across the full track duration
+    // UV-X maps the view window onto [0, 1] across the analysed duration.
+    // While a track is still loading that may end inside the view; the image
+    // then stops at its end instead of being stretched across the rect.
+    const float view_w = width;
     float u0 = (float)(view_start / s->duration);
     float u1 = (float)(view_end   / s->duration);
     if (u0 < 0.0f) u0 = 0.0f;
-    if (u1 > 1.0f) u1 = 1.0f;
     if (u1 <= u0) return;
+    if (u1 > 1.0f) {
+        width *= (float)((s->duration - view_start) / (view_end - view_start));
+        u1 = 1.0f;
+    }
 
     // UV-Y: v=0 = Nyquist (top of texture), v=1 = 0 Hz (bottom of texture).
     float nyquist = s->sample_rate > 0 ? (float)(s->sample_rate / 2) : 22050.0f;
     if (max_freq <= 0.0f || max_freq > nyquist) max_freq = nyquist;
 
-    if (!log_freq) {
+    if (axis == SPECTRO_AXIS_CQT) {
+        // Rows are CQT bins, bottom to top, so the axis is a single image.
+        // The columns may run a little past the end of the track, or, while
+        // the texture of a shorter prefix is shown during a load, stop short
+        // of it.
+        if (!s->cqt_texture || s->cqt_span <= 0.0) return;
+        double end = view_end < s->duration ? view_end : s->duration;
+        if (end > s->cqt_span) end = s->cqt_span;
+        if (end <= view_start) return;
+        float cw  = view_w * (float)((end - view_start) / (view_end - view_start));
+        float cu0 = (float)(view_start / s->cqt_span);
+        float cu1 = (float)(end / s->cqt_span);
+        if (cu0 < 0.0f) cu0 = 0.0f;
+        float lo, hi;
+        cqt_range(max_freq, &lo, &hi);
+        float v0 = 1.0f - log2f(hi / lo) * CQT_BINS_PER_OCTAVE / CQT_BINS;
+        if (v0 < 0.0f) v0 = 0.0f;
+        dl->AddImage((ImTextureID)(intptr_t)s->cqt_texture,
+                     ImVec2(x, y), ImVec2(x + cw, y + height),
+                     ImVec2(cu0, v0), ImVec2(cu1, 1.0f));
+    } else if (axis == SPECTRO_AXIS_LINEAR) {
         // Linear: single image covering the whole rect
         float v0 = 1.0f - max_freq / nyquist;
         if (v0 < 0.0f) v0 = 0.0f;
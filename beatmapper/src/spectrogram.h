@@ -2,7 +2,15 @@
 
 #include <stdint.h>
 
-// Spectrogram module: STFT via hand-rolled Cooley-Tukey FFT, GPU texture, render.
+// Spectrogram module: STFT from the shared track cache (stft_cache.h), GPU texture, render.
+
+// Frequency axis.  LOG stretches the linear STFT texture; CQT draws a
+// separate constant-Q texture (cqt.h) whose rows are already log-spaced.
+enum SpectroAxis {
+    SPECTRO_AXIS_LINEAR = 0,
+    SPECTRO_AXIS_LOG,
+    SPECTRO_AXIS_CQT,
+};
 
 struct SpectrogramState {
     bool         computed;
@@ -10,29 +18,60 @@ struct SpectrogramState {
     unsigned int texture;     // GLuint (stored as uint to avoid GL headers here)
     int          tex_w;       // texture width  (time columns)
     int          tex_h;       // texture height (frequency bins)
-    unsigned int sample_rate; // native sample rate (for frequency axis labels)
+    unsigned int sample_rate; // rate of the PCM drawn (for frequency axis labels)
+
+    // Constant-Q texture, built on first use by spectrogram_compute_cqt and
+    // marked stale by the next spectrogram_compute, which leaves it drawn
+    // until its replacement is in.
+    bool         cqt_computed;
+    unsigned int cqt_texture;
+    double       cqt_span;    // seconds covered by the texture's columns
 };
 
 void spectrogram_init(SpectrogramState* s);
 void spectrogram_shutdown(SpectrogramState* s);
 
-// Compute STFT from mono f32 PCM and upload to a GPU texture.
-// Must be called from the GL thread (i.e. the main thread).
+// Build the texture from interleaved f32 PCM (any channel count; channels
+// are averaged) using the shared STFT cache, so the frames are kept and
+// extended while a track loads.  Must be called from the GL thread (i.e. the
+// main thread).
 void spectrogram_compute(SpectrogramState* s,
-                         const float* mono_samples,
-                         uint64_t     num_samples,
+                         const float* pcm,
+                         uint64_t     frame_count,
+                         uint32_t     channels,
                          uint32_t     sample_rate);
 
+// Build the constant-Q texture for the track last given to
+// spectrogram_compute.  Slower than the STFT texture, so it is only built
+// when the CQT axis is first shown, and on a worker thread: the first call
+// starts it, and later ones return at once until it is done, then upload it
+// and set cqt_computed.  Call every frame until then.  pcm lives in store,
+// which the worker keeps a reference to.  A new spectrogram_compute or
+// spectrogram_shutdown cancels a build.  GL thread only.
+struct PcmStore;
+void spectrogram_compute_cqt(SpectrogramState* s, PcmStore* store,
+                             const float* pcm,
+                             uint64_t     frame_count,
+                             uint32_t     channels,
+                             uint32_t     sample_rate);
+
 // Minimum frequency (Hz) for the logarithmic axis display.
 static constexpr float SPECTRO_LOG_FMIN = 20.0f;
 
 // Render into the current ImGui window's draw list.
 // Draws in the rect [x, y, x+width, y+height].
 // view_start/view_end are the visible time range in seconds.
-// max_freq: highest frequency (Hz) to display; clamped to [0, Nyquist].
-// log_freq: if true, map the y axis logarithmically (SPECTRO_LOG_FMIN..max_freq).
+// max_freq: highest frequency (Hz) to display; clamped to [0, Nyquist], and
+// to the top CQT bin on the CQT axis.
+// axis: LOG maps SPECTRO_LOG_FMIN..max_freq logarithmically; CQT spans the
+// lowest CQT bin..max_freq.
 struct ImDrawList;
 void spectrogram_render(SpectrogramState* s, ImDrawList* dl,
                         float x, float y, float width, float height,
                         double view_start, double view_end, float max_freq,
-                        bool log_freq = false);
+                        SpectroAxis axis = SPECTRO_AXIS_LINEAR);
+
+// Where frequency f is drawn on an axis, as a fraction of the height from the
+// top (0 = max_freq, 1 = bottom edge).  May fall outside [0, 1].
+float spectrogram_freq_frac(const SpectrogramState* s, SpectroAxis axis,
+                            float max_freq, float f);
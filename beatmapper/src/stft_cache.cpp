@@ -0,0 +1,308 @@
+#include "stft_cache.h"
+#include "fft.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <condition_variable>
+
+// ---------------------------------------------------------------------------
+// One block of STFT_BLOCK frames.  A block is computed outside the lock: the
+// thread that finds it missing marks it busy, computes, and publishes; other
+// threads wanting it wait on s_cv.
+// ---------------------------------------------------------------------------
+struct StftBlock {
+    float*   mag;        // frames * bins floats, or nullptr
+    int      pins;       // views currently holding this block
+    bool     busy;       // being computed
+    uint64_t last_use;
+};
+
+struct StftEntry {
+    const float*   pcm;
+    uint64_t       frame_count;
+    uint32_t       channels;
+    uint32_t       sample_rate;
+    int            n_fft;
+    int            hop;
+    StftWindow     window;
+
+    int            bins;
+    int64_t        num_frames;
+    int            num_blocks;
+    StftBlock*     blocks;
+    float*         win;
+    const FftPlan* plan;
+    StftEntry*     next;
+};
+
+static std::mutex              s_mutex;
+static std::condition_variable s_cv;
+static StftEntry*              s_entries = nullptr;
+static size_t                  s_bytes   = 0;
+static size_t                  s_budget  = STFT_DEFAULT_BUDGET;
+static uint64_t                s_clock   = 0;
+
+static size_t block_bytes(const StftEntry* e, int b)
+{
+    int64_t first = (int64_t)b * STFT_BLOCK;
+    int64_t n     = e->num_frames - first;
+    if (n > STFT_BLOCK) n = STFT_BLOCK;
+    return (size_t)n * e->bins * sizeof(float);
+}
+
+static void entry_free(StftEntry* e)
+{
+    for (int b = 0; b < e->num_blocks; b++) free(e->blocks[b].mag);
+    free(e->blocks);
+    free(e->win);
+    free(e);
+}
+
+// Drop least-recently-used unheld blocks until under budget.  Caller holds
+// s_mutex.
+static void evict_locked()
+{
+    while (s_bytes > s_budget) {
+        StftEntry* victim_e = nullptr;
+        int        victim_b = -1;
+        uint64_t   oldest   = UINT64_MAX;
+        for (StftEntry* e = s_entries; e; e = e->next)
+            for (int b = 0; b < e->num_blocks; b++) {
+                const StftBlock& bl = e->blocks[b];
+                if (bl.mag && bl.pins == 0 && bl.last_use < oldest) {
+                    oldest = bl.last_use; victim_e = e; victim_b = b;
+                }
+            }
+        if (!victim_e) return;
+        StftBlock& bl = victim_e->blocks[victim_b];
+        free(bl.mag);
+        bl.mag   = nullptr;
+        s_bytes -= block_bytes(victim_e, victim_b);
+    }
+}
+
+// Grow e to cover frame_count samples.  Only while nothing holds or is
+// computing one of its blocks: views read the block array without the lock.
+// The last block is dropped if it was partial, since it gains frames.  Caller
+// holds s_mutex.
+static bool entry_extend(StftEntry* e, uint64_t frame_count)
+{
+    for (int b = 0; b < e->num_blocks; b++)
+        if (e->blocks[b].pins > 0 || e->blocks[b].busy) return false;
+
+    int64_t num_frames = (int64_t)(frame_count - e->n_fft) / e->hop + 1;
+    int     num_blocks = (int)((num_frames + STFT_BLOCK - 1) / STFT_BLOCK);
+    if (num_blocks > e->num_blocks) {
+        StftBlock* blocks = (StftBlock*)realloc(e->blocks, num_blocks * sizeof(StftBlock));
+        if (!blocks) return false;
+        memset(blocks + e->num_blocks, 0,
+               (size_t)(num_blocks - e->num_blocks) * sizeof(StftBlock));
+        e->blocks = blocks;
+    }
+
+    int tail = e->num_blocks - 1;
+    if (tail >= 0 && e->blocks[tail].mag && e->num_frames % STFT_BLOCK != 0) {
+        s_bytes -= block_bytes(e, tail);
+        free(e->blocks[tail].mag);
+        e->blocks[tail].mag = nullptr;
+    }
+
+    e->frame_count = frame_count;
+    e->num_frames  = num_frames;
+    e->num_blocks  = num_blocks;
+    return true;
+}
+
+static float* compute_block(const StftEntry* e, int b)
+{
+    const int n_fft = e->n_fft;
+    const int bins  = e->bins;
+    int64_t   first = (int64_t)b * STFT_BLOCK;
+    int64_t   count = e->num_frames - first;
+    if (count > STFT_BLOCK) count = STFT_BLOCK;
+
+    float* mag   = (float*)malloc((size_t)count * bins * sizeof(float));
+    float* frame = (float*)malloc(n_fft * sizeof(float));
+    float* re    = (float*)malloc(bins  * sizeof(float));
+    float* im    = (float*)malloc(bins  * sizeof(float));
+    if (!mag || !frame || !re || !im) {
+        free(mag); free(frame); free(re); free(im);
+        return nullptr;
+    }
+
+    const uint32_t ch     = e->channels;
+    const float    inv_ch = 1.0f / (float)ch;
+    for (int64_t f = 0; f < count; f++) {
+        const float* src = e->pcm + (uint64_t)(first + f) * e->hop * ch;
+        if (ch == 1) {
+            for (int i = 0; i < n_fft; i++) frame[i] = src[i] * e->win[i];
+        } else {
+            for (int i = 0; i < n_fft; i++) {
+                float s = 0.0f;
+                for (uint32_t c = 0; c < ch; c++) s += src[(uint64_t)i * ch + c];
+                frame[i] = s * inv_ch * e->win[i];
+            }
+        }
+        fft_real(e->plan, frame, re, im);
+
+        float* out = mag + f * bins;
+        for (int k = 0; k < bins; k++) out[k] = sqrtf(re[k] * re[k] + im[k] * im[k]);
+    }
+
+    free(frame); free(re); free(im);
+    return mag;
+}
+
+bool stft_open(StftView* v, const float* pcm, uint64_t frame_count,
+               uint32_t channels, uint32_t sample_rate,
+               int n_fft, int hop, StftWindow window)
+{
+    memset(v, 0, sizeof(*v));
+    v->block = -1;
+    if (!pcm || channels == 0 || sample_rate == 0 || hop <= 0) return false;
+    if (frame_count < (uint64_t)n_fft) return false;
+    const FftPlan* plan = fft_plan(n_fft);
+    if (!plan || n_fft < 4) return false;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    StftEntry* e = s_entries;
+    for (; e; e = e->next)
+        if (e->pcm == pcm && e->frame_count == frame_count && e->channels == channels &&
+            e->sample_rate == sample_rate && e->n_fft == n_fft && e->hop == hop &&
+            e->window == window)
+            break;
+
+    // A buffer still being filled is reopened with a longer frame_count each
+    // time more of it is analysed; frames already computed stay valid.
+    if (!e) {
+        for (StftEntry* x = s_entries; x; x = x->next)
+            if (x->pcm == pcm && x->frame_count < frame_count && x->channels == channels &&
+                x->sample_rate == sample_rate && x->n_fft == n_fft && x->hop == hop &&
+                x->window == window && entry_extend(x, frame_count)) {
+                e = x;
+                break;
+            }
+    }
+
+    if (!e) {
+        e = (StftEntry*)calloc(1, sizeof(StftEntry));
+        if (!e) return false;
+        e->pcm         = pcm;
+        e->frame_count = frame_count;
+        e->channels    = channels;
+        e->sample_rate = sample_rate;
+        e->n_fft       = n_fft;
+        e->hop         = hop;
+        e->window      = window;
+        e->bins        = n_fft / 2 + 1;
+        e->num_frames  = (int64_t)(frame_count - n_fft) / hop + 1;
+        e->num_blocks  = (int)((e->num_frames + STFT_BLOCK - 1) / STFT_BLOCK);
+        e->plan        = plan;
+        e->blocks      = (StftBlock*)calloc(e->num_blocks, sizeof(StftBlock));
+        e->win         = (float*)malloc(n_fft * sizeof(float));
+        if (!e->blocks || !e->win) { entry_free(e); return false; }
+        for (int i = 0; i < n_fft; i++)
+            e->win[i] = 0.5f * (1.0f - cosf(2.0f * 3.14159265358979f * i / (n_fft - 1)));
+        e->next   = s_entries;
+        s_entries = e;
+    }
+
+    v->entry      = e;
+    v->n_fft      = n_fft;
+    v->hop        = hop;
+    v->bins       = e->bins;
+    v->num_frames = e->num_frames;
+    return true;
+}
+
+const float* stft_frame(StftView* v, int64_t k)
+{
+    StftEntry* e = v->entry;
+    if (!e || k < 0 || k >= v->num_frames) return nullptr;
+    int b   = (int)(k / STFT_BLOCK);
+    int off = (int)(k % STFT_BLOCK) * v->bins;
+
+    // The held block cannot be evicted, so no lock is needed to read it.
+    if (b == v->block) return e->blocks[b].mag + off;
+
+    std::unique_lock<std::mutex> lock(s_mutex);
+    if (v->block >= 0) { e->blocks[v->block].pins--; v->block = -1; }
+
+    StftBlock& bl = e->blocks[b];
+    while (!bl.mag) {
+        if (bl.busy) { s_cv.wait(lock); continue; }
+        bl.busy = true;
+        lock.unlock();
+        float* mag = compute_block(e, b);
+        lock.lock();
+        bl.busy = false;
+        s_cv.notify_all();
+        if (!mag) return nullptr;
+        bl.mag   = mag;
+        s_bytes += block_bytes(e, b);
+    }
+    bl.pins++;
+    bl.last_use = ++s_clock;
+    v->block    = b;
+    evict_locked();
+    return bl.mag + off;
+}
+
+void stft_close(StftView* v)
+{
+    if (v->entry && v->block >= 0) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        v->entry->blocks[v->block].pins--;
+    }
+    v->entry = nullptr;
+    v->block = -1;
+}
+
+void stft_grid_range(int frame_len, int hop, int64_t num_frames,
+                     int64_t s0, int64_t s1, int64_t* k0, int64_t* k1)
+{
+    *k0 = *k1 = 0;
+    if (num_frames <= 0 || s1 - s0 < frame_len) return;
+    if (s0 < 0) s0 = 0;
+
+    int64_t a = (s0 + hop - 1) / hop;
+    int64_t z = (s1 >= frame_len) ? (s1 - frame_len) / hop + 1 : 0;
+    if (z > num_frames) z = num_frames;
+    if (a < z) { *k0 = a; *k1 = z; return; }
+
+    double  centre = 0.5 * (double)(s0 + s1) - 0.5 * frame_len;
+    int64_t k      = (int64_t)floor(centre / hop + 0.5);
+    if (k < 0) k = 0;
+    if (k >= num_frames) k = num_frames - 1;
+    *k0 = k; *k1 = k + 1;
+}
+
+void stft_frame_range(const StftView* v, int64_t s0, int64_t s1,
+                      int64_t* k0, int64_t* k1)
+{
+    *k0 = *k1 = 0;
+    if (!v->entry) return;
+    stft_grid_range(v->n_fft, v->hop, v->num_frames, s0, s1, k0, k1);
+}
+
+void stft_release(const float* pcm)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    StftEntry** link = &s_entries;
+    while (*link) {
+        StftEntry* e = *link;
+        if (e->pcm != pcm) { link = &e->next; continue; }
+        for (int b = 0; b < e->num_blocks; b++)
+            if (e->blocks[b].mag) s_bytes -= block_bytes(e, b);
+        *link = e->next;
+        entry_free(e);
+    }
+}
+
+void stft_set_budget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_budget = bytes;
+    evict_locked();
+}
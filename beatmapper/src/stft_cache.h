@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ---------------------------------------------------------------------------
+// Shared per-track STFT store.
+//
+// Every FFT-based analysis (spectrogram, spectral-flux ODF, HPS / NNLS / peak
+// chroma) reads magnitude frames from here instead of running its own STFT.
+// An entry is keyed by the PCM buffer (pointer, length, channels, rate) and
+// by (FFT size, hop, window); frame k covers samples [k*hop, k*hop + n_fft)
+// of the channel-averaged signal, so every caller with the same parameters
+// sees the same frames regardless of the region it asks about.
+//
+// Frames are computed lazily in blocks of STFT_BLOCK on first access and kept
+// until the total crosses the memory budget, at which point the least
+// recently used blocks not currently held by a view are dropped (and simply
+// recomputed if asked for again).
+//
+// A buffer that grows in place (a track still decoding) may be reopened with a
+// larger frame_count: the entry is extended and keeps the frames it has, as
+// long as no view on it holds a block at that moment.
+//
+// Thread-safe: views on the same entry may be used from different threads.
+// ---------------------------------------------------------------------------
+
+enum StftWindow {
+    STFT_HANN = 0,     // symmetric Hann, 0.5 * (1 - cos(2 pi i / (n - 1)))
+};
+
+static const int    STFT_BLOCK          = 32;                    // frames per block
+static const size_t STFT_DEFAULT_BUDGET = (size_t)512 << 20;     // bytes
+
+struct StftEntry;
+
+// Cursor into one entry.  Holds at most one block at a time, so the pointer
+// returned by stft_frame() stays valid until the next stft_frame() or
+// stft_close() on the same view.
+struct StftView {
+    StftEntry* entry;
+    int        n_fft;
+    int        hop;
+    int        bins;          // n_fft / 2 + 1 magnitudes per frame (DC .. Nyquist)
+    int64_t    num_frames;    // frames that fit entirely inside the buffer
+    int        block;         // block currently held, -1 if none
+};
+
+// Open a view, creating the entry on first use.  n_fft must be a power of two
+// and hop > 0.  Returns false (and leaves v closed) if the buffer is shorter
+// than one FFT or the parameters are invalid.
+bool stft_open(StftView* v, const float* pcm, uint64_t frame_count,
+               uint32_t channels, uint32_t sample_rate,
+               int n_fft, int hop, StftWindow window);
+
+// Unnormalised magnitudes |X[0 .. bins-1]| of frame k, or nullptr if k is out
+// of range or memory ran out.
+const float* stft_frame(StftView* v, int64_t k);
+
+void stft_close(StftView* v);
+
+// Frames lying entirely inside samples [s0, s1): [*k0, *k1).  A span at least
+// one FFT long that falls between grid frames yields the single frame whose
+// centre is nearest the span's centre, so it is never reported empty.
+void stft_frame_range(const StftView* v, int64_t s0, int64_t s1,
+                      int64_t* k0, int64_t* k1);
+
+// The same selection for any grid of num_frames frames of frame_len samples,
+// frame k starting at k * hop.
+void stft_grid_range(int frame_len, int hop, int64_t num_frames,
+                     int64_t s0, int64_t s1, int64_t* k0, int64_t* k1);
+
+// Drop every entry built over pcm.  Call before the buffer is freed (or
+// reused); no view on it may be open.
+void stft_release(const float* pcm);
+
+// Memory budget for cached frames across all entries.
+void stft_set_budget(size_t bytes);
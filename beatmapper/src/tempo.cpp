@@ -0,0 +1,103 @@
+#include "tempo.h"
+#include "fft.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Raw autocorrelation sums ac[0 .. lag_max] of x[0 .. n): the FFT is padded
+// to at least n + lag_max so the circular wrap never reaches a wanted lag.
+// The power spectrum is real and even, so transforming it forward again gives
+// the inverse transform times N.
+static bool autocorr_fft(const float* x, int n, int lag_max, float* ac)
+{
+    int N = 4;
+    while (N < n + lag_max + 1) N <<= 1;
+    const FftPlan* plan = fft_plan(N);
+    const int      bins = N / 2 + 1;
+    float* buf = (float*)malloc(N    * sizeof(float));
+    float* re  = (float*)malloc(bins * sizeof(float));
+    float* im  = (float*)malloc(bins * sizeof(float));
+    if (!plan || !buf || !re || !im) { free(buf); free(re); free(im); return false; }
+
+    memcpy(buf, x, n * sizeof(float));
+    memset(buf + n, 0, (N - n) * sizeof(float));
+    fft_real(plan, buf, re, im);
+
+    for (int k = 0; k < bins; k++) buf[k] = re[k] * re[k] + im[k] * im[k];
+    for (int k = 1; k < N / 2; k++) buf[N - k] = buf[k];
+    fft_real(plan, buf, re, im);
+
+    const float inv_n = 1.0f / (float)N;
+    for (int lag = 0; lag <= lag_max; lag++) ac[lag] = re[lag] * inv_n;
+
+    free(buf); free(re); free(im);
+    return true;
+}
+
+bool tempo_curve_compute(const float* odf, int n, float fps,
+                         float min_bpm, float max_bpm, TempoCurve* out)
+{
+    memset(out, 0, sizeof(*out));
+    out->fps = fps;
+
+    int lag_min = (int)(fps * 60.0f / max_bpm);
+    int lag_max = (int)(fps * 60.0f / min_bpm);
+    if (lag_min < 1)  lag_min = 1;
+    if (lag_max >= n) lag_max = n - 1;
+    if (!odf || lag_min > lag_max) return false;
+
+    float* ac = (float*)malloc((lag_max + 1) * sizeof(float));
+    if (!ac) return false;
+    if (!autocorr_fft(odf, n, lag_max, ac)) { free(ac); return false; }
+    for (int lag = lag_min; lag <= lag_max; lag++) ac[lag] /= (float)(n - lag);
+
+    out->strength = (float*)malloc((lag_max - lag_min + 1) * sizeof(float));
+    if (!out->strength) { free(ac); return false; }
+    out->lag_min = lag_min;
+    out->count   = lag_max - lag_min + 1;
+    memcpy(out->strength, ac + lag_min, out->count * sizeof(float));
+
+    float best_val = -1.0f;
+    int   best_lag = lag_min;
+    for (int lag = lag_min; lag <= lag_max; lag++)
+        if (ac[lag] > best_val) { best_val = ac[lag]; best_lag = lag; }
+
+    // Prefer double the period if it's nearly as strong (avoids 8th-note lock).
+    int double_lag = best_lag * 2;
+    if (double_lag <= lag_max && ac[double_lag] >= best_val * 0.70f)
+        best_lag = double_lag;
+    out->best_lag = best_lag;
+
+    free(ac);
+    return true;
+}
+
+void tempo_curve_free(TempoCurve* c)
+{
+    free(c->strength);
+    c->strength = nullptr;
+    c->count    = 0;
+}
+
+float tempo_lag_bpm(const TempoCurve* c, float lag)
+{
+    return lag > 0.0f ? 60.0f * c->fps / lag : 0.0f;
+}
+
+int tempo_curve_peaks(const TempoCurve* c, int* lags, int max)
+{
+    int found = 0;
+    for (int i = 0; i < c->count; i++) {
+        float v = c->strength[i];
+        if (i > 0            && c->strength[i - 1] >= v) continue;
+        if (i + 1 < c->count && c->strength[i + 1] >  v) continue;
+
+        // Insert by strength, dropping the weakest when full.
+        int j = found < max ? found++ : max;
+        while (j > 0 && c->strength[lags[j - 1] - c->lag_min] < v) {
+            if (j < max) lags[j] = lags[j - 1];
+            j--;
+        }
+        if (j < max) lags[j] = c->lag_min + i;
+    }
+    return found;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+
+// ---------------------------------------------------------------------------
+// Tempo strength from onset-detection-function autocorrelation.
+//
+// The autocorrelation of the ODF at lag L (mean product of frames L apart)
+// measures how strongly the audio repeats with period L frames.  It is
+// computed for every lag at once through the shared FFT (fft.h): zero-pad,
+// transform, take the power spectrum, transform back -- O(n log n) however
+// wide the BPM range, where the lag-by-lag dot product was O(n * lags).
+//
+// The whole curve over the requested BPM range is kept, not just its peak,
+// so callers can list or plot alternative tempi (half / double time, swing)
+// without scanning again.
+// ---------------------------------------------------------------------------
+
+struct TempoCurve {
+    float  fps;        // ODF frames per second
+    int    lag_min;    // strength[i] is lag lag_min + i frames
+    int    count;      // number of lags (0 if the range was empty)
+    float* strength;   // mean ODF product per lag (malloc'd)
+    int    best_lag;   // strongest lag after the octave check, frames
+};
+
+// Curve for lags between 60*fps/max_bpm and 60*fps/min_bpm (clamped to the
+// ODF length).  best_lag is the strongest lag, except that double the lag
+// wins when it is at least 70% as strong -- the ODF of most music also
+// repeats at the eighth note, and that is rarely the beat the user wants.
+// Returns false (and an empty curve) if no lag is in range.
+bool tempo_curve_compute(const float* odf, int n, float fps,
+                         float min_bpm, float max_bpm, TempoCurve* out);
+
+void tempo_curve_free(TempoCurve* c);
+
+// BPM of a (possibly fractional) lag.
+float tempo_lag_bpm(const TempoCurve* c, float lag);
+
+// Local maxima of the curve, strongest first: writes up to max lags to
+// lags[] and returns how many.
+int tempo_curve_peaks(const TempoCurve* c, int* lags, int max);
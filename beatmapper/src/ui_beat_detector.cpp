@@ -1,6 +1,8 @@
 #include "ui_beat_detector.h"
+#include "tempo.h"
 #include "imgui.h"
 #include <math.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -26,16 +28,23 @@ static float  s_last_thresh   = -1.0f;
 static float  s_last_tight    = -1.0f;
 static float  s_last_pre_ms   = -1.0f;
 static bool   s_last_seeds    = false;
+static uint64_t s_last_frames  = 0;      // analysed frames the last run saw
+static double   s_last_covered = 0.0;    // ... and the seconds they cover
 
-// Seed buffer (accepted beats within the window)
-static double s_seed_buf[MAX_BEAT_CANDS];
-static int    s_seed_count = 0;
+// Seed buffer (accepted beats within the window), grown as needed
+static double* s_seed_buf = nullptr;
+static int     s_seed_cap = 0;
+static int     s_seed_count = 0;
 
 // ---------------------------------------------------------------------------
 // Helper: returns true if any params changed since last run
 // ---------------------------------------------------------------------------
-static bool params_changed(double t_start, double t_end) {
-    return (t_start     != s_last_t_start  ||
+static bool params_changed(double t_start, double t_end, const AudioState* audio) {
+    // A track still loading has grown: only matters if the window reaches
+    // past what the last run could see.
+    bool grown = audio->analysis_frames != s_last_frames && t_end > s_last_covered;
+    return (grown                          ||
+            t_start     != s_last_t_start  ||
             t_end       != s_last_t_end    ||
             s_algo_idx  != s_last_algo     ||
             s_min_bpm   != s_last_min_bpm  ||
@@ -46,7 +55,9 @@ static bool params_changed(double t_start, double t_end) {
             s_use_seeds != s_last_seeds);
 }
 
-static void save_last(double t_start, double t_end) {
+static void save_last(double t_start, double t_end, uint64_t frames, uint32_t sample_rate) {
+    s_last_frames   = frames;
+    s_last_covered  = (double)frames / sample_rate;
     s_last_t_start  = t_start;
     s_last_t_end    = t_end;
     s_last_algo     = s_algo_idx;
@@ -68,13 +79,17 @@ static void run_detection(EditorState* editor, AudioState* audio,
     uint64_t frame_count = 0;
     uint32_t channels    = 0;
     uint32_t sample_rate = 0;
-    const float* pcm = audio_pcm_data(audio, &frame_count, &channels, &sample_rate);
+    const float* pcm = audio_analysis_pcm(audio, &frame_count, &channels, &sample_rate);
     if (!pcm) return;
 
     // Collect accepted beats within the window as seeds
     s_seed_count = 0;
+    if (s_use_seeds && beatmap->count > s_seed_cap) {
+        double* buf = (double*)realloc(s_seed_buf, beatmap->count * sizeof(double));
+        if (buf) { s_seed_buf = buf; s_seed_cap = beatmap->count; }
+    }
     if (s_use_seeds) {
-        for (int i = 0; i < beatmap->count && s_seed_count < MAX_BEAT_CANDS; i++) {
+        for (int i = 0; i < beatmap->count && s_seed_count < s_seed_cap; i++) {
             double bt = beatmap->beats[i].time;
             if (bt >= t_start && bt <= t_end)
                 s_seed_buf[s_seed_count++] = bt;
@@ -92,11 +107,83 @@ static void run_detection(EditorState* editor, AudioState* audio,
 
     BEAT_ALGOS[s_algo_idx].fn(pcm, frame_count, channels, sample_rate,
                                t_start, t_end, &p, autobeat);
-    save_last(t_start, t_end);
+    save_last(t_start, t_end, frame_count, sample_rate);
     s_needs_run = false;
     (void)editor;
 }
 
+// ---------------------------------------------------------------------------
+// Tempo-strength curve of the last run, slowest tempo on the left.  The
+// detected tempo is marked; the strongest peaks are listed underneath.
+// Clicking the curve narrows the BPM range around the tempo under the mouse
+// and re-runs detection, which is how an alternative tempo is picked.
+// ---------------------------------------------------------------------------
+static void draw_tempo_curve(const AutoBeatList* ab, float w)
+{
+    const int n = ab->tempo_lag_count;
+    if (n < 2) return;
+    TempoCurve c = {};
+    c.fps      = ab->tempo_fps;
+    c.lag_min  = ab->tempo_lag_min;
+    c.count    = n;
+    c.strength = (float*)ab->tempo_strength;
+
+    const float h = 44.0f;
+    ImVec2 p0 = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton("##tempocurve", ImVec2(w, h));
+    bool   hovered = ImGui::IsItemHovered();
+    ImDrawList* dl = ImGui::GetWindowDrawList();
+    dl->AddRectFilled(p0, ImVec2(p0.x + w, p0.y + h), IM_COL32(18, 18, 30, 255));
+
+    float lo = ab->tempo_strength[0], hi = lo;
+    for (int i = 1; i < n; i++) {
+        lo = fminf(lo, ab->tempo_strength[i]);
+        hi = fmaxf(hi, ab->tempo_strength[i]);
+    }
+    float range = hi > lo ? hi - lo : 1.0f;
+
+    // Point i is lag lag_min + n - 1 - i, so tempo rises to the right.
+    ImVec2 pts[MAX_TEMPO_LAGS];
+    for (int i = 0; i < n; i++) {
+        float v = ab->tempo_strength[n - 1 - i];
+        pts[i] = ImVec2(p0.x + w * i / (n - 1),
+                        p0.y + h - 2.0f - (h - 4.0f) * (v - lo) / range);
+    }
+    dl->AddPolyline(pts, n, IM_COL32(120, 180, 255, 220), 0, 1.5f);
+
+    if (ab->estimated_bpm > 0.0f) {
+        float lag = 60.0f * c.fps / ab->estimated_bpm;
+        float x   = p0.x + w * (n - 1 - (lag - c.lag_min)) / (n - 1);
+        if (x >= p0.x && x <= p0.x + w)
+            dl->AddLine(ImVec2(x, p0.y), ImVec2(x, p0.y + h), IM_COL32(255, 200, 60, 200));
+    }
+
+    if (hovered) {
+        float frac = (ImGui::GetIO().MousePos.x - p0.x) / w;
+        int   i    = (int)(frac * (n - 1) + 0.5f);
+        if (i < 0) i = 0;
+        if (i > n - 1) i = n - 1;
+        float bpm = tempo_lag_bpm(&c, (float)(c.lag_min + n - 1 - i));
+        dl->AddLine(ImVec2(pts[i].x, p0.y), ImVec2(pts[i].x, p0.y + h), IM_COL32(200, 200, 220, 120));
+        ImGui::SetTooltip("%.1f BPM\nClick to search around this tempo", bpm);
+        if (ImGui::IsItemClicked()) {
+            s_min_bpm   = fmaxf(30.0f,  bpm / 1.08f);   // slider limits
+            s_max_bpm   = fminf(300.0f, bpm * 1.08f);
+            s_needs_run = true;
+        }
+    }
+
+    int peaks[3];
+    int np = tempo_curve_peaks(&c, peaks, 3);
+    if (np > 0) {
+        char buf[64];
+        int  len = snprintf(buf, sizeof(buf), "Peaks:");
+        for (int k = 0; k < np && len < (int)sizeof(buf); k++)
+            len += snprintf(buf + len, sizeof(buf) - len, " %.1f", tempo_lag_bpm(&c, (float)peaks[k]));
+        ImGui::TextDisabled("%s BPM", buf);
+    }
+}
+
 // ---------------------------------------------------------------------------
 // Public API
 // ---------------------------------------------------------------------------
@@ -204,17 +291,18 @@ void ui_beat_detector_content(EditorState* editor, AudioState* audio,
     if (editor->has_region) {
         t_start = editor->region_start;
         t_end   = editor->region_end;
-        have_window = (audio_pcm_data(audio, nullptr, nullptr, nullptr) != nullptr);
+        have_window = (audio_pcm_store(audio) != nullptr);
     }
 
     // --- Auto-run when window or params change ---
-    if (have_window && (params_changed(t_start, t_end) || s_needs_run))
+    if (have_window && (params_changed(t_start, t_end, audio) || s_needs_run))
         run_detection(editor, audio, beatmap, autobeat, t_start, t_end);
     else if (!have_window) {
         // Clear stale results when no window
         autobeat->beat_count  = 0;
         autobeat->onset_count = 0;
         autobeat->estimated_bpm = 0.0f;
+        autobeat->tempo_lag_count = 0;
         s_last_t_start = s_last_t_end = -99.0;
         s_last_algo    = -1;
     }
@@ -243,6 +331,7 @@ void ui_beat_detector_content(EditorState* editor, AudioState* audio,
     } else {
         ImGui::TextDisabled("No beats detected");
     }
+    if (have_window) draw_tempo_curve(autobeat, avail_w);
 
     ImGui::Spacing();
 
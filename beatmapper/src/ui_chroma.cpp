@@ -1,5 +1,7 @@
 #include "ui_chroma.h"
 #include "chroma_algo.h"
+#include "chroma_resonate.h"
+#include "chromagram.h"
 #include "imgui.h"
 #include <math.h>
 #include <string.h>
@@ -54,6 +56,55 @@ static float s_chroma[12]      = {};
 static double s_last_t_start   = -99.0;
 static double s_last_t_end     = -99.0;
 static int    s_last_algo      = -1;
+static bool   s_waiting        = false;   // s_chroma computed directly; chromagram pending
+static int    s_algo_idx       = 0;      // selected algorithm; also drives the timeline strip
+
+// Rolling Resonate window during playback: one persistent bank fed only the
+// samples played since the previous frame.
+static const float ROLL_MAX_SECS = 10.0f;       // slider maximum
+
+static ResonateStream* s_stream       = nullptr;
+static const float*    s_stream_pcm   = nullptr;    // track the bank was fed from
+static uint32_t        s_stream_sr    = 0;
+static uint32_t        s_stream_jumps = 0;          // audio->jumps at the last push
+static float           s_stream_roll  = 0.0f;
+static int64_t         s_stream_pos   = 0;          // next sample to push
+
+static void stream_chroma(const AudioState* audio, const float* pcm,
+                          uint64_t frame_count, uint32_t channels, uint32_t sample_rate,
+                          double t_end, float roll_secs)
+{
+    if (s_stream && s_stream_sr != sample_rate) {
+        resonate_stream_destroy(s_stream);
+        s_stream = nullptr;
+    }
+    if (!s_stream) {
+        s_stream = resonate_stream_create(sample_rate, ROLL_MAX_SECS);
+        if (!s_stream) return;
+        s_stream_sr  = sample_rate;
+        s_stream_pcm = nullptr;                      // force a restart below
+    }
+
+    // Anything but forward playback within one window (seek, loop wrap, new
+    // track, window resize) restarts the bank on the new window.
+    int64_t end  = (int64_t)(t_end * sample_rate);
+    if (end > (int64_t)frame_count) end = (int64_t)frame_count;
+    int64_t roll = (int64_t)(roll_secs * sample_rate);
+    if (pcm != s_stream_pcm || audio->jumps != s_stream_jumps ||
+        roll_secs != s_stream_roll || end < s_stream_pos || end - s_stream_pos > roll) {
+        resonate_stream_reset(s_stream);
+        s_stream_pcm   = pcm;
+        s_stream_jumps = audio->jumps;
+        s_stream_roll  = roll_secs;
+        s_stream_pos   = end - roll > 0 ? end - roll : 0;
+    }
+    if (end > s_stream_pos) {
+        resonate_stream_push(s_stream, pcm + (uint64_t)s_stream_pos * channels,
+                             (uint64_t)(end - s_stream_pos), channels);
+        s_stream_pos = end;
+    }
+    resonate_stream_read_chroma(s_stream, roll_secs, s_chroma);
+}
 
 // ---------------------------------------------------------------------------
 // Public API
@@ -62,14 +113,13 @@ static int    s_last_algo      = -1;
 void ui_chroma_content(EditorState* editor, AudioState* audio)
 {
     // Persistent UI state
-    static int   s_algo_idx      = 0;
     static float s_roll_secs     = 2.0f;
 
     // Fetch PCM
     uint64_t frame_count = 0;
     uint32_t channels    = 0;
     uint32_t sample_rate = 0;
-    const float* pcm = audio_pcm_data(audio, &frame_count, &channels, &sample_rate);
+    const float* pcm = audio_analysis_pcm(audio, &frame_count, &channels, &sample_rate);
 
     // Determine analysis window
     double t_start = 0.0, t_end = 0.0;
@@ -87,12 +137,36 @@ void ui_chroma_content(EditorState* editor, AudioState* audio)
         }
     }
 
-    // Recompute when window or algorithm changes
-    if (have_window && (t_start  != s_last_t_start ||
+    // Recompute when window or algorithm changes.  A rolling Resonate window
+    // is updated incrementally instead.
+    bool streaming = have_window && !editor->has_region &&
+                     CHROMA_ALGOS[s_algo_idx].fn == chroma_resonate;
+    if (streaming) {
+        stream_chroma(audio, pcm, frame_count, channels, sample_rate, t_end, s_roll_secs);
+        s_last_t_start = s_last_t_end = -99.0;
+        s_last_algo    = -1;
+    } else if (have_window && (t_start  != s_last_t_start ||
                         t_end    != s_last_t_end   ||
-                        s_algo_idx != s_last_algo)) {
-        CHROMA_ALGOS[s_algo_idx].fn(pcm, frame_count, channels, sample_rate,
-                                     t_start, t_end, s_chroma);
+                        s_algo_idx != s_last_algo || s_waiting)) {
+        // Regions come from the whole-track chromagram (built once per
+        // track and algorithm), so dragging one is instant at any length.
+        // Until its background build reaches the region, compute the region
+        // directly once and keep checking for the chromagram's answer.
+        const ChromaAlgoDesc* algo = &CHROMA_ALGOS[s_algo_idx];
+        Chromagram* g = editor->has_region
+                      ? chromagram_get(algo, pcm, frame_count, channels, sample_rate)
+                      : nullptr;
+        bool changed = t_start != s_last_t_start || t_end != s_last_t_end ||
+                       s_algo_idx != s_last_algo;
+        float c[12];
+        if (g && chromagram_query(g, t_start, t_end, c)) {
+            memcpy(s_chroma, c, sizeof(s_chroma));
+            s_waiting = false;
+        } else {
+            if (changed)
+                algo->fn(pcm, frame_count, channels, sample_rate, t_start, t_end, s_chroma);
+            s_waiting = g != nullptr;
+        }
         s_last_t_start = t_start;
         s_last_t_end   = t_end;
         s_last_algo    = s_algo_idx;
@@ -125,7 +199,7 @@ void ui_chroma_content(EditorState* editor, AudioState* audio)
     // --- Rolling window size (shown only when not using a region) ---
     if (!editor->has_region) {
         ImGui::SetNextItemWidth(avail_w);
-        if (ImGui::SliderFloat("##win", &s_roll_secs, 0.5f, 10.0f, "roll %.1fs")) {
+        if (ImGui::SliderFloat("##win", &s_roll_secs, 0.5f, ROLL_MAX_SECS, "roll %.1fs")) {
             s_last_t_start = s_last_t_end = -99.0;
         }
         if (ImGui::IsItemHovered())
@@ -217,3 +291,42 @@ void ui_chroma_content(EditorState* editor, AudioState* audio)
                           NOTE_NAMES[editor->chroma_hover_note],
                           s_chroma[editor->chroma_hover_note] * 100.0f);
 }
+
+void ui_chroma_strip(AudioState* audio, ImDrawList* dl, float x, float y,
+                     float w, float h, double view_start, double view_end)
+{
+    dl->AddRectFilled(ImVec2(x, y), ImVec2(x + w, y + h), chroma_colormap(0.0f));
+    if (w <= 0.0f || view_end <= view_start) return;
+
+    uint64_t frame_count = 0;
+    uint32_t channels    = 0;
+    uint32_t sample_rate = 0;
+    const float* pcm = audio_analysis_pcm(audio, &frame_count, &channels, &sample_rate);
+    if (!pcm) return;
+    Chromagram* g = chromagram_get(&CHROMA_ALGOS[s_algo_idx], pcm, frame_count,
+                                   channels, sample_rate);
+    if (!g) return;
+
+    // Tiles about two pixels wide; each is finished once and memoised.
+    const double px_sec = (view_end - view_start) / w;
+    const int    level  = chromagram_level(g, 2.0 * px_sec);
+    const float  row_h  = h / 12.0f;
+    int64_t k   = chromagram_tile_at(g, level, view_start);
+    int64_t end = chromagram_tile_at(g, level, view_end);
+    if (k < 0) k = 0;
+
+    dl->PushClipRect(ImVec2(x, y), ImVec2(x + w, y + h), true);
+    for (; k <= end; k++) {
+        double t0, t1;
+        const float* c = chromagram_tile(g, level, k, &t0, &t1);
+        if (!c) break;
+        float x0 = x + (float)((t0 - view_start) / px_sec);
+        float x1 = x + (float)((t1 - view_start) / px_sec);
+        for (int pc = 0; pc < 12; pc++) {
+            float y1 = y + h - (float)pc * row_h;        // C at the bottom
+            dl->AddRectFilled(ImVec2(x0, y1 - row_h), ImVec2(x1, y1),
+                              chroma_colormap(c[pc]));
+        }
+    }
+    dl->PopClipRect();
+}
@@ -7,3 +7,10 @@
 // dock into the drawer or a floating window.  Updates
 // editor->chroma_hover_note each frame; the dock resets it when hidden.
 void ui_chroma_content(EditorState* editor, AudioState* audio);
+
+// Chromagram band for the timeline: the whole-track chromagram of the
+// panel's selected algorithm over [view_start, view_end), drawn into the
+// rect [x, y, x+w, y+h] with C at the bottom and B at the top.
+struct ImDrawList;
+void ui_chroma_strip(AudioState* audio, ImDrawList* dl, float x, float y,
+                     float w, float h, double view_start, double view_end);
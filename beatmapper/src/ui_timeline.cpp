@@ -6,6 +6,7 @@
 #include "ui_annstrip.h"
 #include "beat_algo.h"
 #include "ui_beat_detector.h"
+#include "ui_chroma.h"
 #include "ui_smoothing.h"
 #include "panels.h"
 #include "undo.h"
@@ -437,6 +438,7 @@ static const float SECTION_H         = 52.0f;  // section strip
 static const float LYRIC_H       = 36.0f;  // lyric strip
 static const float COLLAPSED_H   = 12.0f;  // any strip collapsed to a display band
 static const float STRIP_DIV_H   = 1.0f;   // single divider line between strips
+static const float CHROMA_STRIP_H = 48.0f; // chromagram band under the spectrogram
 
 // Per-kind fill and border colours (index = SectionKind)
 static const ImU32 s_sec_fill[SK_COUNT] = {
@@ -488,7 +490,7 @@ void ui_timeline_render(EditorState* editor, AudioState* audio,
     ImGuiIO& io = ImGui::GetIO();
 
     static int  s_spectro_max_khz  = 22;     // max displayed frequency [2, 22] kHz
-    static bool s_spectro_log      = false;  // logarithmic frequency axis
+    static SpectroAxis s_spectro_axis = SPECTRO_AXIS_LINEAR;  // frequency axis
 
     // Strips are always present; the per-strip panel flags now mean
     // "expanded".  Collapsed strips shrink to a slim display-only band.
@@ -586,6 +588,13 @@ void ui_timeline_render(EditorState* editor, AudioState* audio,
     float ruler_y = mm_y + mm_h + 2.0f;
     float tx = cx,   ty = ruler_y + RULER_H + 2.0f,   tw = cw,   th = spectro_h;
 
+    // While the Chroma panel is open, the bottom of the spectrogram row
+    // shows the chromagram of its selected algorithm.  th still spans the
+    // whole row (selection, playhead); sg_h is the spectrogram part.
+    float chroma_h = editor->show_chroma_panel && th > 3.0f * CHROMA_STRIP_H
+                   ? CHROMA_STRIP_H : 0.0f;
+    float sg_h     = th - chroma_h;
+
     // Running-y: every strip is always present (collapsed or expanded), with a
     // single divider line above each.
     float _y = ty + th;
@@ -1540,29 +1549,27 @@ void ui_timeline_render(EditorState* editor, AudioState* audio,
     }
 
     // Frequency axis labels aligned to the spectrogram row
-    if (spectro->computed && spectro->sample_rate > 0 && th > 0.0f) {
+    if (spectro->computed && spectro->sample_rate > 0 && sg_h > 0.0f) {
         float nyquist = (float)(spectro->sample_rate / 2);
         float max_freq_hz = (float)(s_spectro_max_khz * 1000);
         if (max_freq_hz > nyquist) max_freq_hz = nyquist;
         static const int   sb_freqs[] = {
+            100, 200, 500,
             1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000, 10000, 12000, 16000, 20000 };
         static const char* sb_names[] = {
+            "100", "200", "500",
             "1k", "2k", "3k", "4k", "5k", "6k", "7k", "8k", "10k", "12k", "16k", "20k" };
         int   n_sb    = (int)(sizeof(sb_freqs) / sizeof(sb_freqs[0]));
         float lh      = ImGui::GetTextLineHeight();
         float last_bot = ty - lh - 2.0f;  // primed so the first label always passes
-        float log_range = s_spectro_log ? logf(max_freq_hz / SPECTRO_LOG_FMIN) : 0.0f;
         for (int i = n_sb - 1; i >= 0; i--) {  // high-freq → low-freq  (top → bottom)
             if (sb_freqs[i] >= (int)max_freq_hz) continue;
-            float frac;
-            if (s_spectro_log && log_range > 0.0f && sb_freqs[i] > SPECTRO_LOG_FMIN)
-                frac = 1.0f - logf((float)sb_freqs[i] / SPECTRO_LOG_FMIN) / log_range;
-            else
-                frac = 1.0f - (float)sb_freqs[i] / max_freq_hz;
-            float cy_freq = ty + frac * th;
+            float frac = spectrogram_freq_frac(spectro, s_spectro_axis, max_freq_hz,
+                                               (float)sb_freqs[i]);
+            float cy_freq = ty + frac * sg_h;
             float label_y = cy_freq - lh * 0.5f;
             if (label_y < ty) continue;
-            if (label_y + lh > ty + th) continue;
+            if (label_y + lh > ty + sg_h) continue;
             if (label_y < last_bot + 1.0f) continue;   // skip if overlapping
             ImVec2 ts = ImGui::CalcTextSize(sb_names[i]);
             dl->AddText(ImVec2(cx - ts.x - 4.0f, label_y),
@@ -1583,13 +1590,22 @@ void ui_timeline_render(EditorState* editor, AudioState* audio,
     draw_ruler(dl, cx, ruler_y, cw, RULER_H,
                editor->view_start, editor->view_end);
 
-    spectrogram_render(spectro, dl, tx, ty, tw, th,
+    if (s_spectro_axis == SPECTRO_AXIS_CQT && spectro->computed && !spectro->cqt_computed) {
+        uint64_t nframes = 0;
+        uint32_t nch = 0, sr = 0;
+        const float* pcm = audio_analysis_pcm(audio, &nframes, &nch, &sr);
+        if (pcm) spectrogram_compute_cqt(spectro, audio_pcm_store(audio), pcm, nframes, nch, sr);
+    }
+    spectrogram_render(spectro, dl, tx, ty, tw, sg_h,
                        editor->view_start, editor->view_end,
-                       (float)(s_spectro_max_khz * 1000), s_spectro_log);
+                       (float)(s_spectro_max_khz * 1000), s_spectro_axis);
+    if (chroma_h > 0.0f)
+        ui_chroma_strip(audio, dl, tx, ty + sg_h, tw, chroma_h,
+                        editor->view_start, editor->view_end);
 
     // Spectrogram view controls, overlaid in the upper-left corner of the view:
-    // Log toggle and +/- max-frequency buttons.  Semi-transparent so the
-    // spectrogram stays readable underneath.
+    // Log / CQT axis toggles and +/- max-frequency buttons.  Semi-transparent
+    // so the spectrogram stays readable underneath.
     {
         bool at_max = (s_spectro_max_khz >= 22);
         bool at_min = (s_spectro_max_khz <= 2);
@@ -1599,17 +1615,26 @@ void ui_timeline_render(EditorState* editor, AudioState* audio,
         float by = ty + 6.0f;
         const float BW = 26.0f;
 
-        // Log toggle button — snapshot state before Button() which may flip it
-        bool log_active = s_spectro_log;
-        if (log_active) {
-            ImGui::PushStyleColor(ImGuiCol_Button,        IM_COL32(45, 100, 55, 220));
-            ImGui::PushStyleColor(ImGuiCol_ButtonHovered, IM_COL32(60, 130, 70, 255));
+        // Axis toggle buttons — snapshot state before Button() which may flip
+        // it.  Turning the active one off returns to the linear axis.
+        struct AxisButton { const char* label; SpectroAxis axis; const char* tip; };
+        static const AxisButton axis_buttons[] = {
+            { "Log##sl", SPECTRO_AXIS_LOG, "Logarithmic frequency axis" },
+            { "CQT##sq", SPECTRO_AXIS_CQT, "Constant-Q transform, 36 bins/octave (C2 up)" },
+        };
+        for (const AxisButton& ab : axis_buttons) {
+            bool active = (s_spectro_axis == ab.axis);
+            if (active) {
+                ImGui::PushStyleColor(ImGuiCol_Button,        IM_COL32(45, 100, 55, 220));
+                ImGui::PushStyleColor(ImGuiCol_ButtonHovered, IM_COL32(60, 130, 70, 255));
+            }
+            ImGui::SetCursorScreenPos(ImVec2(bx, by));
+            if (ImGui::Button(ab.label, ImVec2(34.0f, 0)))
+                s_spectro_axis = active ? SPECTRO_AXIS_LINEAR : ab.axis;
+            if (active) ImGui::PopStyleColor(2);
+            if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", ab.tip);
+            bx += 34.0f + 4.0f;
         }
-        ImGui::SetCursorScreenPos(ImVec2(bx, by));
-        if (ImGui::Button("Log##sl", ImVec2(34.0f, 0))) s_spectro_log = !s_spectro_log;
-        if (log_active) ImGui::PopStyleColor(2);
-        if (ImGui::IsItemHovered()) ImGui::SetTooltip("Logarithmic frequency axis");
-        bx += 34.0f + 4.0f;
 
         ImGui::SetCursorScreenPos(ImVec2(bx, by));
         if (at_min) ImGui::BeginDisabled();
@@ -1648,19 +1673,11 @@ void ui_timeline_render(EditorState* editor, AudioState* audio,
             if (freq_hi > max_freq_hz) freq_hi = max_freq_hz;
 
             // Frequency → y: higher freq = smaller y (higher on screen)
-            float y_top, y_bot;
-            if (s_spectro_log) {
-                float lr = logf(max_freq_hz / SPECTRO_LOG_FMIN);
-                float fhi = freq_hi > SPECTRO_LOG_FMIN ? freq_hi : SPECTRO_LOG_FMIN;
-                float flo = freq_lo > SPECTRO_LOG_FMIN ? freq_lo : SPECTRO_LOG_FMIN;
-                y_top = ty + th * (1.0f - logf(fhi / SPECTRO_LOG_FMIN) / lr);
-                y_bot = ty + th * (1.0f - logf(flo / SPECTRO_LOG_FMIN) / lr);
-            } else {
-                y_top = ty + th * (1.0f - freq_hi / max_freq_hz);
-                y_bot = ty + th * (1.0f - freq_lo / max_freq_hz);
-            }
+            float y_top = ty + sg_h * spectrogram_freq_frac(spectro, s_spectro_axis, max_freq_hz, freq_hi);
+            float y_bot = ty + sg_h * spectrogram_freq_frac(spectro, s_spectro_axis, max_freq_hz, freq_lo);
+            if (y_top >= ty + sg_h) continue;            // below the axis
             if (y_top < ty)        y_top = ty;
-            if (y_bot > ty + th)   y_bot = ty + th;
+            if (y_bot > ty + sg_h) y_bot = ty + sg_h;
             if (y_bot <= y_top + 0.5f) y_bot = y_top + 1.0f;
 
             dl->AddRectFilled(ImVec2(tx, y_top), ImVec2(tx + tw, y_bot),
@@ -187,6 +187,10 @@ void ui_toolbar_render(EditorState* editor, AudioState* audio, BeatMap* beatmap,
         const char* slash = strrchr(audio->filename, '/');
         const char* name  = slash ? slash + 1 : audio->filename;
         ImGui::TextDisabled("%s", name);
+        if (audio->loading) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(decoding %d%%)", (int)(audio->load_progress * 100.0f));
+        }
     }
     if (beatmap->dirty) {
         ImGui::SameLine();
@@ -1,4 +1,6 @@
 #include "wsola.h"
+#include "pcm_store.h"
+#include "simd.h"
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
@@ -33,6 +35,145 @@ static ma_data_source_vtable s_vtable = {
     0,      // flags
 };
 
+// Frames of pcm that may be read: everything, or what the decoder has
+// committed so far.
+static inline uint64_t readable_frames(const WsolaSource* ws)
+{
+    return ws->store ? pcm_store_decoded(ws->store) : ws->frame_count;
+}
+
+static inline bool input_complete(const WsolaSource* ws)
+{
+    return !ws->store || pcm_store_complete(ws->store);
+}
+
+// ---- similarity search ------------------------------------------------------
+
+// Dot product of n floats (a multiple of 16).  The scalar loop sums in order;
+// the vector ones in lanes, so they can differ from it in the last bits.
+static float dot_scalar(const float* a, const float* b, int n)
+{
+    float acc = 0.0f;
+    for (int i = 0; i < n; i++) acc += a[i] * b[i];
+    return acc;
+}
+
+static float dot_f4(const float* a, const float* b, int n)
+{
+    f4 s0 = f4_set1(0.0f), s1 = f4_set1(0.0f);
+    for (int i = 0; i < n; i += 8) {
+        s0 = f4_madd(f4_load(a + i),     f4_load(b + i),     s0);
+        s1 = f4_madd(f4_load(a + i + 4), f4_load(b + i + 4), s1);
+    }
+    return f4_hsum(f4_add(s0, s1));
+}
+
+#if SIMD_HAVE_AVX2
+SIMD_AVX2_FN static float dot_avx2(const float* a, const float* b, int n)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    for (int i = 0; i < n; i += 16) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i),     _mm256_loadu_ps(b + i),     s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+    }
+    __m256 s  = _mm256_add_ps(s0, s1);
+    __m128 h  = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+    return _mm_cvtss_f32(h);
+}
+#endif
+
+static inline float dot(SimdLevel level, const float* a, const float* b, int n)
+{
+#if SIMD_HAVE_AVX2
+    if (level == SIMD_AVX2) return dot_avx2(a, b, n);
+#endif
+    if (level == SIMD_SCALAR) return dot_scalar(a, b, n);
+    return dot_f4(a, b, n);
+}
+
+// Best of candidates [c0, c1] by correlation with ref: the first one scoring
+// highest, as in a plain scan.
+static int64_t scan(SimdLevel level, const float* ref, const float* src, uint32_t ch,
+                    int64_t c0, int64_t c1, float* best_corr, int64_t best)
+{
+    for (int64_t c = c0; c <= c1; c++) {
+        float corr = dot(level, ref, src + c * ch, WSOLA_HOP * (int)ch);
+        if (corr > *best_corr) { *best_corr = corr; best = c; }
+    }
+    return best;
+}
+
+// Sum runs of WSOLA_COARSE frames: out frame j is in frames
+// [j * WSOLA_COARSE, (j + 1) * WSOLA_COARSE).
+static void coarsen(const float* in, int out_frames, uint32_t ch, float* out)
+{
+    for (int j = 0; j < out_frames; j++)
+        for (uint32_t c = 0; c < ch; c++) {
+            const float* p = in + (size_t)j * WSOLA_COARSE * ch + c;
+            float s = 0.0f;
+            for (int q = 0; q < WSOLA_COARSE; q++) s += p[q * ch];
+            out[j * ch + c] = s;
+        }
+}
+
+// The candidate among count, whose first frames are src[0], src[ch], ...,
+// whose next WSOLA_HOP frames best match ref.  Audio thread: no allocation.
+static int search(const WsolaSource* ws, const float* ref, const float* src, int count)
+{
+    const uint32_t  ch    = ws->channels;
+    const SimdLevel level = simd_level();
+    float best_corr = -FLT_MAX;
+    if (!ws->coarse || count <= 2 * WSOLA_COARSE)
+        return (int)scan(level, ref, src, ch, 0, count - 1, &best_corr, 0);
+
+    // Coarse pass: candidate m * WSOLA_COARSE scored on summed frames.
+    const int CHOP = WSOLA_HOP / WSOLA_COARSE;
+    const int MAXC = 2 * WSOLA_SEARCH / WSOLA_COARSE + 1;
+    float cref[CHOP * WSOLA_MAX_CH];
+    float csrc[(MAXC + CHOP) * WSOLA_MAX_CH];
+    float ccorr[MAXC];
+    const int m_count = (count - 1) / WSOLA_COARSE + 1;
+    coarsen(ref, CHOP, ch, cref);
+    coarsen(src, m_count - 1 + CHOP, ch, csrc);
+    for (int m = 0; m < m_count; m++)
+        ccorr[m] = dot(level, cref, csrc + m * ch, CHOP * (int)ch);
+
+    // The WSOLA_PEAKS highest local maxima, best first.
+    int   peak[WSOLA_PEAKS];
+    int   npeak = 0;
+    for (int m = 0; m < m_count; m++) {
+        if ((m > 0 && ccorr[m - 1] > ccorr[m]) || (m + 1 < m_count && ccorr[m + 1] > ccorr[m]))
+            continue;
+        int at = npeak < WSOLA_PEAKS ? npeak++ : WSOLA_PEAKS;
+        while (at > 0 && ccorr[peak[at - 1]] < ccorr[m]) {
+            if (at < WSOLA_PEAKS) peak[at] = peak[at - 1];
+            at--;
+        }
+        if (at < WSOLA_PEAKS) peak[at] = m;
+    }
+
+    // Fine pass around each, in ascending order with overlaps merged, so ties
+    // go to the earliest candidate as in the full scan.
+    for (int i = 1; i < npeak; i++)
+        for (int j = i; j > 0 && peak[j - 1] > peak[j]; j--) {
+            int t = peak[j]; peak[j] = peak[j - 1]; peak[j - 1] = t;
+        }
+    int64_t best = 0, done = -1;
+    for (int i = 0; i < npeak; i++) {
+        int64_t c0 = (int64_t)peak[i] * WSOLA_COARSE - WSOLA_COARSE;
+        int64_t c1 = (int64_t)peak[i] * WSOLA_COARSE + WSOLA_COARSE;
+        if (c0 <= done)     c0 = done + 1;
+        if (c1 > count - 1) c1 = count - 1;
+        if (c0 < 0)         c0 = 0;
+        if (c1 < c0) continue;
+        best = scan(level, ref, src, ch, c0, c1, &best_corr, best);
+        done = c1;
+    }
+    return (int)best;
+}
+
 // ---- core WSOLA step --------------------------------------------------------
 
 // Generate one synthesis hop (WSOLA_HOP frames) into ws->output_buf.
@@ -43,36 +184,50 @@ static void wsola_step(WsolaSource* ws)
     const int    HOP    = WSOLA_HOP;
     const int    SEARCH = WSOLA_SEARCH;
     const uint32_t ch   = ws->channels;
+    const uint64_t n    = readable_frames(ws);
 
     double input_pos = ws->input_pos;
     float  speed     = ws->speed.load(std::memory_order_relaxed);
     float  pitch     = ws->pitch.load(std::memory_order_relaxed);
     if (pitch < 0.01f) pitch = 0.01f;  // guard against division by zero
 
+    // Input frame f is at pcm + (f - base) * ch.  A compact store is
+    // converted to f32 only over the frames this step can touch: the search
+    // range around input_pos plus one frame, or the last frame of the input.
+    const float* pcm  = ws->pcm;
+    int64_t      base = 0;
+    if (!pcm) {
+        int64_t ip = (int64_t)input_pos;
+        int64_t lo = ip - SEARCH;
+        if (lo > (int64_t)n - FRAME) lo = (int64_t)n - FRAME;
+        if (lo < 0) lo = 0;
+        int64_t hi = ip + SEARCH + FRAME;
+        if (hi > (int64_t)n) hi = (int64_t)n;
+        if (hi > lo) pcm_store_read(ws->store, (uint64_t)lo, (uint64_t)(hi - lo), ws->window);
+        pcm  = ws->window;
+        base = lo;
+    }
+
     // 1. Find the best analysis position by maximizing cross-correlation
-    //    between the candidate input frame and the current overlap tail.
+    //    between the candidate input frame and the current overlap tail,
+    //    over the offsets within ±SEARCH whose HOP frames are all readable.
     int best_delta = 0;
-    if (!ws->first_frame && ws->frame_count >= (uint64_t)HOP) {
-        float best_corr = -FLT_MAX;
-        for (int d = -SEARCH; d <= SEARCH; d++) {
-            int64_t cand = (int64_t)input_pos + d;
-            if (cand < 0 || (uint64_t)(cand + HOP) > ws->frame_count) continue;
-            float corr = 0.0f;
-            const float* src = ws->pcm + cand * ch;
-            const float* ref = ws->synth_buf;   // current overlap tail
-            for (int i = 0; i < HOP; i++) {
-                for (uint32_t c = 0; c < ch; c++)
-                    corr += ref[i * ch + c] * src[i * ch + c];
-            }
-            if (corr > best_corr) { best_corr = corr; best_delta = d; }
-        }
+    if (!ws->first_frame && n >= (uint64_t)HOP) {
+        int64_t ip = (int64_t)input_pos;
+        int64_t c0 = ip - SEARCH;
+        int64_t c1 = ip + SEARCH;
+        if (c0 < 0) c0 = 0;
+        if (c1 > (int64_t)n - HOP) c1 = (int64_t)n - HOP;
+        if (c1 >= c0)
+            best_delta = (int)(c0 - ip) +
+                         search(ws, ws->synth_buf, pcm + (c0 - base) * ch, (int)(c1 - c0 + 1));
     }
 
     // 2. Clamp the final read position so it never goes out of bounds.
     int64_t read_pos = (int64_t)input_pos + best_delta;
     if (read_pos < 0) read_pos = 0;
-    if ((int64_t)ws->frame_count >= FRAME) {
-        int64_t max_pos = (int64_t)ws->frame_count - FRAME;
+    if ((int64_t)n >= FRAME) {
+        int64_t max_pos = (int64_t)n - FRAME;
         if (read_pos > max_pos) read_pos = max_pos;
     } else {
         read_pos = 0;
@@ -81,9 +236,9 @@ static void wsola_step(WsolaSource* ws)
     // 3. Overlap-add: Hann-windowed input frame into synth_buf.
     for (int i = 0; i < FRAME; i++) {
         int64_t fi = read_pos + i;
-        if (fi >= 0 && (uint64_t)fi < ws->frame_count) {
+        if (fi >= 0 && (uint64_t)fi < n) {
             float w = hann(i, FRAME);
-            const float* src = ws->pcm + fi * ch;
+            const float* src = pcm + (fi - base) * ch;
             for (uint32_t c = 0; c < ch; c++)
                 ws->synth_buf[i * ch + c] += src[c] * w;
         }
@@ -124,8 +279,24 @@ static ma_result wsola_on_read(ma_data_source* pDS, void* pFramesOut,
             bool     loop_en = ws->loop_enabled.load(std::memory_order_relaxed);
             uint64_t loop_e  = ws->loop_end_frames.load(std::memory_order_relaxed);
             uint64_t loop_s  = ws->loop_start_frames.load(std::memory_order_relaxed);
+            uint64_t avail   = readable_frames(ws);
+            bool     done    = input_complete(ws);
+            uint64_t end     = done ? avail : ws->frame_count;
+            if (loop_e > end) loop_e = end;
             double   eof     = (loop_en && loop_e > loop_s) ? (double)loop_e
-                                                             : (double)ws->frame_count;
+                                                             : (double)end;
+            // Still decoding and the next frame (with its search window) is
+            // not in yet: idle on silence until it is rather than ending.
+            if (!done) {
+                double need = ws->input_pos + WSOLA_FRAME + WSOLA_SEARCH;
+                if (need > eof) need = eof;
+                if (need > (double)avail) {
+                    memset(out + written * ch, 0,
+                           (size_t)(frameCount - written) * ch * sizeof(float));
+                    written = frameCount;
+                    break;
+                }
+            }
             if (ws->input_pos >= eof) {
                 if (loop_en && loop_e > loop_s) {
                     // Seamless wrap: modulo the loop range.
@@ -136,6 +307,7 @@ static ma_result wsola_on_read(ma_data_source* pDS, void* pFramesOut,
                                     fmod(ws->input_pos - (double)loop_s, range);
                     ws->cursor_frames.store((uint64_t)ws->input_pos,
                                            std::memory_order_relaxed);
+                    ws->jumps.fetch_add(1, std::memory_order_relaxed);
                 } else {
                     break;  // EOF, no loop
                 }
@@ -165,6 +337,7 @@ static ma_result wsola_on_seek(ma_data_source* pDS, ma_uint64 frameIndex)
     ws->output_offset  = 0;
     ws->first_frame    = true;
     ws->cursor_frames.store(frameIndex, std::memory_order_relaxed);
+    ws->jumps.fetch_add(1, std::memory_order_relaxed);
     memset(ws->synth_buf, 0, sizeof(ws->synth_buf));
     return MA_SUCCESS;
 }
@@ -193,7 +366,7 @@ static ma_result wsola_on_get_cursor(ma_data_source* pDS, ma_uint64* pCursor)
 static ma_result wsola_on_get_length(ma_data_source* pDS, ma_uint64* pLength)
 {
     WsolaSource* ws = (WsolaSource*)pDS;
-    *pLength = ws->frame_count;
+    *pLength = readable_frames(ws);
     return MA_SUCCESS;
 }
 
@@ -206,18 +379,24 @@ bool wsola_init(WsolaSource* ws, float* pcm, uint64_t frames,
     memset(&ws->base,           0, sizeof(ws->base));
     memset(ws->synth_buf,       0, sizeof(ws->synth_buf));
     memset(ws->output_buf,      0, sizeof(ws->output_buf));
+    memset(ws->window,          0, sizeof(ws->window));
     ws->pcm            = nullptr;
     ws->frame_count    = 0;
     ws->channels       = 0;
     ws->sample_rate    = 0;
     ws->owns_pcm       = false;
+    ws->store          = nullptr;
     ws->input_pos      = 0.0;
     ws->output_pending = 0;
     ws->output_offset  = 0;
     ws->first_frame    = false;
+    const char* mode   = getenv("RIFFHOUND_WSOLA_SEARCH");
+    ws->coarse         = mode && strcmp(mode, "coarse") == 0;
+    simd_level();   // detected here rather than on the audio thread
     ws->speed.store(1.0f, std::memory_order_relaxed);
     ws->pitch.store(1.0f, std::memory_order_relaxed);
     ws->cursor_frames.store(0, std::memory_order_relaxed);
+    ws->jumps.store(0, std::memory_order_relaxed);
     ws->loop_enabled.store(false, std::memory_order_relaxed);
     ws->loop_start_frames.store(0, std::memory_order_relaxed);
     ws->loop_end_frames.store(0, std::memory_order_relaxed);
@@ -235,6 +414,11 @@ bool wsola_init(WsolaSource* ws, float* pcm, uint64_t frames,
     return true;
 }
 
+void wsola_set_store(WsolaSource* ws, const PcmStore* store)
+{
+    ws->store = store;
+}
+
 void wsola_uninit(WsolaSource* ws)
 {
     ma_data_source_uninit(&ws->base);
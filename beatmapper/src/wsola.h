@@ -14,15 +14,33 @@
 #define WSOLA_SEARCH    128   // ±sample search radius for best analysis frame
 #define WSOLA_MAX_CH      2   // maximum supported channel count
 
+// The search for the best analysis frame scores every offset in the radius
+// with vector dot products (simd.h), and so picks the same offset as the
+// scalar loop it replaced, up to float summation order.
+//
+// RIFFHOUND_WSOLA_SEARCH=coarse opts into an approximate coarse-to-fine
+// search at about a third of the cost: every WSOLA_COARSE-th offset is scored
+// on signals summed over WSOLA_COARSE frames, and only the WSOLA_PEAKS best
+// coarse maxima are re-scored at full resolution, ±WSOLA_COARSE around each.
+// It picks a different offset in up to 0.6% of hops.
+#define WSOLA_COARSE      2
+#define WSOLA_PEAKS       4
+
 struct WsolaSource {
     ma_data_source_base base;   // must be first member
 
-    // Input PCM (interleaved f32, channels <= WSOLA_MAX_CH)
+    // Input PCM (interleaved f32, channels <= WSOLA_MAX_CH).  nullptr when
+    // playing a store held in a compact format: each step then converts the
+    // frames it can reach into window.
     float*   pcm;
     uint64_t frame_count;
     uint32_t channels;
     uint32_t sample_rate;
     bool     owns_pcm;      // if true, wsola_uninit frees pcm
+    // Set while the track is still decoding into pcm: only its committed
+    // prefix is read, and playback idles at the decode front instead of
+    // ending there.  nullptr = all frame_count frames are present.
+    const struct PcmStore* store;
 
     // Playback state
     // input_pos written by audio thread; cursor_frames readable from any thread
@@ -30,6 +48,7 @@ struct WsolaSource {
     std::atomic<float>    speed;           // [0.25, 2.0]; set from main thread
     std::atomic<float>    pitch;           // [0.5, 2.0] ratio; set from main thread
     std::atomic<uint64_t> cursor_frames;   // last committed input frame (for UI)
+    std::atomic<uint32_t> jumps;           // bumped on every seek and loop wrap
 
     // Loop parameters (set from main thread, read from audio thread)
     std::atomic<bool>     loop_enabled;
@@ -38,11 +57,14 @@ struct WsolaSource {
 
     // WSOLA synthesis accumulation buffer (overlap-add staging)
     float synth_buf[WSOLA_FRAME * WSOLA_MAX_CH];
+    // Input frames one step can read (search range plus a frame), as f32
+    float window[(WSOLA_FRAME + 2 * WSOLA_SEARCH) * WSOLA_MAX_CH];
     // One hop of output ready to drain before the next wsola_step
     float output_buf[WSOLA_HOP  * WSOLA_MAX_CH];
     int   output_pending;   // frames staged in output_buf
     int   output_offset;    // frames already consumed from output_buf
     bool  first_frame;      // skip search on very first step
+    bool  coarse;           // approximate search (RIFFHOUND_WSOLA_SEARCH)
 };
 
 // Initialize with caller-owned (or borrowed) PCM data.
@@ -52,6 +74,11 @@ bool  wsola_init(WsolaSource* ws, float* pcm, uint64_t frames,
 
 void  wsola_uninit(WsolaSource* ws);
 
+// Play from a store, possibly still being filled (pcm_store.h); pcm must be
+// its f32 buffer, or nullptr for a compact one, and frames its capacity.
+// Call before playback starts.
+void  wsola_set_store(WsolaSource* ws, const struct PcmStore* store);
+
 // Thread-safe speed accessors (atomic).
 void  wsola_set_speed(WsolaSource* ws, float speed);
 float wsola_get_speed(const WsolaSource* ws);
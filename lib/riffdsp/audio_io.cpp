@@ -1,11 +1,90 @@
+// Decoding only: no devices, engine, resource manager or threads.
+#define MINIAUDIO_IMPLEMENTATION
+#define MA_NO_DEVICE_IO
+#define MA_NO_ENGINE
+#define MA_NO_NODE_GRAPH
+#define MA_NO_RESOURCE_MANAGER
+#define MA_NO_ENCODING
+#define MA_NO_GENERATION
+#define MA_NO_THREADING
+#include "miniaudio.h"
 #include "audio_io.h"
+#include "pcm_cache.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <mutex>
 
-static const uint32_t SAMPLE_RATE = 44100;
+static const uint32_t SAMPLE_RATE = 44100;   // ffmpeg path only
 static const uint32_t CHANNELS    = 2;
 
+// Frames per ma_decoder_read_pcm_frames call: 4 MB of stereo f32.
+static const uint64_t DECODE_BLOCK = 1u << 19;
+
+// PCM cache tags.  miniaudio decodes at the native rate, exactly as the GUI
+// does, so the two share cache entries; ffmpeg resamples to 44.1 kHz.
+static const char* MINIAUDIO_TAG = "miniaudio-f32x2";
+static const char* FFMPEG_TAG    = "ffmpeg-f32x2-44100";
+
+// Buffers handed out from the cache, so audio_free() can tell a mapping from
+// a malloc'd decode.  Tracks are decoded on several threads by `eval`.
+struct MappedPcm {
+    PcmMap     map;
+    MappedPcm* next;
+};
+static std::mutex s_mutex;
+static MappedPcm* s_mapped = nullptr;
+
+static bool decode_cached(const char* path, const char* tag, float** out_pcm,
+                          uint64_t* out_frames, uint32_t* out_channels,
+                          uint32_t* out_sample_rate) {
+    PcmMap map;
+    if (!pcm_cache_open(path, tag, &map)) return false;
+    if (map.channels != CHANNELS) { pcm_cache_close(&map); return false; }
+    if (map.format == PCM_S16) {
+        // Written by a GUI holding tracks in s16: widen a private copy.
+        const size_t n   = (size_t)map.frames * map.channels;
+        float*       buf = (float*)malloc(n * sizeof(float));
+        if (buf) pcm_s16_to_f32((const int16_t*)map.data, buf, n);
+        *out_pcm         = buf;
+        *out_frames      = map.frames;
+        *out_channels    = map.channels;
+        *out_sample_rate = map.sample_rate;
+        pcm_cache_close(&map);
+        return buf != nullptr;
+    }
+    MappedPcm* m = (MappedPcm*)malloc(sizeof(MappedPcm));
+    if (!m) { pcm_cache_close(&map); return false; }
+    m->map = map;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        m->next  = s_mapped;
+        s_mapped = m;
+    }
+    *out_pcm         = (float*)map.data;
+    *out_frames      = map.frames;
+    *out_channels    = map.channels;
+    *out_sample_rate = map.sample_rate;
+    return true;
+}
+
+void audio_free(float* pcm) {
+    if (!pcm) return;
+    MappedPcm* found = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (MappedPcm** link = &s_mapped; *link; link = &(*link)->next)
+            if ((*link)->map.data == pcm) {
+                found = *link;
+                *link = found->next;
+                break;
+            }
+    }
+    if (!found) { free(pcm); return; }
+    pcm_cache_close(&found->map);
+    free(found);
+}
+
 // Quote a path for /bin/sh so spaces and apostrophes in track names survive.
 // "The Rover.mp3" and "Don't Look Back.m4a" both occur in the library.
 static void shell_quote(const char* in, char* out, size_t out_size) {
@@ -24,9 +103,59 @@ static void shell_quote(const char* in, char* out, size_t out_size) {
     out[o < out_size ? o : out_size - 1] = '\0';
 }
 
+// In-process decode through the vendored miniaudio (MP3, WAV, FLAC).  The
+// buffer is sized from the decoder's length up front and filled a block at a
+// time; it only grows if that length was short.  False if miniaudio cannot
+// open the file or gets no audio out of it.
+static bool decode_miniaudio(const char* path, float** out_pcm, uint64_t* out_frames,
+                             uint32_t* out_channels, uint32_t* out_sample_rate) {
+    ma_decoder_config cfg = ma_decoder_config_init(ma_format_f32, CHANNELS, 0);
+    ma_decoder        dec;
+    if (ma_decoder_init_file(path, &cfg, &dec) != MA_SUCCESS) return false;
+
+    ma_uint64 len = 0;
+    if (ma_decoder_get_length_in_pcm_frames(&dec, &len) != MA_SUCCESS) len = 0;
+    uint64_t cap   = len > 0 ? len : DECODE_BLOCK * 16;
+    uint64_t total = 0;
+    float*   buf   = (float*)malloc(cap * CHANNELS * sizeof(float));
+    if (!buf) { ma_decoder_uninit(&dec); return false; }
+
+    while (true) {
+        if (total == cap) {
+            uint64_t ncap = cap * 2;
+            float*   nb   = (float*)realloc(buf, ncap * CHANNELS * sizeof(float));
+            if (!nb) { free(buf); ma_decoder_uninit(&dec); return false; }
+            buf = nb;
+            cap = ncap;
+        }
+        uint64_t  want = cap - total < DECODE_BLOCK ? cap - total : DECODE_BLOCK;
+        ma_uint64 got  = 0;
+        ma_result r    = ma_decoder_read_pcm_frames(&dec, buf + total * CHANNELS, want, &got);
+        total += got;
+        if (r != MA_SUCCESS || got < want) break;
+    }
+    const uint32_t sr = dec.outputSampleRate;
+    ma_decoder_uninit(&dec);
+    if (total == 0) { free(buf); return false; }
+
+    pcm_cache_store(path, MINIAUDIO_TAG, buf, PCM_F32, total, CHANNELS, sr);
+
+    *out_pcm         = buf;
+    *out_frames      = total;
+    *out_channels    = CHANNELS;
+    *out_sample_rate = sr;
+    return true;
+}
+
 bool audio_decode(const char* path, float** out_pcm,
                   uint64_t* out_frames, uint32_t* out_channels,
                   uint32_t* out_sample_rate) {
+    if (decode_cached(path, MINIAUDIO_TAG, out_pcm, out_frames, out_channels, out_sample_rate) ||
+        decode_miniaudio(path, out_pcm, out_frames, out_channels, out_sample_rate) ||
+        decode_cached(path, FFMPEG_TAG, out_pcm, out_frames, out_channels, out_sample_rate))
+        return true;
+
+    // Formats miniaudio has no decoder for (.m4a): ffmpeg.
     char quoted[1200];
     shell_quote(path, quoted, sizeof(quoted));
 
@@ -65,6 +194,8 @@ bool audio_decode(const char* path, float** out_pcm,
         return false;
     }
 
+    pcm_cache_store(path, FFMPEG_TAG, buf, PCM_F32, total / CHANNELS, CHANNELS, SAMPLE_RATE);
+
     *out_pcm         = buf;
     *out_frames      = total / CHANNELS;
     *out_channels    = CHANNELS;
@@ -1,13 +1,20 @@
 #pragma once
 #include <stdint.h>
 
-// Decode any audio file ffmpeg understands to interleaved stereo f32.
+// Decode an audio file to interleaved stereo f32.
 //
-// riffdsp shells out to ffmpeg rather than linking a decoder: it keeps the
-// library dependency-free (libc + libm only), and it accepts every format in
-// the library including .m4a, which miniaudio cannot decode on its own.
+// MP3, WAV and FLAC decode in-process through the vendored miniaudio (header
+// only, so riffdsp still links nothing beyond libc + libm), at the file's own
+// sample rate.  Anything else -- .m4a, which miniaudio cannot decode on its
+// own -- goes through ffmpeg, resampled to 44.1 kHz.
 //
-// Returns true on success; caller frees *out_pcm with free().
+// A track decoded before comes straight from the PCM cache shared with the
+// GUI (pcm_cache.h), memory-mapped read-only; a fresh decode is written to it.
+//
+// Returns true on success; caller releases *out_pcm with audio_free() and
+// must not write to it.
 bool audio_decode(const char* path, float** out_pcm,
                   uint64_t* out_frames, uint32_t* out_channels,
                   uint32_t* out_sample_rate);
+
+void audio_free(float* pcm);
@@ -0,0 +1,268 @@
+#include "gridfit.h"
+#include "pool.h"
+#include <math.h>
+#include <stdlib.h>
+
+static const double GRID_TOL    = (double)GRID_TOL_STEPS / GRID_PHASES;
+
+// Added to every bound so float rounding in the binned sums can never prune
+// a pair that the direct sum would score higher.
+static const double BOUND_SLACK = 1e-9;
+
+double grid_score(const double* on, int n, double t0, double t1,
+                  double T, double phase, double support_exp)
+{
+    if (T <= 0 || t1 <= t0) return 0;
+    double tol = GRID_TOL * T;
+    int nlines = (int)((t1 - phase) / T) + 1;
+    if (nlines < 4) return 0;
+
+    // Onsets are sorted, so the nearest line only moves forward: a line is
+    // newly supported exactly when it is past the last one counted.
+    double agree = 0;
+    int  used = 0, nsup = 0;
+    long last = -1;
+    for (int i = 0; i < n; i++) {
+        if (on[i] < t0 || on[i] > t1) continue;
+        used++;
+        double k  = (on[i] - phase) / T;
+        long   ki = (long)floor(k + 0.5);
+        double d  = fabs(k - ki) * T;
+        if (d < tol) {
+            agree += 1.0 - d / tol;
+            if (ki > last && ki < nlines) { nsup++; last = ki; }
+        }
+    }
+    if (!used) return 0;
+
+    double support_frac = (double)nsup / nlines;
+    return (agree / used) * pow(support_frac, support_exp);
+}
+
+// ---------------------------------------------------------------------------
+// Per-period bounds.
+//
+// Onset phases are folded into GRID_PHASES bins of one phase step each, keeping
+// per bin the count and the sum of the offsets into the bin.  Phase j sits on
+// the boundary of bin j and the tolerance is a whole number of steps, so every
+// bin lies on one straight side of each phase's triangular kernel: the
+// agreement of phase j is exactly a weighted sum of the 2 * GRID_TOL_STEPS bins
+// around it.  The support fraction is at most the number of onsets inside the
+// tolerance over the number of lines (and at most 1), which bounds the score.
+//
+// The bins are stored with GRID_TOL_STEPS of wrap-around padding on each side,
+// so the window of phase j is the plain run [j, j + 2 * GRID_TOL_STEPS).
+// ---------------------------------------------------------------------------
+static const int PAD = GRID_TOL_STEPS;
+
+static void period_bounds(const double* on, int lo, int hi, double t0, double t1,
+                          double T, double support_exp, double* ub)
+{
+    double cnt[GRID_PHASES + 2 * PAD] = {}, off[GRID_PHASES + 2 * PAD] = {};
+    const double steps = GRID_PHASES / T;
+    for (int i = lo; i < hi; i++) {
+        double x = (on[i] - t0) * steps;
+        x -= floor(x * (1.0 / GRID_PHASES)) * GRID_PHASES;
+        int b = (int)x;
+        if (b >= GRID_PHASES) b = GRID_PHASES - 1;
+        cnt[PAD + b] += 1.0;
+        off[PAD + b] += x - b;
+    }
+    for (int k = 0; k < PAD; k++) {
+        cnt[k] = cnt[GRID_PHASES + k];  cnt[GRID_PHASES + PAD + k] = cnt[PAD + k];
+        off[k] = off[GRID_PHASES + k];  off[GRID_PHASES + PAD + k] = off[PAD + k];
+    }
+
+    const int    used = hi - lo;
+    const double inv  = 1.0 / GRID_TOL_STEPS;
+    for (int j = 0; j < GRID_PHASES; j++) {
+        double phase  = t0 + j * T / GRID_PHASES;
+        int    nlines = (int)((t1 - phase) / T) + 1;
+        if (nlines < 4 || used == 0) { ub[j] = 0.0; continue; }
+
+        // Bin PAD + j + o holds onsets o..o+1 steps after phase j.
+        const double* c = cnt + PAD + j;
+        const double* f = off + PAD + j;
+        double agree = 0.0, within = 0.0;
+        for (int o = -GRID_TOL_STEPS; o < 0; o++) {
+            agree  += c[o] * (1.0 + o * inv) + f[o] * inv;
+            within += c[o];
+        }
+        for (int o = 0; o < GRID_TOL_STEPS; o++) {
+            agree  += c[o] * (1.0 - o * inv) - f[o] * inv;
+            within += c[o];
+        }
+        double bound = agree / used;
+        if (within < nlines && support_exp != 0.0)
+            bound *= pow(within / nlines, support_exp);
+        ub[j] = bound + BOUND_SLACK;
+    }
+}
+
+static int period_count(double lo, double hi)
+{
+    return hi < lo ? 0 : (int)floor((hi - lo) / GRID_PERIOD_STEP + 1e-9) + 1;
+}
+
+struct GridCand {
+    double ub;
+    int    idx;     // period index * GRID_PHASES + phase index
+};
+
+static double cand_score(const double* on, int n, double t0, double t1, double Tlo,
+                         int idx, double support_exp)
+{
+    double T = Tlo + (idx / GRID_PHASES) * GRID_PERIOD_STEP;
+    return grid_score(on, n, t0, t1, T, t0 + (idx % GRID_PHASES) * T / GRID_PHASES,
+                      support_exp);
+}
+
+static int cand_cmp(const void* a, const void* b)
+{
+    const GridCand* x = (const GridCand*)a;
+    const GridCand* y = (const GridCand*)b;
+    if (x->ub != y->ub) return x->ub > y->ub ? -1 : 1;
+    return x->idx - y->idx;
+}
+
+GridFit grid_search(const double* on, int n, double t0, double t1,
+                    double Tlo, double Thi, double support_exp)
+{
+    GridFit best = { Tlo, t0, 0.0 };
+    const int nper = period_count(Tlo, Thi);
+    if (nper == 0) return best;
+
+    // Onsets [lo, hi) lie in [t0, t1].
+    int lo = 0, hi = n;
+    while (lo < n  && on[lo] < t0)     lo++;
+    while (hi > lo && on[hi - 1] > t1) hi--;
+
+    const int total = nper * GRID_PHASES;
+    const int batch = 64 * core_count();
+    double*   ub    = (double*)  malloc((size_t)total * sizeof(double));
+    GridCand* cand  = (GridCand*)malloc((size_t)total * sizeof(GridCand));
+    double*   score = (double*)  malloc((size_t)batch * sizeof(double));
+    if (!ub || !cand || !score) {
+        free(ub); free(cand); free(score);
+        return grid_search_exhaustive(on, n, t0, t1, Tlo, Thi, support_exp);
+    }
+
+    parallel_for(nper, [&](int i) {
+        period_bounds(on, lo, hi, t0, t1, Tlo + i * GRID_PERIOD_STEP, support_exp,
+                      ub + (size_t)i * GRID_PHASES);
+    });
+
+    // The pair with the highest bound is usually the winner, and its score is
+    // a floor no pair bounded below can beat: only the rest are sorted.
+    int top = 0;
+    for (int k = 1; k < total; k++) if (ub[k] > ub[top]) top = k;
+    double floor_s = cand_score(on, n, t0, t1, Tlo, top, support_exp);
+    int    ncand   = 0;
+    for (int k = 0; k < total; k++)
+        if (ub[k] >= floor_s) { cand[ncand].ub = ub[k]; cand[ncand].idx = k; ncand++; }
+    free(ub);
+    qsort(cand, ncand, sizeof(GridCand), cand_cmp);
+
+    // Score in descending order of bound, a batch at a time, until no bound
+    // left can reach the best score (ties included: a lower index may win).
+    double best_s   = -1.0;
+    int    best_idx = 0;
+    for (int pos = 0; pos < ncand && cand[pos].ub >= best_s; ) {
+        int m = ncand - pos < batch ? ncand - pos : batch;
+        parallel_for(m, [&](int k) {
+            score[k] = cand_score(on, n, t0, t1, Tlo, cand[pos + k].idx, support_exp);
+        });
+        for (int k = 0; k < m; k++) {
+            int idx = cand[pos + k].idx;
+            if (score[k] > best_s || (score[k] == best_s && idx < best_idx)) {
+                best_s   = score[k];
+                best_idx = idx;
+            }
+        }
+        pos += m;
+    }
+    free(score);
+    free(cand);
+
+    best.period = Tlo + (best_idx / GRID_PHASES) * GRID_PERIOD_STEP;
+    best.phase  = t0 + (best_idx % GRID_PHASES) * best.period / GRID_PHASES;
+    best.score  = best_s;
+    return best;
+}
+
+GridFit grid_search_exhaustive(const double* on, int n, double t0, double t1,
+                               double Tlo, double Thi, double support_exp)
+{
+    GridFit best = { Tlo, t0, -1.0 };
+    const int nper = period_count(Tlo, Thi);
+    for (int i = 0; i < nper; i++) {
+        double T = Tlo + i * GRID_PERIOD_STEP;
+        for (int j = 0; j < GRID_PHASES; j++) {
+            double ph = t0 + j * T / GRID_PHASES;
+            double s  = grid_score(on, n, t0, t1, T, ph, support_exp);
+            if (s > best.score) { best.score = s; best.period = T; best.phase = ph; }
+        }
+    }
+    if (best.score < 0) best.score = 0;
+    return best;
+}
+
+int grid_beats(const double* on, int n, double t0, double t1, const GridFit* fit,
+               double** beats, int* anchored, int* lines)
+{
+    *beats    = nullptr;
+    *anchored = 0;
+    *lines    = 0;
+    const double T  = fit->period;
+    const int    nb = (int)((t1 - fit->phase) / T) + 1;
+    if (nb < 2 || n <= 0) return 0;
+
+    double* anchor = (double*)malloc(nb * sizeof(double));
+    bool*   has    = (bool*)  calloc(nb, sizeof(bool));
+    double* out    = (double*)malloc(nb * sizeof(double));
+    if (!anchor || !has || !out) { free(anchor); free(has); free(out); return 0; }
+
+    // Nearest onset to each line.  Lines and onsets both ascend, so the
+    // nearest index only moves forward (ties keep the earlier onset).
+    int bi = 0;
+    for (int k = 0; k < nb; k++) {
+        double g = fit->phase + k * T;
+        while (bi + 1 < n && fabs(on[bi + 1] - g) < fabs(on[bi] - g)) bi++;
+        if (fabs(on[bi] - g) < 0.25 * T) { anchor[k] = on[bi]; has[k] = true; }
+    }
+
+    const int W = 16;
+    double prev = -1e9;
+    int    count = 0;
+    for (int k = 0; k < nb; k++) {
+        double sx = 0, sy = 0, sxx = 0, sxy = 0; int m = 0;
+        for (int j = k - W; j <= k + W; j++) {
+            if (j < 0 || j >= nb || !has[j]) continue;
+            sx += j; sy += anchor[j]; sxx += (double)j * j; sxy += (double)j * anchor[j];
+            m++;
+        }
+        double t;
+        if (m >= 4) {
+            double den = m * sxx - sx * sx;
+            if (fabs(den) < 1e-9) t = fit->phase + k * T;
+            else {
+                double slope = (m * sxy - sx * sy) / den;
+                double icpt  = (sy - slope * sx) / m;
+                t = icpt + slope * k;
+            }
+        } else {
+            t = fit->phase + k * T;
+        }
+        if (has[k]) (*anchored)++;
+        if (t < t0 - 0.01 || t > t1) continue;
+        if (t <= prev + 0.05) continue;
+        out[count++] = t;
+        prev = t;
+    }
+    free(anchor); free(has);
+
+    *lines = nb;
+    if (count == 0) { free(out); return 0; }
+    *beats = out;
+    return count;
+}
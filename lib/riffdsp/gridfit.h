@@ -0,0 +1,63 @@
+#pragma once
+
+// Global tempo/phase grid fit over a list of onset times.
+//
+// A grid is the set of lines phase + k * period.  grid_score() rates how well
+// one grid explains the onsets; grid_search() finds the best grid over a range
+// of periods, stepping the period by GRID_PERIOD_STEP seconds and the phase by
+// period / GRID_PHASES.
+//
+// The search is exact over that lattice -- it returns what scoring every
+// (period, phase) pair would -- but scores only the pairs that can still win.
+// For each period, one pass over the onsets folds their phases into
+// GRID_PHASES bins; the agreement term of every phase then follows from the
+// bins alone, and together with a bound on the support term gives an upper
+// bound on every score.  Pairs are then scored in descending order of bound
+// until no remaining bound beats the best score found.  Both passes run on
+// all cores.
+
+static const double GRID_PERIOD_STEP = 0.0005;   // seconds
+static const int    GRID_PHASES      = 100;      // phase steps per period
+static const int    GRID_TOL_STEPS   = 12;       // onset tolerance, in phase steps (0.12 T)
+
+struct GridFit {
+    double period;   // seconds
+    double phase;    // time of a grid line, seconds
+    double score;    // grid_score() of this grid
+};
+
+// How well the grid {phase + k * period} explains the onsets in [t0, t1]:
+//   (a) onset agreement -- how close onsets sit to grid lines
+//   (b) line support    -- fraction of grid lines in [phase, t1] with an onset
+//                          within the tolerance, raised to support_exp
+// multiplied.  (b) is what prevents the octave error: doubling the tempo
+// always explains at least as many onsets as the true tempo (every real beat
+// still lands on a line, and the eighth-note offbeats now land on lines too),
+// so (a) alone is biased towards fast grids; but at double tempo roughly half
+// the grid lines have no onset at all, which (b) penalises directly.
+//
+// onsets must be sorted ascending.  0 if fewer than four lines fit.
+double grid_score(const double* onsets, int n, double t0, double t1,
+                  double period, double phase, double support_exp);
+
+// Best grid with period in [period_lo, period_hi] and phase measured from t0.
+// Ties go to the shortest period, then the earliest phase.  onsets must be
+// sorted ascending.
+GridFit grid_search(const double* onsets, int n, double t0, double t1,
+                    double period_lo, double period_hi, double support_exp);
+
+// The same lattice scored pair by pair on one thread; the reference the fast
+// search is checked against.
+GridFit grid_search_exhaustive(const double* onsets, int n, double t0, double t1,
+                               double period_lo, double period_hi,
+                               double support_exp);
+
+// Beats of a fitted grid over [t0, t1].  Each grid line is anchored to its
+// nearest onset when one lies within a quarter period, and every beat is then
+// placed by a local linear regression of anchor time on line index (+/- 16
+// lines), which tracks gradual tempo drift without chasing individual
+// mis-detections.  Returns the beat count, 0 if the grid is shorter than two
+// lines; *beats is malloc'd (caller frees).  *anchored / *lines receive how
+// many grid lines had onset support.
+int grid_beats(const double* onsets, int n, double t0, double t1, const GridFit* fit,
+               double** beats, int* anchored, int* lines);
@@ -8,27 +8,40 @@
 
 #include "timeseries.h"
 #include "audio_io.h"
+#include "analysis_rate.h"
 #include "chords.h"
 #include "beat_algo.h"
 #include "chroma_algo.h"
+#include "tempo.h"
+#include "gridfit.h"
+#include "pool.h"
+#include "stft_cache.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <sys/stat.h>
+#include <chrono>
 
 static void usage() {
     fprintf(stderr,
         "usage: riffdsp <command> [options] <audio-file>\n"
+        "       riffdsp eval [options] <reference.txt>...\n"
         "\n"
         "commands:\n"
         "  beats    detect beats and print a beatmap in timeseries format\n"
         "  onsets   print raw onset times\n"
+        "  tempo    print the whole-track tempo-strength curve (bpm, strength)\n"
         "  grid     fit a global tempo/phase grid to the onsets (best for\n"
         "           unattended whole-track beatmapping)\n"
+        "  gridwalk fit the grid window by window, following tempo drift, and\n"
+        "           leave a GAP comment where a window's fit is poorly supported\n"
         "  chroma   print one beat-synchronous 12-bin chroma vector per beat\n"
         "  chords   label each beat with a chord and print chord: events\n"
         "  info     print duration and sample rate\n"
+        "  eval     score a detector against hand-made beatmaps (audio found\n"
+        "           next to each reference by stem, or listed with --pairs)\n"
         "\n"
         "options:\n"
         "  --beats FILE      read beat times from a timeseries file\n"
@@ -37,14 +50,26 @@ static void usage() {
         "  --end SEC         analysis window end (default end of track)\n"
         "  --min-bpm N       tempo search floor (default 60)\n"
         "  --max-bpm N       tempo search ceiling (default 200)\n"
-        "  --algo NAME       chroma algorithm: nnls|goertzel|hps|peaks\n"
+        "  --algo NAME       chroma algorithm: nnls|goertzel|hps|peaks|constant-q\n"
         "  --self-bonus F    chord continuity strength (default 0.18)\n"
         "  --no-sevenths     restrict chord vocabulary to triads and power chords\n"
         "  --no-sus          drop sus2/sus4 from the vocabulary\n"
         "  --hint-bpm N      known tempo; restricts the grid search around it\n"
         "  --support-exp F   grid-line support weight (0=off, default 0.5)\n"
+        "  --exhaustive      grid: score every tempo/phase pair (slow reference)\n"
+        "  --window SEC      gridwalk window length (default 20)\n"
+        "  --hop SEC         gridwalk window step (default 16)\n"
+        "  --drift F         gridwalk tempo change allowed between windows (default 0.10)\n"
+        "  --min-support F   gridwalk: reject windows with less line support (default 0.55)\n"
+        "  --seed-bpm N      gridwalk: tempo to search around in the first window\n"
         "  --min-margin F    label beats below this margin as uncertain\n"
-        "  --tsv             chords: print a per-beat table instead of events\n");
+        "  --tsv             chords: print a per-beat table instead of events\n"
+        "  --mode NAME       eval: beats|grid|gridwalk|chords (default grid)\n"
+        "  --tol SEC         eval: beat match tolerance (default 0.070)\n"
+        "  --windowed        eval: detect each annotated island separately\n"
+        "  --min-beats N     eval: skip references with fewer beats (default 30)\n"
+        "  --pairs FILE      eval: read 'audio<TAB>reference' lines from FILE\n"
+        "  --jobs N          worker threads (default: all cores)\n");
 }
 
 struct Opts {
@@ -61,9 +86,20 @@ struct Opts {
     bool        tsv         = false;
     float       hint_bpm    = 0.0f;   // 0 = no hint
     float       hint_tol    = 0.06f;  // +/- fraction around the hint
+    bool        exhaustive  = false;  // grid: score every period/phase pair
+    double      window      = 20.0;   // gridwalk: window length, seconds
+    double      hop         = 16.0;   // gridwalk: window step, seconds
+    float       drift       = 0.10f;  // gridwalk: +/- tempo fraction between windows
+    float       min_support = 0.55f;  // gridwalk: line support a window needs
+    float       seed_bpm    = 0.0f;   // gridwalk: 0 = search the full range first
+    const char* mode        = "grid"; // eval: detector to score
+    double      tol         = 0.070;  // eval: beat match tolerance, seconds
+    bool        windowed    = false;  // eval: one detection per reference island
+    int         min_beats   = 30;     // eval: skip sparser references
+    const char* pairs_file  = nullptr;// eval: audio/reference list
 };
 
-static ChromaFn pick_chroma(const char* name) {
+static const ChromaAlgoDesc* pick_chroma(const char* name) {
     for (int i = 0; i < CHROMA_ALGO_COUNT; i++) {
         // match on a case-insensitive prefix of the registered name
         const char* n = CHROMA_ALGOS[i].name;
@@ -75,7 +111,7 @@ static ChromaFn pick_chroma(const char* name) {
             if (b >= 'A' && b <= 'Z') b += 32;
             if (a != b) { hit = false; break; }
         }
-        if (hit) return CHROMA_ALGOS[i].fn;
+        if (hit) return &CHROMA_ALGOS[i];
     }
     return nullptr;
 }
@@ -100,15 +136,31 @@ static int load_beats(const char* path, double** out) {
 // Beat-synchronous chroma: one vector per beat interval [b[i], b[i+1]).
 // Also fills a bass-band chroma when out_bass is non-null; the low band is a
 // strong root cue and is what disambiguates a G chord from its Em relative.
+// All intervals go through the algorithm's batch entry point, so frames
+// shared by neighbouring beats are analysed once.
 static void beat_chroma(const float* pcm, uint64_t frames, uint32_t ch,
                         uint32_t sr, const double* beats, int nbeats,
-                        ChromaFn fn, float* out, float* out_bass,
+                        ChromaBatchFn batch, float* out, float* out_bass,
                         const float* lowpcm) {
-    for (int i = 0; i + 1 < nbeats; i++) {
-        fn(pcm, frames, ch, sr, beats[i], beats[i + 1], out + i * 12);
-        if (out_bass && lowpcm)
-            fn(lowpcm, frames, ch, sr, beats[i], beats[i + 1], out_bass + i * 12);
-    }
+    int nint = nbeats - 1;
+    batch(pcm, frames, ch, sr, beats, beats + 1, nint, out);
+    if (out_bass && lowpcm)
+        batch(lowpcm, frames, ch, sr, beats, beats + 1, nint, out_bass);
+}
+
+// Swap a decoded track for its analysis signal (analysis_rate.h), the mono,
+// usually decimated buffer the GUI's analyses read, so both front ends see
+// the same samples.  On failure the decode is left as it was.
+static void to_analysis(float** pcm, uint64_t* frames, uint32_t* ch, uint32_t* sr) {
+    uint64_t n    = 0;
+    uint32_t rate = 0;
+    float*   sig  = analysis_signal(*pcm, *frames, *ch, *sr, &n, &rate);
+    if (!sig) return;
+    audio_free(*pcm);
+    *pcm    = sig;
+    *frames = n;
+    *ch     = 1;
+    *sr     = rate;
 }
 
 // One-pole low-pass at ~220 Hz, applied to a copy of the buffer, to isolate
@@ -131,98 +183,648 @@ static float* make_lowband(const float* pcm, uint64_t frames, uint32_t ch,
     return lp;
 }
 
-// Collect raw onsets across a whole track by running the detector in chunks.
-// Returns the count; *out is malloc'd and owned by the caller.
+// Free a make_lowband copy, and first the STFT frames the chroma algorithms
+// cached under its address: malloc may hand the address straight back for
+// another track's copy, which would then be served this track's spectra.
+static void free_lowband(float* lp) {
+    if (!lp) return;
+    stft_release(lp);
+    free(lp);
+}
+
+// Raw onsets of [t0, t1] from one detector pass.  Returns the count; *out is
+// malloc'd and owned by the caller.
 static int collect_onsets(const float* pcm, uint64_t frames, uint32_t ch,
                           uint32_t sr, double t0, double t1,
-                          const BeatAlgoParams* bp, double** out,
-                          float* out_bpm) {
-    int    cap = 4096, n = 0;
-    double* buf = (double*)malloc(cap * sizeof(double));
-    if (!buf) return -1;
+                          const BeatAlgoParams* bp, double** out) {
+    AutoBeatList ab;
+    autobeat_init(&ab);
+    beat_spectral_flux(pcm, frames, ch, sr, t0, t1, bp, &ab);
+    int n = ab.onset_count;
+    *out = ab.onset_times;          // hand the array over to the caller
+    ab.onset_times = nullptr;
+    autobeat_shutdown(&ab);
+    return n;
+}
 
+// Tempo-strength curve of [t0, t1] from a single spectral-flux ODF; unlike
+// the detector's per-window estimate this sees the whole span at once.
+static bool track_tempo(const float* pcm, uint64_t frames, uint32_t ch,
+                        uint32_t sr, double t0, double t1,
+                        float min_bpm, float max_bpm, TempoCurve* curve) {
+    int    n = 0;
+    double odf_t0 = 0;
+    float* odf = beat_flux_odf(pcm, frames, ch, sr, t0, t1, &n, &odf_t0);
+    bool ok = odf && tempo_curve_compute(odf, n, (float)sr / beat_flux_hop(sr),
+                                         min_bpm, max_bpm, curve);
+    free(odf);
+    return ok;
+}
+
+static void print_tempo_peaks(const TempoCurve* curve) {
+    int peaks[5];
+    int np = tempo_curve_peaks(curve, peaks, 5);
+    fprintf(stderr, "riffdsp: autocorrelation tempo %.1f BPM; peaks",
+            tempo_lag_bpm(curve, (float)curve->best_lag));
+    for (int i = 0; i < np; i++)
+        fprintf(stderr, " %.1f", tempo_lag_bpm(curve, (float)peaks[i]));
+    fprintf(stderr, "\n");
+}
+
+// Exponent of grid_score()'s line-support term.
+static double g_support_exp = 0.5;   // tuned against riffeval; see findings
+
+// ---------------------------------------------------------------------------
+// Detectors.  Each analyses [o.start, o.end] and hands back its beats without
+// printing anything, so the single-track commands and `eval` share them.
+// ---------------------------------------------------------------------------
+
+static BeatAlgoParams flux_params(const Opts& o) {
+    BeatAlgoParams bp = {};
+    bp.min_bpm         = o.min_bpm;
+    bp.max_bpm         = o.max_bpm;
+    bp.onset_threshold = 1.5f;
+    bp.dp_tightness    = 400.0f;
+    bp.pre_onset_ms    = 30.0f;
+    bp.seed_times      = nullptr;
+    bp.seed_count      = 0;
+    return bp;
+}
+
+// Spectral-flux DP tracker.  Returns the beat count; *beats is malloc'd.
+static int detect_beats(const float* pcm, uint64_t frames, uint32_t ch,
+                        uint32_t sr, const Opts& o, double** beats, float* bpm) {
+    BeatAlgoParams bp = flux_params(o);
     AutoBeatList ab;
     autobeat_init(&ab);
-    double bpm_sum = 0; int bpm_n = 0;
-
-    const double CHUNK = 45.0;
-    for (double t = t0; t < t1 - 0.05; ) {
-        double t2 = t + CHUNK; if (t2 > t1) t2 = t1;
-        beat_spectral_flux(pcm, frames, ch, sr, t, t2, bp, &ab);
-        if (ab.estimated_bpm > 0) { bpm_sum += ab.estimated_bpm; bpm_n++; }
-        for (int i = 0; i < ab.onset_count; i++) {
-            double ot = ab.onset_times[i];
-            if (ot < t || ot >= t2) continue;
-            if (n > 0 && ot <= buf[n - 1] + 0.005) continue;   // de-dup
-            if (n == cap) {
-                cap *= 2;
-                double* nb = (double*)realloc(buf, cap * sizeof(double));
-                if (!nb) { free(buf); return -1; }
-                buf = nb;
-            }
-            buf[n++] = ot;
+    beat_spectral_flux(pcm, frames, ch, sr, o.start, o.end, &bp, &ab);
+    int n = ab.beat_count;
+    *beats = ab.beat_times;
+    *bpm   = ab.estimated_bpm;
+    ab.beat_times = nullptr;
+    autobeat_shutdown(&ab);
+    return n;
+}
+
+// Period range of the grid search.  An external tempo (from a tab, an ID3
+// tag, or a sibling track) is the cheapest way to settle the half/double-tempo
+// ambiguity, which is the single largest source of error in unattended
+// beatmapping, so --hint-bpm narrows the range to a band around it.
+static void grid_periods(const Opts& o, double* Tlo, double* Thi) {
+    *Tlo = 60.0 / o.max_bpm;
+    *Thi = 60.0 / o.min_bpm;
+    if (o.hint_bpm > 0) {
+        *Tlo = 60.0 / (o.hint_bpm * (1.0 + o.hint_tol));
+        *Thi = 60.0 / (o.hint_bpm * (1.0 - o.hint_tol));
+    }
+}
+
+struct GridResult {
+    GridFit fit;
+    int     onsets;     // onsets the grid was fitted to
+    int     anchored;   // grid lines with onset support
+    int     lines;      // grid lines in the span
+};
+
+// Global tempo/phase grid.  The DP tracker inserts spurious beats on
+// syncopated material, but the *tempo estimate* is reliable.  Fitting one
+// global grid to the onsets and then letting it drift locally is far more
+// robust for unattended whole-track work.  Returns the beat count, or -1 if
+// there were no onsets; *beats is malloc'd.
+static int detect_grid(const float* pcm, uint64_t frames, uint32_t ch,
+                       uint32_t sr, const Opts& o, double** beats, GridResult* r) {
+    *beats = nullptr;
+    memset(r, 0, sizeof(*r));
+    BeatAlgoParams bp = flux_params(o);
+    double* on  = nullptr;
+    int     non = collect_onsets(pcm, frames, ch, sr, o.start, o.end, &bp, &on);
+    if (non <= 0) { free(on); return -1; }
+
+    double Tlo, Thi;
+    grid_periods(o, &Tlo, &Thi);
+    r->fit = o.exhaustive
+           ? grid_search_exhaustive(on, non, o.start, o.end, Tlo, Thi, g_support_exp)
+           : grid_search(on, non, o.start, o.end, Tlo, Thi, g_support_exp);
+    r->onsets = non;
+    int nb = grid_beats(on, non, o.start, o.end, &r->fit, beats, &r->anchored, &r->lines);
+    free(on);
+    return nb;
+}
+
+struct WalkWindow { double t0, t1, bpm, support; bool accepted; };
+
+struct WalkResult {
+    WalkWindow* win;
+    int         nwin;
+    int         accepted;
+    double*     beats;
+    int         nbeats;
+};
+
+static void walk_free(WalkResult* w) {
+    free(w->win);
+    free(w->beats);
+    memset(w, 0, sizeof(*w));
+}
+
+// `grid` fits ONE tempo to a whole track.  That is right for a track cut to a
+// click and wrong for anything that breathes -- Stairway to Heaven runs from
+// about 72 BPM at the start to over 100 by the end.  This walks the track in
+// overlapping windows, searching each one near the previous window's tempo so
+// the grid can drift, and refuses to emit beats where the fit is not well
+// supported: the gaps tell the user exactly which stretch still needs a human.
+//
+// The ODF is computed once; each window picks onsets from its own slice with
+// its own adaptive threshold, as `grid --start --end` would.  Returns false if
+// there is no ODF (or no memory); *w is then empty.
+static bool detect_gridwalk(const float* pcm, uint64_t frames, uint32_t ch,
+                            uint32_t sr, const Opts& o, WalkResult* w) {
+    memset(w, 0, sizeof(*w));
+    int    nodf   = 0;
+    double odf_t0 = 0;
+    float* odf = beat_flux_odf(pcm, frames, ch, sr, o.start, o.end, &nodf, &odf_t0);
+    if (!odf) return false;
+    const double fsec = (double)beat_flux_hop(sr) / sr;
+
+    int nwin = (int)((o.end - o.start) / o.hop) + 1;
+    w->win   = (WalkWindow*)calloc(nwin, sizeof(WalkWindow));
+    w->beats = (double*)malloc(((size_t)((o.end - o.start) / 0.25) + 2) * sizeof(double));
+    if (!w->win || !w->beats) { walk_free(w); free(odf); return false; }
+
+    double prev_bpm = o.seed_bpm;
+    for (double t = o.start; t < o.end - 2.0 && w->nwin < nwin; t += o.hop) {
+        WalkWindow* win = &w->win[w->nwin++];
+        win->t0 = t;
+        win->t1 = t + o.window < o.end ? t + o.window : o.end;
+
+        double lo = o.min_bpm, hi = o.max_bpm;
+        if (prev_bpm > 0) {
+            lo = fmax(o.min_bpm, prev_bpm * (1.0 - o.drift));
+            hi = fmin(o.max_bpm, prev_bpm * (1.0 + o.drift));
+        }
+
+        int f0 = (int)ceil((win->t0 - odf_t0) / fsec);
+        int f1 = (int)floor((win->t1 - odf_t0) / fsec) + 1;
+        if (f0 < 0)    f0 = 0;
+        if (f1 > nodf) f1 = nodf;
+        double* on  = nullptr;
+        int     non = f1 > f0 ? beat_flux_onsets(odf + f0, f1 - f0, odf_t0 + f0 * fsec,
+                                                 sr, 1.5f, &on) : 0;
+        int nbeats = 0;
+        double* beats = nullptr;
+        if (non > 0) {
+            GridFit fit = grid_search(on, non, win->t0, win->t1, 60.0 / hi, 60.0 / lo,
+                                      g_support_exp);
+            int anchored = 0, lines = 0;
+            nbeats = grid_beats(on, non, win->t0, win->t1, &fit, &beats, &anchored, &lines);
+            win->bpm     = 60.0 / fit.period;
+            win->support = lines ? (double)anchored / lines : 0.0;
+        }
+        free(on);
+
+        win->accepted = win->bpm > 0 && win->support >= o.min_support && nbeats >= 4;
+        if (win->accepted) {
+            // Keep beats from the first window that covers each time, so
+            // the overlap does not produce doubled beats.
+            for (int i = 0; i < nbeats; i++)
+                if (w->nbeats == 0 || beats[i] - w->beats[w->nbeats - 1] > 0.25)
+                    w->beats[w->nbeats++] = beats[i];
+            prev_bpm = win->bpm;
+            w->accepted++;
+        } else if (win->support < 0.35) {
+            prev_bpm = 0;   // do not carry a bad tempo into the next window
         }
-        if (t2 >= t1) break;
-        t = t2;
+        free(beats);
     }
-    *out = buf;
-    if (out_bpm) *out_bpm = bpm_n ? (float)(bpm_sum / bpm_n) : 0.0f;
-    return n;
+    free(odf);
+    return true;
+}
+
+static void chord_params_of(const Opts& o, ChordParams* cp) {
+    chord_params_defaults(cp);
+    cp->self_bonus     = o.self_bonus;
+    cp->allow_sevenths = !o.no_sevenths;
+    cp->allow_sus      = !o.no_sus;
 }
 
-// How well a grid of period T starting at phase p explains the onsets.
+// ---------------------------------------------------------------------------
+// eval: score a detector against hand-made beatmaps.
 //
-// Two terms, multiplied:
-//   (a) onset agreement -- how close onsets sit to grid lines
-//   (b) line support    -- what fraction of grid lines have any onset near them
+// The metric is riffeval.py's, line for line: a detected beat is a hit if it
+// lies within --tol of a reference beat, one-to-one, and both sides are
+// restricted to the islands the human annotated (runs of reference beats no
+// more than 3 s apart, padded by 0.1 s) -- a detector is not punished for
+// beats in a stretch nobody marked.  What changes is the cost: every track is
+// decoded once, in-process, and the tracks run concurrently on the worker
+// pool, largest first so that a long track is never the one left running
+// alone at the end.
 //
-// (b) is what prevents the octave error.  Doubling the tempo always explains at
-// least as many onsets as the true tempo (every real beat still lands on a line,
-// and the eighth-note offbeats now land on lines too), so (a) alone is biased
-// towards fast grids.  But at double tempo roughly half the grid lines have no
-// onset at all, which (b) penalises directly.
-static double g_support_exp = 0.5;   // tuned against riffeval; see findings
+// --mode chords labels the reference's own beats (as `chords --beats REF`
+// does) and scores the time-weighted agreement with its chord: events, both
+// exact and by root.  References without chord: events are skipped.  It
+// also counts audible beats whose chroma came out all zero, and fails if
+// there are any.
+// ---------------------------------------------------------------------------
+
+static const double ISLAND_GAP = 3.0;   // seconds between beats that splits an island
+static const double ISLAND_PAD = 0.1;   // seconds either side of an island that still count
+
+struct EvalTrack {
+    char   audio[1024];
+    char   ref[1024];
+    char   name[64];
+    long long size;       // audio file bytes; the pool starts the largest first
+    bool   scored;
+    bool   failed;        // could not decode the audio
+    int    nref;          // reference beats (chords: chord events)
+    int    nest;          // detected beats inside the islands (chords: segments)
+    double f, prec, rec;  // chords: exact and root agreement in f and prec
+    double covered;       // annotated seconds
+    double seconds;       // time spent on the track
+    int    empty;         // chords: audible beat intervals with all-zero chroma
+};
+
+static double now_sec() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static long long file_size(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+// Audio next to a reference: same stem, any extension riffeval.py accepts.
+static bool find_audio(const char* ref, char* out, size_t out_size) {
+    static const char* EXTS[] = { ".mp3", ".m4a", ".wav", ".flac", ".MP3" };
+    const char* dot   = strrchr(ref, '.');
+    const char* slash = strrchr(ref, '/');
+    int stem = (dot && (!slash || dot > slash)) ? (int)(dot - ref) : (int)strlen(ref);
+    for (const char* ext : EXTS) {
+        snprintf(out, out_size, "%.*s%s", stem, ref, ext);
+        if (file_size(out) >= 0) return true;
+    }
+    return false;
+}
+
+// Runs of beats no more than ISLAND_GAP apart, as [lo, hi] spans; runs of a
+// single beat are dropped.  lo and hi hold up to n entries.  Returns the count.
+static int ref_islands(const double* ref, int n, double* lo, double* hi) {
+    int count = 0;
+    for (int i = 0; i < n; ) {
+        int j = i;
+        while (j + 1 < n && ref[j + 1] - ref[j] <= ISLAND_GAP) j++;
+        if (j > i) { lo[count] = ref[i]; hi[count] = ref[j]; count++; }
+        i = j + 1;
+    }
+    return count;
+}
+
+// One-to-one greedy matching in reference order, exactly as riffeval.py does
+// it: each reference beat takes the closest unused estimate within tol,
+// scanning the estimates in order.  Returns the hit count.
+static int f_measure(const double* ref, int nref, const double* est, int nest,
+                     double tol, double* f, double* p, double* r) {
+    bool* used = (bool*)calloc(nest > 0 ? nest : 1, sizeof(bool));
+    int hits = 0;
+    for (int i = 0; i < nref; i++) {
+        double best = tol;
+        int    bi   = -1;
+        for (int k = 0; k < nest; k++) {
+            if (used[k]) continue;
+            double d = fabs(est[k] - ref[i]);
+            if (d <= best)                 { best = d; bi = k; }
+            else if (est[k] > ref[i] + tol) break;
+        }
+        if (bi >= 0) { used[bi] = true; hits++; }
+    }
+    free(used);
+    *p = nest ? (double)hits / nest : 0.0;
+    *r = nref ? (double)hits / nref : 0.0;
+    *f = (*p + *r) > 0 ? 2 * *p * *r / (*p + *r) : 0.0;
+    return hits;
+}
+
+// Detector by --mode over [o.start, o.end].  Returns the beat count;
+// *beats is malloc'd (or null).
+static int detect_mode(const float* pcm, uint64_t frames, uint32_t ch,
+                       uint32_t sr, const Opts& o, double** beats) {
+    *beats = nullptr;
+    if (!strcmp(o.mode, "beats")) {
+        float bpm = 0;
+        return detect_beats(pcm, frames, ch, sr, o, beats, &bpm);
+    }
+    if (!strcmp(o.mode, "gridwalk")) {
+        WalkResult w;
+        if (!detect_gridwalk(pcm, frames, ch, sr, o, &w)) return 0;
+        int n = w.nbeats;
+        *beats  = w.beats;
+        w.beats = nullptr;
+        walk_free(&w);
+        return n;
+    }
+    GridResult r;
+    int n = detect_grid(pcm, frames, ch, sr, o, beats, &r);
+    return n > 0 ? n : 0;
+}
+
+// Pitch class of a chord name's root ("F#m7" -> 6), -1 if it has none.
+static int chord_root(const char* name) {
+    static const int NATURAL[7] = { 9, 11, 0, 2, 4, 5, 7 };   // A..G
+    if (name[0] < 'A' || name[0] > 'G') return -1;
+    int pc = NATURAL[name[0] - 'A'];
+    if (name[1] == '#') pc++;
+    if (name[1] == 'b') pc--;
+    return (pc + 12) % 12;
+}
+
+// Beat intervals that carry sound but got no chroma at all: every algorithm
+// must give each interval at least one frame, however short the beat.
+static const double SILENT_RMS = 1e-4;
+
+static int silent_chroma(const float* pcm, uint64_t frames, uint32_t ch, uint32_t sr,
+                         const double* beats, int nint, const float* chroma) {
+    int n = 0;
+    for (int i = 0; i < nint; i++) {
+        bool zero = true;
+        for (int k = 0; k < 12 && zero; k++) zero = chroma[i * 12 + k] == 0.0f;
+        if (!zero) continue;
+        uint64_t a = (uint64_t)fmax(0.0, beats[i] * sr);
+        uint64_t b = (uint64_t)fmax(0.0, beats[i + 1] * sr);
+        if (b > frames) b = frames;
+        if (b <= a) continue;
+        double sum = 0;
+        for (uint64_t f = a * ch; f < b * ch; f++) sum += (double)pcm[f] * pcm[f];
+        if (sqrt(sum / ((b - a) * ch)) > SILENT_RMS) n++;
+    }
+    return n;
+}
+
+static void eval_chords(EvalTrack* t, const TsFile* ts, const double* beats, int nbeats,
+                        const float* pcm, uint64_t frames, uint32_t ch, uint32_t sr,
+                        const ChromaAlgoDesc* algo, const Opts& o) {
+    int nint = nbeats - 1;
+    float*      chroma = (float*)calloc((size_t)nint * 12, sizeof(float));
+    float*      bass   = (float*)calloc((size_t)nint * 12, sizeof(float));
+    ChordLabel* labels = (ChordLabel*)calloc(nint, sizeof(ChordLabel));
+    float*      lowpcm = make_lowband(pcm, frames, ch, sr);
+    if (!chroma || !bass || !labels || !lowpcm) {
+        free(chroma); free(bass); free(labels); free_lowband(lowpcm);
+        t->failed = true;
+        return;
+    }
+    beat_chroma(pcm, frames, ch, sr, beats, nbeats, algo->batch, chroma, bass, lowpcm);
+    t->empty = silent_chroma(pcm, frames, ch, sr, beats, nint, chroma);
+    ChordParams cp;
+    chord_params_of(o, &cp);
+    chord_label_sequence(chroma, bass, nint, &cp, labels);
+
+    char (*names)[16] = (char (*)[16])malloc((size_t)nint * 16);
+    for (int i = 0; i < nint; i++) chord_name(&labels[i], names[i], 16);
+    for (int i = 0; i < nint; i++)
+        if (strcmp(names[i], "N") && (i == 0 || strcmp(names[i], names[i - 1]))) t->nest++;
+
+    // Overlap of every reference chord with every beat interval under it.
+    double total = 0, exact = 0, root = 0;
+    int k0 = 0;
+    for (int e = 0; e < ts->count; e++) {
+        const TsEvent* ev = &ts->events[e];
+        if (!ts_is(ev, "chord") || ev->t_end <= ev->t_start) continue;
+        const char* want = ts_payload(ev);
+        if (!*want || !strcmp(want, "N")) continue;
+        total += ev->t_end - ev->t_start;
+        t->nref++;
+        while (k0 < nint && beats[k0 + 1] <= ev->t_start) k0++;
+        for (int k = k0; k < nint && beats[k] < ev->t_end; k++) {
+            double ov = fmin(ev->t_end, beats[k + 1]) - fmax(ev->t_start, beats[k]);
+            if (ov <= 0) continue;
+            if (!strcmp(names[k], want))                       exact += ov;
+            if (chord_root(want) >= 0 && chord_root(want) == labels[k].root) root += ov;
+        }
+    }
+    t->covered = total;
+    t->f       = total > 0 ? exact / total : 0.0;
+    t->prec    = total > 0 ? root  / total : 0.0;
+    t->scored  = t->nref > 0;
+    free(names); free(chroma); free(bass); free(labels); free_lowband(lowpcm);
+}
+
+static void eval_track(EvalTrack* t, const Opts& o, const ChromaAlgoDesc* algo) {
+    const double t_begin = now_sec();
+    const bool   chords  = !strcmp(o.mode, "chords");
+
+    TsFile ts;
+    ts_init(&ts);
+    if (!ts_load(&ts, t->ref)) { ts_shutdown(&ts); return; }
+    ts_sort(&ts);
+    double* ref = (double*)malloc(sizeof(double) * (ts.count + 1));
+    double* lo  = (double*)malloc(sizeof(double) * (ts.count + 1));
+    double* hi  = (double*)malloc(sizeof(double) * (ts.count + 1));
+    int nref = ref ? ts_beat_times(&ts, ref, ts.count + 1) : 0;
+    int nisl = lo && hi ? ref_islands(ref, nref, lo, hi) : 0;
+
+    bool wanted = chords ? nref >= 2 : (nref >= o.min_beats && nisl > 0);
+    float*   pcm    = nullptr;
+    uint64_t frames = 0;
+    uint32_t ch = 0, sr = 0;
+    if (wanted && !audio_decode(t->audio, &pcm, &frames, &ch, &sr)) {
+        t->failed = true;
+        wanted    = false;
+    }
+    if (wanted) to_analysis(&pcm, &frames, &ch, &sr);
+
+    if (wanted && chords) {
+        eval_chords(t, &ts, ref, nref, pcm, frames, ch, sr, algo, o);
+    } else if (wanted) {
+        const double duration = (double)frames / sr;
+        double* est  = nullptr;
+        int     nest = 0;
+        if (o.windowed) {
+            for (int g = 0; g < nisl; g++) {
+                Opts w  = o;           // clamped as the single-track commands clamp
+                w.start = lo[g] - 0.5;
+                w.end   = fmin(duration, hi[g] + 0.5);
+                double* b = nullptr;
+                int     n = detect_mode(pcm, frames, ch, sr, w, &b);
+                double* grown = n > 0 ? (double*)realloc(est, (nest + n) * sizeof(double)) : est;
+                if (grown) {
+                    est = grown;
+                    if (n > 0) memcpy(est + nest, b, n * sizeof(double));
+                    nest += n > 0 ? n : 0;
+                }
+                free(b);
+            }
+        } else {
+            Opts w  = o;
+            w.start = 0.0;
+            w.end   = duration;
+            nest = detect_mode(pcm, frames, ch, sr, w, &est);
+        }
+
+        // Restrict the estimate to the spans the human actually annotated.
+        int nin = 0;
+        for (int i = 0; i < nest; i++)
+            for (int g = 0; g < nisl; g++)
+                if (est[i] >= lo[g] - ISLAND_PAD && est[i] <= hi[g] + ISLAND_PAD) {
+                    est[nin++] = est[i];
+                    break;
+                }
+        f_measure(ref, nref, est, nin, o.tol, &t->f, &t->prec, &t->rec);
+        t->nref = nref;
+        t->nest = nin;
+        for (int g = 0; g < nisl; g++) t->covered += hi[g] - lo[g] + 2 * ISLAND_PAD;
+        t->scored = true;
+        free(est);
+    }
+
+    if (pcm) {
+        // Nothing else will analyse this buffer; drop its cached spectra now
+        // rather than letting them crowd out the tracks still running.
+        stft_release(pcm);
+        beat_spectral_flux_release(pcm);
+        audio_free(pcm);
+    }
+    free(ref); free(lo); free(hi);
+    ts_shutdown(&ts);
+    t->seconds = now_sec() - t_begin;
+}
+
+static int track_cmp_size(const void* a, const void* b) {
+    long long x = ((const EvalTrack*)a)->size, y = ((const EvalTrack*)b)->size;
+    return x > y ? -1 : x < y ? 1 : 0;
+}
+
+// Ascending F, then name: riffeval.py's row order.
+static int track_cmp_score(const void* a, const void* b) {
+    const EvalTrack* x = (const EvalTrack*)a;
+    const EvalTrack* y = (const EvalTrack*)b;
+    if (x->f != y->f) return x->f < y->f ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+static bool add_track(EvalTrack** tracks, int* n, int* cap,
+                      const char* audio, const char* ref) {
+    if (*n == *cap) {
+        int nc = *cap ? *cap * 2 : 64;
+        EvalTrack* t = (EvalTrack*)realloc(*tracks, nc * sizeof(EvalTrack));
+        if (!t) return false;
+        *tracks = t;
+        *cap    = nc;
+    }
+    EvalTrack* t = &(*tracks)[(*n)++];
+    memset(t, 0, sizeof(*t));
+    snprintf(t->audio, sizeof(t->audio), "%s", audio);
+    snprintf(t->ref,   sizeof(t->ref),   "%s", ref);
+    const char* base = strrchr(ref, '/');
+    base = base ? base + 1 : ref;
+    int len = (int)strlen(base);
+    if (len > 4 && !strcmp(base + len - 4, ".txt")) len -= 4;
+    snprintf(t->name, sizeof(t->name), "%.*s", len, base);
+    t->size = file_size(audio);
+    return true;
+}
 
-static double grid_score(const double* on, int n, double t0, double t1,
-                         double T, double phase) {
-    if (T <= 0 || t1 <= t0) return 0;
-    double tol = 0.12 * T;
-    int nlines = (int)((t1 - phase) / T) + 1;
-    if (nlines < 4) return 0;
-
-    // Mark which grid lines got support, and accumulate onset agreement.
-    static const int MAXLINES = 65536;
-    if (nlines > MAXLINES) nlines = MAXLINES;
-    static bool supported[MAXLINES];
-    memset(supported, 0, sizeof(bool) * nlines);
-
-    double agree = 0;
-    int used = 0;
-    for (int i = 0; i < n; i++) {
-        if (on[i] < t0 || on[i] > t1) continue;
-        used++;
-        double k = (on[i] - phase) / T;
-        long   ki = (long)floor(k + 0.5);
-        double d  = fabs(k - ki) * T;
-        if (d < tol) {
-            agree += 1.0 - d / tol;
-            if (ki >= 0 && ki < nlines) supported[ki] = true;
+static int run_eval(const Opts& o, const char* const* refs, int nrefs) {
+    const bool chords = !strcmp(o.mode, "chords");
+    if (!chords && strcmp(o.mode, "grid") && strcmp(o.mode, "beats") &&
+        strcmp(o.mode, "gridwalk")) {
+        fprintf(stderr, "riffdsp: unknown eval mode '%s'\n", o.mode);
+        return 1;
+    }
+    const ChromaAlgoDesc* algo = pick_chroma(o.algo);
+    if (chords && !algo) {
+        fprintf(stderr, "riffdsp: unknown chroma algorithm '%s'\n", o.algo);
+        return 1;
+    }
+    if (!strcmp(o.mode, "gridwalk") && (o.hop <= 0 || o.window <= 0)) {
+        fprintf(stderr, "riffdsp: bad window\n");
+        return 1;
+    }
+
+    EvalTrack* tracks = nullptr;
+    int ntracks = 0, cap = 0;
+    if (o.pairs_file) {
+        FILE* f = fopen(o.pairs_file, "r");
+        if (!f) { fprintf(stderr, "riffdsp: cannot read pairs file '%s'\n", o.pairs_file); return 1; }
+        char line[2200];
+        while (fgets(line, sizeof(line), f)) {
+            line[strcspn(line, "\r\n")] = 0;
+            char* tab = strchr(line, '\t');
+            if (line[0] == '#' || !tab) continue;
+            *tab = 0;
+            add_track(&tracks, &ntracks, &cap, line, tab + 1);
         }
+        fclose(f);
+    }
+    for (int i = 0; i < nrefs; i++) {
+        char audio[1024];
+        if (find_audio(refs[i], audio, sizeof(audio)))
+            add_track(&tracks, &ntracks, &cap, audio, refs[i]);
+    }
+    if (ntracks == 0) {
+        fprintf(stderr, "riffdsp: eval found no reference/audio pairs\n");
+        free(tracks);
+        return 1;
     }
-    if (!used) return 0;
 
-    int nsup = 0;
-    for (int i = 0; i < nlines; i++) if (supported[i]) nsup++;
-    double support_frac = (double)nsup / nlines;
+    qsort(tracks, ntracks, sizeof(EvalTrack), track_cmp_size);
+    const double t_begin = now_sec();
+    parallel_for(ntracks, [&](int i) { eval_track(&tracks[i], o, algo); });
+    const double wall = now_sec() - t_begin;
+    qsort(tracks, ntracks, sizeof(EvalTrack), track_cmp_score);
 
-    return (agree / used) * pow(support_frac, g_support_exp);
+    if (chords)
+        printf("%-44s %5s %5s %6s %6s  %8s %6s\n",
+               "track", "ref", "est", "exact", "root", "chord s", "run s");
+    else
+        printf("%-44s %5s %5s %6s %6s %6s  %8s %6s\n",
+               "track", "ref", "est", "F", "prec", "rec", "annotated s", "run s");
+    printf("%s\n", "--------------------------------------------------------------------------------------------------");
+    int    rows = 0, good = 0, empty = 0;
+    double sum_f = 0, sum_root = 0, busy = 0;
+    for (int i = 0; i < ntracks; i++) {
+        const EvalTrack* t = &tracks[i];
+        busy += t->seconds;
+        if (t->failed) { printf("%-44.44s ERROR cannot decode %s\n", t->name, t->audio); continue; }
+        if (!t->scored) continue;
+        if (chords)
+            printf("%-44.44s %5d %5d %6.3f %6.3f  %8.1f %6.2f\n",
+                   t->name, t->nref, t->nest, t->f, t->prec, t->covered, t->seconds);
+        else
+            printf("%-44.44s %5d %5d %6.3f %6.3f %6.3f  %8.1f %6.2f\n",
+                   t->name, t->nref, t->nest, t->f, t->prec, t->rec, t->covered, t->seconds);
+        rows++;
+        empty    += t->empty;
+        sum_f    += t->f;
+        sum_root += t->prec;
+        if (t->f >= 0.80) good++;
+    }
+    if (rows) {
+        printf("%s\n", "--------------------------------------------------------------------------------------------------");
+        if (chords)
+            printf("%d tracks   mean exact = %.3f   mean root = %.3f   empty beats = %d\n",
+                   rows, sum_f / rows, sum_root / rows, empty);
+        else
+            printf("%d tracks   mean F = %.3f   F>=0.80 on %d (%.0f%%)\n",
+                   rows, sum_f / rows, good, 100.0 * good / rows);
+    }
+    printf("wall %.2f s for %d tracks on %d threads (%.2f s of track time)\n",
+           wall, ntracks, core_count() < ntracks ? core_count() : ntracks, busy);
+    free(tracks);
+    if (empty) {
+        fprintf(stderr, "riffdsp: %d audible beat intervals got no chroma\n", empty);
+        return 1;
+    }
+    return 0;
 }
 
 int main(int argc, char** argv) {
     if (argc < 3) { usage(); return 1; }
 
-    const char* cmd  = argv[1];
-    const char* path = nullptr;
+    const char*  cmd  = argv[1];
+    const char*  path = nullptr;
+    const char** pos  = (const char**)malloc(argc * sizeof(const char*));
+    int          npos = 0;
     Opts o;
 
     for (int i = 2; i < argc; i++) {
@@ -241,9 +843,27 @@ int main(int argc, char** argv) {
         else if (!strcmp(a, "--support-exp") && i + 1 < argc) g_support_exp = atof(argv[++i]);
         else if (!strcmp(a, "--hint-bpm")  && i + 1 < argc) o.hint_bpm = (float)atof(argv[++i]);
         else if (!strcmp(a, "--hint-tol")  && i + 1 < argc) o.hint_tol = (float)atof(argv[++i]);
-        else if (a[0] == '-') { fprintf(stderr, "riffdsp: unknown option %s\n", a); return 1; }
-        else path = a;
+        else if (!strcmp(a, "--exhaustive"))  o.exhaustive  = true;
+        else if (!strcmp(a, "--window")      && i + 1 < argc) o.window      = atof(argv[++i]);
+        else if (!strcmp(a, "--hop")         && i + 1 < argc) o.hop         = atof(argv[++i]);
+        else if (!strcmp(a, "--drift")       && i + 1 < argc) o.drift       = (float)atof(argv[++i]);
+        else if (!strcmp(a, "--min-support") && i + 1 < argc) o.min_support = (float)atof(argv[++i]);
+        else if (!strcmp(a, "--seed-bpm")    && i + 1 < argc) o.seed_bpm    = (float)atof(argv[++i]);
+        else if (!strcmp(a, "--mode")        && i + 1 < argc) o.mode        = argv[++i];
+        else if (!strcmp(a, "--tol")         && i + 1 < argc) o.tol         = atof(argv[++i]);
+        else if (!strcmp(a, "--windowed"))    o.windowed    = true;
+        else if (!strcmp(a, "--min-beats")   && i + 1 < argc) o.min_beats   = atoi(argv[++i]);
+        else if (!strcmp(a, "--pairs")       && i + 1 < argc) o.pairs_file  = argv[++i];
+        else if (!strcmp(a, "--jobs")        && i + 1 < argc) pool_set_threads(atoi(argv[++i]));
+        else if (a[0] == '-') { fprintf(stderr, "riffdsp: unknown option %s\n", a); free(pos); return 1; }
+        else path = pos[npos++] = a;
     }
+    if (!strcmp(cmd, "eval")) {
+        int rc = run_eval(o, pos, npos);
+        free(pos);
+        return rc;
+    }
+    free(pos);
     if (!path) { usage(); return 1; }
 
     float*   pcm    = nullptr;
@@ -258,172 +878,133 @@ int main(int argc, char** argv) {
         printf("duration\t%.3f\n", duration);
         printf("sample_rate\t%u\n", sr);
         printf("channels\t%u\n", ch);
-        free(pcm);
+        audio_free(pcm);
         return 0;
     }
+    to_analysis(&pcm, &frames, &ch, &sr);
 
     if (!strcmp(cmd, "beats")) {
-        BeatAlgoParams bp = {};
-        bp.min_bpm         = o.min_bpm;
-        bp.max_bpm         = o.max_bpm;
-        bp.onset_threshold = 1.5f;
-        bp.dp_tightness    = 400.0f;
-        bp.pre_onset_ms    = 30.0f;
-        bp.seed_times      = nullptr;
-        bp.seed_count      = 0;
-
-        AutoBeatList ab;
-        autobeat_init(&ab);
-
-        // The detector output is capped at MAX_BEAT_CANDS, so a long track is
-        // analysed in overlapping chunks and the results stitched together.
-        const double CHUNK = 60.0;   // seconds
-        const double OVER  =  4.0;   // overlap, discarded from the tail
+        double* beats = nullptr;
+        float   bpm   = 0;
+        int     nb    = detect_beats(pcm, frames, ch, sr, o, &beats, &bpm);
         printf("# Beatmap  ~src=riffdsp/spectral_flux\n");
-        double t = o.start;
-        double last_emitted = -1e9;
-        double bpm_sum = 0; int bpm_n = 0;
-        while (t < o.end - 0.1) {
-            double t2 = t + CHUNK; if (t2 > o.end) t2 = o.end;
-            beat_spectral_flux(pcm, frames, ch, sr, t, t2, &bp, &ab);
-            if (ab.estimated_bpm > 0) { bpm_sum += ab.estimated_bpm; bpm_n++; }
-            double cutoff = (t2 >= o.end) ? t2 : t2 - OVER;
-            for (int i = 0; i < ab.beat_count; i++) {
-                double bt = ab.beat_times[i];
-                if (bt < t || bt >= cutoff) continue;
-                if (bt - last_emitted < 0.15) continue;   // de-dup across chunks
-                printf("%.6f\t%.6f\tB\n", bt, bt);
-                last_emitted = bt;
-            }
-            if (t2 >= o.end) break;
-            t = cutoff;
+        for (int i = 0; i < nb; i++)
+            printf("%.6f\t%.6f\tB\n", beats[i], beats[i]);
+        if (bpm > 0)
+            fprintf(stderr, "riffdsp: estimated tempo %.1f BPM\n", bpm);
+        free(beats);
+        audio_free(pcm);
+        return 0;
+    }
+
+    if (!strcmp(cmd, "tempo")) {
+        TempoCurve curve;
+        if (!track_tempo(pcm, frames, ch, sr, o.start, o.end, o.min_bpm, o.max_bpm, &curve)) {
+            fprintf(stderr, "riffdsp: no tempo estimate\n");
+            audio_free(pcm);
+            return 1;
         }
-        if (bpm_n) fprintf(stderr, "riffdsp: mean estimated tempo %.1f BPM\n", bpm_sum / bpm_n);
-        free(pcm);
+        printf("# Tempo  ~src=riffdsp/autocorr ~bpm=%.2f\n",
+               tempo_lag_bpm(&curve, (float)curve.best_lag));
+        for (int i = curve.count - 1; i >= 0; i--)   // slowest lag last: ascending BPM
+            printf("%.3f\t%.6g\n", tempo_lag_bpm(&curve, (float)(curve.lag_min + i)),
+                   curve.strength[i]);
+        print_tempo_peaks(&curve);
+        tempo_curve_free(&curve);
+        audio_free(pcm);
         return 0;
     }
 
-    if (!strcmp(cmd, "onsets") || !strcmp(cmd, "grid")) {
-        BeatAlgoParams bp = {};
-        bp.min_bpm         = o.min_bpm;
-        bp.max_bpm         = o.max_bpm;
-        bp.onset_threshold = 1.5f;
-        bp.dp_tightness    = 400.0f;
-        bp.pre_onset_ms    = 30.0f;
+    if (!strcmp(cmd, "gridwalk")) {
+        if (o.hop <= 0 || o.window <= 0) { fprintf(stderr, "riffdsp: bad window\n"); audio_free(pcm); return 1; }
+        WalkResult w;
+        if (!detect_gridwalk(pcm, frames, ch, sr, o, &w)) {
+            fprintf(stderr, "riffdsp: no onsets found\n");
+            audio_free(pcm);
+            return 1;
+        }
 
-        double* on = nullptr;
-        float est_bpm = 0;
-        int non = collect_onsets(pcm, frames, ch, sr, o.start, o.end, &bp, &on, &est_bpm);
-        if (non <= 0) { fprintf(stderr, "riffdsp: no onsets found\n"); free(pcm); return 1; }
-
-        if (!strcmp(cmd, "onsets")) {
-            printf("# Onsets  ~src=riffdsp/spectral_flux\n");
-            for (int i = 0; i < non; i++) printf("%.6f\t%.6f\tonset\n", on[i], on[i]);
-            free(on); free(pcm);
-            return 0;
+        printf("# Beatmap  ~src=riffdsp/gridwalk\n");
+        printf("# windows accepted %d, rejected %d\n", w.accepted, w.nwin - w.accepted);
+        if (w.accepted) {
+            double bmin = 1e9, bmax = 0;
+            for (int i = 0; i < w.nwin; i++)
+                if (w.win[i].accepted) { bmin = fmin(bmin, w.win[i].bpm); bmax = fmax(bmax, w.win[i].bpm); }
+            printf("# tempo range %.1f - %.1f BPM\n", bmin, bmax);
         }
+        for (int i = 0; i < w.nwin; i++) {
+            if (w.win[i].accepted) continue;
+            char bpm[16] = "?";
+            if (w.win[i].bpm > 0) snprintf(bpm, sizeof(bpm), "%.1f", w.win[i].bpm);
+            printf("# GAP %.1f-%.1f s  bpm=%s support=%.2f  -- needs a human\n",
+                   w.win[i].t0, w.win[i].t1, bpm, w.win[i].support);
+        }
+        for (int i = 0; i < w.nbeats; i++) printf("%.6f\t%.6f\tB\n", w.beats[i], w.beats[i]);
+        fprintf(stderr, "riffdsp: gridwalk %d beats, %d/%d windows accepted (%.0f%% of track)\n",
+                w.nbeats, w.accepted, w.nwin, 100.0 * w.accepted / (w.nwin ? w.nwin : 1));
+        walk_free(&w);
+        audio_free(pcm);
+        return 0;
+    }
+
+    if (!strcmp(cmd, "onsets")) {
+        BeatAlgoParams bp = flux_params(o);
+        double* on = nullptr;
+        int non = collect_onsets(pcm, frames, ch, sr, o.start, o.end, &bp, &on);
+        if (non <= 0) { fprintf(stderr, "riffdsp: no onsets found\n"); free(on); audio_free(pcm); return 1; }
+        printf("# Onsets  ~src=riffdsp/spectral_flux\n");
+        for (int i = 0; i < non; i++) printf("%.6f\t%.6f\tonset\n", on[i], on[i]);
+        free(on); audio_free(pcm);
+        return 0;
+    }
 
-        // --- global tempo/phase search -----------------------------------
-        // The per-chunk DP tracker inserts spurious beats on syncopated
-        // material, but the *tempo estimate* is reliable.  Fitting one global
-        // grid to the onsets and then letting it drift locally is far more
-        // robust for unattended whole-track work.
-        double bestT = 0, bestP = 0, bestS = -1;
-        double Tlo = 60.0 / o.max_bpm, Thi = 60.0 / o.min_bpm;
-        // An external tempo (from a tab, an ID3 tag, or a sibling track) is the
-        // cheapest way to settle the half/double-tempo ambiguity, which is the
-        // single largest source of error in unattended beatmapping.
+    if (!strcmp(cmd, "grid")) {
         if (o.hint_bpm > 0) {
-            Tlo = 60.0 / (o.hint_bpm * (1.0 + o.hint_tol));
-            Thi = 60.0 / (o.hint_bpm * (1.0 - o.hint_tol));
+            double Tlo, Thi;
+            grid_periods(o, &Tlo, &Thi);
             fprintf(stderr, "riffdsp: tempo hint %.1f BPM, searching %.1f-%.1f BPM\n",
                     o.hint_bpm, 60.0 / Thi, 60.0 / Tlo);
         }
-        for (double T = Tlo; T <= Thi; T += 0.0005) {
-            // Coarse phase sweep; the kernel is smooth so this is enough.
-            for (double ph = 0; ph < T; ph += T / 100.0) {
-                double s = grid_score(on, non, o.start, o.end, T, o.start + ph);
-                if (s > bestS) { bestS = s; bestT = T; bestP = o.start + ph; }
-            }
-        }
+        double*    beats = nullptr;
+        GridResult r;
+        int emitted = detect_grid(pcm, frames, ch, sr, o, &beats, &r);
+        if (emitted < 0) { fprintf(stderr, "riffdsp: no onsets found\n"); audio_free(pcm); return 1; }
         fprintf(stderr, "riffdsp: grid fit %.2f BPM (period %.4f s), support %.1f/%d onsets\n",
-                60.0 / bestT, bestT, bestS, non);
-        if (est_bpm > 0)
-            fprintf(stderr, "riffdsp: chunked tempo estimate was %.1f BPM\n", est_bpm);
-
-        // --- anchor to onsets, then local linear refit ---------------------
-        int nb = (int)((o.end - bestP) / bestT) + 1;
-        if (nb < 2) { fprintf(stderr, "riffdsp: grid too short\n"); free(on); free(pcm); return 1; }
-        double* anchor = (double*)malloc(nb * sizeof(double));
-        bool*   has    = (bool*)  calloc(nb, sizeof(bool));
-        for (int k = 0; k < nb; k++) {
-            double g = bestP + k * bestT;
-            double best = 1e30; int bi = -1;
-            for (int i = 0; i < non; i++) {
-                double d = fabs(on[i] - g);
-                if (d < best) { best = d; bi = i; }
-            }
-            if (bi >= 0 && best < 0.25 * bestT) { anchor[k] = on[bi]; has[k] = true; }
-        }
-
-        // Local linear regression of anchor time on beat index, which tracks
-        // gradual tempo drift without chasing individual mis-detections.
-        const int W = 16;
-        printf("# Beatmap  ~src=riffdsp/grid ~bpm=%.2f\n", 60.0 / bestT);
-        double prev = -1e9;
-        int emitted = 0, anchored = 0;
-        for (int k = 0; k < nb; k++) {
-            double sx = 0, sy = 0, sxx = 0, sxy = 0; int m = 0;
-            for (int j = k - W; j <= k + W; j++) {
-                if (j < 0 || j >= nb || !has[j]) continue;
-                sx += j; sy += anchor[j]; sxx += (double)j * j; sxy += (double)j * anchor[j];
-                m++;
-            }
-            double t;
-            if (m >= 4) {
-                double den = m * sxx - sx * sx;
-                if (fabs(den) < 1e-9) t = bestP + k * bestT;
-                else {
-                    double slope = (m * sxy - sx * sy) / den;
-                    double icpt  = (sy - slope * sx) / m;
-                    t = icpt + slope * k;
-                }
-            } else {
-                t = bestP + k * bestT;
-            }
-            if (has[k]) anchored++;
-            if (t < o.start - 0.01 || t > o.end) continue;
-            if (t <= prev + 0.05) continue;
-            printf("%.6f\t%.6f\tB\n", t, t);
-            prev = t;
-            emitted++;
+                60.0 / r.fit.period, r.fit.period, r.fit.score, r.onsets);
+        TempoCurve curve;
+        if (track_tempo(pcm, frames, ch, sr, o.start, o.end, o.min_bpm, o.max_bpm, &curve)) {
+            print_tempo_peaks(&curve);
+            tempo_curve_free(&curve);
         }
+        if (r.lines < 2) { fprintf(stderr, "riffdsp: grid too short\n"); free(beats); audio_free(pcm); return 1; }
+        printf("# Beatmap  ~src=riffdsp/grid ~bpm=%.2f\n", 60.0 / r.fit.period);
+        for (int i = 0; i < emitted; i++) printf("%.6f\t%.6f\tB\n", beats[i], beats[i]);
         fprintf(stderr, "riffdsp: emitted %d beats, %d/%d had onset support (%.0f%%)\n",
-                emitted, anchored, nb, 100.0 * anchored / nb);
-        free(anchor); free(has); free(on); free(pcm);
+                emitted, r.anchored, r.lines, 100.0 * r.anchored / r.lines);
+        free(beats); audio_free(pcm);
         return 0;
     }
 
     // chroma and chords both need a beatmap.
     if (!o.beats_file) {
         fprintf(stderr, "riffdsp: %s requires --beats FILE\n", cmd);
-        free(pcm);
+        audio_free(pcm);
         return 1;
     }
     double* beats = nullptr;
     int nbeats = load_beats(o.beats_file, &beats);
     if (nbeats < 2) {
         fprintf(stderr, "riffdsp: need at least 2 beats, got %d\n", nbeats);
-        free(pcm); free(beats);
+        audio_free(pcm); free(beats);
         return 1;
     }
 
-    ChromaFn fn = pick_chroma(o.algo);
-    if (!fn) {
+    const ChromaAlgoDesc* algo = pick_chroma(o.algo);
+    if (!algo) {
         fprintf(stderr, "riffdsp: unknown chroma algorithm '%s'; available:\n", o.algo);
         for (int i = 0; i < CHROMA_ALGO_COUNT; i++)
             fprintf(stderr, "  %s — %s\n", CHROMA_ALGOS[i].name, CHROMA_ALGOS[i].tip);
-        free(pcm); free(beats);
+        audio_free(pcm); free(beats);
         return 1;
     }
 
@@ -431,7 +1012,7 @@ int main(int argc, char** argv) {
     float* chroma = (float*)calloc((size_t)nint * 12, sizeof(float));
     float* bass   = (float*)calloc((size_t)nint * 12, sizeof(float));
     float* lowpcm = make_lowband(pcm, frames, ch, sr);
-    beat_chroma(pcm, frames, ch, sr, beats, nbeats, fn, chroma, bass, lowpcm);
+    beat_chroma(pcm, frames, ch, sr, beats, nbeats, algo->batch, chroma, bass, lowpcm);
 
     if (!strcmp(cmd, "chroma")) {
         printf("# beat\tt_start\tt_end");
@@ -444,10 +1025,7 @@ int main(int argc, char** argv) {
         }
     } else if (!strcmp(cmd, "chords")) {
         ChordParams cp;
-        chord_params_defaults(&cp);
-        cp.self_bonus     = o.self_bonus;
-        cp.allow_sevenths = !o.no_sevenths;
-        cp.allow_sus      = !o.no_sus;
+        chord_params_of(o, &cp);
 
         ChordLabel* labels = (ChordLabel*)calloc(nint, sizeof(ChordLabel));
         chord_label_sequence(chroma, bass, nint, &cp, labels);
@@ -490,6 +1068,6 @@ int main(int argc, char** argv) {
         usage();
     }
 
-    free(chroma); free(bass); free(lowpcm); free(beats); free(pcm);
+    free(chroma); free(bass); free_lowband(lowpcm); free(beats); audio_free(pcm);
     return 0;
 }
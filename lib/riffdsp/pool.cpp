@@ -0,0 +1,108 @@
+#include "pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static int s_threads = 0;                 // 0 = hardware concurrency
+static thread_local bool s_in_task = false;
+
+// One parallel_run at a time hands its loop to the workers.  helpers of them
+// join in (the caller is the remaining thread); the rest sit this one out.
+struct PoolJob {
+    void (*fn)(void* ctx, int i);
+    void*            ctx;
+    int              n;
+    int              helpers;
+    std::atomic<int> next;
+};
+
+// Workers are started on first need and then kept, parked on wake between
+// loops, so that a loop issued over and over (grid_search scores its
+// candidates in batches) does not pay for creating threads each time.  They
+// are detached and live as long as the process, and so does the state they
+// wait on: it is never destroyed, as tearing down a condition variable with
+// threads still waiting on it hangs the exit.
+struct Pool {
+    std::mutex              run_mutex;       // serialises parallel_run callers
+    std::mutex              mutex;           // guards everything below
+    std::condition_variable wake;            // a new job was posted
+    std::condition_variable done;            // the last helper finished
+    PoolJob*                job     = nullptr;
+    unsigned long long      gen     = 0;     // bumped per job posted
+    int                     busy    = 0;     // helpers still working on job
+    int                     workers = 0;
+};
+
+static Pool* the_pool()
+{
+    static Pool* pool = new Pool;
+    return pool;
+}
+
+int core_count()
+{
+    int nt = s_threads > 0 ? s_threads : (int)std::thread::hardware_concurrency();
+    if (nt < 1)                nt = 1;
+    if (nt > POOL_MAX_THREADS) nt = POOL_MAX_THREADS;
+    return nt;
+}
+
+void pool_set_threads(int n)
+{
+    s_threads = n > 0 ? n : 0;
+}
+
+static void run_tasks(PoolJob* j)
+{
+    s_in_task = true;
+    for (int i = j->next.fetch_add(1); i < j->n; i = j->next.fetch_add(1)) j->fn(j->ctx, i);
+    s_in_task = false;
+}
+
+static void worker(Pool* p, int id, unsigned long long seen)
+{
+    std::unique_lock<std::mutex> lock(p->mutex);
+    for (;;) {
+        p->wake.wait(lock, [&] { return p->gen != seen; });
+        seen = p->gen;
+        PoolJob* j = p->job;
+        if (!j || id >= j->helpers) continue;   // not needed, or long over
+        lock.unlock();
+        run_tasks(j);
+        lock.lock();
+        if (--p->busy == 0) p->done.notify_all();
+    }
+}
+
+void parallel_run(int n, void (*fn)(void* ctx, int i), void* ctx)
+{
+    int nt = s_in_task ? 1 : core_count();
+    if (nt > n) nt = n;
+    if (nt <= 1) {
+        for (int i = 0; i < n; i++) fn(ctx, i);
+        return;
+    }
+
+    Pool* p = the_pool();
+    std::lock_guard<std::mutex> run(p->run_mutex);
+    PoolJob job;
+    job.fn      = fn;
+    job.ctx     = ctx;
+    job.n       = n;
+    job.helpers = nt - 1;
+    job.next.store(0);
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        for (; p->workers < job.helpers; p->workers++)
+            std::thread(worker, p, p->workers, p->gen).detach();
+        p->job  = &job;
+        p->busy = job.helpers;
+        p->gen++;
+    }
+    p->wake.notify_all();
+    run_tasks(&job);
+    std::unique_lock<std::mutex> lock(p->mutex);
+    p->done.wait(lock, [p] { return p->busy == 0; });
+    p->job = nullptr;
+}
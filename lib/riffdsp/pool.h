@@ -0,0 +1,32 @@
+#pragma once
+
+// Run independent tasks across all cores.
+//
+// parallel_for(n, fn) calls fn(i) once for every i in [0, n).  Tasks are
+// handed out one at a time from a shared counter, so a worker that finishes a
+// short task immediately takes the next one and uneven task sizes balance
+// themselves: give the largest tasks the lowest indices and the small ones
+// fill in behind them.  The worker threads are started on first use and kept
+// for the life of the process, so a loop issued many times over costs no
+// thread creation after the first.
+//
+// A parallel_for issued from inside a task of a loop that is running on
+// several threads runs on the calling thread: the outer loop already has
+// every core busy, and a second layer of threads per task would only
+// oversubscribe them (`riffdsp eval` runs one track per task, and each
+// track's grid_search is itself a parallel_for).
+
+// Worker threads a parallel_for uses: pool_set_threads(), or the hardware
+// concurrency, capped at POOL_MAX_THREADS.
+static const int POOL_MAX_THREADS = 64;
+
+int  core_count();
+void pool_set_threads(int n);   // 0 = back to the hardware concurrency
+
+void parallel_run(int n, void (*fn)(void* ctx, int i), void* ctx);
+
+template <typename F>
+inline void parallel_for(int n, const F& fn)
+{
+    parallel_run(n, [](void* ctx, int i) { (*(const F*)ctx)(i); }, (void*)&fn);
+}
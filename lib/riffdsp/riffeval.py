@@ -14,6 +14,10 @@ Because several reference beatmaps cover only part of their track, scoring is
 restricted by default to the time spans the reference actually covers -- a
 detector should not be punished for finding beats in a region the human never
 annotated.
+
+`riffdsp eval` computes the same table in one process, decoding each track
+once and running tracks on all cores; this script remains the reference for
+the metric.
 """
 
 import argparse